@@ -83,11 +83,13 @@ static const pa_daemon_conf default_conf = {
     .log_time = false,
     .resample_method = PA_RESAMPLER_AUTO,
     .avoid_resampling = false,
+    .premix_resampling = false,
     .disable_remixing = false,
     .remixing_use_all_sink_channels = true,
     .remixing_produce_lfe = false,
     .remixing_consume_lfe = false,
     .lfe_crossover_freq = 0,
+    .render_threads = 0,
     .config_file = NULL,
     .use_pid_file = true,
     .system_instance = false,
@@ -98,6 +100,8 @@ static const pa_daemon_conf default_conf = {
     .disable_shm = false,
     .disable_memfd = false,
     .lock_memory = false,
+    .enable_hugepages = false,
+    .enable_numa_pools = false,
     .deferred_volume = true,
     .default_n_fragments = 4,
     .default_fragment_size_msec = 25,
@@ -106,7 +110,9 @@ static const pa_daemon_conf default_conf = {
     .default_sample_spec = { .format = PA_SAMPLE_S16NE, .rate = 44100, .channels = 2 },
     .alternate_sample_rate = 48000,
     .default_channel_map = { .channels = 2, .map = { PA_CHANNEL_POSITION_LEFT, PA_CHANNEL_POSITION_RIGHT } },
-    .shm_size = 0
+    .shm_size = 0,
+    .mempool_slot_sizes = { 64*1024 },
+    .n_mempool_slot_sizes = 1
 #ifdef HAVE_SYS_RESOURCE_H
    ,.rlimit_fsize = { .value = 0, .is_set = false },
     .rlimit_data = { .value = 0, .is_set = false },
@@ -472,6 +478,40 @@ static int parse_nice_level(pa_config_parser_state *state) {
     return 0;
 }
 
+static int parse_mempool_slot_sizes(pa_config_parser_state *state) {
+    pa_daemon_conf *c;
+    size_t sizes[PA_MEMPOOL_CLASSES_MAX];
+    unsigned n = 0;
+    const char *split_state = NULL;
+    char *k;
+
+    pa_assert(state);
+
+    c = state->data;
+
+    while ((k = pa_split(state->rvalue, ", ", &split_state))) {
+        uint32_t size;
+
+        if (n >= PA_MEMPOOL_CLASSES_MAX || pa_atou(k, &size) < 0 || size <= 0 || size > 16*1024*1024) {
+            pa_log(_("[%s:%u] Invalid memory pool slot sizes '%s'."), state->filename, state->lineno, state->rvalue);
+            pa_xfree(k);
+            return -1;
+        }
+
+        sizes[n++] = size;
+        pa_xfree(k);
+    }
+
+    if (n <= 0) {
+        pa_log(_("[%s:%u] Invalid memory pool slot sizes '%s'."), state->filename, state->lineno, state->rvalue);
+        return -1;
+    }
+
+    memcpy(c->mempool_slot_sizes, sizes, n * sizeof(size_t));
+    c->n_mempool_slot_sizes = n;
+    return 0;
+}
+
 static int parse_rtprio(pa_config_parser_state *state) {
 #if !defined(OS_IS_WIN32) && defined(HAVE_SCHED_H)
     pa_daemon_conf *c;
@@ -606,6 +646,7 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
                                         pa_config_parse_int,      &c->deferred_volume_extra_delay_usec, NULL },
         { "nice-level",                 parse_nice_level,         c, NULL },
         { "avoid-resampling",           pa_config_parse_bool,     &c->avoid_resampling, NULL },
+        { "premix-resampling",          pa_config_parse_bool,     &c->premix_resampling, NULL },
         { "disable-remixing",           pa_config_parse_bool,     &c->disable_remixing, NULL },
         { "enable-remixing",            pa_config_parse_not_bool, &c->disable_remixing, NULL },
         { "remixing-use-all-sink-channels",
@@ -615,8 +656,12 @@ int pa_daemon_conf_load(pa_daemon_conf *c, const char *filename) {
         { "remixing-produce-lfe",       pa_config_parse_bool,     &c->remixing_produce_lfe, NULL },
         { "remixing-consume-lfe",       pa_config_parse_bool,     &c->remixing_consume_lfe, NULL },
         { "lfe-crossover-freq",         pa_config_parse_unsigned, &c->lfe_crossover_freq, NULL },
+        { "render-threads",             pa_config_parse_unsigned, &c->render_threads, NULL },
         { "load-default-script-file",   pa_config_parse_bool,     &c->load_default_script_file, NULL },
         { "shm-size-bytes",             pa_config_parse_size,     &c->shm_size, NULL },
+        { "mempool-slot-sizes",         parse_mempool_slot_sizes, c, NULL },
+        { "enable-hugepages",           pa_config_parse_bool,     &c->enable_hugepages, NULL },
+        { "enable-numa-pools",          pa_config_parse_bool,     &c->enable_numa_pools, NULL },
         { "log-meta",                   pa_config_parse_bool,     &c->log_meta, NULL },
         { "log-time",                   pa_config_parse_bool,     &c->log_time, NULL },
         { "log-backtrace",              pa_config_parse_unsigned, &c->log_backtrace, NULL },
@@ -779,6 +824,7 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf *s;
     char cm[PA_CHANNEL_MAP_SNPRINT_MAX];
     char *log_target = NULL;
+    unsigned i;
 
     pa_assert(c);
 
@@ -819,11 +865,13 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "log-level = %s\n", log_level_to_string[c->log_level]);
     pa_strbuf_printf(s, "resample-method = %s\n", pa_resample_method_to_string(c->resample_method));
     pa_strbuf_printf(s, "avoid-resampling = %s\n", pa_yes_no(c->avoid_resampling));
+    pa_strbuf_printf(s, "premix-resampling = %s\n", pa_yes_no(c->premix_resampling));
     pa_strbuf_printf(s, "enable-remixing = %s\n", pa_yes_no(!c->disable_remixing));
     pa_strbuf_printf(s, "remixing-use-all-sink-channels = %s\n", pa_yes_no(c->remixing_use_all_sink_channels));
     pa_strbuf_printf(s, "remixing-produce-lfe = %s\n", pa_yes_no(c->remixing_produce_lfe));
     pa_strbuf_printf(s, "remixing-consume-lfe = %s\n", pa_yes_no(c->remixing_consume_lfe));
     pa_strbuf_printf(s, "lfe-crossover-freq = %u\n", c->lfe_crossover_freq);
+    pa_strbuf_printf(s, "render-threads = %u\n", c->render_threads);
     pa_strbuf_printf(s, "default-sample-format = %s\n", pa_sample_format_to_string(c->default_sample_spec.format));
     pa_strbuf_printf(s, "default-sample-rate = %u\n", c->default_sample_spec.rate);
     pa_strbuf_printf(s, "alternate-sample-rate = %u\n", c->alternate_sample_rate);
@@ -835,6 +883,12 @@ char *pa_daemon_conf_dump(pa_daemon_conf *c) {
     pa_strbuf_printf(s, "deferred-volume-safety-margin-usec = %u\n", c->deferred_volume_safety_margin_usec);
     pa_strbuf_printf(s, "deferred-volume-extra-delay-usec = %d\n", c->deferred_volume_extra_delay_usec);
     pa_strbuf_printf(s, "shm-size-bytes = %lu\n", (unsigned long) c->shm_size);
+    pa_strbuf_puts(s, "mempool-slot-sizes =");
+    for (i = 0; i < c->n_mempool_slot_sizes; i++)
+        pa_strbuf_printf(s, " %lu", (unsigned long) c->mempool_slot_sizes[i]);
+    pa_strbuf_puts(s, "\n");
+    pa_strbuf_printf(s, "enable-hugepages = %s\n", pa_yes_no(c->enable_hugepages));
+    pa_strbuf_printf(s, "enable-numa-pools = %s\n", pa_yes_no(c->enable_numa_pools));
     pa_strbuf_printf(s, "log-meta = %s\n", pa_yes_no(c->log_meta));
     pa_strbuf_printf(s, "log-time = %s\n", pa_yes_no(c->log_time));
     pa_strbuf_printf(s, "log-backtrace = %u\n", c->log_backtrace);
@@ -68,6 +68,7 @@ typedef struct pa_daemon_conf {
         disable_shm,
         disable_memfd,
         avoid_resampling,
+        premix_resampling,
         disable_remixing,
         remixing_use_all_sink_channels,
         remixing_produce_lfe,
@@ -79,6 +80,8 @@ typedef struct pa_daemon_conf {
         flat_volumes,
         rescue_streams,
         lock_memory,
+        enable_hugepages,
+        enable_numa_pools,
         deferred_volume;
     pa_server_type_t local_server_type;
     int exit_idle_time,
@@ -133,10 +136,13 @@ typedef struct pa_daemon_conf {
     unsigned deferred_volume_safety_margin_usec;
     int deferred_volume_extra_delay_usec;
     unsigned lfe_crossover_freq;
+    unsigned render_threads;
     pa_sample_spec default_sample_spec;
     uint32_t alternate_sample_rate;
     pa_channel_map default_channel_map;
     size_t shm_size;
+    size_t mempool_slot_sizes[PA_MEMPOOL_CLASSES_MAX];
+    unsigned n_mempool_slot_sizes;
 } pa_daemon_conf;
 
 /* Allocate a new structure and fill it with sane defaults */
@@ -1189,7 +1189,10 @@ int main(int argc, char *argv[]) {
 
     if (!(c = pa_core_new(pa_mainloop_get_api(mainloop), !conf->disable_shm,
                           !conf->disable_shm && !conf->disable_memfd && pa_memfd_is_locally_supported(),
-                          conf->shm_size))) {
+                          conf->shm_size,
+                          (conf->enable_hugepages ? PA_MEMPOOL_HUGEPAGES : 0) |
+                          (conf->enable_numa_pools ? PA_MEMPOOL_NUMA : 0),
+                          conf->mempool_slot_sizes, conf->n_mempool_slot_sizes))) {
         pa_log(_("pa_core_new() failed."));
         goto finish;
     }
@@ -1202,12 +1205,14 @@ int main(int argc, char *argv[]) {
     c->deferred_volume_safety_margin_usec = conf->deferred_volume_safety_margin_usec;
     c->deferred_volume_extra_delay_usec = conf->deferred_volume_extra_delay_usec;
     c->lfe_crossover_freq = conf->lfe_crossover_freq;
+    c->render_threads = conf->render_threads;
     c->exit_idle_time = conf->exit_idle_time;
     c->scache_idle_time = conf->scache_idle_time;
     c->resample_method = conf->resample_method;
     c->realtime_priority = conf->realtime_priority;
     c->realtime_scheduling = conf->realtime_scheduling;
     c->avoid_resampling = conf->avoid_resampling;
+    c->premix_resampling = conf->premix_resampling;
     c->disable_remixing = conf->disable_remixing;
     c->remixing_use_all_sink_channels = conf->remixing_use_all_sink_channels;
     c->remixing_produce_lfe = conf->remixing_produce_lfe;
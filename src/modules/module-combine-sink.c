@@ -765,7 +765,7 @@ static int sink_input_process_msg(pa_msgobject *obj, int code, void *data, int64
         case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
             size_t length;
 
-            length = pa_memblockq_get_length(o->sink_input->thread_info.render_memblockq);
+            length = pa_sink_input_get_render_length(o->sink_input);
 
             o->latency_snapshot.output_memblockq_size = pa_memblockq_get_length(o->memblockq);
 
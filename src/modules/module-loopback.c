@@ -1166,7 +1166,7 @@ static int sink_input_process_msg_cb(pa_msgobject *obj, int code, void *data, in
         case SINK_INPUT_MESSAGE_LATENCY_SNAPSHOT: {
             size_t length;
 
-            length = pa_memblockq_get_length(u->sink_input->thread_info.render_memblockq);
+            length = pa_sink_input_get_render_length(u->sink_input);
 
             u->latency_snapshot.recv_counter = u->output_thread_info.recv_counter;
             u->latency_snapshot.loopback_memblockq_length = pa_memblockq_get_length(u->memblockq);
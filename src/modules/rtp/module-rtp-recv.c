@@ -289,7 +289,7 @@ static int rtpoll_work_cb(pa_rtpoll_item *i) {
 
         sink_delay = pa_sink_get_latency_within_thread(s->sink_input->sink, false);
         sink_delay += pa_resampler_get_delay_usec(s->sink_input->thread_info.resampler);
-        render_delay = pa_bytes_to_usec(pa_memblockq_get_length(s->sink_input->thread_info.render_memblockq), &s->sink_input->sink->sample_spec);
+        render_delay = pa_bytes_to_usec(pa_sink_input_get_render_length(s->sink_input), &s->sink_input->sink->sample_spec);
 
         if (ri > render_delay+sink_delay)
             ri -= render_delay+sink_delay;
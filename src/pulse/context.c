@@ -398,10 +398,14 @@ static void handle_srbchannel_memblock(pa_context *c, pa_memblock *memblock) {
         return;
     }
 
+    pa_srbchannel_set_busy_poll(sr, c->srb_busy_poll_usec);
+
     /* Ack the enable command */
     t = pa_tagstruct_new();
     pa_tagstruct_putu32(t, PA_COMMAND_ENABLE_SRBCHANNEL);
     pa_tagstruct_putu32(t, c->srb_setup_tag);
+    if (c->version >= 36)
+        pa_tagstruct_putu32(t, c->srb_busy_poll_usec);
     pa_pstream_send_tagstruct(c->pstream, t);
 
     /* ...and switch over */
@@ -1496,6 +1500,7 @@ static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uin
 
 #ifdef HAVE_CREDS
     pa_cmsg_ancil_data *ancil = NULL;
+    uint32_t busy_poll_usec = 0;
 
     pa_assert(pd);
     pa_assert(command == PA_COMMAND_ENABLE_SRBCHANNEL);
@@ -1514,11 +1519,18 @@ static void pa_command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uin
     if (ancil->nfd != 2 || ancil->fds[0] == -1 || ancil->fds[1] == -1)
         goto fail;
 
+    /* The server tells us how long we may busy poll */
+    if (c->version >= 36)
+        if (pa_tagstruct_getu32(t, &busy_poll_usec) < 0 ||
+            !pa_tagstruct_eof(t))
+            goto fail;
+
     pa_context_ref(c);
 
     c->srb_template.readfd = ancil->fds[0];
     c->srb_template.writefd = ancil->fds[1];
     c->srb_setup_tag = tag;
+    c->srb_busy_poll_usec = PA_MIN(c->conf->srbchannel_busy_poll_usec, busy_poll_usec);
 
     pa_context_unref(c);
 
@@ -82,6 +82,7 @@ struct pa_context {
 
     pa_srbchannel_template srb_template;
     uint32_t srb_setup_tag;
+    uint32_t srb_busy_poll_usec;
 
     pa_hashmap *record_streams, *playback_streams;
     PA_LLIST_HEAD(pa_stream, streams);
@@ -2277,3 +2277,178 @@ pa_operation* pa_context_send_message_to_object(pa_context *c, const char *objec
 
     return o;
 }
+
+/*** Snapshots ***/
+
+struct snapshot_request {
+    pa_operation *operation;
+    pa_snapshot_callbacks callbacks;
+};
+
+static void snapshot_request_free(struct snapshot_request *r) {
+    pa_assert(r);
+
+    pa_operation_unref(r->operation);
+    pa_xfree(r);
+}
+
+/* Feeds one facility's blob to the same parser that handles the reply of
+ * the respective GET_*_INFO_LIST command, through an operation of its own */
+static int snapshot_parse_list(pa_pdispatch *pd, struct snapshot_request *r, uint32_t facility, pa_tagstruct *list) {
+    pa_operation *o = r->operation;
+    pa_pdispatch_cb_t parse;
+    pa_operation_cb_t cb;
+
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            parse = context_get_sink_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.sink;
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            parse = context_get_source_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.source;
+            break;
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            parse = context_get_sink_input_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.sink_input;
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            parse = context_get_source_output_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.source_output;
+            break;
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            parse = context_get_module_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.module;
+            break;
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            parse = context_get_client_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.client;
+            break;
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE:
+            parse = context_get_sample_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.sample;
+            break;
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            parse = context_get_card_info_callback;
+            cb = (pa_operation_cb_t) r->callbacks.card;
+            break;
+        default:
+            return -1;
+    }
+
+    parse(pd, PA_COMMAND_REPLY, 0, list, pa_operation_new(o->context, NULL, cb, o->userdata));
+
+    /* The parser fails the context on malformed data */
+    return o->context ? 0 : -1;
+}
+
+static void context_get_snapshot_callback(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    struct snapshot_request *r = userdata;
+    pa_operation *o;
+    uint64_t seq = 0;
+    bool full = false;
+    int success = 1;
+
+    pa_assert(pd);
+    pa_assert(r);
+
+    o = r->operation;
+    pa_assert(PA_REFCNT_VALUE(o) >= 1);
+
+    if (!o->context)
+        goto finish;
+
+    if (command != PA_COMMAND_REPLY) {
+        if (pa_context_handle_error(o->context, command, t, false) < 0)
+            goto finish;
+
+        success = 0;
+    } else {
+        if (pa_tagstruct_getu64(t, &seq) < 0 ||
+            pa_tagstruct_get_boolean(t, &full) < 0)
+            goto fail;
+
+        while (!pa_tagstruct_eof(t)) {
+            uint32_t facility, length, n_removed, idx;
+            const void *data;
+            pa_tagstruct *list;
+            int ret;
+
+            if (pa_tagstruct_getu32(t, &facility) < 0 ||
+                pa_tagstruct_getu32(t, &length) < 0 ||
+                pa_tagstruct_get_arbitrary(t, &data, length) < 0)
+                goto fail;
+
+            /* A delta may well have no objects of a kind */
+            list = length > 0 ? pa_tagstruct_new_fixed(data, length) : pa_tagstruct_new();
+            ret = snapshot_parse_list(pd, r, facility, list);
+            pa_tagstruct_free(list);
+
+            if (ret < 0) {
+                if (!o->context)
+                    goto finish;
+
+                goto fail;
+            }
+
+            if (pa_tagstruct_getu32(t, &n_removed) < 0)
+                goto fail;
+
+            for (; n_removed > 0; n_removed--) {
+                if (pa_tagstruct_getu32(t, &idx) < 0)
+                    goto fail;
+
+                if (r->callbacks.removed && o->context)
+                    r->callbacks.removed(o->context, facility, idx, o->userdata);
+            }
+
+            /* One of the callbacks might have cancelled the operation */
+            if (!o->context)
+                goto finish;
+        }
+    }
+
+    if (o->callback) {
+        pa_snapshot_done_cb_t cb = (pa_snapshot_done_cb_t) o->callback;
+        cb(o->context, success, seq, full, o->userdata);
+    }
+
+finish:
+    pa_operation_done(o);
+    snapshot_request_free(r);
+    return;
+
+fail:
+    pa_context_fail(o->context, PA_ERR_PROTOCOL);
+    goto finish;
+}
+
+pa_operation* pa_context_get_snapshot(pa_context *c, pa_subscription_mask_t mask, uint64_t since, const pa_snapshot_callbacks *cb, pa_snapshot_done_cb_t done_cb, void *userdata) {
+    struct snapshot_request *r;
+    pa_operation *o;
+    pa_tagstruct *t;
+    uint32_t tag;
+
+    pa_assert(c);
+    pa_assert(PA_REFCNT_VALUE(c) >= 1);
+    pa_assert(cb);
+
+    PA_CHECK_VALIDITY_RETURN_NULL(c, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->state == PA_CONTEXT_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, (mask & ~PA_SUBSCRIPTION_MASK_ALL) == 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY_RETURN_NULL(c, c->version >= 36, PA_ERR_NOTSUPPORTED);
+
+    o = pa_operation_new(c, NULL, (pa_operation_cb_t) done_cb, userdata);
+
+    r = pa_xnew(struct snapshot_request, 1);
+    r->operation = pa_operation_ref(o);
+    r->callbacks = *cb;
+
+    t = pa_tagstruct_command(c, PA_COMMAND_GET_SNAPSHOT, &tag);
+    pa_tagstruct_putu32(t, mask & ~(PA_SUBSCRIPTION_MASK_SERVER | PA_SUBSCRIPTION_MASK_AUTOLOAD));
+    pa_tagstruct_putu64(t, since);
+    pa_pstream_send_tagstruct(c->pstream, t);
+    pa_pdispatch_register_reply(c->pdispatch, tag, DEFAULT_TIMEOUT, context_get_snapshot_callback, r, (pa_free_cb_t) snapshot_request_free);
+
+    return o;
+}
@@ -134,6 +134,15 @@
  * either pa_context_get_client_info() or pa_context_get_client_info_list().
  * The information structure is called pa_client_info.
  *
+ * \subsection snapshot_subsec Snapshots
+ *
+ * Objects of several kinds can be retrieved in one round trip with
+ * pa_context_get_snapshot(). All of them are read by the server at the
+ * same point in time, so they are consistent with each other. The snapshot
+ * carries a sequence number, which can be passed to a later call to only
+ * get the objects that were added or changed since, and the indexes of
+ * those that were removed.
+ *
  * \section ctrl_sec Control
  *
  * Some parts of the server are only possible to read, but most can also be
@@ -795,6 +804,48 @@ pa_operation* pa_context_get_sample_info_list(pa_context *c, pa_sample_info_cb_t
 
 /** @} */
 
+/** @{ \name Snapshots */
+
+/** Callback prototype for objects that were removed since the snapshot a
+ * delta was requested against. \since 18.0 */
+typedef void (*pa_snapshot_removed_cb_t)(pa_context *c, pa_subscription_event_type_t facility, uint32_t idx, void *userdata);
+
+/** Callback prototype for the end of pa_context_get_snapshot(). success is
+ * 1 if the snapshot was received completely, 0 otherwise. seq can be
+ * passed to a later call to get only the changes since this snapshot. full
+ * is 1 if all objects were reported, and 0 if only the changes were. \since 18.0 */
+typedef void (*pa_snapshot_done_cb_t)(pa_context *c, int success, uint64_t seq, int full, void *userdata);
+
+/** The callbacks pa_context_get_snapshot() reports the objects to. Each of
+ * them is called the same way as for the respective *_info_list()
+ * function, i.e. once per object and once more with eol set at the end of
+ * the kind. Any of them may be NULL. The application allocates this
+ * structure and pa_context_get_snapshot() copies it, hence it will never be
+ * extended. Callbacks for new kinds of objects will come with a new
+ * function instead. \since 18.0 */
+typedef struct pa_snapshot_callbacks {
+    pa_sink_info_cb_t sink;
+    pa_source_info_cb_t source;
+    pa_sink_input_info_cb_t sink_input;
+    pa_source_output_info_cb_t source_output;
+    pa_module_info_cb_t module;
+    pa_client_info_cb_t client;
+    pa_sample_info_cb_t sample;
+    pa_card_info_cb_t card;
+    pa_snapshot_removed_cb_t removed;   /**< Only called for deltas */
+} pa_snapshot_callbacks;
+
+/** Get the objects of all kinds selected by mask, in one consistent
+ * snapshot. PA_SUBSCRIPTION_MASK_SERVER and PA_SUBSCRIPTION_MASK_AUTOLOAD
+ * are ignored. If since is not 0, it should be the seq of an earlier
+ * snapshot, and only the objects that were added or changed since are
+ * reported, plus the indexes of the removed ones. If the server can't
+ * tell what changed anymore, all objects are reported and done_cb gets
+ * full set. \since 18.0 */
+pa_operation* pa_context_get_snapshot(pa_context *c, pa_subscription_mask_t mask, uint64_t since, const pa_snapshot_callbacks *cb, pa_snapshot_done_cb_t done_cb, void *userdata);
+
+/** @} */
+
 /** \cond fulldocs */
 
 /** @{ \name Autoload Entries */
@@ -36,12 +36,17 @@
 #include <winsock2.h>
 #endif
 
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/poll.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/hashmap.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/i18n.h>
 #include <pulsecore/llist.h>
@@ -53,6 +58,20 @@
 #include "mainloop.h"
 #include "internal.h"
 
+#ifdef HAVE_SYS_EPOLL_H
+/* An fd can only be in an epoll set once, but several IO events may watch
+ * it, e.g. the read and the write watch of a D-Bus connection. All of them
+ * share one registration for the OR of their flags. */
+struct epoll_fd {
+    int fd;
+    bool registered:1;
+    uint32_t events;
+
+    /* Linked by fd_next, including dead events until they're cleaned up */
+    pa_io_event *io_events;
+};
+#endif
+
 struct pa_io_event {
     pa_mainloop *mainloop;
     bool dead:1;
@@ -61,6 +80,11 @@ struct pa_io_event {
     pa_io_event_flags_t events;
     struct pollfd *pollfd;
 
+#ifdef HAVE_SYS_EPOLL_H
+    struct epoll_fd *epoll_fd;
+    pa_io_event *fd_next;
+#endif
+
     pa_io_event_cb_t callback;
     void *userdata;
     pa_io_event_destroy_cb_t destroy_callback;
@@ -76,6 +100,13 @@ struct pa_time_event {
     bool use_rtclock:1;
     pa_usec_t time;
 
+    /* Position in the timer heap, or TIME_HEAP_INVALID if not in it. Enabled
+     * events are always in the heap, except while they're on the due list in
+     * dispatch_timeout() */
+    unsigned heap_index;
+    pa_time_event *due_next;
+    bool due:1;
+
     pa_time_event_cb_t callback;
     void *userdata;
     pa_time_event_destroy_cb_t destroy_callback;
@@ -108,8 +139,21 @@ struct pa_mainloop {
     struct pollfd *pollfds;
     unsigned max_pollfds, n_pollfds;
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* When available, IO events are registered with epoll as they come and
+     * go, so that polling and dispatching only cost as much as the number
+     * of fds that are ready. -1 if we're using the pollfd array instead. */
+    int epoll_fd;
+    struct epoll_event *epoll_events;
+    unsigned max_epoll_events;
+    pa_hashmap *epoll_fds;
+#endif
+
     pa_usec_t prepared_timeout;
-    pa_time_event *cached_next_time_event;
+
+    /* Binary min-heap of the enabled time events, ordered by time */
+    pa_time_event **time_heap;
+    unsigned n_time_heap, max_time_heap;
 
     pa_mainloop_api api;
 
@@ -148,6 +192,218 @@ static pa_io_event_flags_t map_flags_from_libc(short flags) {
         (flags & POLLHUP ? PA_IO_EVENT_HANGUP : 0);
 }
 
+/* Timer heap */
+#define TIME_HEAP_INVALID ((unsigned) -1)
+
+static void time_heap_set(pa_mainloop *m, unsigned i, pa_time_event *e) {
+    m->time_heap[i] = e;
+    e->heap_index = i;
+}
+
+static void time_heap_sift_up(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    while (i > 0) {
+        unsigned parent = (i - 1) / 2;
+
+        if (m->time_heap[parent]->time <= e->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[parent]);
+        i = parent;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_sift_down(pa_mainloop *m, unsigned i) {
+    pa_time_event *e = m->time_heap[i];
+
+    for (;;) {
+        unsigned child = 2 * i + 1;
+
+        if (child >= m->n_time_heap)
+            break;
+
+        if (child + 1 < m->n_time_heap && m->time_heap[child + 1]->time < m->time_heap[child]->time)
+            child++;
+
+        if (e->time <= m->time_heap[child]->time)
+            break;
+
+        time_heap_set(m, i, m->time_heap[child]);
+        i = child;
+    }
+
+    time_heap_set(m, i, e);
+}
+
+static void time_heap_insert(pa_mainloop *m, pa_time_event *e) {
+    pa_assert(e->heap_index == TIME_HEAP_INVALID);
+
+    if (m->n_time_heap >= m->max_time_heap) {
+        m->max_time_heap = PA_MAX(m->max_time_heap * 2, 32U);
+        m->time_heap = pa_xrenew(pa_time_event*, m->time_heap, m->max_time_heap);
+    }
+
+    time_heap_set(m, m->n_time_heap++, e);
+    time_heap_sift_up(m, e->heap_index);
+}
+
+static void time_heap_remove(pa_mainloop *m, pa_time_event *e) {
+    unsigned i = e->heap_index;
+
+    pa_assert(i < m->n_time_heap);
+    pa_assert(m->time_heap[i] == e);
+
+    e->heap_index = TIME_HEAP_INVALID;
+
+    if (i == --m->n_time_heap)
+        return;
+
+    /* Move the last entry into the hole and restore the heap property in
+     * whichever direction it's violated */
+    time_heap_set(m, i, m->time_heap[m->n_time_heap]);
+
+    if (i > 0 && m->time_heap[i]->time < m->time_heap[(i - 1) / 2]->time)
+        time_heap_sift_up(m, i);
+    else
+        time_heap_sift_down(m, i);
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static uint32_t map_flags_to_epoll(pa_io_event_flags_t flags) {
+    return
+        (flags & PA_IO_EVENT_INPUT ? EPOLLIN : 0) |
+        (flags & PA_IO_EVENT_OUTPUT ? EPOLLOUT : 0) |
+        (flags & PA_IO_EVENT_ERROR ? EPOLLERR : 0) |
+        (flags & PA_IO_EVENT_HANGUP ? EPOLLHUP : 0);
+}
+
+static pa_io_event_flags_t map_flags_from_epoll(uint32_t flags) {
+    return
+        (flags & EPOLLIN ? PA_IO_EVENT_INPUT : 0) |
+        (flags & EPOLLOUT ? PA_IO_EVENT_OUTPUT : 0) |
+        (flags & EPOLLERR ? PA_IO_EVENT_ERROR : 0) |
+        (flags & EPOLLHUP ? PA_IO_EVENT_HANGUP : 0);
+}
+
+static void epoll_fd_free(struct epoll_fd *f) {
+    pa_io_event *e;
+
+    for (e = f->io_events; e; e = e->fd_next)
+        e->epoll_fd = NULL;
+
+    pa_xfree(f);
+}
+
+/* Switch over to the pollfd array for good, e.g. if an fd can't be added
+ * to the epoll set */
+static void disable_epoll(pa_mainloop *m) {
+    if (m->epoll_fd < 0)
+        return;
+
+    pa_log_debug("Falling back to poll() for the main loop.");
+
+    pa_close(m->epoll_fd);
+    m->epoll_fd = -1;
+    m->rebuild_pollfds = true;
+
+    pa_hashmap_free(m->epoll_fds);
+    m->epoll_fds = NULL;
+}
+
+/* Registers the OR of the flags of the live IO events on the fd, and drops
+ * the registration when there are none anymore. If force is true the
+ * registration is renewed even if the flags didn't change, because the fd
+ * may have been closed, which dropped it, and its number reused. */
+static void epoll_fd_update(pa_mainloop *m, struct epoll_fd *f, bool force) {
+    struct epoll_event ev;
+    pa_io_event *e;
+    bool live = false;
+
+    pa_zero(ev);
+    ev.data.ptr = f;
+
+    for (e = f->io_events; e; e = e->fd_next)
+        if (!e->dead) {
+            ev.events |= map_flags_to_epoll(e->events);
+            live = true;
+        }
+
+    if (!live) {
+        /* Fails if the fd was closed already, which is fine */
+        if (f->registered)
+            epoll_ctl(m->epoll_fd, EPOLL_CTL_DEL, f->fd, NULL);
+
+        f->registered = false;
+        return;
+    }
+
+    if (f->registered && f->events == ev.events && !force)
+        return;
+
+    f->events = ev.events;
+
+    if (f->registered) {
+        if (epoll_ctl(m->epoll_fd, EPOLL_CTL_MOD, f->fd, &ev) >= 0)
+            return;
+
+        if (errno != ENOENT)
+            goto fail;
+    }
+
+    if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, f->fd, &ev) < 0)
+        goto fail;
+
+    f->registered = true;
+    return;
+
+fail:
+    pa_log_debug("epoll_ctl(): %s", pa_cstrerror(errno));
+    disable_epoll(m);
+}
+
+static void epoll_add_io_event(pa_mainloop *m, pa_io_event *e) {
+    struct epoll_fd *f;
+
+    if (m->epoll_fd < 0)
+        return;
+
+    if (!(f = pa_hashmap_get(m->epoll_fds, PA_INT_TO_PTR(e->fd)))) {
+        f = pa_xnew0(struct epoll_fd, 1);
+        f->fd = e->fd;
+        pa_assert_se(pa_hashmap_put(m->epoll_fds, PA_INT_TO_PTR(f->fd), f) == 0);
+    }
+
+    e->epoll_fd = f;
+    e->fd_next = f->io_events;
+    f->io_events = e;
+
+    epoll_fd_update(m, f, true);
+}
+
+/* Called when e is cleaned up, it's dead already */
+static void epoll_remove_io_event(pa_mainloop *m, pa_io_event *e) {
+    struct epoll_fd *f = e->epoll_fd;
+    pa_io_event **p;
+
+    if (!f)
+        return;
+
+    for (p = &f->io_events; *p != e; p = &(*p)->fd_next)
+        pa_assert(*p);
+
+    *p = e->fd_next;
+    e->epoll_fd = NULL;
+
+    if (!f->io_events) {
+        pa_assert(!f->registered);
+        pa_assert_se(pa_hashmap_remove_and_free(m->epoll_fds, PA_INT_TO_PTR(f->fd)) == 0);
+    }
+}
+#endif
+
 /* IO events */
 static pa_io_event* mainloop_io_new(
         pa_mainloop_api *a,
@@ -180,6 +436,10 @@ static pa_io_event* mainloop_io_new(
     m->rebuild_pollfds = true;
     m->n_io_events ++;
 
+#ifdef HAVE_SYS_EPOLL_H
+    epoll_add_io_event(m, e);
+#endif
+
     pa_mainloop_wakeup(m);
 
     return e;
@@ -194,6 +454,11 @@ static void mainloop_io_enable(pa_io_event *e, pa_io_event_flags_t events) {
 
     e->events = events;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->epoll_fd)
+        epoll_fd_update(e->mainloop, e->epoll_fd, false);
+#endif
+
     if (e->pollfd)
         e->pollfd->events = map_flags_to_libc(events);
     else
@@ -207,6 +472,11 @@ static void mainloop_io_free(pa_io_event *e) {
     pa_assert(!e->dead);
 
     e->dead = true;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (e->epoll_fd)
+        epoll_fd_update(e->mainloop, e->epoll_fd, false);
+#endif
     e->mainloop->io_events_please_scan ++;
 
     e->mainloop->n_io_events --;
@@ -331,19 +601,14 @@ static pa_time_event* mainloop_time_new(
 
     e = pa_xnew0(pa_time_event, 1);
     e->mainloop = m;
+    e->heap_index = TIME_HEAP_INVALID;
 
     if ((e->enabled = (t != PA_USEC_INVALID))) {
         e->time = t;
         e->use_rtclock = use_rtclock;
 
         m->n_enabled_time_events++;
-
-        if (m->cached_next_time_event) {
-            pa_assert(m->cached_next_time_event->enabled);
-
-            if (t < m->cached_next_time_event->time)
-                m->cached_next_time_event = e;
-        }
+        time_heap_insert(m, e);
     }
 
     e->callback = callback;
@@ -367,6 +632,12 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
 
     t = make_rt(tv, &use_rtclock);
 
+    if (e->heap_index != TIME_HEAP_INVALID)
+        time_heap_remove(e->mainloop, e);
+
+    /* If it's still waiting to be dispatched, it won't be anymore */
+    e->due = false;
+
     valid = (t != PA_USEC_INVALID);
     if (e->enabled && !valid) {
         pa_assert(e->mainloop->n_enabled_time_events > 0);
@@ -377,18 +648,9 @@ static void mainloop_time_restart(pa_time_event *e, const struct timeval *tv) {
     if ((e->enabled = valid)) {
         e->time = t;
         e->use_rtclock = use_rtclock;
+        time_heap_insert(e->mainloop, e);
         pa_mainloop_wakeup(e->mainloop);
     }
-
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
-
-    if (e->mainloop->cached_next_time_event && e->enabled) {
-        pa_assert(e->mainloop->cached_next_time_event->enabled);
-
-        if (t < e->mainloop->cached_next_time_event->time)
-            e->mainloop->cached_next_time_event = e;
-    }
 }
 
 static void mainloop_time_free(pa_time_event *e) {
@@ -404,8 +666,10 @@ static void mainloop_time_free(pa_time_event *e) {
         e->enabled = false;
     }
 
-    if (e->mainloop->cached_next_time_event == e)
-        e->mainloop->cached_next_time_event = NULL;
+    if (e->heap_index != TIME_HEAP_INVALID)
+        time_heap_remove(e->mainloop, e);
+
+    e->due = false;
 
     /* no wakeup needed here. Think about it! */
 }
@@ -480,6 +744,24 @@ pa_mainloop *pa_mainloop_new(void) {
 
     m->rebuild_pollfds = true;
 
+#ifdef HAVE_SYS_EPOLL_H
+    if ((m->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) >= 0) {
+        struct epoll_event ev;
+
+        /* The wakeup pipe is the only one without an IO event */
+        pa_zero(ev);
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+
+        if (epoll_ctl(m->epoll_fd, EPOLL_CTL_ADD, m->wakeup_pipe[0], &ev) < 0) {
+            pa_close(m->epoll_fd);
+            m->epoll_fd = -1;
+        } else
+            m->epoll_fds = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                               NULL, (pa_free_cb_t) epoll_fd_free);
+    }
+#endif
+
     m->api = vtable;
     m->api.userdata = m;
 
@@ -501,6 +783,11 @@ static void cleanup_io_events(pa_mainloop *m, bool force) {
         if (force || e->dead) {
             PA_LLIST_REMOVE(pa_io_event, m->io_events, e);
 
+#ifdef HAVE_SYS_EPOLL_H
+            if (!force)
+                epoll_remove_io_event(m, e);
+#endif
+
             if (e->dead) {
                 pa_assert(m->io_events_please_scan > 0);
                 m->io_events_please_scan--;
@@ -547,6 +834,9 @@ static void cleanup_time_events(pa_mainloop *m, bool force) {
         }
     }
 
+    if (force)
+        m->n_time_heap = 0;
+
     pa_assert(m->time_events_please_scan == 0);
 }
 
@@ -585,12 +875,25 @@ static void cleanup_defer_events(pa_mainloop *m, bool force) {
 void pa_mainloop_free(pa_mainloop *m) {
     pa_assert(m);
 
+#ifdef HAVE_SYS_EPOLL_H
+    /* Before the IO events, the registrations point to them */
+    if (m->epoll_fds)
+        pa_hashmap_free(m->epoll_fds);
+#endif
+
     cleanup_io_events(m, true);
     cleanup_defer_events(m, true);
     cleanup_time_events(m, true);
 
+    pa_xfree(m->time_heap);
     pa_xfree(m->pollfds);
 
+#ifdef HAVE_SYS_EPOLL_H
+    if (m->epoll_fd >= 0)
+        pa_close(m->epoll_fd);
+    pa_xfree(m->epoll_events);
+#endif
+
     pa_close_pipe(m->wakeup_pipe);
 
     pa_xfree(m);
@@ -682,6 +985,54 @@ static unsigned dispatch_pollfds(pa_mainloop *m) {
     return r;
 }
 
+#ifdef HAVE_SYS_EPOLL_H
+static unsigned dispatch_epoll(pa_mainloop *m) {
+    unsigned r = 0, k;
+
+    pa_assert(m->poll_func_ret > 0);
+
+    for (k = 0; k < (unsigned) m->poll_func_ret; k++) {
+        struct epoll_fd *f = m->epoll_events[k].data.ptr;
+        pa_io_event_flags_t flags;
+        pa_io_event *e;
+
+        /* The wakeup pipe */
+        if (!f)
+            continue;
+
+        flags = map_flags_from_epoll(m->epoll_events[k].events);
+
+        /* Events freed by a callback, and their epoll_fd, are only cleaned
+         * up in the next prepare(), so this is safe. Events added by a
+         * callback come first in the list and are skipped. */
+        for (e = f->io_events; e; e = e->fd_next) {
+            pa_io_event_flags_t eflags;
+
+            if (m->quit)
+                return r;
+
+            if (e->dead)
+                continue;
+
+            /* Like poll(), errors and hangups are reported to everybody */
+            if (!(eflags = flags & (e->events | PA_IO_EVENT_ERROR | PA_IO_EVENT_HANGUP)))
+                continue;
+
+            pa_assert(e->callback);
+
+            e->callback(&m->api, e, e->fd, eflags, e->userdata);
+            r++;
+
+            /* The callback made us fall back to poll(), which freed f */
+            if (m->epoll_fd < 0)
+                return r;
+        }
+    }
+
+    return r;
+}
+#endif
+
 static unsigned dispatch_defer(pa_mainloop *m) {
     pa_defer_event *e;
     unsigned r = 0;
@@ -706,28 +1057,9 @@ static unsigned dispatch_defer(pa_mainloop *m) {
 }
 
 static pa_time_event* find_next_time_event(pa_mainloop *m) {
-    pa_time_event *t, *n = NULL;
     pa_assert(m);
 
-    if (m->cached_next_time_event)
-        return m->cached_next_time_event;
-
-    PA_LLIST_FOREACH(t, m->time_events) {
-
-        if (t->dead || !t->enabled)
-            continue;
-
-        if (!n || t->time < n->time) {
-            n = t;
-
-            /* Shortcut for time == 0 */
-            if (n->time == 0)
-                break;
-        }
-    }
-
-    m->cached_next_time_event = n;
-    return n;
+    return m->n_time_heap > 0 ? m->time_heap[0] : NULL;
 }
 
 static pa_usec_t calc_next_timeout(pa_mainloop *m) {
@@ -751,7 +1083,7 @@ static pa_usec_t calc_next_timeout(pa_mainloop *m) {
 }
 
 static unsigned dispatch_timeout(pa_mainloop *m) {
-    pa_time_event *e;
+    pa_time_event *e, *due = NULL, **due_tail = &due;
     pa_usec_t now;
     unsigned r = 0;
     pa_assert(m);
@@ -761,25 +1093,41 @@ static unsigned dispatch_timeout(pa_mainloop *m) {
 
     now = pa_rtclock_now();
 
-    PA_LLIST_FOREACH(e, m->time_events) {
+    /* Take all expired events off the heap first, so that events that are
+     * (re)started from one of the callbacks with a time in the past are
+     * only dispatched in the next iteration, as they used to be */
+    while (m->n_time_heap > 0 && m->time_heap[0]->time <= now) {
+        e = m->time_heap[0];
+        time_heap_remove(m, e);
+
+        e->due = true;
+        e->due_next = NULL;
+        *due_tail = e;
+        due_tail = &e->due_next;
+    }
 
-        if (m->quit)
-            break;
+    for (e = due; e; e = e->due_next) {
+        struct timeval tv;
 
-        if (e->dead || !e->enabled)
+        /* Freed or restarted by an earlier callback */
+        if (!e->due)
             continue;
 
-        if (e->time <= now) {
-            struct timeval tv;
-            pa_assert(e->callback);
+        e->due = false;
 
-            /* Disable time event */
-            mainloop_time_restart(e, NULL);
+        if (m->quit) {
+            time_heap_insert(m, e);
+            continue;
+        }
+
+        pa_assert(e->callback);
 
-            e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+        /* Disable time event */
+        mainloop_time_restart(e, NULL);
 
-            r++;
-        }
+        e->callback(&m->api, e, pa_timeval_rtstore(&tv, e->time, e->use_rtclock), e->userdata);
+
+        r++;
     }
 
     return r;
@@ -815,6 +1163,14 @@ int pa_mainloop_prepare(pa_mainloop *m, int timeout) {
 
     if (m->n_enabled_defer_events <= 0) {
 
+#ifdef HAVE_SYS_EPOLL_H
+        if (m->epoll_fd >= 0) {
+            if (m->max_epoll_events < m->n_io_events + 1) {
+                m->max_epoll_events = (m->n_io_events + 1) * 2;
+                m->epoll_events = pa_xrenew(struct epoll_event, m->epoll_events, m->max_epoll_events);
+            }
+        } else
+#endif
         if (m->rebuild_pollfds)
             rebuild_pollfds(m);
 
@@ -856,6 +1212,20 @@ int pa_mainloop_poll(pa_mainloop *m) {
 
     if (m->n_enabled_defer_events)
         m->poll_func_ret = 0;
+#ifdef HAVE_SYS_EPOLL_H
+    else if (m->epoll_fd >= 0) {
+        m->poll_func_ret = epoll_wait(
+                m->epoll_fd, m->epoll_events, (int) m->max_epoll_events,
+                usec_to_timeout(m->prepared_timeout));
+
+        if (m->poll_func_ret < 0) {
+            if (errno == EINTR)
+                m->poll_func_ret = 0;
+            else
+                pa_log("epoll_wait(): %s", pa_cstrerror(errno));
+        }
+    }
+#endif
     else {
         pa_assert(!m->rebuild_pollfds);
 
@@ -913,8 +1283,14 @@ int pa_mainloop_dispatch(pa_mainloop *m) {
         if (m->quit)
             goto quit;
 
-        if (m->poll_func_ret > 0)
-            dispatched += dispatch_pollfds(m);
+        if (m->poll_func_ret > 0) {
+#ifdef HAVE_SYS_EPOLL_H
+            if (m->epoll_fd >= 0)
+                dispatched += dispatch_epoll(m);
+            else
+#endif
+                dispatched += dispatch_pollfds(m);
+        }
     }
 
     if (m->quit)
@@ -988,6 +1364,12 @@ void pa_mainloop_set_poll_func(pa_mainloop *m, pa_poll_func poll_func, void *use
 
     m->poll_func = poll_func;
     m->poll_func_userdata = userdata;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Custom poll functions work on the pollfd array */
+    if (poll_func)
+        disable_epoll(m);
+#endif
 }
 
 bool pa_mainloop_is_our_api(const pa_mainloop_api *m) {
@@ -1473,6 +1473,63 @@ int pa_stream_begin_write(
     return 0;
 }
 
+int pa_stream_begin_write_min(
+        pa_stream *s,
+        void **data,
+        size_t *nbytes,
+        size_t min_nbytes) {
+
+    size_t m, fs;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    PA_CHECK_VALIDITY(s->context, !pa_detect_fork(), PA_ERR_FORKED);
+    PA_CHECK_VALIDITY(s->context, s->state == PA_STREAM_READY, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, s->direction == PA_STREAM_PLAYBACK || s->direction == PA_STREAM_UPLOAD, PA_ERR_BADSTATE);
+    PA_CHECK_VALIDITY(s->context, data, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, nbytes && *nbytes != 0, PA_ERR_INVALID);
+    PA_CHECK_VALIDITY(s->context, min_nbytes > 0, PA_ERR_INVALID);
+
+    /* Without SHM every write is copied over the socket anyway */
+    PA_CHECK_VALIDITY(s->context, pa_pstream_get_shm(s->context->pstream), PA_ERR_NOTSUPPORTED);
+
+    fs = pa_frame_size(&s->sample_spec);
+    m = pa_mempool_block_size_max(s->context->mempool);
+    m = (m / fs) * fs;
+
+    PA_CHECK_VALIDITY(s->context, min_nbytes <= m, PA_ERR_TOOLARGE);
+
+    if (*nbytes == (size_t) -1 || *nbytes > m)
+        *nbytes = m;
+    else if (*nbytes < min_nbytes)
+        *nbytes = min_nbytes;
+
+    /* Reuse what an earlier pa_stream_begin_write() handed out, if it
+     * qualifies */
+    if (s->write_memblock &&
+        (pa_memblock_get_length(s->write_memblock) < min_nbytes || !pa_memblock_is_pooled(s->write_memblock))) {
+        pa_memblock_release(s->write_memblock);
+        pa_memblock_unref(s->write_memblock);
+        s->write_memblock = NULL;
+        s->write_data = NULL;
+    }
+
+    if (!s->write_memblock) {
+        /* Unlike pa_memblock_new() this never falls back to memory
+         * outside the pool, which would have to be copied */
+        if (!(s->write_memblock = pa_memblock_new_pool(s->context->mempool, *nbytes)))
+            return -pa_context_set_error(s->context, PA_ERR_BUSY);
+
+        s->write_data = pa_memblock_acquire(s->write_memblock);
+    }
+
+    *data = s->write_data;
+    *nbytes = pa_memblock_get_length(s->write_memblock);
+
+    return 0;
+}
+
 int pa_stream_cancel_write(
         pa_stream *s) {
 
@@ -474,6 +474,33 @@ int pa_stream_begin_write(
         void **data,
         size_t *nbytes);
 
+/** Like pa_stream_begin_write(), but the returned memory area is at
+ * least \a min_nbytes large, and it is always a block of the client's
+ * shared memory pool. The server then reads the data from there when
+ * it is written with pa_stream_write(), without any copy being made on
+ * the way. Very small writes may still be copied into the connection's
+ * shared ring buffer, where that's cheaper than passing a reference.
+ *
+ * \a *nbytes is handled as with pa_stream_begin_write(), except that
+ * it is raised to \a min_nbytes if it is smaller. To write more than
+ * the largest block the pool can hold, which is also the largest
+ * possible \a min_nbytes, repeat pa_stream_begin_write_min() and
+ * pa_stream_write() for every block; each of them is passed on without
+ * copying. If pa_stream_begin_write() was called before and the
+ * memory area it returned is not suitable, it is dropped as with
+ * pa_stream_cancel_write().
+ *
+ * Returns zero on success. Fails with PA_ERR_NOTSUPPORTED if the
+ * connection doesn't use shared memory, with PA_ERR_TOOLARGE if
+ * \a min_nbytes is larger than a block of the pool and with
+ * PA_ERR_BUSY if no block of the pool is free at the moment, in which
+ * case pa_stream_begin_write() may still succeed, with a copy. \since 18.0 */
+int pa_stream_begin_write_min(
+        pa_stream *p,
+        void **data,
+        size_t *nbytes,
+        size_t min_nbytes);
+
 /** Reverses the effect of pa_stream_begin_write() dropping all data
  * that has already been placed in the memory area returned by
  * pa_stream_begin_write(). Only valid to call if
@@ -23,6 +23,7 @@
 
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 
@@ -30,7 +31,8 @@
 #include <pulsecore/log.h>
 #include <pulsecore/semaphore.h>
 #include <pulsecore/macro.h>
-#include <pulsecore/mutex.h>
+#include <pulsecore/atomic.h>
+#include <pulsecore/fdsem.h>
 #include <pulsecore/flist.h>
 
 #include "asyncmsgq.h"
@@ -38,7 +40,12 @@
 PA_STATIC_FLIST_DECLARE(asyncmsgq, 0, pa_xfree);
 PA_STATIC_FLIST_DECLARE(semaphores, 0, (void(*)(void*)) pa_semaphore_free);
 
+/* Payloads of pa_asyncmsgq_post_data() up to this size are stored in
+ * the item itself */
+#define INLINE_DATA_MAX 64
+
 struct asyncmsgq_item {
+    struct asyncmsgq_item *next;
     int code;
     pa_msgobject *object;
     void *userdata;
@@ -47,57 +54,147 @@ struct asyncmsgq_item {
     pa_memchunk memchunk;
     pa_semaphore *semaphore;
     int ret;
+
+    /* A copy of the payload that didn't fit inline, freed after free_cb */
+    void *data;
+
+    union {
+        uint8_t bytes[INLINE_DATA_MAX];
+        int64_t _align_i;
+        double _align_d;
+        void *_align_p;
+    } inline_data;
 };
 
 struct pa_asyncmsgq {
     PA_REFCNT_DECLARE;
-    pa_asyncq *asyncq;
-    pa_mutex *mutex; /* only for the writer side */
+
+    /* Writers push onto this stack with a compare-and-swap, so posting
+     * takes no lock no matter how many threads write. The reader takes
+     * the whole stack at once and reverses it, which restores the
+     * order in which the messages were posted. */
+    pa_atomic_ptr_t stack;
+
+    /* Reader side only: what was taken from the stack but is not
+     * dispatched yet, in order */
+    struct asyncmsgq_item *ready;
 
     struct asyncmsgq_item *current;
+
+    /* Posted by writers. The queue is unbounded, so writers never wait
+     * for the reader and write_fdsem is never posted. It exists only
+     * to give the write side something to poll. */
+    pa_fdsem *read_fdsem, *write_fdsem;
 };
 
+/* The size is not used anymore, since the queue is unbounded */
 pa_asyncmsgq *pa_asyncmsgq_new(unsigned size) {
-    pa_asyncq *asyncq;
     pa_asyncmsgq *a;
 
-    asyncq = pa_asyncq_new(size);
-    if (!asyncq)
-        return NULL;
-
-    a = pa_xnew(pa_asyncmsgq, 1);
+    a = pa_xnew0(pa_asyncmsgq, 1);
 
     PA_REFCNT_INIT(a);
-    a->asyncq = asyncq;
-    pa_assert_se(a->mutex = pa_mutex_new(false, true));
-    a->current = NULL;
+    pa_atomic_ptr_store(&a->stack, NULL);
+
+    if (!(a->read_fdsem = pa_fdsem_new())) {
+        pa_xfree(a);
+        return NULL;
+    }
+
+    if (!(a->write_fdsem = pa_fdsem_new())) {
+        pa_fdsem_free(a->read_fdsem);
+        pa_xfree(a);
+        return NULL;
+    }
 
     return a;
 }
 
-static void asyncmsgq_free(pa_asyncmsgq *a) {
-    struct asyncmsgq_item *i;
-    pa_assert(a);
+static void push(pa_asyncmsgq *a, struct asyncmsgq_item *i) {
+    struct asyncmsgq_item *head;
 
-    while ((i = pa_asyncq_pop(a->asyncq, false))) {
+    /* No ABA problem here: whatever the head is when the exchange
+     * succeeds, it is a valid item to link to, since the reader only
+     * ever takes the entire stack */
+    do {
+        head = pa_atomic_ptr_load(&a->stack);
+        i->next = head;
+    } while (!pa_atomic_ptr_cmpxchg(&a->stack, head, i));
 
-        pa_assert(!i->semaphore);
+    pa_fdsem_post(a->read_fdsem);
+}
 
-        if (i->object)
-            pa_msgobject_unref(i->object);
+/* Reader side only. Moves everything posted so far to the ready list,
+ * returns false if there was nothing. */
+static bool take_all(pa_asyncmsgq *a) {
+    struct asyncmsgq_item *head, *ready = NULL;
 
-        if (i->memchunk.memblock)
-            pa_memblock_unref(i->memchunk.memblock);
+    pa_assert(!a->ready);
 
-        if (i->free_cb)
-            i->free_cb(i->userdata);
+    do {
+        if (!(head = pa_atomic_ptr_load(&a->stack)))
+            return false;
+    } while (!pa_atomic_ptr_cmpxchg(&a->stack, head, NULL));
+
+    while (head) {
+        struct asyncmsgq_item *next = head->next;
+
+        head->next = ready;
+        ready = head;
+        head = next;
+    }
+
+    a->ready = ready;
+    return true;
+}
+
+/* Reader side only */
+static struct asyncmsgq_item *pop(pa_asyncmsgq *a, bool wait_op) {
+    struct asyncmsgq_item *i;
+
+    for (;;) {
+        if ((i = a->ready)) {
+            a->ready = i->next;
+            return i;
+        }
+
+        if (take_all(a))
+            continue;
 
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
-            pa_xfree(i);
+        if (!wait_op)
+            return NULL;
+
+        pa_fdsem_wait(a->read_fdsem);
     }
+}
+
+static void item_free(struct asyncmsgq_item *i) {
+    pa_assert(!i->semaphore);
+
+    if (i->free_cb)
+        i->free_cb(i->userdata);
+
+    pa_xfree(i->data);
+
+    if (i->object)
+        pa_msgobject_unref(i->object);
+
+    if (i->memchunk.memblock)
+        pa_memblock_unref(i->memchunk.memblock);
 
-    pa_asyncq_free(a->asyncq, NULL);
-    pa_mutex_free(a->mutex);
+    if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), i) < 0)
+        pa_xfree(i);
+}
+
+static void asyncmsgq_free(pa_asyncmsgq *a) {
+    struct asyncmsgq_item *i;
+    pa_assert(a);
+
+    while ((i = pop(a, false)))
+        item_free(i);
+
+    pa_fdsem_free(a->read_fdsem);
+    pa_fdsem_free(a->write_fdsem);
     pa_xfree(a);
 }
 
@@ -115,17 +212,14 @@ void pa_asyncmsgq_unref(pa_asyncmsgq* q) {
         asyncmsgq_free(q);
 }
 
-void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+static struct asyncmsgq_item *item_new(pa_msgobject *object, int code, int64_t offset, const pa_memchunk *chunk) {
     struct asyncmsgq_item *i;
-    pa_assert(PA_REFCNT_VALUE(a) > 0);
 
     if (!(i = pa_flist_pop(PA_STATIC_FLIST_GET(asyncmsgq))))
         i = pa_xnew(struct asyncmsgq_item, 1);
 
     i->code = code;
     i->object = object ? pa_msgobject_ref(object) : NULL;
-    i->userdata = (void*) userdata;
-    i->free_cb = free_cb;
     i->offset = offset;
     if (chunk) {
         pa_assert(chunk->memblock);
@@ -134,11 +228,39 @@ void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const vo
     } else
         pa_memchunk_reset(&i->memchunk);
     i->semaphore = NULL;
+    i->data = NULL;
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_asyncq_post(a->asyncq, i);
-    pa_mutex_unlock(a->mutex);
+    return i;
+}
+
+void pa_asyncmsgq_post(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    struct asyncmsgq_item *i;
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+
+    i = item_new(object, code, offset, chunk);
+    i->userdata = (void*) userdata;
+    i->free_cb = free_cb;
+
+    push(a, i);
+}
+
+void pa_asyncmsgq_post_data(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *data, size_t size, int64_t offset, const pa_memchunk *chunk, pa_free_cb_t free_cb) {
+    struct asyncmsgq_item *i;
+    pa_assert(PA_REFCNT_VALUE(a) > 0);
+    pa_assert(data);
+    pa_assert(size > 0);
+
+    i = item_new(object, code, offset, chunk);
+
+    if (size <= INLINE_DATA_MAX) {
+        memcpy(i->inline_data.bytes, data, size);
+        i->userdata = i->inline_data.bytes;
+    } else
+        i->userdata = i->data = pa_xmemdup(data, size);
+
+    i->free_cb = free_cb;
+
+    push(a, i);
 }
 
 int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *chunk) {
@@ -151,6 +273,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     i.free_cb = NULL;
     i.ret = -1;
     i.offset = offset;
+    i.data = NULL;
     if (chunk) {
         pa_assert(chunk->memblock);
         i.memchunk = *chunk;
@@ -160,10 +283,7 @@ int pa_asyncmsgq_send(pa_asyncmsgq *a, pa_msgobject *object, int code, const voi
     if (!(i.semaphore = pa_flist_pop(PA_STATIC_FLIST_GET(semaphores))))
         i.semaphore = pa_semaphore_new(0);
 
-    /* This mutex makes the queue multiple-writer safe. This lock is only used on the writing side */
-    pa_mutex_lock(a->mutex);
-    pa_assert_se(pa_asyncq_push(a->asyncq, &i, true) == 0);
-    pa_mutex_unlock(a->mutex);
+    push(a, &i);
 
     pa_semaphore_wait(i.semaphore);
 
@@ -177,7 +297,7 @@ int pa_asyncmsgq_get(pa_asyncmsgq *a, pa_msgobject **object, int *code, void **u
     pa_assert(PA_REFCNT_VALUE(a) > 0);
     pa_assert(!a->current);
 
-    if (!(a->current = pa_asyncq_pop(a->asyncq, wait_op))) {
+    if (!(a->current = pop(a, wait_op))) {
 /*         pa_log("failure"); */
         return -1;
     }
@@ -216,20 +336,8 @@ void pa_asyncmsgq_done(pa_asyncmsgq *a, int ret) {
     if (a->current->semaphore) {
         a->current->ret = ret;
         pa_semaphore_post(a->current->semaphore);
-    } else {
-
-        if (a->current->free_cb)
-            a->current->free_cb(a->current->userdata);
-
-        if (a->current->object)
-            pa_msgobject_unref(a->current->object);
-
-        if (a->current->memchunk.memblock)
-            pa_memblock_unref(a->current->memchunk.memblock);
-
-        if (pa_flist_push(PA_STATIC_FLIST_GET(asyncmsgq), a->current) < 0)
-            pa_xfree(a->current);
-    }
+    } else
+        item_free(a->current);
 
     a->current = NULL;
 }
@@ -284,37 +392,41 @@ int pa_asyncmsgq_process_one(pa_asyncmsgq *a) {
 int pa_asyncmsgq_read_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_fd(a->asyncq);
+    return pa_fdsem_get(a->read_fdsem);
 }
 
 int pa_asyncmsgq_read_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_read_before_poll(a->asyncq);
+    for (;;) {
+        if (a->ready || pa_atomic_ptr_load(&a->stack))
+            return -1;
+
+        if (pa_fdsem_before_poll(a->read_fdsem) >= 0)
+            return 0;
+    }
 }
 
 void pa_asyncmsgq_read_after_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    pa_asyncq_read_after_poll(a->asyncq);
+    pa_fdsem_after_poll(a->read_fdsem);
 }
 
 int pa_asyncmsgq_write_fd(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    return pa_asyncq_write_fd(a->asyncq);
+    return pa_fdsem_get(a->write_fdsem);
 }
 
 void pa_asyncmsgq_write_before_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
 
-    pa_asyncq_write_before_poll(a->asyncq);
+    /* Nothing to do, posting never has to be postponed */
 }
 
 void pa_asyncmsgq_write_after_poll(pa_asyncmsgq *a) {
     pa_assert(PA_REFCNT_VALUE(a) > 0);
-
-    pa_asyncq_write_after_poll(a->asyncq);
 }
 
 int pa_asyncmsgq_dispatch(pa_msgobject *object, int code, void *userdata, int64_t offset, pa_memchunk *memchunk) {
@@ -26,13 +26,13 @@
 #include <pulsecore/memchunk.h>
 #include <pulsecore/msgobject.h>
 
-/* A simple asynchronous message queue, based on pa_asyncq. In
- * contrast to pa_asyncq this one is multiple-writer safe, though
- * still not multiple-reader safe. This queue is intended to be used
- * for controlling real-time threads from normal-priority
- * threads. Multiple-writer-safety is accomplished by using a mutex on
- * the writer side. This queue is thus not useful for communication
- * between several real-time threads.
+/* A simple asynchronous message queue. In contrast to pa_asyncq this
+ * one is multiple-writer safe, though still not multiple-reader
+ * safe. This queue is intended to be used for controlling real-time
+ * threads from normal-priority threads. Posting is lock-free: writers
+ * push onto a list with a compare-and-swap and the reader takes all
+ * pending messages at once. The queue is unbounded, so writers never
+ * block on the reader.
  *
  * The queue takes messages consisting of:
  *    "Object" for which this messages is intended (may be NULL)
@@ -40,9 +40,12 @@
  *    Arbitrary userdata pointer (may be NULL)
  *    A memchunk (may be NULL)
  *
- * There are two functions for submitting messages: _post and
- * _send. The former just enqueues the message asynchronously, the
- * latter waits for completion, synchronously. */
+ * There are three functions for submitting messages: _post,
+ * _post_data and _send. The first just enqueues the message
+ * asynchronously, the second does so too, but copies the userdata
+ * into the queue (small payloads are stored in the message itself,
+ * without an extra allocation), the last waits for completion,
+ * synchronously. */
 
 enum {
     PA_MESSAGE_SHUTDOWN = -1/* A generic message to inform the handler of this queue to quit */
@@ -56,6 +59,11 @@ pa_asyncmsgq* pa_asyncmsgq_ref(pa_asyncmsgq *q);
 void pa_asyncmsgq_unref(pa_asyncmsgq* q);
 
 void pa_asyncmsgq_post(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t userdata_free_cb);
+/* Copies size bytes from data into the message, the handler gets a
+ * pointer to the copy as userdata. The queue owns the copy's storage,
+ * free_cb (may be NULL) is only called to release whatever the copy
+ * refers to. */
+void pa_asyncmsgq_post_data(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *data, size_t size, int64_t offset, const pa_memchunk *memchunk, pa_free_cb_t free_cb);
 int pa_asyncmsgq_send(pa_asyncmsgq *q, pa_msgobject *object, int code, const void *userdata, int64_t offset, const pa_memchunk *memchunk);
 
 int pa_asyncmsgq_get(pa_asyncmsgq *q, pa_msgobject **object, int *code, void **userdata, int64_t *offset, pa_memchunk *memchunk, bool wait);
@@ -57,6 +57,16 @@ struct pa_subscription_event {
     PA_LLIST_FIELDS(pa_subscription_event);
 };
 
+/* Every event is also recorded in a ring of the most recent ones, no
+ * matter if anyone is subscribed, so that clients can ask what changed
+ * after a given sequence number instead of fetching everything again */
+#define JOURNAL_SIZE 1024
+
+struct pa_subscription_journal_entry {
+    pa_subscription_event_type_t type;
+    uint32_t index;
+};
+
 static void sched_event(pa_core *c);
 
 /* Allocate a new subscription object for the given subscription mask. Use the specified callback function and user data */
@@ -116,6 +126,9 @@ void pa_subscription_free_all(pa_core *c) {
     while (c->subscription_event_queue)
         free_event(c->subscription_event_queue);
 
+    pa_xfree(c->subscription_journal);
+    c->subscription_journal = NULL;
+
     if (c->subscription_defer_event) {
         c->mainloop->defer_free(c->subscription_defer_event);
         c->subscription_defer_event = NULL;
@@ -205,8 +218,17 @@ static void sched_event(pa_core *c) {
 /* Append a new subscription event to the subscription event queue and schedule a main loop event */
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx) {
     pa_subscription_event *e;
+    pa_subscription_journal_entry *j;
     pa_assert(c);
 
+    if (!c->subscription_journal)
+        c->subscription_journal = pa_xnew0(pa_subscription_journal_entry, JOURNAL_SIZE);
+
+    c->subscription_seq++;
+    j = &c->subscription_journal[c->subscription_seq % JOURNAL_SIZE];
+    j->type = t;
+    j->index = idx;
+
     /* No need for queuing subscriptions of no one is listening */
     if (!c->subscriptions)
         return;
@@ -260,3 +282,36 @@ void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t i
 
     sched_event(c);
 }
+
+/* Returns the sequence number of the last event posted */
+uint64_t pa_subscription_get_seq(pa_core *c) {
+    pa_assert(c);
+
+    return c->subscription_seq;
+}
+
+/* Adds the indexes of all objects of the given facility that were
+ * created, changed or removed after the event with sequence number seq
+ * to touched, as PA_UINT32_TO_PTR(index + 1). Returns -1 if the journal
+ * doesn't reach back that far anymore, or seq is in the future. */
+int pa_subscription_get_changes(pa_core *c, uint64_t seq, pa_subscription_event_type_t facility, pa_idxset *touched) {
+    uint64_t i;
+
+    pa_assert(c);
+    pa_assert(touched);
+    pa_assert((facility & ~PA_SUBSCRIPTION_EVENT_FACILITY_MASK) == 0);
+
+    if (seq > c->subscription_seq || c->subscription_seq - seq > JOURNAL_SIZE)
+        return -1;
+
+    for (i = seq + 1; i <= c->subscription_seq; i++) {
+        pa_subscription_journal_entry *j = &c->subscription_journal[i % JOURNAL_SIZE];
+
+        if ((j->type & PA_SUBSCRIPTION_EVENT_FACILITY_MASK) != facility || j->index == PA_INVALID_INDEX)
+            continue;
+
+        pa_idxset_put(touched, PA_UINT32_TO_PTR(j->index + 1), NULL);
+    }
+
+    return 0;
+}
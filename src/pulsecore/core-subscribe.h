@@ -22,6 +22,7 @@
 
 typedef struct pa_subscription pa_subscription;
 typedef struct pa_subscription_event pa_subscription_event;
+typedef struct pa_subscription_journal_entry pa_subscription_journal_entry;
 
 #include <pulsecore/core.h>
 #include <pulsecore/native-common.h>
@@ -34,4 +35,7 @@ void pa_subscription_free_all(pa_core *c);
 
 void pa_subscription_post(pa_core *c, pa_subscription_event_type_t t, uint32_t idx);
 
+uint64_t pa_subscription_get_seq(pa_core *c);
+int pa_subscription_get_changes(pa_core *c, uint64_t seq, pa_subscription_event_type_t facility, pa_idxset *touched);
+
 #endif
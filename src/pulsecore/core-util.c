@@ -73,6 +73,10 @@
 #include <sys/mman.h>
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
@@ -3338,6 +3342,71 @@ unsigned pa_ncpus(void) {
     return ncpus <= 0 ? 1 : (unsigned) ncpus;
 }
 
+/* Returns the number of NUMA nodes, i.e. one more than the highest
+ * online node. 1 if that cannot be determined. */
+unsigned pa_numa_nodes(void) {
+    unsigned n = 1;
+#ifdef __linux__
+    char *s;
+    const char *p, *last = NULL;
+    uint32_t k;
+
+    /* A sorted list of ranges, like "0" or "0-1,4-5" */
+    if (!(s = pa_read_line_from_file("/sys/devices/system/node/online")))
+        return 1;
+
+    for (p = s; *p; p++)
+        if (isdigit((unsigned char) *p) && (p == s || !isdigit((unsigned char) p[-1])))
+            last = p;
+
+    if (last && pa_atou(last, &k) >= 0 && k < 1024)
+        n = k + 1;
+
+    pa_xfree(s);
+#endif
+
+    return n;
+}
+
+/* Returns the NUMA node the calling thread currently runs on, 0 if
+ * that cannot be determined */
+unsigned pa_numa_current_node(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu, node;
+
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) == 0)
+        return node;
+#endif
+
+    return 0;
+}
+
+/* Asks the kernel to back the given range with memory of the given
+ * NUMA node where possible. The range should be page aligned. */
+int pa_numa_bind(void *p, size_t size, unsigned node) {
+#if defined(__linux__) && defined(SYS_mbind)
+    /* From <linux/mempolicy.h> */
+    const int mpol_preferred = 1;
+    unsigned long mask[1024 / (8 * sizeof(unsigned long))];
+
+    if (node >= 1024) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    memset(mask, 0, sizeof(mask));
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (syscall(SYS_mbind, p, size, mpol_preferred, mask, (unsigned long) 1024, 0) < 0)
+        return -1;
+
+    return 0;
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
 char *pa_replace(const char*s, const char*a, const char *b) {
     pa_strbuf *sb;
     size_t an;
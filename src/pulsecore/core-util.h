@@ -259,6 +259,10 @@ void pa_reduce(unsigned *num, unsigned *den);
 
 unsigned pa_ncpus(void);
 
+unsigned pa_numa_nodes(void);
+unsigned pa_numa_current_node(void);
+int pa_numa_bind(void *p, size_t size, unsigned node);
+
 /* Replaces all occurrences of `a' in `s' with `b'. The caller has to free the
  * returned string. All parameters must be non-NULL and additionally `a' must
  * not be a zero-length string.
@@ -102,7 +102,8 @@ static int core_message_handler(const char *object_path, const char *message, co
     return -PA_ERR_NOTIMPLEMENTED;
 }
 
-pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t shm_size) {
+pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t shm_size, pa_mempool_flags_t mempool_flags,
+                     const size_t *mempool_slot_sizes, unsigned n_mempool_slot_sizes) {
     pa_core* c;
     pa_mempool *pool;
     pa_mem_type_t type;
@@ -112,7 +113,7 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     if (shared) {
         type = (enable_memfd) ? PA_MEM_TYPE_SHARED_MEMFD : PA_MEM_TYPE_SHARED_POSIX;
-        if (!(pool = pa_mempool_new(type, shm_size, false))) {
+        if (!(pool = pa_mempool_new_full(type, shm_size, false, mempool_flags, mempool_slot_sizes, n_mempool_slot_sizes))) {
             pa_log_warn("Failed to allocate %s memory pool. Falling back to a normal memory pool.",
                         pa_mem_type_to_string(type));
             shared = false;
@@ -120,7 +121,8 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
     }
 
     if (!shared) {
-        if (!(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, shm_size, false))) {
+        if (!(pool = pa_mempool_new_full(PA_MEM_TYPE_PRIVATE, shm_size, false, mempool_flags,
+                                         mempool_slot_sizes, n_mempool_slot_sizes))) {
             pa_log("pa_mempool_new() failed.");
             return NULL;
         }
@@ -175,7 +177,13 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     c->mempool = pool;
     c->shm_size = shm_size;
+    c->mempool_flags = mempool_flags;
+    pa_assert(n_mempool_slot_sizes <= PA_MEMPOOL_CLASSES_MAX);
+    if (n_mempool_slot_sizes > 0)
+        memcpy(c->mempool_slot_sizes, mempool_slot_sizes, n_mempool_slot_sizes * sizeof(size_t));
+    c->n_mempool_slot_sizes = n_mempool_slot_sizes;
     pa_silence_cache_init(&c->silence_cache);
+    c->resampler_cache = pa_resampler_cache_new();
 
     c->exit_event = NULL;
     c->scache_auto_unload_event = NULL;
@@ -189,11 +197,13 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
     c->running_as_daemon = false;
     c->realtime_scheduling = false;
     c->realtime_priority = 5;
+    c->premix_resampling = false;
     c->disable_remixing = false;
     c->remixing_use_all_sink_channels = true;
     c->remixing_produce_lfe = false;
     c->remixing_consume_lfe = false;
     c->lfe_crossover_freq = 0;
+    c->render_threads = 0;
     c->deferred_volume = true;
     c->resample_method = PA_RESAMPLER_SPEEX_FLOAT_BASE + 1;
 
@@ -202,6 +212,12 @@ pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t
 
     pa_random(&c->cookie, sizeof(c->cookie));
 
+    /* Start the sequence at a random point, so that numbers a client
+     * got from an earlier instance of the server are unlikely to be
+     * taken as valid */
+    c->subscription_seq = (uint64_t) c->cookie << 32;
+    c->subscription_journal = NULL;
+
 #ifdef SIGPIPE
     pa_check_signal_is_blocked(SIGPIPE);
 #endif
@@ -270,6 +286,7 @@ static void core_free(pa_object *o) {
     pa_xfree(c->policy_default_sink);
 
     pa_silence_cache_done(&c->silence_cache);
+    pa_resampler_cache_free(c->resampler_cache);
     pa_mempool_unref(c->mempool);
 
     for (j = 0; j < PA_CORE_HOOK_MAX; j++)
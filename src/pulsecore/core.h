@@ -199,6 +199,10 @@ struct pa_core {
     int deferred_volume_extra_delay_usec;
     unsigned lfe_crossover_freq;
 
+    /* Number of helper threads each sink may use to render its inputs
+     * in parallel, 0 to render everything in the IO thread */
+    unsigned render_threads;
+
     pa_defer_event *module_defer_unload_event;
     pa_hashmap *modules_pending_unload; /* pa_module -> pa_module (hashmap-as-a-set) */
 
@@ -207,6 +211,11 @@ struct pa_core {
     PA_LLIST_HEAD(pa_subscription_event, subscription_event_queue);
     pa_subscription_event *subscription_event_last;
 
+    /* Sequence number of the last subscription event, and a ring of the
+     * most recent events, see pa_subscription_get_changes() */
+    uint64_t subscription_seq;
+    pa_subscription_journal_entry *subscription_journal;
+
     /* The mempool is used for data we write to, it's readonly for the client. */
     pa_mempool *mempool;
 
@@ -214,8 +223,16 @@ struct pa_core {
      * or PA daemon defaults (~ 64 MiB). */
     size_t shm_size;
 
+    /* Flags and slot sizes for the memory pools the daemon creates */
+    pa_mempool_flags_t mempool_flags;
+    size_t mempool_slot_sizes[PA_MEMPOOL_CLASSES_MAX];
+    unsigned n_mempool_slot_sizes;
+
     pa_silence_cache silence_cache;
 
+    /* Setups shared between the resamplers of all streams */
+    pa_resampler_cache *resampler_cache;
+
     pa_time_event *exit_event;
     pa_time_event *scache_auto_unload_event;
 
@@ -228,6 +245,7 @@ struct pa_core {
     bool running_as_daemon:1;
     bool realtime_scheduling:1;
     bool avoid_resampling:1;
+    bool premix_resampling:1;
     bool disable_remixing:1;
     bool remixing_use_all_sink_channels:1;
     bool remixing_produce_lfe:1;
@@ -252,7 +270,8 @@ enum {
     PA_CORE_MESSAGE_MAX
 };
 
-pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t shm_size);
+pa_core* pa_core_new(pa_mainloop_api *m, bool shared, bool enable_memfd, size_t shm_size, pa_mempool_flags_t mempool_flags,
+                     const size_t *mempool_slot_sizes, unsigned n_mempool_slot_sizes);
 
 void pa_core_set_configured_default_sink(pa_core *core, const char *sink);
 void pa_core_set_configured_default_source(pa_core *core, const char *source);
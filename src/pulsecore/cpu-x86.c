@@ -32,10 +32,24 @@
 
 #include "cpu-x86.h"
 
+#if (defined(__i386__) || defined(__amd64__)) && defined(HAVE_CPUID_H)
+/* Read the extended control register to find out which register states the
+ * OS saves on context switches. Encoded as bytes so that no -mxsave is
+ * needed. */
+static uint64_t get_xcr0(void) {
+    uint32_t eax, edx;
+
+    __asm__ __volatile__ (".byte 0x0f, 0x01, 0xd0" : "=a" (eax), "=d" (edx) : "c" (0));
+
+    return ((uint64_t) edx << 32) | eax;
+}
+#endif
+
 void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 #if (defined(__i386__) || defined(__amd64__)) && defined(HAVE_CPUID_H)
     uint32_t eax, ebx, ecx, edx;
     uint32_t level;
+    uint64_t xcr0 = 0;
 
     *flags = 0;
 
@@ -70,6 +84,26 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
 
         if (ecx & (1<<20))
           *flags |= PA_CPU_X86_SSE4_2;
+
+        /* AVX needs OSXSAVE and the OS saving the XMM and YMM state */
+        if ((ecx & (1<<27)) && (ecx & (1<<28))) {
+            xcr0 = get_xcr0();
+
+            if ((xcr0 & 0x06) == 0x06)
+              *flags |= PA_CPU_X86_AVX;
+        }
+    }
+
+    if (level >= 7 && (*flags & PA_CPU_X86_AVX)) {
+        if (__get_cpuid_count(0x00000007, 0, &eax, &ebx, &ecx, &edx) == 0)
+            goto finish;
+
+        if (ebx & (1<<5))
+          *flags |= PA_CPU_X86_AVX2;
+
+        /* AVX-512 additionally needs the opmask and ZMM state saved */
+        if ((ebx & (1<<16)) && (xcr0 & 0xe6) == 0xe6)
+          *flags |= PA_CPU_X86_AVX512F;
     }
 
     /* get extended level */
@@ -94,7 +128,7 @@ void pa_cpu_get_x86_flags(pa_cpu_x86_flag_t *flags) {
     }
 
 finish:
-    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s",
+    pa_log_info("CPU flags: %s%s%s%s%s%s%s%s%s%s%s%s%s%s",
     (*flags & PA_CPU_X86_CMOV) ? "CMOV " : "",
     (*flags & PA_CPU_X86_MMX) ? "MMX " : "",
     (*flags & PA_CPU_X86_SSE) ? "SSE " : "",
@@ -103,6 +137,9 @@ finish:
     (*flags & PA_CPU_X86_SSSE3) ? "SSSE3 " : "",
     (*flags & PA_CPU_X86_SSE4_1) ? "SSE4_1 " : "",
     (*flags & PA_CPU_X86_SSE4_2) ? "SSE4_2 " : "",
+    (*flags & PA_CPU_X86_AVX) ? "AVX " : "",
+    (*flags & PA_CPU_X86_AVX2) ? "AVX2 " : "",
+    (*flags & PA_CPU_X86_AVX512F) ? "AVX512F " : "",
     (*flags & PA_CPU_X86_MMXEXT) ? "MMXEXT " : "",
     (*flags & PA_CPU_X86_3DNOW) ? "3DNOW " : "",
     (*flags & PA_CPU_X86_3DNOWEXT) ? "3DNOWEXT " : "");
@@ -129,6 +166,21 @@ bool pa_cpu_init_x86(pa_cpu_x86_flag_t *flags) {
     }
 #endif
 
+#ifdef HAVE_SSE41
+    if (*flags & PA_CPU_X86_SSE4_1)
+        pa_convert_func_init_sse41(*flags);
+#endif
+
+#ifdef HAVE_AVX2
+    if (*flags & PA_CPU_X86_AVX2) {
+        pa_volume_func_init_avx2(*flags);
+        pa_remap_func_init_avx2(*flags);
+        pa_convert_func_init_avx2(*flags);
+        pa_polyphase_func_init_avx2(*flags);
+        pa_crossover_func_init_avx2(*flags);
+    }
+#endif
+
     return true;
 #else /* defined (__i386__) || defined (__amd64__) */
     return false;
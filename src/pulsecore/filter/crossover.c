@@ -7,6 +7,9 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
+#include <pulse/xmalloc.h>
 #include <pulsecore/macro.h>
 
 #include "crossover.h"
@@ -95,3 +98,133 @@ void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, sho
 	lr4->z1 = lz1;
 	lr4->z2 = lz2;
 }
+
+/* The same computation as lr4_process_float32(), one channel at a time, with
+ * the history of the channel in local variables */
+static void bank_process_c(const struct lr4_bank *bank, float *state, int frames, const float *src, float *dest)
+{
+	int n = bank->channels;
+	int lanes = bank->lanes;
+
+	int i, c;
+	for (c = 0; c < n; c++) {
+		float lx1 = state[c];
+		float lx2 = state[lanes + c];
+		float ly1 = state[2 * lanes + c];
+		float ly2 = state[3 * lanes + c];
+		float lz1 = state[4 * lanes + c];
+		float lz2 = state[5 * lanes + c];
+		float lb0 = bank->b0[c];
+		float lb1 = bank->b1[c];
+		float lb2 = bank->b2[c];
+		float la1 = bank->a1[c];
+		float la2 = bank->a2[c];
+
+		for (i = c; i < frames * n; i += n) {
+			float x, y, z;
+			x = src[i];
+			y = lb0*x + lb1*lx1 + lb2*lx2 - la1*ly1 - la2*ly2;
+			z = lb0*y + lb1*ly1 + lb2*ly2 - la1*lz1 - la2*lz2;
+			lx2 = lx1;
+			lx1 = x;
+			ly2 = ly1;
+			ly1 = y;
+			lz2 = lz1;
+			lz1 = z;
+			dest[i] = z;
+		}
+
+		state[c] = lx1;
+		state[lanes + c] = lx2;
+		state[2 * lanes + c] = ly1;
+		state[3 * lanes + c] = ly2;
+		state[4 * lanes + c] = lz1;
+		state[5 * lanes + c] = lz2;
+	}
+}
+
+static lr4_bank_process_func_t bank_process_func = bank_process_c;
+
+struct lr4_bank *lr4_bank_new(int channels)
+{
+	struct lr4_bank *bank;
+	int lanes;
+
+	pa_assert(channels > 0);
+
+	lanes = (channels + LR4_BANK_ALIGN - 1) / LR4_BANK_ALIGN * LR4_BANK_ALIGN;
+
+	/* The coefficients live in the same allocation */
+	bank = pa_xmalloc0(sizeof(*bank) + 5 * lanes * sizeof(float));
+	bank->channels = channels;
+	bank->lanes = lanes;
+	bank->b0 = (float *) (bank + 1);
+	bank->b1 = bank->b0 + lanes;
+	bank->b2 = bank->b1 + lanes;
+	bank->a1 = bank->b2 + lanes;
+	bank->a2 = bank->a1 + lanes;
+
+	return bank;
+}
+
+void lr4_bank_free(struct lr4_bank *bank)
+{
+	pa_xfree(bank);
+}
+
+void lr4_bank_set(struct lr4_bank *bank, int channel, enum biquad_type type, float freq)
+{
+	struct biquad bq;
+
+	pa_assert(channel >= 0 && channel < bank->channels);
+
+	biquad_set(&bq, type, freq);
+	bank->b0[channel] = bq.b0;
+	bank->b1[channel] = bq.b1;
+	bank->b2[channel] = bq.b2;
+	bank->a1[channel] = bq.a1;
+	bank->a2[channel] = bq.a2;
+}
+
+void lr4_bank_reset_state(const struct lr4_bank *bank, float *state)
+{
+	memset(state, 0, LR4_BANK_STATE_SIZE(bank) * sizeof(float));
+}
+
+lr4_bank_process_func_t lr4_get_bank_process_func(void)
+{
+	return bank_process_func;
+}
+
+void lr4_set_bank_process_func(lr4_bank_process_func_t func)
+{
+	bank_process_func = func;
+}
+
+void lr4_bank_process_float32(const struct lr4_bank *bank, float *state, int frames, const float *src, float *dest)
+{
+	bank_process_func(bank, state, frames, src, dest);
+}
+
+void lr4_bank_process_s16(const struct lr4_bank *bank, float *state, int frames, const short *src, short *dest)
+{
+	float buf[1024];
+	int n = bank->channels;
+	int block = PA_ELEMENTSOF(buf) / n;
+
+	while (frames > 0) {
+		int i, count = PA_MIN(frames, block);
+
+		for (i = 0; i < count * n; i++)
+			buf[i] = src[i];
+
+		bank_process_func(bank, state, count, buf, buf);
+
+		for (i = 0; i < count * n; i++)
+			dest[i] = PA_CLAMP_UNLIKELY((int) buf[i], -0x8000, 0x7fff);
+
+		src += count * n;
+		dest += count * n;
+		frames -= count;
+	}
+}
@@ -26,4 +26,37 @@ void lr4_set(struct lr4 *lr4, enum biquad_type type, float freq);
 void lr4_process_float32(struct lr4 *lr4, int samples, int channels, float *src, float *dest);
 void lr4_process_s16(struct lr4 *lr4, int samples, int channels, short *src, short *dest);
 
+/* A bank of LR4 filters for interleaved audio, one lane per channel, so that
+ * all channels of a frame can be filtered at once. The coefficients are kept
+ * lane by lane, and the number of lanes is the number of channels rounded up
+ * to LR4_BANK_ALIGN. The spare lanes are zero.
+ *
+ * The history is kept apart from the bank, so that it can be saved and
+ * restored cheaply. It is an array of LR4_BANK_STATE_SIZE(bank) floats,
+ * holding x1, x2, y1, y2, z1 and z2 of all lanes, in that order.
+ */
+#define LR4_BANK_ALIGN 8
+#define LR4_BANK_STATE_SIZE(bank) (6 * (bank)->lanes)
+
+struct lr4_bank {
+	int channels;
+	int lanes;
+	float *b0, *b1, *b2;
+	float *a1, *a2;
+};
+
+struct lr4_bank *lr4_bank_new(int channels);
+void lr4_bank_free(struct lr4_bank *bank);
+void lr4_bank_set(struct lr4_bank *bank, int channel, enum biquad_type type, float freq);
+void lr4_bank_reset_state(const struct lr4_bank *bank, float *state);
+
+/* Filters frames frames from src into dest, which may be the same buffer */
+typedef void (*lr4_bank_process_func_t)(const struct lr4_bank *bank, float *state, int frames, const float *src, float *dest);
+
+lr4_bank_process_func_t lr4_get_bank_process_func(void);
+void lr4_set_bank_process_func(lr4_bank_process_func_t func);
+
+void lr4_bank_process_float32(const struct lr4_bank *bank, float *state, int frames, const float *src, float *dest);
+void lr4_bank_process_s16(const struct lr4_bank *bank, float *state, int frames, const short *src, short *dest);
+
 #endif /* CROSSOVER_H_ */
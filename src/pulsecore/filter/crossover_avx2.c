@@ -0,0 +1,101 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/filter/crossover.h>
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+#define BLOCK_FRAMES 64
+
+/* Every group of 8 lanes is independent of the others, so each group runs
+ * over all frames with its history kept in registers. The lanes past the
+ * last channel are masked off when loading a frame and when storing it, so
+ * that the neighbouring frame of an in-place buffer stays intact. A masked
+ * store stalls a following load of the next frame, which overlaps it, so the
+ * output is collected in blocks and only stored after the whole block has
+ * been loaded. */
+static void bank_process_avx2(const struct lr4_bank *bank, float *state, int frames, const float *src, float *dest) {
+    PA_DECLARE_ALIGNED(32, float, buf[BLOCK_FRAMES * 8]);
+    int n = bank->channels, lanes = bank->lanes;
+    int v, i, k;
+
+    for (v = 0; v < lanes; v += 8) {
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - v), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256 b0 = _mm256_loadu_ps(bank->b0 + v), b1 = _mm256_loadu_ps(bank->b1 + v), b2 = _mm256_loadu_ps(bank->b2 + v);
+        __m256 a1 = _mm256_loadu_ps(bank->a1 + v), a2 = _mm256_loadu_ps(bank->a2 + v);
+        __m256 x1 = _mm256_loadu_ps(state + v), x2 = _mm256_loadu_ps(state + lanes + v);
+        __m256 y1 = _mm256_loadu_ps(state + 2 * lanes + v), y2 = _mm256_loadu_ps(state + 3 * lanes + v);
+        __m256 z1 = _mm256_loadu_ps(state + 4 * lanes + v), z2 = _mm256_loadu_ps(state + 5 * lanes + v);
+        const float *s = src + v;
+        float *d = dest + v;
+
+        for (i = 0; i < frames; i += BLOCK_FRAMES) {
+            int count = PA_MIN(frames - i, BLOCK_FRAMES);
+
+            for (k = 0; k < count; k++, s += n) {
+                __m256 x, y, z;
+
+                /* No FMA, to stay bit exact with the generic code */
+                x = _mm256_maskload_ps(s, mask);
+                y = _mm256_add_ps(_mm256_mul_ps(b0, x), _mm256_mul_ps(b1, x1));
+                y = _mm256_add_ps(y, _mm256_mul_ps(b2, x2));
+                y = _mm256_sub_ps(y, _mm256_mul_ps(a1, y1));
+                y = _mm256_sub_ps(y, _mm256_mul_ps(a2, y2));
+                z = _mm256_add_ps(_mm256_mul_ps(b0, y), _mm256_mul_ps(b1, y1));
+                z = _mm256_add_ps(z, _mm256_mul_ps(b2, y2));
+                z = _mm256_sub_ps(z, _mm256_mul_ps(a1, z1));
+                z = _mm256_sub_ps(z, _mm256_mul_ps(a2, z2));
+                x2 = x1;
+                x1 = x;
+                y2 = y1;
+                y1 = y;
+                z2 = z1;
+                z1 = z;
+                _mm256_store_ps(buf + k * 8, z);
+            }
+
+            for (k = 0; k < count; k++, d += n)
+                _mm256_maskstore_ps(d, mask, _mm256_load_ps(buf + k * 8));
+        }
+
+        _mm256_storeu_ps(state + v, x1);
+        _mm256_storeu_ps(state + lanes + v, x2);
+        _mm256_storeu_ps(state + 2 * lanes + v, y1);
+        _mm256_storeu_ps(state + 3 * lanes + v, y2);
+        _mm256_storeu_ps(state + 4 * lanes + v, z1);
+        _mm256_storeu_ps(state + 5 * lanes + v, z2);
+    }
+}
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_crossover_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized LR4 crossover filters.");
+        lr4_set_bank_process_func(bank_process_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -23,19 +23,15 @@
 
 #include "lfe-filter.h"
 #include <pulse/xmalloc.h>
-#include <pulsecore/flist.h>
-#include <pulsecore/llist.h>
+#include <pulsecore/macro.h>
 #include <pulsecore/filter/biquad.h>
 #include <pulsecore/filter/crossover.h>
 
-struct saved_state {
-    PA_LLIST_FIELDS(struct saved_state);
-    pa_memchunk chunk;
-    int64_t index;
-    struct lr4 lr4[PA_CHANNELS_MAX];
-};
-
-PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
+/* The filter state is saved every CHECKPOINT_FRAMES frames, and the input of
+   the last maxrewind frames (plus a little) is kept in a ring buffer. A rewind
+   restores the last checkpoint before the new position, and then runs the
+   filter over less than CHECKPOINT_FRAMES frames of saved input to catch up. */
+#define CHECKPOINT_FRAMES 512
 
 /* An LR4 filter, implemented as a chain of two Butterworth filters.
 
@@ -47,36 +43,69 @@ PA_STATIC_FLIST_DECLARE(lfe_state, 0, pa_xfree);
 
 struct pa_lfe_filter {
     int64_t index;
-    PA_LLIST_HEAD(struct saved_state, saved);
     float crossover;
     pa_channel_map cm;
     pa_sample_spec ss;
     size_t maxrewind;
     bool active;
-    struct lr4 lr4[PA_CHANNELS_MAX];
+
+    struct lr4_bank *bank;
+    float *state;
+
+    /* Input frame i is at i % history_frames. history_frames is a multiple
+       of CHECKPOINT_FRAMES, so a block between two checkpoints never wraps. */
+    void *history;
+    size_t history_frames;
+
+    /* One checkpoint per block of history, the state at the start of the
+       block and its position, or -1 if unused */
+    unsigned n_checkpoints;
+    int64_t *checkpoint_index;
+    float *checkpoints;
+
+    /* Output of the catch-up after a rewind, which is thrown away */
+    void *scratch;
 };
 
-static void remove_state(pa_lfe_filter_t *f, struct saved_state *s) {
-    PA_LLIST_REMOVE(struct saved_state, f->saved, s);
-    pa_memblock_unref(s->chunk.memblock);
-    pa_xfree(s);
+static inline uint8_t *history_at(pa_lfe_filter_t *f, int64_t index) {
+    return (uint8_t *) f->history + (size_t) (index % f->history_frames) * pa_frame_size(&f->ss);
+}
+
+static inline float *checkpoint_state(pa_lfe_filter_t *f, unsigned slot) {
+    return f->checkpoints + (size_t) slot * LR4_BANK_STATE_SIZE(f->bank);
 }
 
 pa_lfe_filter_t * pa_lfe_filter_new(const pa_sample_spec* ss, const pa_channel_map* cm, float crossover_freq, size_t maxrewind) {
 
     pa_lfe_filter_t *f = pa_xnew0(struct pa_lfe_filter, 1);
+    size_t fs = pa_frame_size(ss);
+
     f->crossover = crossover_freq;
     f->cm = *cm;
     f->ss = *ss;
     f->maxrewind = maxrewind;
+
+    f->bank = lr4_bank_new(cm->channels);
+    f->state = pa_xnew(float, LR4_BANK_STATE_SIZE(f->bank));
+
+    f->history_frames = (maxrewind / CHECKPOINT_FRAMES + 2) * CHECKPOINT_FRAMES;
+    f->history = pa_xmalloc(f->history_frames * fs);
+    f->n_checkpoints = f->history_frames / CHECKPOINT_FRAMES;
+    f->checkpoint_index = pa_xnew(int64_t, f->n_checkpoints);
+    f->checkpoints = pa_xnew(float, f->n_checkpoints * LR4_BANK_STATE_SIZE(f->bank));
+    f->scratch = pa_xmalloc(CHECKPOINT_FRAMES * fs);
+
     pa_lfe_filter_update_rate(f, ss->rate);
     return f;
 }
 
 void pa_lfe_filter_free(pa_lfe_filter_t *f) {
-    while (f->saved)
-        remove_state(f, f->saved);
-
+    pa_xfree(f->scratch);
+    pa_xfree(f->checkpoints);
+    pa_xfree(f->checkpoint_index);
+    pa_xfree(f->history);
+    pa_xfree(f->state);
+    lr4_bank_free(f->bank);
     pa_xfree(f);
 }
 
@@ -84,73 +113,57 @@ void pa_lfe_filter_reset(pa_lfe_filter_t *f) {
     pa_lfe_filter_update_rate(f, f->ss.rate);
 }
 
-static void process_block(pa_lfe_filter_t *f, pa_memchunk *buf, bool store_result) {
-    int samples = buf->length / pa_frame_size(&f->ss);
-
-    void *garbage = store_result ? NULL : pa_xmalloc(buf->length);
-
-    if (f->ss.format == PA_SAMPLE_FLOAT32NE) {
-        int i;
-        float *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_float32(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
-        pa_memblock_release(buf->memblock);
-    }
-    else if (f->ss.format == PA_SAMPLE_S16NE) {
-        int i;
-        short *data = pa_memblock_acquire_chunk(buf);
-        for (i = 0; i < f->cm.channels; i++)
-            lr4_process_s16(&f->lr4[i], samples, f->cm.channels, &data[i], garbage ? garbage : &data[i]);
-        pa_memblock_release(buf->memblock);
-    }
+static void process_block(pa_lfe_filter_t *f, const void *src, void *dest, size_t frames) {
+    if (f->ss.format == PA_SAMPLE_FLOAT32NE)
+        lr4_bank_process_float32(f->bank, f->state, frames, src, dest);
+    else if (f->ss.format == PA_SAMPLE_S16NE)
+        lr4_bank_process_s16(f->bank, f->state, frames, src, dest);
     else pa_assert_not_reached();
 
-    pa_xfree(garbage);
-    f->index += samples;
+    f->index += frames;
 }
 
 pa_memchunk * pa_lfe_filter_process(pa_lfe_filter_t *f, pa_memchunk *buf) {
-    pa_mempool *pool;
-    struct saved_state *s, *s2;
-    void *data;
+    size_t fs, frames;
+    uint8_t *data;
 
     if (!f->active || !buf->length)
         return buf;
 
-    /* Remove old states (FIXME: we could do better than searching the entire array here?) */
-    PA_LLIST_FOREACH_SAFE(s, s2, f->saved)
-        if (s->index + (int64_t) (s->chunk.length / pa_frame_size(&f->ss) + f->maxrewind) < f->index)
-            remove_state(f, s);
+    fs = pa_frame_size(&f->ss);
+    frames = buf->length / fs;
+    data = pa_memblock_acquire_chunk(buf);
 
-    /* Insert our existing state into the flist */
-    if ((s = pa_flist_pop(PA_STATIC_FLIST_GET(lfe_state))) == NULL)
-        s = pa_xnew(struct saved_state, 1);
-    PA_LLIST_INIT(struct saved_state, s);
+    /* Split the chunk at the checkpoints, and keep a copy of the input in
+       case we are rewound later */
+    while (frames > 0) {
+        size_t offset = f->index % CHECKPOINT_FRAMES;
+        size_t n = PA_MIN(frames, CHECKPOINT_FRAMES - offset);
 
-    /* TODO: This actually memcpys the entire chunk into a new allocation, because we need to retain the original
-       in case of rewinding. Investigate whether this can be avoided. */
-    data = pa_memblock_acquire_chunk(buf);
-    pool = pa_memblock_get_pool(buf->memblock);
-    s->chunk.memblock = pa_memblock_new_malloced(pool, pa_xmemdup(data, buf->length), buf->length);
-    s->chunk.length = buf->length;
-    s->chunk.index = 0;
-    pa_memblock_release(buf->memblock);
-    pa_mempool_unref(pool), pool = NULL;
+        if (offset == 0) {
+            unsigned slot = (f->index / CHECKPOINT_FRAMES) % f->n_checkpoints;
+
+            f->checkpoint_index[slot] = f->index;
+            memcpy(checkpoint_state(f, slot), f->state, LR4_BANK_STATE_SIZE(f->bank) * sizeof(float));
+        }
 
-    s->index = f->index;
-    memcpy(s->lr4, f->lr4, sizeof(struct lr4) * f->cm.channels);
-    PA_LLIST_PREPEND(struct saved_state, f->saved, s);
+        memcpy(history_at(f, f->index), data, n * fs);
+        process_block(f, data, data, n);
 
-    process_block(f, buf, true);
+        data += n * fs;
+        frames -= n;
+    }
+
+    pa_memblock_release(buf->memblock);
     return buf;
 }
 
 void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
-    int i;
+    unsigned i;
     float biquad_freq = f->crossover / (new_rate / 2);
 
-    while (f->saved)
-        remove_state(f, f->saved);
+    for (i = 0; i < f->n_checkpoints; i++)
+        f->checkpoint_index[i] = -1;
 
     f->index = 0;
     f->ss.rate = new_rate;
@@ -161,41 +174,40 @@ void pa_lfe_filter_update_rate(pa_lfe_filter_t *f, uint32_t new_rate) {
     }
 
     for (i = 0; i < f->cm.channels; i++)
-        lr4_set(&f->lr4[i], f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+        lr4_bank_set(f->bank, i, f->cm.map[i] == PA_CHANNEL_POSITION_LFE ? BQ_LOWPASS : BQ_HIGHPASS, biquad_freq);
+    lr4_bank_reset_state(f->bank, f->state);
 
     f->active = true;
 }
 
 void pa_lfe_filter_rewind(pa_lfe_filter_t *f, size_t amount) {
-    struct saved_state *i, *s = NULL;
     size_t samples = amount / pa_frame_size(&f->ss);
+    int64_t start;
+    unsigned slot;
+
     f->index -= samples;
 
-    /* Find the closest saved position */
-    PA_LLIST_FOREACH(i, f->saved) {
-        if (i->index > f->index)
-            continue;
-        if (s == NULL || i->index > s->index)
-            s = i;
-    }
-    if (s == NULL) {
+    /* The checkpoint of a block is only overwritten once its input in the
+       ring buffer is, so if the checkpoint is there, so is the input. Newer
+       checkpoints than the current position are stale after a rewind, but
+       they are never looked at before being written again. */
+    start = f->index - f->index % CHECKPOINT_FRAMES;
+    slot = (start / CHECKPOINT_FRAMES) % f->n_checkpoints;
+
+    if (f->index < 0 || f->checkpoint_index[slot] != start) {
         pa_log_debug("Rewinding LFE filter %zu samples to position %lli. No saved state found", samples, (long long) f->index);
         pa_lfe_filter_update_rate(f, f->ss.rate);
         return;
     }
     pa_log_debug("Rewinding LFE filter %zu samples to position %lli. Found saved state at position %lli",
-        samples, (long long) f->index, (long long) s->index);
-    memcpy(f->lr4, s->lr4, sizeof(struct lr4) * f->cm.channels);
+        samples, (long long) f->index, (long long) start);
+    memcpy(f->state, checkpoint_state(f, slot), LR4_BANK_STATE_SIZE(f->bank) * sizeof(float));
 
     /* now fast forward to the actual position */
-    if (f->index > s->index) {
-        pa_memchunk x = s->chunk;
-        x.length = (f->index - s->index) * pa_frame_size(&f->ss);
-        if (x.length > s->chunk.length) {
-            pa_log_error("Hole in stream, cannot fast forward LFE filter");
-            return;
-        }
-        f->index = s->index;
-        process_block(f, &x, false);
+    if (f->index > start) {
+        size_t n = f->index - start;
+
+        f->index = start;
+        process_block(f, history_at(f, start), f->scratch, n);
     }
 }
@@ -22,6 +22,7 @@
 #endif
 
 #include <stdlib.h>
+#include <string.h>
 
 #include <pulse/xmalloc.h>
 #include <pulsecore/idxset.h>
@@ -30,11 +31,17 @@
 
 #include "hashmap.h"
 
-#define NBUCKETS 127
+/* The bucket array starts out small and embedded in the hashmap, and is
+ * doubled or halved as entries come and go, so that there's about one
+ * entry per bucket. Resizing only relinks the bucket chains, the entries
+ * themselves and the iteration list are left alone. */
+#define MIN_BUCKETS_LOG2 4
+#define MIN_BUCKETS (1U << MIN_BUCKETS_LOG2)
 
 struct hashmap_entry {
     void *key;
     void *value;
+    unsigned hash;
 
     struct hashmap_entry *bucket_next, *bucket_previous;
     struct hashmap_entry *iterate_next, *iterate_previous;
@@ -49,16 +56,51 @@ struct pa_hashmap {
 
     struct hashmap_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
-};
 
-#define BY_HASH(h) ((struct hashmap_entry**) ((uint8_t*) (h) + PA_ALIGN(sizeof(pa_hashmap))))
+    struct hashmap_entry **buckets;
+    unsigned n_buckets_log2;
+    struct hashmap_entry *initial_buckets[MIN_BUCKETS];
+};
 
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
+/* Fibonacci hashing, so that pointer keys with their low bits always
+ * zero still spread over all buckets */
+static inline unsigned bucket_of(const pa_hashmap *h, unsigned hash) {
+    return (uint32_t) (hash * 2654435769U) >> (32 - h->n_buckets_log2);
+}
+
+static void resize(pa_hashmap *h, unsigned n_buckets_log2) {
+    struct hashmap_entry *e;
+
+    pa_assert(n_buckets_log2 >= MIN_BUCKETS_LOG2);
+
+    if (h->buckets != h->initial_buckets)
+        pa_xfree(h->buckets);
+
+    h->n_buckets_log2 = n_buckets_log2;
+
+    if (n_buckets_log2 == MIN_BUCKETS_LOG2) {
+        h->buckets = h->initial_buckets;
+        memset(h->buckets, 0, sizeof(h->initial_buckets));
+    } else
+        h->buckets = pa_xnew0(struct hashmap_entry*, 1U << n_buckets_log2);
+
+    for (e = h->iterate_list_head; e; e = e->iterate_next) {
+        unsigned b = bucket_of(h, e->hash);
+
+        e->bucket_next = h->buckets[b];
+        e->bucket_previous = NULL;
+        if (h->buckets[b])
+            h->buckets[b]->bucket_previous = e;
+        h->buckets[b] = e;
+    }
+}
+
 pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t compare_func, pa_free_cb_t key_free_func, pa_free_cb_t value_free_func) {
     pa_hashmap *h;
 
-    h = pa_xmalloc0(PA_ALIGN(sizeof(pa_hashmap)) + NBUCKETS*sizeof(struct hashmap_entry*));
+    h = pa_xnew0(pa_hashmap, 1);
 
     h->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     h->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
@@ -69,6 +111,9 @@ pa_hashmap *pa_hashmap_new_full(pa_hash_func_t hash_func, pa_compare_func_t comp
     h->n_entries = 0;
     h->iterate_list_head = h->iterate_list_tail = NULL;
 
+    h->buckets = h->initial_buckets;
+    h->n_buckets_log2 = MIN_BUCKETS_LOG2;
+
     return h;
 }
 
@@ -97,10 +142,8 @@ static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
 
     if (e->bucket_previous)
         e->bucket_previous->bucket_next = e->bucket_next;
-    else {
-        unsigned hash = h->hash_func(e->key) % NBUCKETS;
-        BY_HASH(h)[hash] = e->bucket_next;
-    }
+    else
+        h->buckets[bucket_of(h, e->hash)] = e->bucket_next;
 
     if (h->key_free_func)
         h->key_free_func(e->key);
@@ -112,20 +155,30 @@ static void remove_entry(pa_hashmap *h, struct hashmap_entry *e) {
     h->n_entries--;
 }
 
+/* Shrink once the table has become quite sparse, leaving enough headroom
+ * that a few puts and removes won't bounce back and forth */
+static void maybe_shrink(pa_hashmap *h) {
+    if (h->n_buckets_log2 > MIN_BUCKETS_LOG2 && h->n_entries < (1U << h->n_buckets_log2) / 8)
+        resize(h, h->n_buckets_log2 - 1);
+}
+
 void pa_hashmap_free(pa_hashmap *h) {
     pa_assert(h);
 
     pa_hashmap_remove_all(h);
+
+    if (h->buckets != h->initial_buckets)
+        pa_xfree(h->buckets);
+
     pa_xfree(h);
 }
 
 static struct hashmap_entry *hash_scan(const pa_hashmap *h, unsigned hash, const void *key) {
     struct hashmap_entry *e;
     pa_assert(h);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_HASH(h)[hash]; e; e = e->bucket_next)
-        if (h->compare_func(e->key, key) == 0)
+    for (e = h->buckets[bucket_of(h, hash)]; e; e = e->bucket_next)
+        if (e->hash == hash && h->compare_func(e->key, key) == 0)
             return e;
 
     return NULL;
@@ -133,11 +186,11 @@ static struct hashmap_entry *hash_scan(const pa_hashmap *h, unsigned hash, const
 
 int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
     struct hashmap_entry *e;
-    unsigned hash;
+    unsigned hash, b;
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = h->hash_func(key);
 
     if (hash_scan(h, hash, key))
         return -1;
@@ -147,13 +200,15 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
 
     e->key = key;
     e->value = value;
+    e->hash = hash;
 
     /* Insert into hash table */
-    e->bucket_next = BY_HASH(h)[hash];
+    b = bucket_of(h, hash);
+    e->bucket_next = h->buckets[b];
     e->bucket_previous = NULL;
-    if (BY_HASH(h)[hash])
-        BY_HASH(h)[hash]->bucket_previous = e;
-    BY_HASH(h)[hash] = e;
+    if (h->buckets[b])
+        h->buckets[b]->bucket_previous = e;
+    h->buckets[b] = e;
 
     /* Insert into iteration list */
     e->iterate_previous = h->iterate_list_tail;
@@ -170,6 +225,9 @@ int pa_hashmap_put(pa_hashmap *h, void *key, void *value) {
     h->n_entries++;
     pa_assert(h->n_entries >= 1);
 
+    if (h->n_entries > (1U << h->n_buckets_log2))
+        resize(h, h->n_buckets_log2 + 1);
+
     return 0;
 }
 
@@ -179,7 +237,7 @@ void* pa_hashmap_get(const pa_hashmap *h, const void *key) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = h->hash_func(key);
 
     if (!(e = hash_scan(h, hash, key)))
         return NULL;
@@ -194,13 +252,14 @@ void* pa_hashmap_remove(pa_hashmap *h, const void *key) {
 
     pa_assert(h);
 
-    hash = h->hash_func(key) % NBUCKETS;
+    hash = h->hash_func(key);
 
     if (!(e = hash_scan(h, hash, key)))
         return NULL;
 
     data = e->value;
     remove_entry(h, e);
+    maybe_shrink(h);
 
     return data;
 }
@@ -229,6 +288,9 @@ void pa_hashmap_remove_all(pa_hashmap *h) {
         if (h->value_free_func)
             h->value_free_func(data);
     }
+
+    if (h->n_buckets_log2 > MIN_BUCKETS_LOG2)
+        resize(h, MIN_BUCKETS_LOG2);
 }
 
 void *pa_hashmap_iterate(const pa_hashmap *h, void **state, const void **key) {
@@ -325,6 +387,7 @@ void* pa_hashmap_steal_first(pa_hashmap *h) {
 
     data = h->iterate_list_head->value;
     remove_entry(h, h->iterate_list_head);
+    maybe_shrink(h);
 
     return data;
 }
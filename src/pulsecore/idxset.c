@@ -32,11 +32,17 @@
 
 #include "idxset.h"
 
-#define NBUCKETS 127
+/* Both hash tables start out small and embedded in the idxset and are
+ * doubled or halved together as entries come and go, so that there's
+ * about one entry per bucket. Resizing only relinks the bucket chains, the
+ * entries themselves and the iteration list are left alone. */
+#define MIN_BUCKETS_LOG2 4
+#define MIN_BUCKETS (1U << MIN_BUCKETS_LOG2)
 
 struct idxset_entry {
     uint32_t idx;
     void *data;
+    unsigned hash;
 
     struct idxset_entry *data_next, *data_previous;
     struct idxset_entry *index_next, *index_previous;
@@ -51,13 +57,63 @@ struct pa_idxset {
 
     struct idxset_entry *iterate_list_head, *iterate_list_tail;
     unsigned n_entries;
-};
 
-#define BY_DATA(i) ((struct idxset_entry**) ((uint8_t*) (i) + PA_ALIGN(sizeof(pa_idxset))))
-#define BY_INDEX(i) (BY_DATA(i) + NBUCKETS)
+    struct idxset_entry **by_data, **by_index;
+    unsigned n_buckets_log2;
+    struct idxset_entry *initial_buckets[MIN_BUCKETS*2];
+};
 
 PA_STATIC_FLIST_DECLARE(entries, 0, pa_xfree);
 
+/* Fibonacci hashing, so that pointers with their low bits always zero
+ * still spread over all buckets */
+static inline unsigned data_bucket(const pa_idxset *s, unsigned hash) {
+    return (uint32_t) (hash * 2654435769U) >> (32 - s->n_buckets_log2);
+}
+
+/* Indexes are handed out sequentially, so they spread fine on their own */
+static inline unsigned index_bucket(const pa_idxset *s, uint32_t idx) {
+    return idx & ((1U << s->n_buckets_log2) - 1);
+}
+
+static void resize(pa_idxset *s, unsigned n_buckets_log2) {
+    struct idxset_entry *e;
+    unsigned n_buckets = 1U << n_buckets_log2;
+
+    pa_assert(n_buckets_log2 >= MIN_BUCKETS_LOG2);
+
+    if (s->by_data != s->initial_buckets)
+        pa_xfree(s->by_data);
+
+    s->n_buckets_log2 = n_buckets_log2;
+
+    if (n_buckets_log2 == MIN_BUCKETS_LOG2) {
+        s->by_data = s->initial_buckets;
+        memset(s->by_data, 0, sizeof(s->initial_buckets));
+    } else
+        s->by_data = pa_xnew0(struct idxset_entry*, n_buckets*2);
+
+    s->by_index = s->by_data + n_buckets;
+
+    for (e = s->iterate_list_head; e; e = e->iterate_next) {
+        unsigned b = data_bucket(s, e->hash);
+
+        e->data_next = s->by_data[b];
+        e->data_previous = NULL;
+        if (s->by_data[b])
+            s->by_data[b]->data_previous = e;
+        s->by_data[b] = e;
+
+        b = index_bucket(s, e->idx);
+
+        e->index_next = s->by_index[b];
+        e->index_previous = NULL;
+        if (s->by_index[b])
+            s->by_index[b]->index_previous = e;
+        s->by_index[b] = e;
+    }
+}
+
 unsigned pa_idxset_string_hash_func(const void *p) {
     unsigned hash = 0;
     const char *c;
@@ -83,7 +139,7 @@ int pa_idxset_trivial_compare_func(const void *a, const void *b) {
 pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_func) {
     pa_idxset *s;
 
-    s = pa_xmalloc0(PA_ALIGN(sizeof(pa_idxset)) + NBUCKETS*2*sizeof(struct idxset_entry*));
+    s = pa_xnew0(pa_idxset, 1);
 
     s->hash_func = hash_func ? hash_func : pa_idxset_trivial_hash_func;
     s->compare_func = compare_func ? compare_func : pa_idxset_trivial_compare_func;
@@ -92,6 +148,10 @@ pa_idxset* pa_idxset_new(pa_hash_func_t hash_func, pa_compare_func_t compare_fun
     s->n_entries = 0;
     s->iterate_list_head = s->iterate_list_tail = NULL;
 
+    s->by_data = s->initial_buckets;
+    s->by_index = s->initial_buckets + MIN_BUCKETS;
+    s->n_buckets_log2 = MIN_BUCKETS_LOG2;
+
     return s;
 }
 
@@ -116,10 +176,8 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
 
     if (e->data_previous)
         e->data_previous->data_next = e->data_next;
-    else {
-        unsigned hash = s->hash_func(e->data) % NBUCKETS;
-        BY_DATA(s)[hash] = e->data_next;
-    }
+    else
+        s->by_data[data_bucket(s, e->hash)] = e->data_next;
 
     /* Remove from index hash table */
     if (e->index_next)
@@ -128,7 +186,7 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
     if (e->index_previous)
         e->index_previous->index_next = e->index_next;
     else
-        BY_INDEX(s)[e->idx % NBUCKETS] = e->index_next;
+        s->by_index[index_bucket(s, e->idx)] = e->index_next;
 
     if (pa_flist_push(PA_STATIC_FLIST_GET(entries), e) < 0)
         pa_xfree(e);
@@ -137,32 +195,41 @@ static void remove_entry(pa_idxset *s, struct idxset_entry *e) {
     s->n_entries--;
 }
 
+/* Shrink once the tables have become quite sparse, leaving enough headroom
+ * that a few puts and removes won't bounce back and forth */
+static void maybe_shrink(pa_idxset *s) {
+    if (s->n_buckets_log2 > MIN_BUCKETS_LOG2 && s->n_entries < (1U << s->n_buckets_log2) / 8)
+        resize(s, s->n_buckets_log2 - 1);
+}
+
 void pa_idxset_free(pa_idxset *s, pa_free_cb_t free_cb) {
     pa_assert(s);
 
     pa_idxset_remove_all(s, free_cb);
+
+    if (s->by_data != s->initial_buckets)
+        pa_xfree(s->by_data);
+
     pa_xfree(s);
 }
 
 static struct idxset_entry* data_scan(pa_idxset *s, unsigned hash, const void *p) {
     struct idxset_entry *e;
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
     pa_assert(p);
 
-    for (e = BY_DATA(s)[hash]; e; e = e->data_next)
-        if (s->compare_func(e->data, p) == 0)
+    for (e = s->by_data[data_bucket(s, hash)]; e; e = e->data_next)
+        if (e->hash == hash && s->compare_func(e->data, p) == 0)
             return e;
 
     return NULL;
 }
 
-static struct idxset_entry* index_scan(pa_idxset *s, unsigned hash, uint32_t idx) {
+static struct idxset_entry* index_scan(pa_idxset *s, uint32_t idx) {
     struct idxset_entry *e;
     pa_assert(s);
-    pa_assert(hash < NBUCKETS);
 
-    for (e = BY_INDEX(s)[hash]; e; e = e->index_next)
+    for (e = s->by_index[index_bucket(s, idx)]; e; e = e->index_next)
         if (e->idx == idx)
             return e;
 
@@ -170,12 +237,12 @@ static struct idxset_entry* index_scan(pa_idxset *s, unsigned hash, uint32_t idx
 }
 
 int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
-    unsigned hash;
+    unsigned hash, b;
     struct idxset_entry *e;
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = s->hash_func(p);
 
     if ((e = data_scan(s, hash, p))) {
         if (idx)
@@ -188,23 +255,24 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
         e = pa_xnew(struct idxset_entry, 1);
 
     e->data = p;
+    e->hash = hash;
     e->idx = s->current_index++;
 
     /* Insert into data hash table */
-    e->data_next = BY_DATA(s)[hash];
+    b = data_bucket(s, hash);
+    e->data_next = s->by_data[b];
     e->data_previous = NULL;
-    if (BY_DATA(s)[hash])
-        BY_DATA(s)[hash]->data_previous = e;
-    BY_DATA(s)[hash] = e;
-
-    hash = e->idx % NBUCKETS;
+    if (s->by_data[b])
+        s->by_data[b]->data_previous = e;
+    s->by_data[b] = e;
 
     /* Insert into index hash table */
-    e->index_next = BY_INDEX(s)[hash];
+    b = index_bucket(s, e->idx);
+    e->index_next = s->by_index[b];
     e->index_previous = NULL;
-    if (BY_INDEX(s)[hash])
-        BY_INDEX(s)[hash]->index_previous = e;
-    BY_INDEX(s)[hash] = e;
+    if (s->by_index[b])
+        s->by_index[b]->index_previous = e;
+    s->by_index[b] = e;
 
     /* Insert into iteration list */
     e->iterate_previous = s->iterate_list_tail;
@@ -221,6 +289,9 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
     s->n_entries++;
     pa_assert(s->n_entries >= 1);
 
+    if (s->n_entries > (1U << s->n_buckets_log2))
+        resize(s, s->n_buckets_log2 + 1);
+
     if (idx)
         *idx = e->idx;
 
@@ -228,14 +299,11 @@ int pa_idxset_put(pa_idxset*s, void *p, uint32_t *idx) {
 }
 
 void* pa_idxset_get_by_index(pa_idxset*s, uint32_t idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     return e->data;
@@ -247,7 +315,7 @@ void* pa_idxset_get_by_data(pa_idxset*s, const void *p, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = s->hash_func(p);
 
     if (!(e = data_scan(s, hash, p)))
         return NULL;
@@ -264,7 +332,7 @@ bool pa_idxset_contains(pa_idxset *s, const void *p) {
 
     pa_assert(s);
 
-    hash = s->hash_func(p) % NBUCKETS;
+    hash = s->hash_func(p);
 
     if (!(e = data_scan(s, hash, p)))
         return false;
@@ -274,18 +342,16 @@ bool pa_idxset_contains(pa_idxset *s, const void *p) {
 
 void* pa_idxset_remove_by_index(pa_idxset*s, uint32_t idx) {
     struct idxset_entry *e;
-    unsigned hash;
     void *data;
 
     pa_assert(s);
 
-    hash = idx % NBUCKETS;
-
-    if (!(e = index_scan(s, hash, idx)))
+    if (!(e = index_scan(s, idx)))
         return NULL;
 
     data = e->data;
     remove_entry(s, e);
+    maybe_shrink(s);
 
     return data;
 }
@@ -297,7 +363,7 @@ void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
 
     pa_assert(s);
 
-    hash = s->hash_func(data) % NBUCKETS;
+    hash = s->hash_func(data);
 
     if (!(e = data_scan(s, hash, data)))
         return NULL;
@@ -308,6 +374,7 @@ void* pa_idxset_remove_by_data(pa_idxset*s, const void *data, uint32_t *idx) {
         *idx = e->idx;
 
     remove_entry(s, e);
+    maybe_shrink(s);
 
     return r;
 }
@@ -323,18 +390,18 @@ void pa_idxset_remove_all(pa_idxset *s, pa_free_cb_t free_cb) {
         if (free_cb)
             free_cb(data);
     }
+
+    if (s->n_buckets_log2 > MIN_BUCKETS_LOG2)
+        resize(s, MIN_BUCKETS_LOG2);
 }
 
 void* pa_idxset_rrobin(pa_idxset *s, uint32_t *idx) {
-    unsigned hash;
     struct idxset_entry *e;
 
     pa_assert(s);
     pa_assert(idx);
 
-    hash = *idx % NBUCKETS;
-
-    e = index_scan(s, hash, *idx);
+    e = index_scan(s, *idx);
 
     if (e && e->iterate_next)
         e = e->iterate_next;
@@ -428,6 +495,7 @@ void* pa_idxset_steal_first(pa_idxset *s, uint32_t *idx) {
         *idx = s->iterate_list_head->idx;
 
     remove_entry(s, s->iterate_list_head);
+    maybe_shrink(s);
 
     return data;
 }
@@ -446,6 +514,7 @@ void* pa_idxset_steal_last(pa_idxset *s, uint32_t *idx) {
         *idx = s->iterate_list_tail->idx;
 
     remove_entry(s, s->iterate_list_tail);
+    maybe_shrink(s);
 
     return data;
 }
@@ -482,7 +551,6 @@ void* pa_idxset_last(pa_idxset *s, uint32_t *idx) {
 
 void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
 
     pa_assert(s);
     pa_assert(idx);
@@ -490,9 +558,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
     if (*idx == PA_IDXSET_INVALID)
         return NULL;
 
-    hash = *idx % NBUCKETS;
-
-    if ((e = index_scan(s, hash, *idx))) {
+    if ((e = index_scan(s, *idx))) {
 
         e = e->iterate_next;
 
@@ -510,10 +576,7 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
          * the next following */
 
         for ((*idx)++; *idx < s->current_index; (*idx)++) {
-
-            hash = *idx % NBUCKETS;
-
-            if ((e = index_scan(s, hash, *idx))) {
+            if ((e = index_scan(s, *idx))) {
                 *idx = e->idx;
                 return e->data;
             }
@@ -526,7 +589,6 @@ void *pa_idxset_next(pa_idxset *s, uint32_t *idx) {
 
 void *pa_idxset_previous(pa_idxset *s, uint32_t *idx) {
     struct idxset_entry *e;
-    unsigned hash;
 
     pa_assert(s);
     pa_assert(idx);
@@ -534,9 +596,7 @@ void *pa_idxset_previous(pa_idxset *s, uint32_t *idx) {
     if (*idx == PA_IDXSET_INVALID)
         return NULL;
 
-    hash = *idx % NBUCKETS;
-
-    if ((e = index_scan(s, hash, *idx))) {
+    if ((e = index_scan(s, *idx))) {
 
         e = e->iterate_previous;
 
@@ -554,10 +614,7 @@ void *pa_idxset_previous(pa_idxset *s, uint32_t *idx) {
          * the preceding one. */
 
         for ((*idx)--; *idx < s->current_index; (*idx)--) {
-
-            hash = *idx % NBUCKETS;
-
-            if ((e = index_scan(s, hash, *idx))) {
+            if ((e = index_scan(s, *idx))) {
                 *idx = e->idx;
                 return e->data;
             }
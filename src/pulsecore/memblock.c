@@ -37,6 +37,7 @@
 #include <pulse/def.h>
 
 #include <pulsecore/shm.h>
+#include <pulsecore/core-error.h>
 #include <pulsecore/log.h>
 #include <pulsecore/hashmap.h>
 #include <pulsecore/semaphore.h>
@@ -45,6 +46,7 @@
 #include <pulsecore/refcnt.h>
 #include <pulsecore/llist.h>
 #include <pulsecore/flist.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/memtrap.h>
 
@@ -163,6 +165,52 @@ struct pa_memexport {
     PA_LLIST_FIELDS(pa_memexport);
 };
 
+/* A contiguous range of slots with its own free list. Pools normally
+ * have a single one, NUMA pools have one per node, with its memory
+ * bound to that node. */
+struct mempool_node {
+    unsigned first_slot;
+    unsigned n_slots;
+
+    pa_atomic_t n_init;
+
+    /* A list of free slots that may be reused */
+    pa_flist *free_slots;
+};
+
+/* Slots are taken from and given back to a small cache per thread
+ * first, and only moved between that and the shared free lists in
+ * batches, so that threads don't all hammer the same list heads. A
+ * thread maps to one of MEMPOOL_MAGAZINES caches. If another thread
+ * that maps to the same one happens to be using it at the moment, we
+ * simply go to the free lists directly. */
+#define MEMPOOL_MAGAZINES 16
+#define MEMPOOL_MAGAZINE_SLOTS 16
+#define MEMPOOL_MAGAZINE_BATCH (MEMPOOL_MAGAZINE_SLOTS/2)
+
+struct mempool_magazine {
+    pa_atomic_t busy;
+    unsigned n_slots;
+    struct mempool_slot *slots[MEMPOOL_MAGAZINE_SLOTS];
+};
+
+/* A run of slots of the same size in the pool's memory. Pools have a
+ * single class unless configured otherwise, in which case the classes
+ * follow each other in the order of increasing slot size. */
+struct mempool_class {
+    size_t block_size;
+    unsigned n_blocks;
+    uint8_t *base;
+
+    struct mempool_node *nodes;
+    unsigned n_nodes;
+    unsigned slots_per_node;
+
+    /* NULL for classes too small to cache slots without starving
+     * other threads */
+    struct mempool_magazine *magazines;
+};
+
 struct pa_mempool {
     /* Reference count the mempool
      *
@@ -188,18 +236,16 @@ struct pa_mempool {
 
     bool global;
 
-    size_t block_size;
+    struct mempool_class classes[PA_MEMPOOL_CLASSES_MAX];
+    unsigned n_classes;
     unsigned n_blocks;
     bool is_remote_writable;
 
-    pa_atomic_t n_init;
+    pa_mempool_flags_t flags;
 
     PA_LLIST_HEAD(pa_memimport, imports);
     PA_LLIST_HEAD(pa_memexport, exports);
 
-    /* A list of free slots that may be reused */
-    pa_flist *free_slots;
-
     pa_mempool_stat stat;
 };
 
@@ -207,6 +253,10 @@ static void segment_detach(pa_memimport_segment *seg);
 
 PA_STATIC_FLIST_DECLARE(unused_memblocks, 0, pa_xfree);
 
+/* 1 + the index of the magazine of this thread, 0 if not assigned yet */
+PA_STATIC_TLS_DECLARE_NO_FREE(mempool_magazine);
+static pa_atomic_t mempool_magazine_next = PA_ATOMIC_INIT(0);
+
 /* No lock necessary */
 static void stat_add(pa_memblock*b) {
     pa_assert(b);
@@ -292,26 +342,140 @@ static pa_memblock *memblock_new_appended(pa_mempool *p, size_t length) {
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
+static struct mempool_slot* mempool_node_allocate_slot(struct mempool_class *c, struct mempool_node *n) {
     struct mempool_slot *slot;
-    pa_assert(p);
+    int idx;
+
+    if ((slot = pa_flist_pop(n->free_slots)))
+        return slot;
+
+    /* The free list was empty, we have to allocate a new entry */
 
-    if (!(slot = pa_flist_pop(p->free_slots))) {
-        int idx;
+    if ((unsigned) (idx = pa_atomic_inc(&n->n_init)) >= n->n_slots) {
+        pa_atomic_dec(&n->n_init);
+        return NULL;
+    }
+
+    return (struct mempool_slot*) (c->base + (c->block_size * (size_t) (n->first_slot + (unsigned) idx)));
+}
 
-        /* The free list was empty, we have to allocate a new entry */
+/* No lock necessary */
+static struct mempool_slot* mempool_take_slot(struct mempool_class *c) {
+    struct mempool_slot *slot = NULL;
+    unsigned i, local = 0;
 
-        if ((unsigned) (idx = pa_atomic_inc(&p->n_init)) >= p->n_blocks)
-            pa_atomic_dec(&p->n_init);
-        else
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) idx));
+    /* Prefer the node we are running on, but rather take remote
+     * memory than fail */
+    if (c->n_nodes > 1)
+        local = pa_numa_current_node() % c->n_nodes;
 
-        if (!slot) {
-            if (pa_log_ratelimit(PA_LOG_DEBUG))
-                pa_log_debug("Pool full");
-            pa_atomic_inc(&p->stat.n_pool_full);
-            return NULL;
+    for (i = 0; i < c->n_nodes && !slot; i++)
+        slot = mempool_node_allocate_slot(c, &c->nodes[(local + i) % c->n_nodes]);
+
+    return slot;
+}
+
+/* No lock necessary. Returns the magazine of the calling thread if
+ * nobody else is using it right now, NULL otherwise. */
+static struct mempool_magazine* mempool_magazine_acquire(struct mempool_class *c) {
+    struct mempool_magazine *m;
+    unsigned idx;
+
+    if (!c->magazines)
+        return NULL;
+
+    if (!(idx = PA_PTR_TO_UINT(PA_STATIC_TLS_GET(mempool_magazine)))) {
+        idx = (unsigned) pa_atomic_inc(&mempool_magazine_next) % MEMPOOL_MAGAZINES + 1;
+        PA_STATIC_TLS_SET(mempool_magazine, PA_UINT_TO_PTR(idx));
+    }
+
+    m = &c->magazines[idx - 1];
+
+    if (!pa_atomic_cmpxchg(&m->busy, 0, 1))
+        return NULL;
+
+    return m;
+}
+
+/* No lock necessary */
+static void mempool_magazine_release(struct mempool_magazine *m) {
+    pa_atomic_store(&m->busy, 0);
+}
+
+/* No lock necessary. Takes a slot out of any magazine, so that slots
+ * cached by other threads don't make the pool appear full. */
+static struct mempool_slot* mempool_steal_slot(pa_mempool *p, struct mempool_class *c) {
+    struct mempool_slot *slot = NULL;
+    unsigned i;
+
+    if (!c->magazines)
+        return NULL;
+
+    for (i = 0; i < MEMPOOL_MAGAZINES && !slot; i++) {
+        struct mempool_magazine *m = &c->magazines[i];
+
+        if (!pa_atomic_cmpxchg(&m->busy, 0, 1))
+            continue;
+
+        if (m->n_slots > 0) {
+            slot = m->slots[--m->n_slots];
+            pa_atomic_inc(&p->stat.n_cache_steals);
+        }
+
+        mempool_magazine_release(m);
+    }
+
+    return slot;
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_class_allocate_slot(pa_mempool *p, struct mempool_class *c) {
+    struct mempool_slot *slot = NULL;
+    struct mempool_magazine *m;
+
+    if ((m = mempool_magazine_acquire(c))) {
+
+        if (m->n_slots <= 0) {
+            struct mempool_slot *s;
+
+            while (m->n_slots < MEMPOOL_MAGAZINE_BATCH && (s = mempool_take_slot(c)))
+                m->slots[m->n_slots++] = s;
+
+            if (m->n_slots > 0)
+                pa_atomic_inc(&p->stat.n_cache_refills);
         }
+
+        if (m->n_slots > 0)
+            slot = m->slots[--m->n_slots];
+
+        mempool_magazine_release(m);
+    }
+
+    if (!slot)
+        slot = mempool_take_slot(c);
+
+    if (!slot)
+        slot = mempool_steal_slot(p, c);
+
+    return slot;
+}
+
+/* No lock necessary. Allocates a slot of at least the given size,
+ * from the smallest class that fits and still has free slots. */
+static struct mempool_slot* mempool_allocate_slot(pa_mempool *p, size_t size) {
+    struct mempool_slot *slot = NULL;
+    unsigned i;
+    pa_assert(p);
+
+    for (i = 0; i < p->n_classes && !slot; i++)
+        if (p->classes[i].block_size >= size)
+            slot = mempool_class_allocate_slot(p, &p->classes[i]);
+
+    if (!slot) {
+        if (pa_log_ratelimit(PA_LOG_DEBUG))
+            pa_log_debug("Pool full");
+        pa_atomic_inc(&p->stat.n_pool_full);
+        return NULL;
     }
 
 /* #ifdef HAVE_VALGRIND_MEMCHECK_H */
@@ -323,29 +487,116 @@ static struct mempool_slot* mempool_allocate_slot(pa_mempool *p) {
     return slot;
 }
 
+/* No lock necessary. The size of the largest slots. */
+static inline size_t mempool_block_size(pa_mempool *p) {
+    return p->classes[p->n_classes - 1].block_size;
+}
+
 /* No lock necessary, totally redundant anyway */
 static inline void* mempool_slot_data(struct mempool_slot *slot) {
     return slot;
 }
 
 /* No lock necessary */
-static unsigned mempool_slot_idx(pa_mempool *p, void *ptr) {
+static struct mempool_class* mempool_slot_class(pa_mempool *p, void *ptr) {
+    unsigned i;
+
     pa_assert(p);
 
     pa_assert((uint8_t*) ptr >= (uint8_t*) p->memory.ptr);
     pa_assert((uint8_t*) ptr < (uint8_t*) p->memory.ptr + p->memory.size);
 
-    return (unsigned) ((size_t) ((uint8_t*) ptr - (uint8_t*) p->memory.ptr) / p->block_size);
+    for (i = 1; i < p->n_classes; i++)
+        if ((uint8_t*) ptr < p->classes[i].base)
+            break;
+
+    return &p->classes[i - 1];
 }
 
 /* No lock necessary */
-static struct mempool_slot* mempool_slot_by_ptr(pa_mempool *p, void *ptr) {
+static unsigned mempool_slot_idx(struct mempool_class *c, void *ptr) {
+    pa_assert((uint8_t*) ptr >= c->base);
+    pa_assert((uint8_t*) ptr < c->base + c->n_blocks * c->block_size);
+
+    return (unsigned) ((size_t) ((uint8_t*) ptr - c->base) / c->block_size);
+}
+
+/* No lock necessary */
+static struct mempool_node* mempool_slot_node(struct mempool_class *c, struct mempool_slot *slot) {
+    unsigned n;
+
+    /* The last node also takes the remainder */
+    n = mempool_slot_idx(c, slot) / c->slots_per_node;
+
+    return &c->nodes[PA_MIN(n, c->n_nodes - 1)];
+}
+
+/* No lock necessary */
+static struct mempool_slot* mempool_slot_by_ptr(struct mempool_class *c, void *ptr) {
     unsigned idx;
 
-    if ((idx = mempool_slot_idx(p, ptr)) == (unsigned) -1)
+    if ((idx = mempool_slot_idx(c, ptr)) == (unsigned) -1)
         return NULL;
 
-    return (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (idx * p->block_size));
+    return (struct mempool_slot*) (c->base + (idx * c->block_size));
+}
+
+/* No lock necessary */
+static void mempool_return_slot(struct mempool_class *c, struct mempool_slot *slot) {
+
+    /* The free list dimensions should easily allow all slots
+     * to fit in, hence try harder if pushing this slot into
+     * the free list fails */
+    while (pa_flist_push(mempool_slot_node(c, slot)->free_slots, slot) < 0)
+        ;
+}
+
+/* No lock necessary */
+static void mempool_free_slot(pa_mempool *p, struct mempool_class *c, struct mempool_slot *slot) {
+    struct mempool_magazine *m;
+
+    if (!(m = mempool_magazine_acquire(c))) {
+        mempool_return_slot(c, slot);
+        return;
+    }
+
+    if (m->n_slots >= MEMPOOL_MAGAZINE_SLOTS) {
+        unsigned i;
+
+        for (i = 0; i < MEMPOOL_MAGAZINE_BATCH; i++)
+            mempool_return_slot(c, m->slots[--m->n_slots]);
+
+        pa_atomic_inc(&p->stat.n_cache_flushes);
+    }
+
+    m->slots[m->n_slots++] = slot;
+
+    mempool_magazine_release(m);
+}
+
+/* No lock necessary. Moves the slots of all magazines that are not in
+ * use right now back to the free lists. */
+static void mempool_drain_magazines(pa_mempool *p) {
+    unsigned i, j;
+
+    for (j = 0; j < p->n_classes; j++) {
+        struct mempool_class *c = &p->classes[j];
+
+        if (!c->magazines)
+            continue;
+
+        for (i = 0; i < MEMPOOL_MAGAZINES; i++) {
+            struct mempool_magazine *m = &c->magazines[i];
+
+            if (!pa_atomic_cmpxchg(&m->busy, 0, 1))
+                continue;
+
+            while (m->n_slots > 0)
+                mempool_return_slot(c, m->slots[--m->n_slots]);
+
+            mempool_magazine_release(m);
+        }
+    }
 }
 
 /* No lock necessary */
@@ -382,18 +633,18 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
     if (length == (size_t) -1)
         length = pa_mempool_block_size_max(p);
 
-    if (p->block_size >= PA_ALIGN(sizeof(pa_memblock)) + length) {
+    if (mempool_block_size(p) >= PA_ALIGN(sizeof(pa_memblock)) + length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_slot(p, PA_ALIGN(sizeof(pa_memblock)) + length)))
             return NULL;
 
         b = mempool_slot_data(slot);
         b->type = PA_MEMBLOCK_POOL;
         pa_atomic_ptr_store(&b->data, (uint8_t*) b + PA_ALIGN(sizeof(pa_memblock)));
 
-    } else if (p->block_size >= length) {
+    } else if (mempool_block_size(p) >= length) {
 
-        if (!(slot = mempool_allocate_slot(p)))
+        if (!(slot = mempool_allocate_slot(p, length)))
             return NULL;
 
         if (!(b = pa_flist_pop(PA_STATIC_FLIST_GET(unused_memblocks))))
@@ -403,7 +654,7 @@ pa_memblock *pa_memblock_new_pool(pa_mempool *p, size_t length) {
         pa_atomic_ptr_store(&b->data, mempool_slot_data(slot));
 
     } else {
-        pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) p->block_size);
+        pa_log_debug("Memory block too large for pool: %lu > %lu", (unsigned long) length, (unsigned long) mempool_block_size(p));
         pa_atomic_inc(&p->stat.n_too_large_for_pool);
         return NULL;
     }
@@ -492,6 +743,15 @@ bool pa_memblock_is_ours(pa_memblock *b) {
     return b->type != PA_MEMBLOCK_IMPORTED;
 }
 
+/* No lock necessary. Returns true if the data lives in a slot of the
+ * block's pool, i.e. can be exported without copying it. */
+bool pa_memblock_is_pooled(pa_memblock *b) {
+    pa_assert(b);
+    pa_assert(PA_REFCNT_VALUE(b) > 0);
+
+    return b->type == PA_MEMBLOCK_POOL || b->type == PA_MEMBLOCK_POOL_EXTERNAL;
+}
+
 /* No lock necessary */
 bool pa_memblock_is_read_only(pa_memblock *b) {
     pa_assert(b);
@@ -642,10 +902,12 @@ static void memblock_free(pa_memblock *b) {
 
         case PA_MEMBLOCK_POOL_EXTERNAL:
         case PA_MEMBLOCK_POOL: {
+            struct mempool_class *c;
             struct mempool_slot *slot;
             bool call_free;
 
-            pa_assert_se(slot = mempool_slot_by_ptr(b->pool, pa_atomic_ptr_load(&b->data)));
+            c = mempool_slot_class(b->pool, pa_atomic_ptr_load(&b->data));
+            pa_assert_se(slot = mempool_slot_by_ptr(c, pa_atomic_ptr_load(&b->data)));
 
             call_free = b->type == PA_MEMBLOCK_POOL_EXTERNAL;
 
@@ -655,11 +917,7 @@ static void memblock_free(pa_memblock *b) {
 /*             } */
 /* #endif */
 
-            /* The free list dimensions should easily allow all slots
-             * to fit in, hence try harder if pushing this slot into
-             * the free list fails */
-            while (pa_flist_push(b->pool->free_slots, slot) < 0)
-                ;
+            mempool_free_slot(b->pool, c, slot);
 
             if (call_free)
                 if (pa_flist_push(PA_STATIC_FLIST_GET(unused_memblocks), b) < 0)
@@ -711,10 +969,10 @@ static void memblock_make_local(pa_memblock *b) {
 
     pa_atomic_dec(&b->pool->stat.n_allocated_by_type[b->type]);
 
-    if (b->length <= b->pool->block_size) {
+    if (b->length <= mempool_block_size(b->pool)) {
         struct mempool_slot *slot;
 
-        if ((slot = mempool_allocate_slot(b->pool))) {
+        if ((slot = mempool_allocate_slot(b->pool, b->length))) {
             void *new_data;
             /* We can move it into a local pool, perfect! */
 
@@ -826,41 +1084,139 @@ static void memblock_replace_import(pa_memblock *b) {
  * TODO-1: Transform the global core mempool to a per-client one
  * TODO-2: Remove global mempools support */
 pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
+    return pa_mempool_new_full(type, size, per_client, 0, NULL, 0);
+}
+
+/* Splits the slots of a class into one range per NUMA node and binds
+ * each range to its node. Binding is best effort, the memory is still
+ * usable from every node if it fails. */
+static void mempool_setup_nodes(pa_mempool *p, struct mempool_class *c) {
+    unsigned i, n_nodes = 1;
+
+    if (p->flags & PA_MEMPOOL_NUMA)
+        n_nodes = PA_MIN(pa_numa_nodes(), c->n_blocks / 2);
+
+    n_nodes = PA_MAX(n_nodes, 1U);
+
+    c->n_nodes = n_nodes;
+    c->slots_per_node = c->n_blocks / n_nodes;
+    c->nodes = pa_xnew0(struct mempool_node, n_nodes);
+
+    for (i = 0; i < n_nodes; i++) {
+        struct mempool_node *n = &c->nodes[i];
+
+        n->first_slot = i * c->slots_per_node;
+        n->n_slots = i == n_nodes - 1 ? c->n_blocks - n->first_slot : c->slots_per_node;
+        pa_atomic_store(&n->n_init, 0);
+        n->free_slots = pa_flist_new(n->n_slots);
+
+        if (n_nodes > 1 &&
+            pa_numa_bind(c->base + c->block_size * n->first_slot, c->block_size * n->n_slots, i) < 0)
+            pa_log_debug("Failed to bind memory pool slots to NUMA node %u: %s", i, pa_cstrerror(errno));
+    }
+
+    if (n_nodes > 1)
+        pa_log_debug("Memory pool slots split into %u NUMA node local parts of %u slots.", n_nodes, c->slots_per_node);
+}
+
+/* Sets up the size classes from the requested slot sizes, which are
+ * rounded up to whole pages, sorted and deduplicated. Every class gets
+ * the same share of the pool memory. */
+static void mempool_setup_classes(pa_mempool *p, size_t size, const size_t *slot_sizes, unsigned n_slot_sizes) {
+    static const size_t default_slot_size = PA_MEMPOOL_SLOT_SIZE;
+    const size_t page_size = pa_page_size();
+    unsigned i, j;
+
+    if (n_slot_sizes <= 0) {
+        slot_sizes = &default_slot_size;
+        n_slot_sizes = 1;
+    }
+
+    for (i = 0; i < n_slot_sizes; i++) {
+        size_t block_size = PA_MAX(PA_PAGE_ALIGN(slot_sizes[i]), page_size);
+
+        for (j = 0; j < p->n_classes; j++)
+            if (p->classes[j].block_size >= block_size)
+                break;
+
+        if (j < p->n_classes && p->classes[j].block_size == block_size)
+            continue;
+
+        if (p->n_classes >= PA_MEMPOOL_CLASSES_MAX) {
+            pa_log_warn("Too many memory pool slot sizes, ignoring %lu.", (unsigned long) slot_sizes[i]);
+            continue;
+        }
+
+        memmove(&p->classes[j + 1], &p->classes[j], (p->n_classes - j) * sizeof(struct mempool_class));
+        pa_zero(p->classes[j]);
+        p->classes[j].block_size = block_size;
+        p->n_classes++;
+    }
+
+    /* We default to as many slots as would be PA_MEMPOOL_SLOTS_MAX of
+     * the default size */
+    if (size <= 0)
+        size = PA_MEMPOOL_SLOTS_MAX * PA_PAGE_ALIGN(PA_MEMPOOL_SLOT_SIZE);
+
+    for (i = 0; i < p->n_classes; i++) {
+        struct mempool_class *c = &p->classes[i];
+
+        c->n_blocks = (unsigned) (size / p->n_classes / c->block_size);
+
+        if (c->n_blocks < 2)
+            c->n_blocks = 2;
+
+        p->n_blocks += c->n_blocks;
+    }
+}
+
+pa_mempool *pa_mempool_new_full(pa_mem_type_t type, size_t size, bool per_client, pa_mempool_flags_t flags,
+                                const size_t *slot_sizes, unsigned n_slot_sizes) {
     pa_mempool *p;
     char t1[PA_BYTES_SNPRINT_MAX], t2[PA_BYTES_SNPRINT_MAX];
-    const size_t page_size = pa_page_size();
+    size_t total = 0;
+    unsigned i;
 
     p = pa_xnew0(pa_mempool, 1);
     PA_REFCNT_INIT(p);
 
-    p->block_size = PA_PAGE_ALIGN(PA_MEMPOOL_SLOT_SIZE);
-    if (p->block_size < page_size)
-        p->block_size = page_size;
+    p->flags = flags;
 
-    if (size <= 0)
-        p->n_blocks = PA_MEMPOOL_SLOTS_MAX;
-    else {
-        p->n_blocks = (unsigned) (size / p->block_size);
+    mempool_setup_classes(p, size, slot_sizes, n_slot_sizes);
 
-        if (p->n_blocks < 2)
-            p->n_blocks = 2;
-    }
+    for (i = 0; i < p->n_classes; i++)
+        total += p->classes[i].n_blocks * p->classes[i].block_size;
 
-    if (pa_shm_create_rw(&p->memory, type, p->n_blocks * p->block_size, 0700) < 0) {
+    if (pa_shm_create_rw(&p->memory, type, total, 0700, !!(flags & PA_MEMPOOL_HUGEPAGES)) < 0) {
         pa_xfree(p);
         return NULL;
     }
 
-    pa_log_debug("Using %s memory pool with %u slots of size %s each, total size is %s, maximum usable slot size is %lu",
+    pa_log_debug("Using %s%s memory pool with %u slots in %u size classes, total size is %s, maximum usable slot size is %lu",
                  pa_mem_type_to_string(type),
+                 p->memory.hugepages ? " huge page" : "",
                  p->n_blocks,
-                 pa_bytes_snprint(t1, sizeof(t1), (unsigned) p->block_size),
-                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) (p->n_blocks * p->block_size)),
+                 p->n_classes,
+                 pa_bytes_snprint(t2, sizeof(t2), (unsigned) total),
                  (unsigned long) pa_mempool_block_size_max(p));
 
     p->global = !per_client;
 
-    pa_atomic_store(&p->n_init, 0);
+    for (i = 0, total = 0; i < p->n_classes; i++) {
+        struct mempool_class *c = &p->classes[i];
+
+        c->base = (uint8_t*) p->memory.ptr + total;
+        total += c->n_blocks * c->block_size;
+
+        if (p->n_classes > 1)
+            pa_log_debug("Memory pool size class %u has %u slots of size %s each.",
+                         i, c->n_blocks, pa_bytes_snprint(t1, sizeof(t1), (unsigned) c->block_size));
+
+        mempool_setup_nodes(p, c);
+
+        if (c->n_blocks >= MEMPOOL_MAGAZINES * MEMPOOL_MAGAZINE_SLOTS)
+            c->magazines = pa_xnew0(struct mempool_magazine, MEMPOOL_MAGAZINES);
+    }
 
     PA_LLIST_HEAD_INIT(pa_memimport, p->imports);
     PA_LLIST_HEAD_INIT(pa_memexport, p->exports);
@@ -868,12 +1224,12 @@ pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client) {
     p->mutex = pa_mutex_new(true, true);
     p->semaphore = pa_semaphore_new(0);
 
-    p->free_slots = pa_flist_new(p->n_blocks);
-
     return p;
 }
 
 static void mempool_free(pa_mempool *p) {
+    unsigned j, l;
+
     pa_assert(p);
 
     pa_mutex_lock(p->mutex);
@@ -886,8 +1242,6 @@ static void mempool_free(pa_mempool *p) {
 
     pa_mutex_unlock(p->mutex);
 
-    pa_flist_free(p->free_slots, NULL);
-
     if (pa_atomic_load(&p->stat.n_allocated) > 0) {
 
         /* Ouch, somebody is retaining a memory block reference! */
@@ -898,29 +1252,38 @@ static void mempool_free(pa_mempool *p) {
 
         /* Let's try to find at least one of those leaked memory blocks */
 
+        mempool_drain_magazines(p);
         list = pa_flist_new(p->n_blocks);
 
-        for (i = 0; i < (unsigned) pa_atomic_load(&p->n_init); i++) {
-            struct mempool_slot *slot;
-            pa_memblock *b, *k;
+        for (l = 0; l < p->n_classes; l++) {
+            struct mempool_class *c = &p->classes[l];
 
-            slot = (struct mempool_slot*) ((uint8_t*) p->memory.ptr + (p->block_size * (size_t) i));
-            b = mempool_slot_data(slot);
+            for (j = 0; j < c->n_nodes; j++) {
+                struct mempool_node *n = &c->nodes[j];
 
-            while ((k = pa_flist_pop(p->free_slots))) {
-                while (pa_flist_push(list, k) < 0)
-                    ;
+                for (i = 0; i < (unsigned) pa_atomic_load(&n->n_init); i++) {
+                    struct mempool_slot *slot;
+                    pa_memblock *b, *k;
 
-                if (b == k)
-                    break;
-            }
+                    slot = (struct mempool_slot*) (c->base + (c->block_size * (size_t) (n->first_slot + i)));
+                    b = mempool_slot_data(slot);
 
-            if (!k)
-                pa_log("REF: Leaked memory block %p", b);
+                    while ((k = pa_flist_pop(n->free_slots))) {
+                        while (pa_flist_push(list, k) < 0)
+                            ;
 
-            while ((k = pa_flist_pop(list)))
-                while (pa_flist_push(p->free_slots, k) < 0)
-                    ;
+                        if (b == k)
+                            break;
+                    }
+
+                    if (!k)
+                        pa_log("REF: Leaked memory block %p", b);
+
+                    while ((k = pa_flist_pop(list)))
+                        while (pa_flist_push(n->free_slots, k) < 0)
+                            ;
+                }
+            }
         }
 
         pa_flist_free(list, NULL);
@@ -932,6 +1295,16 @@ static void mempool_free(pa_mempool *p) {
 /*         PA_DEBUG_TRAP; */
     }
 
+    for (l = 0; l < p->n_classes; l++) {
+        struct mempool_class *c = &p->classes[l];
+
+        for (j = 0; j < c->n_nodes; j++)
+            pa_flist_free(c->nodes[j].free_slots, NULL);
+
+        pa_xfree(c->nodes);
+        pa_xfree(c->magazines);
+    }
+
     pa_shm_free(&p->memory);
 
     pa_mutex_free(p->mutex);
@@ -951,27 +1324,42 @@ const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p) {
 size_t pa_mempool_block_size_max(pa_mempool *p) {
     pa_assert(p);
 
-    return p->block_size - PA_ALIGN(sizeof(pa_memblock));
+    return mempool_block_size(p) - PA_ALIGN(sizeof(pa_memblock));
 }
 
 /* No lock necessary */
 void pa_mempool_vacuum(pa_mempool *p) {
     struct mempool_slot *slot;
     pa_flist *list;
+    unsigned i, j;
 
     pa_assert(p);
 
+    /* Huge pages would only be split up by punching holes into them */
+    if (p->memory.hugepages)
+        return;
+
+    mempool_drain_magazines(p);
+
     list = pa_flist_new(p->n_blocks);
 
-    while ((slot = pa_flist_pop(p->free_slots)))
-        while (pa_flist_push(list, slot) < 0)
-            ;
+    for (j = 0; j < p->n_classes; j++) {
+        struct mempool_class *c = &p->classes[j];
 
-    while ((slot = pa_flist_pop(list))) {
-        pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), p->block_size);
+        for (i = 0; i < c->n_nodes; i++) {
+            struct mempool_node *n = &c->nodes[i];
 
-        while (pa_flist_push(p->free_slots, slot))
-            ;
+            while ((slot = pa_flist_pop(n->free_slots)))
+                while (pa_flist_push(list, slot) < 0)
+                    ;
+
+            while ((slot = pa_flist_pop(list))) {
+                pa_shm_punch(&p->memory, (size_t) ((uint8_t*) slot - (uint8_t*) p->memory.ptr), c->block_size);
+
+                while (pa_flist_push(n->free_slots, slot))
+                    ;
+            }
+        }
     }
 
     pa_flist_free(list, NULL);
@@ -54,6 +54,15 @@ typedef struct pa_memimport_segment pa_memimport_segment;
 typedef struct pa_memimport pa_memimport;
 typedef struct pa_memexport pa_memexport;
 
+/* The maximum number of different slot sizes in a memory pool */
+#define PA_MEMPOOL_CLASSES_MAX 8
+
+/* Optional properties of a memory pool */
+typedef enum pa_mempool_flags {
+    PA_MEMPOOL_HUGEPAGES = 1 << 0, /* Back the pool with huge pages if possible */
+    PA_MEMPOOL_NUMA = 1 << 1,      /* Keep one part of the pool per NUMA node and allocate from the local one */
+} pa_mempool_flags_t;
+
 typedef void (*pa_memimport_release_cb_t)(pa_memimport *i, uint32_t block_id, void *userdata);
 typedef void (*pa_memexport_revoke_cb_t)(pa_memexport *e, uint32_t block_id, void *userdata);
 
@@ -74,6 +83,13 @@ struct pa_mempool_stat {
     pa_atomic_t n_too_large_for_pool;
     pa_atomic_t n_pool_full;
 
+    /* Batches of slots moved between the per-thread caches and the
+     * shared free lists, and slots taken out of another thread's
+     * cache because the pool was otherwise full */
+    pa_atomic_t n_cache_refills;
+    pa_atomic_t n_cache_flushes;
+    pa_atomic_t n_cache_steals;
+
     pa_atomic_t n_allocated_by_type[PA_MEMBLOCK_TYPE_MAX];
     pa_atomic_t n_accumulated_by_type[PA_MEMBLOCK_TYPE_MAX];
 };
@@ -107,6 +123,7 @@ manually if called from more than one thread at the same time. */
 void pa_memblock_unref_fixed(pa_memblock*b);
 
 bool pa_memblock_is_ours(pa_memblock *b);
+bool pa_memblock_is_pooled(pa_memblock *b);
 bool pa_memblock_is_read_only(pa_memblock *b);
 bool pa_memblock_is_silence(pa_memblock *b);
 bool pa_memblock_ref_is_one(pa_memblock *b);
@@ -125,6 +142,8 @@ pa_memblock *pa_memblock_will_need(pa_memblock *b);
 
 /* The memory block manager */
 pa_mempool *pa_mempool_new(pa_mem_type_t type, size_t size, bool per_client);
+pa_mempool *pa_mempool_new_full(pa_mem_type_t type, size_t size, bool per_client, pa_mempool_flags_t flags,
+                                const size_t *slot_sizes, unsigned n_slot_sizes);
 void pa_mempool_unref(pa_mempool *p);
 pa_mempool* pa_mempool_ref(pa_mempool *p);
 const pa_mempool_stat* pa_mempool_get_stat(pa_mempool *p);
@@ -30,24 +30,32 @@
 #include <pulsecore/log.h>
 #include <pulsecore/mcalign.h>
 #include <pulsecore/macro.h>
-#include <pulsecore/flist.h>
 
 #include "memblockq.h"
 
 /* #define MEMBLOCKQ_DEBUG */
 
-struct list_item {
-    struct list_item *next, *prev;
+/* The blocks are kept sorted by index in a ring of descriptors, which
+ * is grown as needed but never shrunk. Appending at the tail and
+ * dropping from the head, which is what happens almost always, are
+ * O(1) and don't allocate anything. */
+#define RING_SIZE_MIN 16
+
+struct block {
     int64_t index;
     pa_memchunk chunk;
 };
 
-PA_STATIC_FLIST_DECLARE(list_items, 0, pa_xfree);
-
 struct pa_memblockq {
-    struct list_item *blocks, *blocks_tail;
-    struct list_item *current_read, *current_write;
-    unsigned n_blocks;
+    struct block *ring;
+    unsigned ring_size, first, n_blocks;
+
+    /* Hints where to start looking for the next block to read from
+     * and to write to. current_read == n_blocks and current_write == -1
+     * mean that there is no hint. */
+    unsigned current_read;
+    int current_write;
+
     size_t maxlength, tlength, base, prebuf, minreq, maxrewind;
     int64_t read_index, write_index;
     bool in_prebuf;
@@ -58,6 +66,14 @@ struct pa_memblockq {
     pa_sample_spec sample_spec;
 };
 
+static inline struct block *get_block(pa_memblockq *bq, unsigned i) {
+    return &bq->ring[(bq->first + i) & (bq->ring_size - 1)];
+}
+
+static inline int64_t block_end(const struct block *q) {
+    return q->index + (int64_t) q->chunk.length;
+}
+
 pa_memblockq* pa_memblockq_new(
         const char *name,
         int64_t idx,
@@ -77,6 +93,11 @@ pa_memblockq* pa_memblockq_new(
     bq = pa_xnew0(pa_memblockq, 1);
     bq->name = pa_xstrdup(name);
 
+    bq->ring_size = RING_SIZE_MIN;
+    bq->ring = pa_xnew(struct block, bq->ring_size);
+    bq->current_read = 0;
+    bq->current_write = -1;
+
     bq->sample_spec = *sample_spec;
     bq->base = pa_frame_size(sample_spec);
     bq->read_index = bq->write_index = idx;
@@ -116,98 +137,153 @@ void pa_memblockq_free(pa_memblockq* bq) {
     if (bq->mcalign)
         pa_mcalign_free(bq->mcalign);
 
+    pa_xfree(bq->ring);
     pa_xfree(bq->name);
     pa_xfree(bq);
 }
 
 static void fix_current_read(pa_memblockq *bq) {
+    unsigned i;
+
     pa_assert(bq);
 
-    if (PA_UNLIKELY(!bq->blocks)) {
-        bq->current_read = NULL;
+    if (PA_UNLIKELY(bq->n_blocks == 0)) {
+        bq->current_read = 0;
         return;
     }
 
-    if (PA_UNLIKELY(!bq->current_read))
-        bq->current_read = bq->blocks;
+    i = bq->current_read;
 
-    /* Scan left */
-    while (PA_UNLIKELY(bq->current_read->index > bq->read_index))
+    if (PA_UNLIKELY(i >= bq->n_blocks))
+        i = 0;
 
-        if (bq->current_read->prev)
-            bq->current_read = bq->current_read->prev;
-        else
-            break;
+    /* Scan left */
+    while (PA_UNLIKELY(get_block(bq, i)->index > bq->read_index) && i > 0)
+        i--;
 
     /* Scan right */
-    while (PA_LIKELY(bq->current_read != NULL) && PA_UNLIKELY(bq->current_read->index + (int64_t) bq->current_read->chunk.length <= bq->read_index))
-        bq->current_read = bq->current_read->next;
+    while (PA_LIKELY(i < bq->n_blocks) && PA_UNLIKELY(block_end(get_block(bq, i)) <= bq->read_index))
+        i++;
+
+    bq->current_read = i;
 
     /* At this point current_read will either point at or left of the
-       next block to play. It may be NULL in case everything in
+       next block to play. It may be n_blocks in case everything in
        the queue was already played */
 }
 
 static void fix_current_write(pa_memblockq *bq) {
+    int i;
+
     pa_assert(bq);
 
-    if (PA_UNLIKELY(!bq->blocks)) {
-        bq->current_write = NULL;
+    if (PA_UNLIKELY(bq->n_blocks == 0)) {
+        bq->current_write = -1;
         return;
     }
 
-    if (PA_UNLIKELY(!bq->current_write))
-        bq->current_write = bq->blocks_tail;
+    i = bq->current_write;
 
-    /* Scan right */
-    while (PA_UNLIKELY(bq->current_write->index + (int64_t) bq->current_write->chunk.length <= bq->write_index))
+    if (PA_UNLIKELY(i < 0))
+        i = (int) bq->n_blocks - 1;
 
-        if (bq->current_write->next)
-            bq->current_write = bq->current_write->next;
-        else
-            break;
+    /* Scan right */
+    while (PA_UNLIKELY(block_end(get_block(bq, (unsigned) i)) <= bq->write_index) && i < (int) bq->n_blocks - 1)
+        i++;
 
     /* Scan left */
-    while (PA_LIKELY(bq->current_write != NULL) && PA_UNLIKELY(bq->current_write->index > bq->write_index))
-        bq->current_write = bq->current_write->prev;
+    while (PA_LIKELY(i >= 0) && PA_UNLIKELY(get_block(bq, (unsigned) i)->index > bq->write_index))
+        i--;
+
+    bq->current_write = i;
 
     /* At this point current_write will either point at or right of
-       the next block to write data to. It may be NULL in case
+       the next block to write data to. It may be -1 in case
        everything in the queue is still to be played */
 }
 
-static void drop_block(pa_memblockq *bq, struct list_item *q) {
-    pa_assert(bq);
-    pa_assert(q);
+static void grow_ring(pa_memblockq *bq) {
+    struct block *ring;
+    unsigned i;
 
-    pa_assert(bq->n_blocks >= 1);
+    ring = pa_xnew(struct block, bq->ring_size * 2);
 
-    if (q->prev)
-        q->prev->next = q->next;
-    else {
-        pa_assert(bq->blocks == q);
-        bq->blocks = q->next;
-    }
+    for (i = 0; i < bq->n_blocks; i++)
+        ring[i] = *get_block(bq, i);
+
+    pa_xfree(bq->ring);
+    bq->ring = ring;
+    bq->ring_size *= 2;
+    bq->first = 0;
+}
+
+/* Inserts a block in front of the one at position i, taking a
+ * reference to its memblock. Moves whichever side of the ring is
+ * shorter, so appending and prepending are O(1). */
+static struct block *insert_block(pa_memblockq *bq, unsigned i, int64_t index, const pa_memchunk *chunk) {
+    struct block *q;
+    unsigned j;
+
+    pa_assert(i <= bq->n_blocks);
 
-    if (q->next)
-        q->next->prev = q->prev;
-    else {
-        pa_assert(bq->blocks_tail == q);
-        bq->blocks_tail = q->prev;
+    if (bq->n_blocks >= bq->ring_size)
+        grow_ring(bq);
+
+    if (i < bq->n_blocks - i) {
+        bq->first = (bq->first - 1) & (bq->ring_size - 1);
+        bq->n_blocks++;
+
+        for (j = 0; j < i; j++)
+            *get_block(bq, j) = *get_block(bq, j + 1);
+    } else {
+        bq->n_blocks++;
+
+        for (j = bq->n_blocks - 1; j > i; j--)
+            *get_block(bq, j) = *get_block(bq, j - 1);
     }
 
-    if (bq->current_write == q)
-        bq->current_write = q->prev;
+    /* Keep the hints pointing at the same blocks */
+    if (bq->current_read >= i)
+        bq->current_read++;
 
-    if (bq->current_read == q)
-        bq->current_read = q->next;
+    if (bq->current_write >= (int) i)
+        bq->current_write++;
+
+    q = get_block(bq, i);
+    q->index = index;
+    q->chunk = *chunk;
+    pa_memblock_ref(q->chunk.memblock);
+
+    return q;
+}
 
-    pa_memblock_unref(q->chunk.memblock);
+static void drop_block(pa_memblockq *bq, unsigned i) {
+    unsigned j;
 
-    if (pa_flist_push(PA_STATIC_FLIST_GET(list_items), q) < 0)
-        pa_xfree(q);
+    pa_assert(bq);
+    pa_assert(i < bq->n_blocks);
+
+    pa_memblock_unref(get_block(bq, i)->chunk.memblock);
+
+    if (i < bq->n_blocks - 1 - i) {
+        for (j = i; j > 0; j--)
+            *get_block(bq, j) = *get_block(bq, j - 1);
+
+        bq->first = (bq->first + 1) & (bq->ring_size - 1);
+    } else {
+        for (j = i; j < bq->n_blocks - 1; j++)
+            *get_block(bq, j) = *get_block(bq, j + 1);
+    }
 
     bq->n_blocks--;
+
+    /* current_write moves on to the block before the dropped one,
+     * current_read to the one after it */
+    if (bq->current_write >= (int) i)
+        bq->current_write--;
+
+    if (bq->current_read > i)
+        bq->current_read--;
 }
 
 static void drop_backlog(pa_memblockq *bq) {
@@ -216,8 +292,8 @@ static void drop_backlog(pa_memblockq *bq) {
 
     boundary = bq->read_index - (int64_t) bq->maxrewind;
 
-    while (bq->blocks && (bq->blocks->index + (int64_t) bq->blocks->chunk.length <= boundary))
-        drop_block(bq, bq->blocks);
+    while (bq->n_blocks > 0 && block_end(get_block(bq, 0)) <= boundary)
+        drop_block(bq, 0);
 }
 
 static bool can_push(pa_memblockq *bq, size_t l) {
@@ -234,7 +310,7 @@ static bool can_push(pa_memblockq *bq, size_t l) {
             return true;
     }
 
-    end = bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->write_index;
+    end = bq->n_blocks > 0 ? block_end(get_block(bq, bq->n_blocks - 1)) : bq->write_index;
 
     /* Make sure that the list doesn't get too long */
     if (bq->write_index + (int64_t) l > end)
@@ -275,9 +351,10 @@ static void read_index_changed(pa_memblockq *bq, int64_t old_read_index) {
 }
 
 int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
-    struct list_item *q, *n;
+    struct block *q;
     pa_memchunk chunk;
     int64_t old;
+    int i;
 
     pa_assert(bq);
     pa_assert(uchunk);
@@ -294,85 +371,70 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
     chunk = *uchunk;
 
     fix_current_write(bq);
-    q = bq->current_write;
+    i = bq->current_write;
 
-    /* First we advance the q pointer right of where we want to
-     * write to */
+    /* First we advance i right of where we want to write to */
 
-    if (q) {
-        while (bq->write_index + (int64_t) chunk.length > q->index)
-            if (q->next)
-                q = q->next;
+    if (i >= 0) {
+        while (bq->write_index + (int64_t) chunk.length > get_block(bq, (unsigned) i)->index)
+            if (i < (int) bq->n_blocks - 1)
+                i++;
             else
                 break;
     }
 
-    if (!q)
-        q = bq->blocks_tail;
+    if (i < 0)
+        i = (int) bq->n_blocks - 1;
 
     /* We go from back to front to look for the right place to add
      * this new entry. Drop data we will overwrite on the way */
 
-    while (q) {
+    while (i >= 0) {
+        q = get_block(bq, (unsigned) i);
 
-        if (bq->write_index >= q->index + (int64_t) q->chunk.length)
+        if (bq->write_index >= block_end(q))
             /* We found the entry where we need to place the new entry immediately after */
             break;
         else if (bq->write_index + (int64_t) chunk.length <= q->index) {
             /* This entry isn't touched at all, let's skip it */
-            q = q->prev;
+            i--;
         } else if (bq->write_index <= q->index &&
-                   bq->write_index + (int64_t) chunk.length >= q->index + (int64_t) q->chunk.length) {
+                   bq->write_index + (int64_t) chunk.length >= block_end(q)) {
 
             /* This entry is fully replaced by the new entry, so let's drop it */
-
-            struct list_item *p;
-            p = q;
-            q = q->prev;
-            drop_block(bq, p);
+            drop_block(bq, (unsigned) i);
+            i--;
         } else if (bq->write_index >= q->index) {
             /* The write index points into this memblock, so let's
              * truncate or split it */
 
-            if (bq->write_index + (int64_t) chunk.length < q->index + (int64_t) q->chunk.length) {
+            if (bq->write_index + (int64_t) chunk.length < block_end(q)) {
 
                 /* We need to save the end of this memchunk */
-                struct list_item *p;
+                struct block *p;
+                pa_memchunk tail;
                 size_t d;
 
-                /* Create a new list entry for the end of the memchunk */
-                if (!(p = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-                    p = pa_xnew(struct list_item, 1);
-
-                p->chunk = q->chunk;
-                pa_memblock_ref(p->chunk.memblock);
-
                 /* Calculate offset */
                 d = (size_t) (bq->write_index + (int64_t) chunk.length - q->index);
                 pa_assert(d > 0);
 
-                /* Drop it from the new entry */
-                p->index = q->index + (int64_t) d;
-                p->chunk.index = d;
-                p->chunk.length -= d;
+                /* Create a new entry for the end of the memchunk */
+                tail = q->chunk;
+                tail.index += d;
+                tail.length -= d;
 
-                /* Add it to the list */
-                p->prev = q;
-                if ((p->next = q->next))
-                    q->next->prev = p;
-                else
-                    bq->blocks_tail = p;
-                q->next = p;
+                p = insert_block(bq, (unsigned) i + 1, q->index + (int64_t) d, &tail);
+                pa_assert(p);
 
-                bq->n_blocks++;
+                /* The ring might have been moved around */
+                q = get_block(bq, (unsigned) i);
             }
 
             /* Truncate the chunk */
             if (!(q->chunk.length = (size_t) (bq->write_index - q->index))) {
-                struct list_item *p;
-                p = q;
-                q = q->prev;
-                drop_block(bq, p);
+                drop_block(bq, (unsigned) i);
+                i--;
             }
 
             /* We had to truncate this block, hence we're now at the right position */
@@ -381,7 +443,7 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
             size_t d;
 
             pa_assert(bq->write_index + (int64_t)chunk.length > q->index &&
-                      bq->write_index + (int64_t)chunk.length < q->index + (int64_t)q->chunk.length &&
+                      bq->write_index + (int64_t)chunk.length < block_end(q) &&
                       bq->write_index < q->index);
 
             /* The job overwrites the current entry at the end, so let's drop the beginning of this entry */
@@ -391,49 +453,31 @@ int pa_memblockq_push(pa_memblockq* bq, const pa_memchunk *uchunk) {
             q->chunk.index += d;
             q->chunk.length -= d;
 
-            q = q->prev;
+            i--;
         }
     }
 
-    if (q) {
-        pa_assert(bq->write_index >=  q->index + (int64_t)q->chunk.length);
-        pa_assert(!q->next || (bq->write_index + (int64_t)chunk.length <= q->next->index));
+    if (i >= 0) {
+        q = get_block(bq, (unsigned) i);
+
+        pa_assert(bq->write_index >= block_end(q));
+        pa_assert(i == (int) bq->n_blocks - 1 || (bq->write_index + (int64_t)chunk.length <= get_block(bq, (unsigned) i + 1)->index));
 
         /* Try to merge memory blocks */
 
         if (q->chunk.memblock == chunk.memblock &&
             q->chunk.index + q->chunk.length == chunk.index &&
-            bq->write_index == q->index + (int64_t) q->chunk.length) {
+            bq->write_index == block_end(q)) {
 
             q->chunk.length += chunk.length;
             bq->write_index += (int64_t) chunk.length;
             goto finish;
         }
     } else
-        pa_assert(!bq->blocks || (bq->write_index + (int64_t)chunk.length <= bq->blocks->index));
-
-    if (!(n = pa_flist_pop(PA_STATIC_FLIST_GET(list_items))))
-        n = pa_xnew(struct list_item, 1);
-
-    n->chunk = chunk;
-    pa_memblock_ref(n->chunk.memblock);
-    n->index = bq->write_index;
-    bq->write_index += (int64_t) n->chunk.length;
-
-    n->next = q ? q->next : bq->blocks;
-    n->prev = q;
-
-    if (n->next)
-        n->next->prev = n;
-    else
-        bq->blocks_tail = n;
-
-    if (n->prev)
-        n->prev->next = n;
-    else
-        bq->blocks = n;
+        pa_assert(bq->n_blocks == 0 || (bq->write_index + (int64_t)chunk.length <= get_block(bq, 0)->index));
 
-    bq->n_blocks++;
+    insert_block(bq, (unsigned) (i + 1), bq->write_index, &chunk);
+    bq->write_index += (int64_t) chunk.length;
 
 finish:
 
@@ -471,8 +515,67 @@ static bool update_prebuf(pa_memblockq *bq) {
     }
 }
 
+/* Describes what is to be read at index ri, i.e. either data from a
+ * block, silence or a hole. *i is the position of the first block that
+ * might be at or right of ri and is moved on as blocks are consumed. No
+ * reference is taken. Returns false if there is neither data nor
+ * silence to return. */
+static bool peek_at(pa_memblockq *bq, unsigned *i, int64_t ri, pa_memchunk *chunk) {
+    struct block *q = NULL;
+    size_t length;
+
+    while (*i < bq->n_blocks) {
+        q = get_block(bq, *i);
+
+        if (block_end(q) > ri)
+            break;
+
+        q = NULL;
+        (*i)++;
+    }
+
+    /* Ok, let's pass real data to the caller */
+    if (q && q->index <= ri) {
+        *chunk = q->chunk;
+        chunk->index += (size_t) (ri - q->index);
+        chunk->length -= (size_t) (ri - q->index);
+
+        (*i)++;
+        return true;
+    }
+
+    /* How much silence shall we return? */
+    if (q)
+        length = (size_t) (q->index - ri);
+    else if (bq->write_index > ri)
+        length = (size_t) (bq->write_index - ri);
+    else
+        length = 0;
+
+    /* We need to return silence, since no data is yet available */
+    if (bq->silence.memblock) {
+        *chunk = bq->silence;
+
+        if (length > 0 && length < chunk->length)
+            chunk->length = length;
+
+        return true;
+    }
+
+    /* If the memblockq is empty there's nothing to return, otherwise
+     * return the time to sleep */
+    if (length <= 0)
+        return false;
+
+    chunk->memblock = NULL;
+    chunk->index = 0;
+    chunk->length = length;
+    return true;
+}
+
 int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
-    int64_t d;
+    unsigned i;
+
     pa_assert(bq);
     pa_assert(chunk);
 
@@ -482,58 +585,54 @@ int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk) {
 
     fix_current_read(bq);
 
-    /* Do we need to spit out silence? */
-    if (!bq->current_read || bq->current_read->index > bq->read_index) {
-        size_t length;
+    i = bq->current_read;
+    if (!peek_at(bq, &i, bq->read_index, chunk))
+        return -1;
 
-        /* How much silence shall we return? */
-        if (bq->current_read)
-            length = (size_t) (bq->current_read->index - bq->read_index);
-        else if (bq->write_index > bq->read_index)
-            length = (size_t) (bq->write_index - bq->read_index);
-        else
-            length = 0;
+    if (chunk->memblock)
+        pa_memblock_ref(chunk->memblock);
+
+    return 0;
+}
 
-        /* We need to return silence, since no data is yet available */
-        if (bq->silence.memblock) {
-            *chunk = bq->silence;
-            pa_memblock_ref(chunk->memblock);
+unsigned pa_memblockq_peek_many(pa_memblockq *bq, pa_memchunk *chunks, unsigned n, size_t length) {
+    unsigned i, k;
+    int64_t ri;
 
-            if (length > 0 && length < chunk->length)
-                chunk->length = length;
+    pa_assert(bq);
+    pa_assert(chunks || n == 0);
 
-        } else {
+    if (update_prebuf(bq))
+        return 0;
 
-            /* If the memblockq is empty, return -1, otherwise return
-             * the time to sleep */
-            if (length <= 0)
-                return -1;
+    fix_current_read(bq);
 
-            chunk->memblock = NULL;
-            chunk->length = length;
-        }
+    i = bq->current_read;
+    ri = bq->read_index;
 
-        chunk->index = 0;
-        return 0;
-    }
+    for (k = 0; k < n && length > 0; k++) {
 
-    /* Ok, let's pass real data to the caller */
-    *chunk = bq->current_read->chunk;
-    pa_memblock_ref(chunk->memblock);
+        if (!peek_at(bq, &i, ri, &chunks[k]))
+            break;
 
-    pa_assert(bq->read_index >= bq->current_read->index);
-    d = bq->read_index - bq->current_read->index;
-    chunk->index += (size_t) d;
-    chunk->length -= (size_t) d;
+        if (chunks[k].length > length)
+            chunks[k].length = length;
 
-    return 0;
+        if (chunks[k].memblock)
+            pa_memblock_ref(chunks[k].memblock);
+
+        ri += (int64_t) chunks[k].length;
+        length -= chunks[k].length;
+    }
+
+    return k;
 }
 
 int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchunk *chunk) {
     pa_mempool *pool;
     pa_memchunk tchunk, rchunk;
     int64_t ri;
-    struct list_item *item;
+    unsigned i;
 
     pa_assert(bq);
     pa_assert(block_size > 0);
@@ -562,31 +661,13 @@ int pa_memblockq_peek_fixed_size(pa_memblockq *bq, size_t block_size, pa_memchun
 
     /* We don't need to call fix_current_read() here, since
      * pa_memblock_peek() already did that */
-    item = bq->current_read;
+    i = bq->current_read;
     ri = bq->read_index + tchunk.length;
 
     while (rchunk.index < block_size) {
 
-        if (!item || item->index > ri) {
-            /* Do we need to append silence? */
-            tchunk = bq->silence;
-
-            if (item)
-                tchunk.length = PA_MIN(tchunk.length, (size_t) (item->index - ri));
-
-        } else {
-            int64_t d;
-
-            /* We can append real data! */
-            tchunk = item->chunk;
-
-            d = ri - item->index;
-            tchunk.index += (size_t) d;
-            tchunk.length -= (size_t) d;
-
-            /* Go to next item for the next iteration */
-            item = item->next;
-        }
+        /* With a silence block configured this never fails */
+        pa_assert_se(peek_at(bq, &i, ri, &tchunk));
 
         rchunk.length = tchunk.length = PA_MIN(tchunk.length, block_size - rchunk.index);
         pa_memchunk_memcpy(&rchunk, &tchunk);
@@ -617,13 +698,13 @@ void pa_memblockq_drop(pa_memblockq *bq, size_t length) {
 
         fix_current_read(bq);
 
-        if (bq->current_read) {
+        if (bq->current_read < bq->n_blocks) {
             int64_t p, d;
 
             /* We go through this piece by piece to make sure we don't
              * drop more than allowed by prebuf */
 
-            p = bq->current_read->index + (int64_t) bq->current_read->chunk.length;
+            p = block_end(get_block(bq, bq->current_read));
             pa_assert(p >= bq->read_index);
             d = p - bq->read_index;
 
@@ -697,7 +778,7 @@ void pa_memblockq_seek(pa_memblockq *bq, int64_t offset, pa_seek_mode_t seek, bo
             bq->write_index = bq->read_index + offset;
             break;
         case PA_SEEK_RELATIVE_END:
-            bq->write_index = (bq->blocks_tail ? bq->blocks_tail->index + (int64_t) bq->blocks_tail->chunk.length : bq->read_index) + offset;
+            bq->write_index = (bq->n_blocks > 0 ? block_end(get_block(bq, bq->n_blocks - 1)) : bq->read_index) + offset;
             break;
         default:
             pa_assert_not_reached();
@@ -968,14 +1049,14 @@ int pa_memblockq_splice(pa_memblockq *bq, pa_memblockq *source) {
 }
 
 void pa_memblockq_willneed(pa_memblockq *bq) {
-    struct list_item *q;
+    unsigned i;
 
     pa_assert(bq);
 
     fix_current_read(bq);
 
-    for (q = bq->current_read; q; q = q->next)
-        pa_memchunk_will_need(&q->chunk);
+    for (i = bq->current_read; i < bq->n_blocks; i++)
+        pa_memchunk_will_need(&get_block(bq, i)->chunk);
 }
 
 void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
@@ -994,16 +1075,16 @@ void pa_memblockq_set_silence(pa_memblockq *bq, pa_memchunk *silence) {
 bool pa_memblockq_is_empty(pa_memblockq *bq) {
     pa_assert(bq);
 
-    return !bq->blocks;
+    return bq->n_blocks == 0;
 }
 
 void pa_memblockq_silence(pa_memblockq *bq) {
     pa_assert(bq);
 
-    while (bq->blocks)
-        drop_block(bq, bq->blocks);
+    while (bq->n_blocks > 0)
+        drop_block(bq, bq->n_blocks - 1);
 
-    pa_assert(bq->n_blocks == 0);
+    bq->first = 0;
 }
 
 unsigned pa_memblockq_get_nblocks(pa_memblockq *bq) {
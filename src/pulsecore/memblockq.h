@@ -95,6 +95,13 @@ void pa_memblockq_seek(pa_memblockq *bq, int64_t offset, pa_seek_mode_t seek, bo
  * was passed we return the length of the hole in chunk->length. */
 int pa_memblockq_peek(pa_memblockq* bq, pa_memchunk *chunk);
 
+/* Like calling pa_memblockq_peek() and pa_memblockq_drop() repeatedly,
+ * but without dropping anything: fills in up to n chunks that follow
+ * each other, covering at most length bytes. Prebuffering is only
+ * checked for the first one. Each chunk carries its own reference.
+ * Returns the number of chunks filled in. */
+unsigned pa_memblockq_peek_many(pa_memblockq *bq, pa_memchunk *chunks, unsigned n, size_t length);
+
 /* Much like pa_memblockq_peek, but guarantees that the returned chunk
  * will have a length of the block size passed. You must configure a
  * silence memchunk for this memblockq if you use this call. */
@@ -610,6 +610,21 @@ void pa_mix_func_init(const pa_cpu_info *cpu_info) {
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_generic_s16ne;
     else
         do_mix_table[PA_SAMPLE_S16NE] = (pa_do_mix_func_t) pa_mix_s16ne_c;
+
+    do_mix_table[PA_SAMPLE_S32NE] = (pa_do_mix_func_t) pa_mix_s32ne_c;
+    do_mix_table[PA_SAMPLE_FLOAT32NE] = (pa_do_mix_func_t) pa_mix_float32ne_c;
+
+    if (cpu_info->force_generic_code || cpu_info->cpu_type != PA_CPU_X86)
+        return;
+
+    /* Pick the widest instruction set available, later calls override the
+     * table entries set by earlier ones */
+#ifdef HAVE_AVX2
+    pa_mix_func_init_avx2(cpu_info->flags.x86);
+#endif
+#ifdef HAVE_AVX512
+    pa_mix_func_init_avx512(cpu_info->flags.x86);
+#endif
 }
 
 size_t pa_mix(
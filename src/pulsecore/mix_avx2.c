@@ -0,0 +1,261 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/sample-util.h>
+
+#include "cpu-x86.h"
+#include "mix.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* The streams are summed block by block into an accumulator that stays in
+ * L1. A block always starts on the first channel and is a multiple of the
+ * volume pattern length, i.e. the least common multiple of the number of
+ * channels and the number of vector lanes, so the per-lane volumes of a
+ * stream can be laid out once per block and loaded with plain vector loads. */
+#define BLOCK_SAMPLES 1024
+#define PATTERN_MAX (PA_CHANNELS_MAX * 8)
+
+static unsigned pattern_length(unsigned channels, unsigned lanes) {
+    unsigned a = channels, b = lanes;
+
+    while (b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return channels / a * lanes;
+}
+
+static unsigned block_length(unsigned pattern) {
+    unsigned n = BLOCK_SAMPLES / pattern;
+
+    return PA_MAX(n, 1U) * pattern;
+}
+
+static bool stream_is_muted_i(const pa_mix_info *m, unsigned channels) {
+    unsigned c;
+
+    for (c = 0; c < channels; c++)
+        if (m->linear[c].i > 0)
+            return false;
+
+    return true;
+}
+
+static bool stream_is_muted_f(const pa_mix_info *m, unsigned channels) {
+    unsigned c;
+
+    for (c = 0; c < channels; c++)
+        if (m->linear[c].f > 0)
+            return false;
+
+    return true;
+}
+
+static void pa_mix_s16ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int16_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, acc[BLOCK_SAMPLES]);
+    PA_DECLARE_ALIGNED(32, int32_t, vol_lo[PATTERN_MAX]);
+    PA_DECLARE_ALIGNED(32, int32_t, vol_hi[PATTERN_MAX]);
+    unsigned pattern, block, offset, i, j;
+
+    length /= sizeof(int16_t);
+    pattern = pattern_length(channels, 8);
+    block = block_length(pattern);
+
+    for (offset = 0; offset < length; offset += block) {
+        unsigned n = PA_MIN(block, length - offset);
+        unsigned nvec = n & ~7U;
+
+        memset(acc, 0, n * sizeof(int32_t));
+
+        for (i = 0; i < nstreams; i++) {
+            const int16_t *src = (const int16_t *) streams[i].ptr + offset;
+
+            if (stream_is_muted_i(&streams[i], channels))
+                continue;
+
+            /* Split the volume the same way pa_mult_s16_volume() does on
+             * 32 bit platforms so that all products fit in 32 bits. */
+            for (j = 0; j < pattern; j++) {
+                int32_t cv = streams[i].linear[j % channels].i;
+                vol_lo[j] = cv & 0xFFFF;
+                vol_hi[j] = cv >> 16;
+            }
+
+            for (j = 0; j < nvec; j += 8) {
+                unsigned p = j % pattern;
+                __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *) (src + j)));
+                __m256i lo = _mm256_srai_epi32(_mm256_mullo_epi32(v, _mm256_load_si256((const __m256i *) (vol_lo + p))), 16);
+                __m256i hi = _mm256_mullo_epi32(v, _mm256_load_si256((const __m256i *) (vol_hi + p)));
+                __m256i a = _mm256_load_si256((const __m256i *) (acc + j));
+
+                a = _mm256_add_epi32(a, _mm256_add_epi32(lo, hi));
+                _mm256_store_si256((__m256i *) (acc + j), a);
+            }
+
+            for (; j < n; j++)
+                acc[j] += pa_mult_s16_volume(src[j], streams[i].linear[j % channels].i);
+        }
+
+        for (j = 0; j + 16 <= nvec; j += 16) {
+            __m256i a = _mm256_load_si256((const __m256i *) (acc + j));
+            __m256i b = _mm256_load_si256((const __m256i *) (acc + j + 8));
+
+            /* packs saturates, which is exactly the clamp we need, but works
+             * per 128 bit lane, so restore the sample order afterwards */
+            a = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xd8);
+            _mm256_storeu_si256((__m256i *) (data + offset + j), a);
+        }
+
+        for (; j < n; j++)
+            data[offset + j] = (int16_t) PA_CLAMP_UNLIKELY(acc[j], -0x8000, 0x7FFF);
+    }
+
+    for (i = 0; i < nstreams; i++)
+        streams[i].ptr = (uint8_t *) streams[i].ptr + length * sizeof(int16_t);
+}
+
+static void pa_mix_s32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, int32_t *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int64_t, acc[BLOCK_SAMPLES]);
+    PA_DECLARE_ALIGNED(32, int64_t, vol[PATTERN_MAX]);
+    const __m256i sign_bits = _mm256_set1_epi64x((int64_t) 0xFFFF000000000000ULL);
+    const __m256i max = _mm256_set1_epi64x(0x7FFFFFFFLL);
+    const __m256i min = _mm256_set1_epi64x(-0x80000000LL);
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 0, 2, 4, 6);
+    unsigned pattern, block, offset, i, j;
+
+    length /= sizeof(int32_t);
+    pattern = pattern_length(channels, 4);
+    block = block_length(pattern);
+
+    for (offset = 0; offset < length; offset += block) {
+        unsigned n = PA_MIN(block, length - offset);
+        unsigned nvec = n & ~3U;
+
+        memset(acc, 0, n * sizeof(int64_t));
+
+        for (i = 0; i < nstreams; i++) {
+            const int32_t *src = (const int32_t *) streams[i].ptr + offset;
+
+            if (stream_is_muted_i(&streams[i], channels))
+                continue;
+
+            for (j = 0; j < pattern; j++)
+                vol[j] = streams[i].linear[j % channels].i;
+
+            for (j = 0; j < nvec; j += 4) {
+                __m256i v = _mm256_cvtepi32_epi64(_mm_loadu_si128((const __m128i *) (src + j)));
+                __m256i p = _mm256_mul_epi32(v, _mm256_load_si256((const __m256i *) (vol + j % pattern)));
+                __m256i a = _mm256_load_si256((const __m256i *) (acc + j));
+
+                /* AVX2 has no 64 bit arithmetic shift, so put the sign
+                 * bits back in by hand */
+                p = _mm256_or_si256(_mm256_srli_epi64(p, 16),
+                                    _mm256_and_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), p), sign_bits));
+
+                _mm256_store_si256((__m256i *) (acc + j), _mm256_add_epi64(a, p));
+            }
+
+            for (; j < n; j++)
+                acc[j] += ((int64_t) src[j] * streams[i].linear[j % channels].i) >> 16;
+        }
+
+        for (j = 0; j < nvec; j += 4) {
+            __m256i a = _mm256_load_si256((const __m256i *) (acc + j));
+
+            a = _mm256_blendv_epi8(a, max, _mm256_cmpgt_epi64(a, max));
+            a = _mm256_blendv_epi8(a, min, _mm256_cmpgt_epi64(min, a));
+            a = _mm256_permutevar8x32_epi32(a, even);
+            _mm_storeu_si128((__m128i *) (data + offset + j), _mm256_castsi256_si128(a));
+        }
+
+        for (; j < n; j++)
+            data[offset + j] = (int32_t) PA_CLAMP_UNLIKELY(acc[j], -0x80000000LL, 0x7FFFFFFFLL);
+    }
+
+    for (i = 0; i < nstreams; i++)
+        streams[i].ptr = (uint8_t *) streams[i].ptr + length * sizeof(int32_t);
+}
+
+static void pa_mix_float32ne_avx2(pa_mix_info streams[], unsigned nstreams, unsigned channels, float *data, unsigned length) {
+    PA_DECLARE_ALIGNED(32, float, acc[BLOCK_SAMPLES]);
+    PA_DECLARE_ALIGNED(32, float, vol[PATTERN_MAX]);
+    unsigned pattern, block, offset, i, j;
+
+    length /= sizeof(float);
+    pattern = pattern_length(channels, 8);
+    block = block_length(pattern);
+
+    for (offset = 0; offset < length; offset += block) {
+        unsigned n = PA_MIN(block, length - offset);
+        unsigned nvec = n & ~7U;
+
+        memset(acc, 0, n * sizeof(float));
+
+        for (i = 0; i < nstreams; i++) {
+            const float *src = (const float *) streams[i].ptr + offset;
+
+            if (stream_is_muted_f(&streams[i], channels))
+                continue;
+
+            for (j = 0; j < pattern; j++)
+                vol[j] = streams[i].linear[j % channels].f;
+
+            /* Multiply and add separately rather than using FMA so that the
+             * result is bit exact with the generic code */
+            for (j = 0; j < nvec; j += 8) {
+                __m256 v = _mm256_mul_ps(_mm256_loadu_ps(src + j), _mm256_load_ps(vol + j % pattern));
+
+                _mm256_store_ps(acc + j, _mm256_add_ps(_mm256_load_ps(acc + j), v));
+            }
+
+            for (; j < n; j++)
+                acc[j] += src[j] * streams[i].linear[j % channels].f;
+        }
+
+        memcpy(data + offset, acc, n * sizeof(float));
+    }
+
+    for (i = 0; i < nstreams; i++)
+        streams[i].ptr = (uint8_t *) streams[i].ptr + length * sizeof(float);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_mix_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized mixing functions.");
+
+        pa_set_mix_func(PA_SAMPLE_S16NE, (pa_do_mix_func_t) pa_mix_s16ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_S32NE, (pa_do_mix_func_t) pa_mix_s32ne_avx2);
+        pa_set_mix_func(PA_SAMPLE_FLOAT32NE, (pa_do_mix_func_t) pa_mix_float32ne_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -190,6 +190,9 @@ enum {
     /* Supported since protocol v34 (14.0) */
     PA_COMMAND_SEND_OBJECT_MESSAGE,
 
+    /* Supported since protocol v36 (18.0) */
+    PA_COMMAND_GET_SNAPSHOT,
+
     PA_COMMAND_MAX
 };
 
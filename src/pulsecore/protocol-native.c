@@ -27,6 +27,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <pulse/mainloop.h>
 #include <pulse/rtclock.h>
 #include <pulse/timeval.h>
 #include <pulse/version.h>
@@ -56,6 +57,7 @@
 #include <pulsecore/creds.h>
 #include <pulsecore/core-util.h>
 #include <pulsecore/ipacl.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/thread-mq.h>
 #include <pulsecore/mem.h>
 
@@ -69,6 +71,9 @@
 /* Don't accept more connection than this */
 #define MAX_CONNECTIONS 64
 
+/* Don't start more I/O worker threads than this */
+#define MAX_WORKERS 16
+
 #define MAX_MEMBLOCKQ_LENGTH (4*1024*1024) /* 4MB */
 #define DEFAULT_TLENGTH_MSEC 2000 /* 2s */
 #define DEFAULT_PROCESS_MSEC 20   /* 20ms */
@@ -168,6 +173,22 @@ typedef struct upload_stream {
 #define UPLOAD_STREAM(o) (upload_stream_cast(o))
 PA_DEFINE_PRIVATE_CLASS(upload_stream, output_stream);
 
+/* A thread that does the socket I/O, framing and SHM import for some of
+ * the connections. Packets and memblocks are still handled in the main
+ * loop, they are just passed on to it through the worker's outq. */
+typedef struct native_worker {
+    pa_msgobject parent;
+
+    pa_thread *thread;
+    pa_mainloop *mainloop;
+    pa_thread_mq mq;
+
+    unsigned n_connections;
+} native_worker;
+
+#define NATIVE_WORKER(o) (native_worker_cast(o))
+PA_DEFINE_PRIVATE_CLASS(native_worker, pa_msgobject);
+
 struct pa_native_connection {
     pa_msgobject parent;
     pa_native_protocol *protocol;
@@ -189,6 +210,9 @@ struct pa_native_connection {
     pa_subscription *subscription;
     pa_time_event *auth_timeout_event;
     pa_srbchannel *srbpending;
+
+    /* NULL if the pstream is serviced by the main loop */
+    native_worker *worker;
 };
 
 #define PA_NATIVE_CONNECTION(o) (pa_native_connection_cast(o))
@@ -204,6 +228,9 @@ struct pa_native_protocol {
     pa_hook hooks[PA_NATIVE_HOOK_MAX];
 
     pa_hashmap *extensions;
+
+    native_worker *workers[MAX_WORKERS];
+    unsigned n_workers;
 };
 
 enum {
@@ -236,7 +263,41 @@ enum {
 
 enum {
     CONNECTION_MESSAGE_RELEASE,
-    CONNECTION_MESSAGE_REVOKE
+    CONNECTION_MESSAGE_REVOKE,
+    CONNECTION_MESSAGE_PACKET,   /* pstream events from a worker thread to the main loop */
+    CONNECTION_MESSAGE_MEMBLOCK,
+    CONNECTION_MESSAGE_DRAIN,
+    CONNECTION_MESSAGE_DIE,
+    CONNECTION_MESSAGE_CONNECT_FAILED,
+    CONNECTION_MESSAGE_UNLINKED,
+    CONNECTION_MESSAGE_MAX
+};
+
+enum {
+    WORKER_MESSAGE_CONNECT,      /* from the main loop to a worker thread */
+    WORKER_MESSAGE_UNLINK,
+    WORKER_MESSAGE_RELEASE,
+    WORKER_MESSAGE_REVOKE,
+    WORKER_MESSAGE_STOPPED = CONNECTION_MESSAGE_MAX /* from a worker thread to the main loop */
+};
+
+struct worker_connect {
+    pa_native_connection *connection;
+    pa_mempool *pool;
+    int ifd, ofd;
+};
+
+struct worker_packet {
+    pa_packet *packet;
+#ifdef HAVE_CREDS
+    pa_cmsg_ancil_data ancil_data;
+#endif
+};
+
+struct worker_memblock {
+    uint32_t channel;
+    pa_seek_mode_t seek;
+    pa_memchunk chunk;
 };
 
 static bool sink_input_process_underrun_cb(pa_sink_input *i);
@@ -249,7 +310,12 @@ static void sink_input_update_max_rewind_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_update_max_request_cb(pa_sink_input *i, size_t nbytes);
 static void sink_input_send_event_cb(pa_sink_input *i, const char *event, pa_proplist *pl);
 
+static void native_connection_unlink(pa_native_connection *c);
 static void native_connection_send_memblock(pa_native_connection *c);
+static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata);
+static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek, const pa_memchunk *chunk, void *userdata);
+static void pstream_die_callback(pa_pstream *p, void *userdata);
+static void pstream_drain_callback(pa_pstream *p, void *userdata);
 static void playback_stream_request_bytes(struct playback_stream*s);
 
 static void source_output_kill_cb(pa_source_output *o);
@@ -1168,6 +1234,37 @@ static int native_connection_process_msg(pa_msgobject *o, int code, void*userdat
         case CONNECTION_MESSAGE_RELEASE:
             pa_pstream_send_release(c->pstream, PA_PTR_TO_UINT(userdata));
             break;
+
+        case CONNECTION_MESSAGE_PACKET: {
+            struct worker_packet *wp = userdata;
+
+#ifdef HAVE_CREDS
+            pstream_packet_callback(c->pstream, wp->packet, &wp->ancil_data, c);
+#else
+            pstream_packet_callback(c->pstream, wp->packet, NULL, c);
+#endif
+            break;
+        }
+
+        case CONNECTION_MESSAGE_MEMBLOCK: {
+            struct worker_memblock *wm = userdata;
+
+            pstream_memblock_callback(c->pstream, wm->channel, offset, wm->seek, &wm->chunk, c);
+            break;
+        }
+
+        case CONNECTION_MESSAGE_DRAIN:
+            pstream_drain_callback(c->pstream, c);
+            break;
+
+        case CONNECTION_MESSAGE_DIE:
+            pstream_die_callback(c->pstream, c);
+            break;
+
+        case CONNECTION_MESSAGE_CONNECT_FAILED:
+            native_connection_unlink(c);
+            pa_log_warn("Failed to hand connection over to a worker thread.");
+            break;
     }
 
     return 0;
@@ -1203,7 +1300,15 @@ static void native_connection_unlink(pa_native_connection *c) {
     if (c->subscription)
         pa_subscription_free(c->subscription);
 
-    if (c->pstream)
+    if (c->worker) {
+        /* The pstream's I/O events belong to the worker's mainloop, and
+         * until it has unlinked the pstream the worker may still call
+         * back into us. We don't wait for that, since the worker might
+         * itself be waiting for room in its outq. Instead it drops our
+         * extra reference from the main loop once it is done. */
+        pa_asyncmsgq_post(c->worker->mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_UNLINK, pa_native_connection_ref(c), 0, NULL, NULL);
+        c->worker->n_connections--;
+    } else if (c->pstream)
         pa_pstream_unlink(c->pstream);
 
     if (c->auth_timeout_event) {
@@ -1228,7 +1333,8 @@ static void native_connection_free(pa_object *o) {
     pa_idxset_free(c->output_streams, NULL);
 
     pa_pdispatch_unref(c->pdispatch);
-    pa_pstream_unref(c->pstream);
+    if (c->pstream)
+        pa_pstream_unref(c->pstream);
     if (c->rw_mempool)
         pa_mempool_unref(c->rw_mempool);
 
@@ -1420,7 +1526,7 @@ static int sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int
             /* Atomically get a snapshot of all timing parameters... */
             s->read_index = pa_memblockq_get_read_index(s->memblockq);
             s->write_index = pa_memblockq_get_write_index(s->memblockq);
-            s->render_memblockq_length = pa_memblockq_get_length(s->sink_input->thread_info.render_memblockq);
+            s->render_memblockq_length = pa_sink_input_get_render_length(s->sink_input);
             s->current_sink_latency = pa_sink_get_latency_within_thread(s->sink_input->sink, false);
             /* Add resampler latency */
             s->current_sink_latency += pa_resampler_get_delay_usec(i->thread_info.resampler);
@@ -2484,6 +2590,11 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
         return;
     }
 
+    if (c->worker) {
+        pa_log_debug("Disabling srbchannel, reason: Connection is serviced by a worker thread");
+        return;
+    }
+
     if (c->version < 30) {
         pa_log_debug("Disabling srbchannel, reason: Protocol too old");
         return;
@@ -2500,7 +2611,18 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
         return;
     }
 
-    if (!(c->rw_mempool = pa_mempool_new(shm_type, c->protocol->core->shm_size, true))) {
+    /* Nothing but the srbchannel lives in this pool, so if the ring size
+     * is configured, make that the only slot size */
+    if (c->options->srbchannel_size > 0) {
+        size_t ring_size = c->options->srbchannel_size;
+
+        c->rw_mempool = pa_mempool_new_full(shm_type, c->protocol->core->shm_size, true, c->protocol->core->mempool_flags,
+                                            &ring_size, 1);
+    } else
+        c->rw_mempool = pa_mempool_new_full(shm_type, c->protocol->core->shm_size, true, c->protocol->core->mempool_flags,
+                                            c->protocol->core->mempool_slot_sizes, c->protocol->core->n_mempool_slot_sizes);
+
+    if (!c->rw_mempool) {
         pa_log_warn("Disabling srbchannel, reason: Failed to allocate shared "
                     "writable memory pool.");
         return;
@@ -2520,13 +2642,15 @@ static void setup_srbchannel(pa_native_connection *c, pa_mem_type_t shm_type) {
         pa_log_debug("Failed to create srbchannel");
         goto fail;
     }
-    pa_log_debug("Enabling srbchannel...");
+    pa_log_debug("Enabling srbchannel, ring capacity 2 * %zu bytes...", pa_srbchannel_get_capacity(srb));
     pa_srbchannel_export(srb, &srbt);
 
     /* Send enable command to client */
     t = pa_tagstruct_new();
     pa_tagstruct_putu32(t, PA_COMMAND_ENABLE_SRBCHANNEL);
     pa_tagstruct_putu32(t, (size_t) srb); /* tag */
+    if (c->version >= 36)
+        pa_tagstruct_putu32(t, c->options->srbchannel_busy_poll_usec);
     fdlist[0] = srbt.readfd;
     fdlist[1] = srbt.writefd;
     pa_pstream_send_tagstruct_with_fds(c->pstream, t, 2, fdlist, false);
@@ -2549,13 +2673,24 @@ fail:
 
 static void command_enable_srbchannel(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    uint32_t busy_poll_usec = 0;
 
     if (tag != (uint32_t) (size_t) c->srbpending) {
         protocol_error(c);
         return;
     }
 
-    pa_log_debug("Client enabled srbchannel.");
+    if (c->version >= 36) {
+        if (pa_tagstruct_getu32(t, &busy_poll_usec) < 0 ||
+            busy_poll_usec > c->options->srbchannel_busy_poll_usec ||
+            !pa_tagstruct_eof(t)) {
+            protocol_error(c);
+            return;
+        }
+    }
+
+    pa_log_debug("Client enabled srbchannel, busy poll %u usec.", busy_poll_usec);
+    pa_srbchannel_set_busy_poll(c->srbpending, busy_poll_usec);
     pa_pstream_set_srbchannel(c->pstream, c->srbpending);
     c->srbpending = NULL;
 }
@@ -3675,6 +3810,162 @@ static void command_get_info_list(pa_pdispatch *pd, uint32_t command, uint32_t t
     pa_pstream_send_tagstruct(c->pstream, reply);
 }
 
+static pa_idxset *facility_objects(pa_core *core, pa_subscription_event_type_t facility) {
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            return core->sinks;
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            return core->sources;
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            return core->sink_inputs;
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            return core->source_outputs;
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            return core->modules;
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            return core->clients;
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE:
+            return core->scache;
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            return core->cards;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+static void facility_fill_tagstruct(pa_native_connection *c, pa_tagstruct *t, pa_subscription_event_type_t facility, void *p) {
+    switch (facility) {
+        case PA_SUBSCRIPTION_EVENT_SINK:
+            sink_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE:
+            source_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_SINK_INPUT:
+            sink_input_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT:
+            source_output_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_MODULE:
+            module_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_CLIENT:
+            client_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE:
+            scache_fill_tagstruct(c, t, p);
+            break;
+        case PA_SUBSCRIPTION_EVENT_CARD:
+            card_fill_tagstruct(c, t, p);
+            break;
+        default:
+            pa_assert_not_reached();
+    }
+}
+
+/* Replies with the objects of several facilities at once. Either all of
+ * them, or, if the client passes the sequence number of an earlier
+ * snapshot and the subscription journal still reaches back that far,
+ * only those that were touched since, plus the indexes of those that
+ * are gone. Each facility's objects are wrapped in a blob that has the
+ * same layout as the reply to the respective GET_*_INFO_LIST command. */
+static void command_get_snapshot(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
+    static const pa_subscription_event_type_t facilities[] = {
+        PA_SUBSCRIPTION_EVENT_MODULE,
+        PA_SUBSCRIPTION_EVENT_CLIENT,
+        PA_SUBSCRIPTION_EVENT_CARD,
+        PA_SUBSCRIPTION_EVENT_SINK,
+        PA_SUBSCRIPTION_EVENT_SOURCE,
+        PA_SUBSCRIPTION_EVENT_SINK_INPUT,
+        PA_SUBSCRIPTION_EVENT_SOURCE_OUTPUT,
+        PA_SUBSCRIPTION_EVENT_SAMPLE_CACHE
+    };
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
+    pa_core *core = c->protocol->core;
+    uint32_t mask;
+    uint64_t since;
+    bool full;
+    pa_tagstruct *reply;
+    pa_idxset *touched;
+    unsigned k;
+
+    pa_native_connection_assert_ref(c);
+    pa_assert(t);
+
+    if (pa_tagstruct_getu32(t, &mask) < 0 ||
+        pa_tagstruct_getu64(t, &since) < 0 ||
+        !pa_tagstruct_eof(t)) {
+        protocol_error(c);
+        return;
+    }
+
+    CHECK_VALIDITY(c->pstream, c->authorized, tag, PA_ERR_ACCESS);
+    CHECK_VALIDITY(c->pstream, (mask & ~PA_SUBSCRIPTION_MASK_ALL) == 0, tag, PA_ERR_INVALID);
+
+    touched = pa_idxset_new(NULL, NULL);
+
+    /* Check if a delta is possible at all before writing anything */
+    full = since == 0;
+    for (k = 0; k < PA_ELEMENTSOF(facilities) && !full; k++)
+        if (pa_subscription_match_flags(mask, facilities[k]) &&
+            pa_subscription_get_changes(core, since, facilities[k], touched) < 0)
+            full = true;
+
+    reply = reply_new(tag);
+    pa_tagstruct_putu64(reply, pa_subscription_get_seq(core));
+    pa_tagstruct_put_boolean(reply, full);
+
+    for (k = 0; k < PA_ELEMENTSOF(facilities); k++) {
+        pa_subscription_event_type_t f = facilities[k];
+        pa_idxset *objects = facility_objects(core, f);
+        pa_tagstruct *list;
+        const uint8_t *data;
+        size_t length;
+        uint32_t idx, n_removed = 0;
+        void *p;
+
+        if (!pa_subscription_match_flags(mask, f))
+            continue;
+
+        list = pa_tagstruct_new();
+        pa_idxset_remove_all(touched, NULL);
+
+        if (full) {
+            if (objects)
+                PA_IDXSET_FOREACH(p, objects, idx)
+                    facility_fill_tagstruct(c, list, f, p);
+        } else {
+            pa_assert_se(pa_subscription_get_changes(core, since, f, touched) >= 0);
+
+            PA_IDXSET_FOREACH(p, touched, idx) {
+                void *o = objects ? pa_idxset_get_by_index(objects, PA_PTR_TO_UINT32(p) - 1) : NULL;
+
+                if (o)
+                    facility_fill_tagstruct(c, list, f, o);
+                else
+                    n_removed++;
+            }
+        }
+
+        data = pa_tagstruct_data(list, &length);
+        pa_tagstruct_putu32(reply, f);
+        pa_tagstruct_putu32(reply, (uint32_t) length);
+        pa_tagstruct_put_arbitrary(reply, data, length);
+        pa_tagstruct_free(list);
+
+        pa_tagstruct_putu32(reply, n_removed);
+        if (n_removed > 0)
+            PA_IDXSET_FOREACH(p, touched, idx)
+                if (!objects || !pa_idxset_get_by_index(objects, PA_PTR_TO_UINT32(p) - 1))
+                    pa_tagstruct_putu32(reply, PA_PTR_TO_UINT32(p) - 1);
+    }
+
+    pa_idxset_free(touched, NULL);
+
+    pa_pstream_send_tagstruct(c->pstream, reply);
+}
+
 static void command_get_server_info(pa_pdispatch *pd, uint32_t command, uint32_t tag, pa_tagstruct *t, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_tagstruct *reply;
@@ -5037,12 +5328,37 @@ static const pa_pdispatch_cb_t command_table[PA_COMMAND_MAX] = {
     [PA_COMMAND_REGISTER_MEMFD_SHMID] = command_register_memfd_shmid,
 
     [PA_COMMAND_SEND_OBJECT_MESSAGE] = command_send_object_message,
+    [PA_COMMAND_GET_SNAPSHOT] = command_get_snapshot,
 
     [PA_COMMAND_EXTENSION] = command_extension
 };
 
 /*** pstream callbacks ***/
 
+/* The pstream callbacks of connections that are serviced by a worker
+ * are called in the worker thread, and just pass everything on to the
+ * main loop, where the same callbacks are called once more. */
+static bool in_worker(pa_native_connection *c) {
+    return c->worker && pa_thread_mq_get() == &c->worker->mq;
+}
+
+static void worker_packet_free(void *userdata) {
+    struct worker_packet *wp = userdata;
+
+    pa_packet_unref(wp->packet);
+#ifdef HAVE_CREDS
+    /* In case nobody took the fds */
+    pa_cmsg_ancil_data_close_fds(&wp->ancil_data);
+#endif
+}
+
+static void worker_memblock_free(void *userdata) {
+    struct worker_memblock *wm = userdata;
+
+    if (wm->chunk.memblock)
+        pa_memblock_unref(wm->chunk.memblock);
+}
+
 static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
     pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
 
@@ -5050,6 +5366,23 @@ static void pstream_packet_callback(pa_pstream *p, pa_packet *packet, pa_cmsg_an
     pa_assert(packet);
     pa_native_connection_assert_ref(c);
 
+    if (in_worker(c)) {
+        struct worker_packet wp;
+
+        pa_zero(wp);
+        wp.packet = pa_packet_ref(packet);
+#ifdef HAVE_CREDS
+        if (ancil_data) {
+            /* The fds are ours now, the pstream forgets about them */
+            wp.ancil_data = *ancil_data;
+            ancil_data->nfd = 0;
+        }
+#endif
+
+        pa_asyncmsgq_post_data(c->worker->mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_PACKET, &wp, sizeof(wp), 0, NULL, worker_packet_free);
+        return;
+    }
+
     if (pa_pdispatch_run(c->pdispatch, packet, ancil_data, c) < 0) {
         pa_log("invalid packet.");
         native_connection_unlink(c);
@@ -5064,6 +5397,20 @@ static void pstream_memblock_callback(pa_pstream *p, uint32_t channel, int64_t o
     pa_assert(chunk);
     pa_native_connection_assert_ref(c);
 
+    if (in_worker(c)) {
+        struct worker_memblock wm;
+
+        wm.channel = channel;
+        wm.seek = seek;
+        wm.chunk = *chunk;
+        if (wm.chunk.memblock)
+            pa_memblock_ref(wm.chunk.memblock);
+
+        /* Small enough to travel inside the message itself */
+        pa_asyncmsgq_post_data(c->worker->mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_MEMBLOCK, &wm, sizeof(wm), offset, NULL, worker_memblock_free);
+        return;
+    }
+
     if (!(stream = OUTPUT_STREAM(pa_idxset_get_by_index(c->output_streams, channel)))) {
         pa_log_debug("Client sent block for invalid stream.");
         /* Ignoring */
@@ -5143,6 +5490,11 @@ static void pstream_die_callback(pa_pstream *p, void *userdata) {
     pa_assert(p);
     pa_native_connection_assert_ref(c);
 
+    if (in_worker(c)) {
+        pa_asyncmsgq_post(c->worker->mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DIE, NULL, 0, NULL, NULL);
+        return;
+    }
+
     native_connection_unlink(c);
     pa_log_info("Connection died.");
 }
@@ -5153,25 +5505,198 @@ static void pstream_drain_callback(pa_pstream *p, void *userdata) {
     pa_assert(p);
     pa_native_connection_assert_ref(c);
 
+    if (in_worker(c)) {
+        pa_asyncmsgq_post(c->worker->mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_DRAIN, NULL, 0, NULL, NULL);
+        return;
+    }
+
     native_connection_send_memblock(c);
 }
 
+/* For connections serviced by a worker the memexport lock may be held
+ * here, which the worker takes while holding the pstream lock. Hence
+ * don't lock the pstream from the main loop, let the worker do it. */
 static void pstream_revoke_callback(pa_pstream *p, uint32_t block_id, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_thread_mq *q;
 
-    if (!(q = pa_thread_mq_get()))
-        pa_pstream_send_revoke(p, block_id);
+    if ((q = pa_thread_mq_get()))
+        pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_REVOKE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
+    else if (c->worker)
+        pa_asyncmsgq_post(c->worker->mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_REVOKE, pa_pstream_ref(p), block_id, NULL, (pa_free_cb_t) pa_pstream_unref);
     else
-        pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_REVOKE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
+        pa_pstream_send_revoke(p, block_id);
 }
 
 static void pstream_release_callback(pa_pstream *p, uint32_t block_id, void *userdata) {
+    pa_native_connection *c = PA_NATIVE_CONNECTION(userdata);
     pa_thread_mq *q;
 
-    if (!(q = pa_thread_mq_get()))
-        pa_pstream_send_release(p, block_id);
+    if ((q = pa_thread_mq_get()))
+        pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_RELEASE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
+    else if (c->worker)
+        pa_asyncmsgq_post(c->worker->mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_RELEASE, pa_pstream_ref(p), block_id, NULL, (pa_free_cb_t) pa_pstream_unref);
     else
-        pa_asyncmsgq_post(q->outq, PA_MSGOBJECT(userdata), CONNECTION_MESSAGE_RELEASE, PA_UINT_TO_PTR(block_id), 0, NULL, NULL);
+        pa_pstream_send_release(p, block_id);
+}
+
+/*** worker threads ***/
+
+/* Called from worker thread context */
+static int native_worker_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offset, pa_memchunk *chunk) {
+    native_worker *w = NATIVE_WORKER(o);
+
+    native_worker_assert_ref(w);
+
+    switch (code) {
+
+        case WORKER_MESSAGE_CONNECT: {
+            struct worker_connect *wc = userdata;
+            pa_native_connection *c = wc->connection;
+            pa_mainloop_api *api = pa_mainloop_get_api(w->mainloop);
+            pa_iochannel *io;
+
+            io = pa_iochannel_new(api, wc->ifd, wc->ofd);
+
+            if (!(c->pstream = pa_pstream_new_threaded(api, io, wc->pool))) {
+                pa_iochannel_free(io);
+                pa_asyncmsgq_post(w->mq.outq, PA_MSGOBJECT(c), CONNECTION_MESSAGE_CONNECT_FAILED, NULL, 0, NULL, NULL);
+                return -1;
+            }
+
+#ifdef HAVE_CREDS
+            if (pa_iochannel_creds_supported(io))
+                pa_iochannel_creds_enable(io);
+#endif
+
+            pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
+            pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
+            pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
+            pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
+            pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+            pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+            return 0;
+        }
+
+        case WORKER_MESSAGE_UNLINK: {
+            pa_native_connection *c = userdata;
+
+            if (c->pstream)
+                pa_pstream_unlink(c->pstream);
+
+            /* The last reference must be dropped in the main loop */
+            pa_asyncmsgq_post(w->mq.outq, NULL, CONNECTION_MESSAGE_UNLINKED, c, 0, NULL, (pa_free_cb_t) pa_native_connection_unref);
+            return 0;
+        }
+
+        case WORKER_MESSAGE_RELEASE:
+            pa_pstream_send_release(userdata, (uint32_t) offset);
+            return 0;
+
+        case WORKER_MESSAGE_REVOKE:
+            pa_pstream_send_revoke(userdata, (uint32_t) offset);
+            return 0;
+    }
+
+    return 0;
+}
+
+static void native_worker_thread_func(void *userdata) {
+    native_worker *w = userdata;
+
+    pa_assert(w);
+
+    pa_log_debug("Native protocol worker thread starting up");
+
+    pa_thread_mq_install(&w->mq);
+
+    /* Returns once we get PA_MESSAGE_SHUTDOWN */
+    if (pa_mainloop_run(w->mainloop, NULL) < 0)
+        pa_log_error("Native protocol worker mainloop failed.");
+
+    pa_asyncmsgq_post(w->mq.outq, NULL, WORKER_MESSAGE_STOPPED, NULL, 0, NULL, NULL);
+
+    pa_log_debug("Native protocol worker thread shutting down");
+}
+
+/* Called from main context */
+static void native_worker_free(pa_object *o) {
+    native_worker *w = NATIVE_WORKER(o);
+
+    pa_assert(w);
+
+    if (w->thread) {
+        /* Keep dispatching the outq until the thread is gone, it might
+         * be waiting for room in it */
+        pa_asyncmsgq_post(w->mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL, NULL);
+        pa_asyncmsgq_wait_for(w->mq.outq, WORKER_MESSAGE_STOPPED);
+        pa_thread_free(w->thread);
+    }
+
+    pa_thread_mq_done(&w->mq);
+
+    if (w->mainloop)
+        pa_mainloop_free(w->mainloop);
+
+    pa_xfree(w);
+}
+
+/* Called from main context */
+static native_worker *native_worker_new(pa_core *core, unsigned idx) {
+    native_worker *w;
+    char name[16];
+
+    w = pa_msgobject_new(native_worker);
+    w->parent.parent.free = native_worker_free;
+    w->parent.process_msg = native_worker_process_msg;
+    w->thread = NULL;
+    w->n_connections = 0;
+
+    w->mainloop = pa_mainloop_new();
+
+    if (pa_thread_mq_init_thread_mainloop(&w->mq, core->mainloop, pa_mainloop_get_api(w->mainloop)) < 0) {
+        pa_log("pa_thread_mq_init_thread_mainloop() failed.");
+        goto fail;
+    }
+
+    pa_snprintf(name, sizeof(name), "native-io%u", idx);
+
+    if (!(w->thread = pa_thread_new(name, native_worker_thread_func, w))) {
+        pa_log("Failed to create native protocol worker thread.");
+        goto fail;
+    }
+
+    return w;
+
+fail:
+    native_worker_unref(w);
+    return NULL;
+}
+
+/* Called from main context. Returns the least busy of the first n
+ * workers, starting them if necessary. */
+static native_worker *native_protocol_get_worker(pa_native_protocol *p, unsigned n) {
+    native_worker *w = NULL;
+    unsigned i;
+
+    pa_assert(n > 0 && n <= MAX_WORKERS);
+
+    while (p->n_workers < n) {
+        native_worker *nw;
+
+        if (!(nw = native_worker_new(p->core, p->n_workers)))
+            break;
+
+        p->workers[p->n_workers++] = nw;
+    }
+
+    n = PA_MIN(n, p->n_workers);
+
+    for (i = 0; i < n; i++)
+        if (!w || p->workers[i]->n_connections < w->n_connections)
+            w = p->workers[i];
+
+    return w;
 }
 
 /*** client callbacks ***/
@@ -5281,13 +5806,40 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     c->rw_mempool = NULL;
 
-    c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
-    pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
-    pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
-    pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
-    pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
-    pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
-    pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+    c->pstream = NULL;
+    c->worker = NULL;
+
+    if (o->workers > 0 && (c->worker = native_protocol_get_worker(p, o->workers))) {
+        struct worker_connect wc;
+
+        wc.connection = c;
+        wc.pool = p->core->mempool;
+        wc.ifd = pa_iochannel_get_recv_fd(io);
+        wc.ofd = pa_iochannel_get_send_fd(io);
+
+        /* The worker sets up its own iochannel on the same fds, and
+         * the pstream on top of it. Nothing but the worker touches
+         * c->pstream before the first message from it arrives. */
+        pa_asyncmsgq_post_data(c->worker->mq.inq, PA_MSGOBJECT(c->worker), WORKER_MESSAGE_CONNECT, &wc, sizeof(wc), 0, NULL, NULL);
+        pa_iochannel_set_noclose(io, true);
+        pa_iochannel_free(io);
+        c->worker->n_connections++;
+    }
+
+    if (!c->worker) {
+        c->pstream = pa_pstream_new(p->core->mainloop, io, p->core->mempool);
+        pa_pstream_set_receive_packet_callback(c->pstream, pstream_packet_callback, c);
+        pa_pstream_set_receive_memblock_callback(c->pstream, pstream_memblock_callback, c);
+        pa_pstream_set_die_callback(c->pstream, pstream_die_callback, c);
+        pa_pstream_set_drain_callback(c->pstream, pstream_drain_callback, c);
+        pa_pstream_set_revoke_callback(c->pstream, pstream_revoke_callback, c);
+        pa_pstream_set_release_callback(c->pstream, pstream_release_callback, c);
+
+#ifdef HAVE_CREDS
+        if (pa_iochannel_creds_supported(io))
+            pa_iochannel_creds_enable(io);
+#endif
+    }
 
     c->pdispatch = pa_pdispatch_new(p->core->mainloop, true, command_table, PA_COMMAND_MAX);
 
@@ -5299,11 +5851,6 @@ void pa_native_protocol_connect(pa_native_protocol *p, pa_iochannel *io, pa_nati
 
     pa_idxset_put(p->connections, c, NULL);
 
-#ifdef HAVE_CREDS
-    if (pa_iochannel_creds_supported(io))
-        pa_iochannel_creds_enable(io);
-#endif
-
     pa_hook_fire(&p->hooks[PA_NATIVE_HOOK_CONNECTION_PUT], c);
 }
 
@@ -5334,6 +5881,8 @@ static pa_native_protocol* native_protocol_new(pa_core *c) {
 
     p->extensions = pa_hashmap_new(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func);
 
+    p->n_workers = 0;
+
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
         pa_hook_init(&p->hooks[h], p);
 
@@ -5363,6 +5912,7 @@ pa_native_protocol* pa_native_protocol_ref(pa_native_protocol *p) {
 void pa_native_protocol_unref(pa_native_protocol *p) {
     pa_native_connection *c;
     pa_native_hook_t h;
+    unsigned i;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) >= 1);
@@ -5375,6 +5925,9 @@ void pa_native_protocol_unref(pa_native_protocol *p) {
 
     pa_idxset_free(p->connections, NULL);
 
+    for (i = 0; i < p->n_workers; i++)
+        native_worker_unref(p->workers[i]);
+
     pa_strlist_free(p->servers);
 
     for (h = 0; h < PA_NATIVE_HOOK_MAX; h++)
@@ -5490,6 +6043,29 @@ int pa_native_options_parse(pa_native_options *o, pa_core *c, pa_modargs *ma) {
         return -1;
     }
 
+    /* Busy polling burns CPU time in the thread that serves the
+     * connection, on behalf of the client, so it is off unless the
+     * server admin allows it */
+    o->srbchannel_busy_poll_usec = 0;
+    if (pa_modargs_get_value_u32(ma, "srbchannel-busy-poll-usec", &o->srbchannel_busy_poll_usec) < 0 ||
+        o->srbchannel_busy_poll_usec > PA_USEC_PER_MSEC * 10) {
+        pa_log("srbchannel-busy-poll-usec= expects a number of microseconds between 0 and %u.", (unsigned) PA_USEC_PER_MSEC * 10);
+        return -1;
+    }
+
+    o->srbchannel_size = 0;
+    if (pa_modargs_get_value_u32(ma, "srbchannel-size", &o->srbchannel_size) < 0 ||
+        (o->srbchannel_size > 0 && (o->srbchannel_size < 4096 || o->srbchannel_size > 16*1024*1024))) {
+        pa_log("srbchannel-size= expects a number of bytes between 4096 and %u, or 0 for the default.", 16*1024*1024);
+        return -1;
+    }
+
+    o->workers = 0;
+    if (pa_modargs_get_value_u32(ma, "workers", &o->workers) < 0 || o->workers > MAX_WORKERS) {
+        pa_log("workers= expects a number between 0 and %u.", MAX_WORKERS);
+        return -1;
+    }
+
     if (pa_modargs_get_value_boolean(ma, "auth-anonymous", &o->auth_anonymous) < 0) {
         pa_log("auth-anonymous= expects a boolean argument.");
         return -1;
@@ -43,6 +43,9 @@ typedef struct pa_native_options {
 
     bool auth_anonymous;
     bool srbchannel;
+    uint32_t srbchannel_busy_poll_usec;
+    uint32_t srbchannel_size;
+    uint32_t workers;
     char *auth_group;
     pa_ip_acl *auth_ip_acl;
     pa_auth_cookie *auth_cookie;
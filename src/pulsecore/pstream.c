@@ -33,6 +33,8 @@
 #include <pulse/xmalloc.h>
 
 #include <pulsecore/idxset.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/mutex.h>
 #include <pulsecore/socket.h>
 #include <pulsecore/queue.h>
 #include <pulsecore/log.h>
@@ -86,6 +88,15 @@ typedef uint32_t pa_pstream_descriptor[PA_PSTREAM_DESCRIPTOR_MAX];
  */
 #define DEFAULT_PSTREAM_MEMBLOCK_ALIGN (256)
 
+/* When writing to the iochannel, up to this many queued items, or as many
+ * as it takes to exceed this many bytes, are sent with a single writev() */
+#define WRITE_BATCH_ITEMS_MAX (32)
+#define WRITE_BATCH_BYTES_MAX (64*1024)
+
+/* Memblocks up to this fraction of the srbchannel's ring are copied into
+ * the ring rather than exported, see memblock_send_inline() */
+#define SRB_INLINE_FRACTION (8)
+
 PA_STATIC_FLIST_DECLARE(items, 0, pa_xfree);
 
 struct item_info {
@@ -113,6 +124,17 @@ struct item_info {
     uint32_t block_id;
 };
 
+struct pstream_write {
+    union {
+        uint8_t minibuf[MINIBUF_SIZE];
+        pa_pstream_descriptor descriptor;
+    };
+    struct item_info* current;
+    void *data;
+    int minibuf_validsize;
+    pa_memchunk memchunk;
+};
+
 struct pstream_read {
     pa_pstream_descriptor descriptor;
     pa_memblock *memblock;
@@ -136,15 +158,11 @@ struct pa_pstream {
     bool dead;
 
     struct {
-        union {
-            uint8_t minibuf[MINIBUF_SIZE];
-            pa_pstream_descriptor descriptor;
-        };
-        struct item_info* current;
-        void *data;
+        /* Ring of items that are ready to be written, the first one may
+         * have been written partially already */
+        struct pstream_write items[WRITE_BATCH_ITEMS_MAX];
+        unsigned first, n_items;
         size_t index;
-        int minibuf_validsize;
-        pa_memchunk memchunk;
     } write;
 
     struct pstream_read readio, readsrb;
@@ -185,9 +203,15 @@ struct pa_pstream {
     pa_mempool *mempool;
 
 #ifdef HAVE_CREDS
-    pa_cmsg_ancil_data read_ancil_data, *write_ancil_data;
-    bool send_ancil_data_now;
+    pa_cmsg_ancil_data read_ancil_data;
 #endif
+
+    /* Only for pstreams created with pa_pstream_new_threaded(): the
+     * mutex protects all of the above, and other threads wake up the
+     * mainloop through the fdsem instead of the defer event */
+    pa_mutex *mutex;
+    pa_fdsem *fdsem;
+    pa_io_event *fdsem_event;
 };
 
 #ifdef HAVE_CREDS
@@ -240,11 +264,22 @@ void pa_cmsg_ancil_data_close_fds(struct pa_cmsg_ancil_data *ancil) {
 static int do_write(pa_pstream *p);
 static int do_read(pa_pstream *p, struct pstream_read *re);
 
+static void pstream_lock(pa_pstream *p) {
+    if (p->mutex)
+        pa_mutex_lock(p->mutex);
+}
+
+static void pstream_unlock(pa_pstream *p) {
+    if (p->mutex)
+        pa_mutex_unlock(p->mutex);
+}
+
 static void do_pstream_read_write(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
     pa_pstream_ref(p);
+    pstream_lock(p);
 
     p->mainloop->defer_enable(p->defer_event, 0);
 
@@ -275,6 +310,7 @@ static void do_pstream_read_write(pa_pstream *p) {
             break;
     }
 
+    pstream_unlock(p);
     pa_pstream_unref(p);
     return;
 
@@ -284,6 +320,7 @@ fail:
         p->die_callback(p, p->die_callback_userdata);
 
     pa_pstream_unlink(p);
+    pstream_unlock(p);
     pa_pstream_unref(p);
 }
 
@@ -328,6 +365,21 @@ static void defer_callback(pa_mainloop_api *m, pa_defer_event *e, void*userdata)
     do_pstream_read_write(p);
 }
 
+static void fdsem_callback(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    pa_pstream *p = userdata;
+
+    pa_assert(p);
+    pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->fdsem_event == e);
+
+    /* Another thread queued something, let the defer event pick it up */
+    pa_fdsem_after_poll(p->fdsem);
+    p->mainloop->defer_enable(p->defer_event, 1);
+
+    while (pa_fdsem_before_poll(p->fdsem) < 0)
+        ;
+}
+
 static void memimport_release_cb(pa_memimport *i, uint32_t block_id, void *userdata);
 
 pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
@@ -359,6 +411,23 @@ pa_pstream *pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *poo
     return p;
 }
 
+pa_pstream *pa_pstream_new_threaded(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *pool) {
+    pa_pstream *p;
+    pa_fdsem *fdsem;
+
+    /* Fail before taking over the iochannel */
+    if (!(fdsem = pa_fdsem_new()))
+        return NULL;
+
+    p = pa_pstream_new(m, io, pool);
+    p->fdsem = fdsem;
+    p->mutex = pa_mutex_new(true, false);
+    p->fdsem_event = m->io_new(m, pa_fdsem_get(p->fdsem), PA_IO_EVENT_INPUT, fdsem_callback, p);
+    pa_assert_se(pa_fdsem_before_poll(p->fdsem) >= 0);
+
+    return p;
+}
+
 /* Attach memfd<->SHM_ID mapping to given pstream and its memimport.
  * Check pa_pstream_register_memfd_mempool() for further info.
  *
@@ -368,24 +437,33 @@ int pa_pstream_attach_memfd_shmid(pa_pstream *p, unsigned shm_id, int memfd_fd)
 
     pa_assert(memfd_fd != -1);
 
+    pstream_lock(p);
+
     if (!p->use_memfd) {
         pa_log_warn("Received memfd ID registration request over a pipe "
                     "that does not support memfds");
-        return err;
+        goto finish;
     }
 
+    if (p->dead)
+        goto finish;
+
     if (pa_idxset_get_by_data(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL)) {
         pa_log_warn("previously registered memfd SHM ID = %u", shm_id);
-        return err;
+        goto finish;
     }
 
     if (pa_memimport_attach_memfd(p->import, shm_id, memfd_fd, true)) {
         pa_log("Failed to create permanent mapping for memfd region with ID = %u", shm_id);
-        return err;
+        goto finish;
     }
 
     pa_assert_se(pa_idxset_put(p->registered_memfd_ids, PA_UINT32_TO_PTR(shm_id), NULL) == 0);
-    return 0;
+    err = 0;
+
+finish:
+    pstream_unlock(p);
+    return err;
 }
 
 static void item_free(void *item) {
@@ -418,13 +496,23 @@ static void pstream_free(pa_pstream *p) {
 
     pa_pstream_unlink(p);
 
+    /* The export first, freeing the import revokes blocks in it */
+    if (p->export)
+        pa_memexport_free(p->export);
+
+    if (p->import)
+        pa_memimport_free(p->import);
+
     pa_queue_free(p->send_queue, item_free);
 
-    if (p->write.current)
-        item_free(p->write.current);
+    for (; p->write.n_items > 0; p->write.n_items--) {
+        struct pstream_write *w = &p->write.items[p->write.first++ % WRITE_BATCH_ITEMS_MAX];
 
-    if (p->write.memchunk.memblock)
-        pa_memblock_unref(p->write.memchunk.memblock);
+        item_free(w->current);
+
+        if (w->memchunk.memblock)
+            pa_memblock_unref(w->memchunk.memblock);
+    }
 
     if (p->readsrb.memblock)
         pa_memblock_unref(p->readsrb.memblock);
@@ -441,9 +529,23 @@ static void pstream_free(pa_pstream *p) {
     if (p->registered_memfd_ids)
         pa_idxset_free(p->registered_memfd_ids, NULL);
 
+    if (p->mutex)
+        pa_mutex_free(p->mutex);
+
     pa_xfree(p);
 }
 
+/* Called with the pstream locked */
+static void queue_item(pa_pstream *p, struct item_info *i) {
+    pa_queue_push(p->send_queue, i);
+
+    /* The defer event may only be touched from the mainloop's thread */
+    if (p->fdsem)
+        pa_fdsem_post(p->fdsem);
+    else
+        p->mainloop->defer_enable(p->defer_event, 1);
+}
+
 void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data) {
     struct item_info *i;
 
@@ -451,10 +553,13 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data
     pa_assert(PA_REFCNT_VALUE(p) > 0);
     pa_assert(packet);
 
+    pstream_lock(p);
+
     if (p->dead) {
 #ifdef HAVE_CREDS
         pa_cmsg_ancil_data_close_fds(ancil_data);
 #endif
+        pstream_unlock(p);
         return;
     }
 
@@ -474,9 +579,8 @@ void pa_pstream_send_packet(pa_pstream*p, pa_packet *packet, pa_cmsg_ancil_data
     }
 #endif
 
-    pa_queue_push(p->send_queue, i);
-
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, i);
+    pstream_unlock(p);
 }
 
 void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa_seek_mode_t seek_mode, const pa_memchunk *chunk, size_t align) {
@@ -488,8 +592,12 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
     pa_assert(channel != (uint32_t) -1);
     pa_assert(chunk);
 
-    if (p->dead)
+    pstream_lock(p);
+
+    if (p->dead) {
+        pstream_unlock(p);
         return;
+    }
 
     idx = 0;
     length = chunk->length;
@@ -521,13 +629,13 @@ void pa_pstream_send_memblock(pa_pstream*p, uint32_t channel, int64_t offset, pa
         i->with_ancil_data = false;
 #endif
 
-        pa_queue_push(p->send_queue, i);
+        queue_item(p, i);
 
         idx += n;
         length -= n;
     }
 
-    p->mainloop->defer_enable(p->defer_event, 1);
+    pstream_unlock(p);
 }
 
 void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
@@ -535,8 +643,12 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (p->dead)
+    pstream_lock(p);
+
+    if (p->dead) {
+        pstream_unlock(p);
         return;
+    }
 
 /*     pa_log("Releasing block %u", block_id); */
 
@@ -548,8 +660,8 @@ void pa_pstream_send_release(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
+    pstream_unlock(p);
 }
 
 /* might be called from thread context */
@@ -573,8 +685,12 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (p->dead)
+    pstream_lock(p);
+
+    if (p->dead) {
+        pstream_unlock(p);
         return;
+    }
 /*     pa_log("Revoking block %u", block_id); */
 
     if (!(item = pa_flist_pop(PA_STATIC_FLIST_GET(items))))
@@ -585,8 +701,8 @@ void pa_pstream_send_revoke(pa_pstream *p, uint32_t block_id) {
     item->with_ancil_data = false;
 #endif
 
-    pa_queue_push(p->send_queue, item);
-    p->mainloop->defer_enable(p->defer_event, 1);
+    queue_item(p, item);
+    pstream_unlock(p);
 }
 
 /* might be called from thread context */
@@ -596,74 +712,102 @@ static void memexport_revoke_cb(pa_memexport *e, uint32_t block_id, void *userda
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    if (p->dead)
+        return;
+
     if (p->revoke_callback)
         p->revoke_callback(p, block_id, p->revoke_callback_userdata);
     else
         pa_pstream_send_revoke(p, block_id);
 }
 
-static void prepare_next_write_item(pa_pstream *p) {
+static struct pstream_write *get_write_item(pa_pstream *p, unsigned i) {
+    pa_assert(i < p->write.n_items);
+
+    return &p->write.items[(p->write.first + i) % WRITE_BATCH_ITEMS_MAX];
+}
+
+static size_t write_item_size(struct pstream_write *w) {
+    return PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]);
+}
+
+/* Exporting a memblock costs the receiver a SHMRELEASE message back once
+ * it's done with the block, and us a revoke if we need the block before.
+ * For small blocks it's cheaper to copy the data into the srbchannel's
+ * ring, which the receiver reads without any syscalls anyway. The
+ * descriptor's channel field tells the streams apart as always. */
+static bool memblock_send_inline(pa_pstream *p, size_t length) {
+    return p->srb && length <= pa_srbchannel_get_capacity(p->srb) / SRB_INLINE_FRACTION;
+}
+
+/* Takes the next item off the send queue and appends it to the items that
+ * are ready to be written. Returns NULL if the queue is empty. */
+static struct pstream_write *prepare_next_write_item(pa_pstream *p) {
+    struct pstream_write *w;
+    struct item_info *i;
+
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
+    pa_assert(p->write.n_items < WRITE_BATCH_ITEMS_MAX);
 
-    p->write.current = pa_queue_pop(p->send_queue);
+    if (!(i = pa_queue_pop(p->send_queue)))
+        return NULL;
 
-    if (!p->write.current)
-        return;
-    p->write.index = 0;
-    p->write.data = NULL;
-    p->write.minibuf_validsize = 0;
-    pa_memchunk_reset(&p->write.memchunk);
-
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
-    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
-
-    if (p->write.current->type == PA_PSTREAM_ITEM_PACKET) {
+    w = &p->write.items[(p->write.first + p->write.n_items++) % WRITE_BATCH_ITEMS_MAX];
+    w->current = i;
+    w->data = NULL;
+    w->minibuf_validsize = 0;
+    pa_memchunk_reset(&w->memchunk);
+
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl((uint32_t) -1);
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = 0;
+    w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = 0;
+
+    if (w->current->type == PA_PSTREAM_ITEM_PACKET) {
         size_t plen;
 
-        pa_assert(p->write.current->packet);
+        pa_assert(w->current->packet);
 
-        p->write.data = (void *) pa_packet_data(p->write.current->packet, &plen);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
+        w->data = (void *) pa_packet_data(w->current->packet, &plen);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) plen);
 
         if (plen <= MINIBUF_SIZE - PA_PSTREAM_DESCRIPTOR_SIZE) {
-            memcpy(&p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], p->write.data, plen);
-            p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
+            memcpy(&w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE], w->data, plen);
+            w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + plen;
         }
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMRELEASE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMRELEASE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
-    } else if (p->write.current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
+    } else if (w->current->type == PA_PSTREAM_ITEM_SHMREVOKE) {
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(p->write.current->block_id);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(PA_FLAG_SHMREVOKE);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl(w->current->block_id);
 
     } else {
         uint32_t flags;
         bool send_payload = true;
 
-        pa_assert(p->write.current->type == PA_PSTREAM_ITEM_MEMBLOCK);
-        pa_assert(p->write.current->chunk.memblock);
+        pa_assert(w->current->type == PA_PSTREAM_ITEM_MEMBLOCK);
+        pa_assert(w->current->chunk.memblock);
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(p->write.current->channel);
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) p->write.current->offset) >> 32));
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) p->write.current->offset));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_CHANNEL] = htonl(w->current->channel);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_HI] = htonl((uint32_t) (((uint64_t) w->current->offset) >> 32));
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_OFFSET_LO] = htonl((uint32_t) ((uint64_t) w->current->offset));
 
-        flags = (uint32_t) (p->write.current->seek_mode & PA_FLAG_SEEKMASK);
+        flags = (uint32_t) (w->current->seek_mode & PA_FLAG_SEEKMASK);
 
-        if (p->use_shm) {
+        if (p->use_shm && !memblock_send_inline(p, w->current->chunk.length)) {
             pa_mem_type_t type;
             uint32_t block_id, shm_id;
             size_t offset, length;
-            uint32_t *shm_info = (uint32_t *) &p->write.minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
+            uint32_t *shm_info = (uint32_t *) &w->minibuf[PA_PSTREAM_DESCRIPTOR_SIZE];
             size_t shm_size = sizeof(uint32_t) * PA_PSTREAM_SHM_MAX;
-            pa_mempool *current_pool = pa_memblock_get_pool(p->write.current->chunk.memblock);
+            pa_mempool *current_pool = pa_memblock_get_pool(w->current->chunk.memblock);
             pa_memexport *current_export;
 
             if (p->mempool == current_pool)
@@ -672,7 +816,7 @@ static void prepare_next_write_item(pa_pstream *p) {
                 pa_assert_se(current_export = pa_memexport_new(current_pool, memexport_revoke_cb, p));
 
             if (pa_memexport_put(current_export,
-                                 p->write.current->chunk.memblock,
+                                 w->current->chunk.memblock,
                                  &type,
                                  &block_id,
                                  &shm_id,
@@ -705,11 +849,11 @@ static void prepare_next_write_item(pa_pstream *p) {
 
                     shm_info[PA_PSTREAM_SHM_BLOCKID] = htonl(block_id);
                     shm_info[PA_PSTREAM_SHM_SHMID] = htonl(shm_id);
-                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + p->write.current->chunk.index));
-                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
+                    shm_info[PA_PSTREAM_SHM_INDEX] = htonl((uint32_t) (offset + w->current->chunk.index));
+                    shm_info[PA_PSTREAM_SHM_LENGTH] = htonl((uint32_t) w->current->chunk.length);
 
-                    p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
-                    p->write.minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
+                    w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl(shm_size);
+                    w->minibuf_validsize = PA_PSTREAM_DESCRIPTOR_SIZE + shm_size;
                 }
             }
 /*             else */
@@ -722,18 +866,15 @@ static void prepare_next_write_item(pa_pstream *p) {
         }
 
         if (send_payload) {
-            p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) p->write.current->chunk.length);
-            p->write.memchunk = p->write.current->chunk;
-            pa_memblock_ref(p->write.memchunk.memblock);
+            w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH] = htonl((uint32_t) w->current->chunk.length);
+            w->memchunk = w->current->chunk;
+            pa_memblock_ref(w->memchunk.memblock);
         }
 
-        p->write.descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
+        w->descriptor[PA_PSTREAM_DESCRIPTOR_FLAGS] = htonl(flags);
     }
 
-#ifdef HAVE_CREDS
-    if ((p->send_ancil_data_now = p->write.current->with_ancil_data))
-        p->write_ancil_data = &p->write.current->ancil_data;
-#endif
+    return w;
 }
 
 static void check_srbpending(pa_pstream *p) {
@@ -750,59 +891,176 @@ static void check_srbpending(pa_pstream *p) {
         pa_srbchannel_set_callback(p->srb, srb_callback, p);
 }
 
+/* Returns the part of the item that starts at byte offset index and can be
+ * written in one go: the minibuf, the descriptor or the payload. If the
+ * payload is a memblock, it is acquired and returned in *release. */
+static size_t get_write_segment(struct pstream_write *w, size_t index, void **d, pa_memblock **release) {
+    size_t l;
+
+    *release = NULL;
+
+    if (w->minibuf_validsize > 0) {
+        *d = w->minibuf + index;
+        l = w->minibuf_validsize - index;
+    } else if (index < PA_PSTREAM_DESCRIPTOR_SIZE) {
+        *d = (uint8_t*) w->descriptor + index;
+        l = PA_PSTREAM_DESCRIPTOR_SIZE - index;
+    } else {
+        pa_assert(w->data || w->memchunk.memblock);
+
+        if (w->data)
+            *d = w->data;
+        else {
+            *d = pa_memblock_acquire_chunk(&w->memchunk);
+            *release = w->memchunk.memblock;
+        }
+
+        *d = (uint8_t*) *d + index - PA_PSTREAM_DESCRIPTOR_SIZE;
+        l = ntohl(w->descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (index - PA_PSTREAM_DESCRIPTOR_SIZE);
+    }
+
+    pa_assert(l > 0);
+
+    return l;
+}
+
+static bool write_item_has_ancil_data(struct pstream_write *w) {
+#ifdef HAVE_CREDS
+    return w->current->with_ancil_data;
+#else
+    return false;
+#endif
+}
+
+/* Account for r more bytes having been written, and free all items that
+ * have been written completely */
+static void advance_write(pa_pstream *p, size_t r) {
+
+    while (p->write.n_items > 0) {
+        struct pstream_write *w = get_write_item(p, 0);
+        size_t left = write_item_size(w) - p->write.index;
+
+        if (r < left) {
+            p->write.index += r;
+            return;
+        }
+
+        r -= left;
+
+        item_free(w->current);
+        w->current = NULL;
+
+        if (w->memchunk.memblock)
+            pa_memblock_unref(w->memchunk.memblock);
+
+        pa_memchunk_reset(&w->memchunk);
+
+        p->write.first = (p->write.first + 1) % WRITE_BATCH_ITEMS_MAX;
+        p->write.n_items--;
+        p->write.index = 0;
+
+        if (p->drain_callback && !pa_pstream_is_pending(p))
+            p->drain_callback(p, p->drain_callback_userdata);
+    }
+
+    pa_assert(r == 0);
+}
+
+#ifdef HAVE_SYS_UIO_H
+/* Write as many of the queued items as fit into the budget with a single
+ * writev(). Items that carry ancillary data need a write of their own, so
+ * they end the batch. */
+static int do_writev(pa_pstream *p) {
+    struct iovec iov[WRITE_BATCH_ITEMS_MAX * 2];
+    pa_memblock *release_memblocks[WRITE_BATCH_ITEMS_MAX];
+    unsigned n_iov = 0, n_release = 0, i;
+    size_t l = 0;
+    ssize_t r;
+
+    for (i = 0; ; i++) {
+        struct pstream_write *w;
+        size_t index, size;
+
+        if (i == p->write.n_items)
+            if (i >= WRITE_BATCH_ITEMS_MAX || l >= WRITE_BATCH_BYTES_MAX || !prepare_next_write_item(p))
+                break;
+
+        w = get_write_item(p, i);
+
+        if (i > 0 && write_item_has_ancil_data(w))
+            break;
+
+        size = write_item_size(w);
+
+        for (index = i == 0 ? p->write.index : 0; index < size; n_iov++) {
+            pa_memblock *release;
+
+            iov[n_iov].iov_len = get_write_segment(w, index, &iov[n_iov].iov_base, &release);
+            index += iov[n_iov].iov_len;
+            l += iov[n_iov].iov_len;
+
+            if (release)
+                release_memblocks[n_release++] = release;
+        }
+    }
+
+    r = pa_iochannel_writev(p->io, iov, (int) n_iov);
+
+    for (i = 0; i < n_release; i++)
+        pa_memblock_release(release_memblocks[i]);
+
+    if (r < 0)
+        return -1;
+
+    advance_write(p, (size_t) r);
+
+    return (size_t) r == l ? 1 : 0;
+}
+#endif
+
 static int do_write(pa_pstream *p) {
+    struct pstream_write *w;
     void *d;
     size_t l;
     ssize_t r;
-    pa_memblock *release_memblock = NULL;
+    pa_memblock *release_memblock;
 
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
-    if (!p->write.current)
-        prepare_next_write_item(p);
-
-    if (!p->write.current) {
+    if (p->write.n_items == 0 && !prepare_next_write_item(p)) {
         /* The out queue is empty, so switching channels is safe */
         check_srbpending(p);
         return 0;
     }
 
-    if (p->write.minibuf_validsize > 0) {
-        d = p->write.minibuf + p->write.index;
-        l = p->write.minibuf_validsize - p->write.index;
-    } else if (p->write.index < PA_PSTREAM_DESCRIPTOR_SIZE) {
-        d = (uint8_t*) p->write.descriptor + p->write.index;
-        l = PA_PSTREAM_DESCRIPTOR_SIZE - p->write.index;
-    } else {
-        pa_assert(p->write.data || p->write.memchunk.memblock);
+    w = get_write_item(p, 0);
 
-        if (p->write.data)
-            d = p->write.data;
-        else {
-            d = pa_memblock_acquire_chunk(&p->write.memchunk);
-            release_memblock = p->write.memchunk.memblock;
-        }
-
-        d = (uint8_t*) d + p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE;
-        l = ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH]) - (p->write.index - PA_PSTREAM_DESCRIPTOR_SIZE);
-    }
+#ifdef HAVE_SYS_UIO_H
+    /* The srbchannel copies into shared memory, there are no syscalls to
+     * save there */
+    if (!p->srb && !write_item_has_ancil_data(w))
+        return do_writev(p);
+#endif
 
-    pa_assert(l > 0);
+    l = get_write_segment(w, p->write.index, &d, &release_memblock);
 
 #ifdef HAVE_CREDS
-    if (p->send_ancil_data_now) {
-        if (p->write_ancil_data->creds_valid) {
-            pa_assert(p->write_ancil_data->nfd == 0);
-            if ((r = pa_iochannel_write_with_creds(p->io, d, l, &p->write_ancil_data->creds)) < 0)
-                goto fail;
-        }
-        else
-            if ((r = pa_iochannel_write_with_fds(p->io, d, l, p->write_ancil_data->nfd, p->write_ancil_data->fds)) < 0)
-                goto fail;
+    if (w->current->with_ancil_data) {
+        pa_cmsg_ancil_data *ancil_data = &w->current->ancil_data;
 
-        pa_cmsg_ancil_data_close_fds(p->write_ancil_data);
-        p->send_ancil_data_now = false;
+        if (ancil_data->creds_valid) {
+            pa_assert(ancil_data->nfd == 0);
+            r = pa_iochannel_write_with_creds(p->io, d, l, &ancil_data->creds);
+        } else
+            r = pa_iochannel_write_with_fds(p->io, d, l, ancil_data->nfd, ancil_data->fds);
+
+        /* The ancillary data goes out with the first chunk only */
+        pa_cmsg_ancil_data_close_fds(ancil_data);
+        w->current->with_ancil_data = false;
+
+        if (r < 0)
+            goto fail;
     } else
 #endif
     if (p->srb)
@@ -813,30 +1071,11 @@ static int do_write(pa_pstream *p) {
     if (release_memblock)
         pa_memblock_release(release_memblock);
 
-    p->write.index += (size_t) r;
-
-    if (p->write.index >= PA_PSTREAM_DESCRIPTOR_SIZE + ntohl(p->write.descriptor[PA_PSTREAM_DESCRIPTOR_LENGTH])) {
-        pa_assert(p->write.current);
-        item_free(p->write.current);
-        p->write.current = NULL;
-
-        if (p->write.memchunk.memblock)
-            pa_memblock_unref(p->write.memchunk.memblock);
-
-        pa_memchunk_reset(&p->write.memchunk);
-
-        if (p->drain_callback && !pa_pstream_is_pending(p))
-            p->drain_callback(p, p->drain_callback_userdata);
-    }
+    advance_write(p, (size_t) r);
 
     return (size_t) r == l ? 1 : 0;
 
 fail:
-#ifdef HAVE_CREDS
-    if (p->send_ancil_data_now)
-        pa_cmsg_ancil_data_close_fds(p->write_ancil_data);
-#endif
-
     if (release_memblock)
         pa_memblock_release(release_memblock);
 
@@ -1124,48 +1363,60 @@ void pa_pstream_set_die_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->die_callback = cb;
     p->die_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_drain_callback(pa_pstream *p, pa_pstream_notify_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->drain_callback = cb;
     p->drain_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_packet_callback(pa_pstream *p, pa_pstream_packet_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_packet_callback = cb;
     p->receive_packet_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_receive_memblock_callback(pa_pstream *p, pa_pstream_memblock_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->receive_memblock_callback = cb;
     p->receive_memblock_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_release_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->release_callback = cb;
     p->release_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 void pa_pstream_set_revoke_callback(pa_pstream *p, pa_pstream_block_id_cb_t cb, void *userdata) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
     p->revoke_callback = cb;
     p->revoke_callback_userdata = userdata;
+    pstream_unlock(p);
 }
 
 bool pa_pstream_is_pending(pa_pstream *p) {
@@ -1174,10 +1425,14 @@ bool pa_pstream_is_pending(pa_pstream *p) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     if (p->dead)
         b = false;
     else
-        b = p->write.current || !pa_queue_isempty(p->send_queue);
+        b = p->write.n_items > 0 || !pa_queue_isempty(p->send_queue);
+
+    pstream_unlock(p);
 
     return b;
 }
@@ -1201,22 +1456,32 @@ pa_pstream* pa_pstream_ref(pa_pstream*p) {
 void pa_pstream_unlink(pa_pstream *p) {
     pa_assert(p);
 
-    if (p->dead)
+    pstream_lock(p);
+
+    if (p->dead) {
+        pstream_unlock(p);
         return;
+    }
 
     p->dead = true;
 
     while (p->srb || p->is_srbpending) /* In theory there could be one active and one pending */
         pa_pstream_set_srbchannel(p, NULL);
 
-    if (p->import) {
-        pa_memimport_free(p->import);
-        p->import = NULL;
-    }
+    /* A threaded pstream is usually unlinked in another thread than
+     * the one that drops the last blocks we imported, and freeing the
+     * memimport concurrently with that is not safe. Leave the import
+     * and the export to pstream_free() then. */
+    if (!p->mutex) {
+        if (p->import) {
+            pa_memimport_free(p->import);
+            p->import = NULL;
+        }
 
-    if (p->export) {
-        pa_memexport_free(p->export);
-        p->export = NULL;
+        if (p->export) {
+            pa_memexport_free(p->export);
+            p->export = NULL;
+        }
     }
 
     if (p->io) {
@@ -1229,16 +1494,30 @@ void pa_pstream_unlink(pa_pstream *p) {
         p->defer_event = NULL;
     }
 
+    if (p->fdsem_event) {
+        p->mainloop->io_free(p->fdsem_event);
+        p->fdsem_event = NULL;
+    }
+
+    if (p->fdsem) {
+        pa_fdsem_free(p->fdsem);
+        p->fdsem = NULL;
+    }
+
     p->die_callback = NULL;
     p->drain_callback = NULL;
     p->receive_packet_callback = NULL;
     p->receive_memblock_callback = NULL;
+
+    pstream_unlock(p);
 }
 
 void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0);
 
+    pstream_lock(p);
+
     p->use_shm = enable;
 
     if (enable) {
@@ -1253,6 +1532,8 @@ void pa_pstream_enable_shm(pa_pstream *p, bool enable) {
             p->export = NULL;
         }
     }
+
+    pstream_unlock(p);
 }
 
 void pa_pstream_enable_memfd(pa_pstream *p) {
@@ -1260,11 +1541,15 @@ void pa_pstream_enable_memfd(pa_pstream *p) {
     pa_assert(PA_REFCNT_VALUE(p) > 0);
     pa_assert(p->use_shm);
 
+    pstream_lock(p);
+
     p->use_memfd = true;
 
     if (!p->registered_memfd_ids) {
         p->registered_memfd_ids = pa_idxset_new(NULL, NULL);
     }
+
+    pstream_unlock(p);
 }
 
 bool pa_pstream_get_shm(pa_pstream *p) {
@@ -1285,6 +1570,10 @@ void pa_pstream_set_srbchannel(pa_pstream *p, pa_srbchannel *srb) {
     pa_assert(p);
     pa_assert(PA_REFCNT_VALUE(p) > 0 || srb == NULL);
 
+    /* srbchannels are tied to a single thread, which doesn't go well
+     * with pstreams that may be used from several */
+    pa_assert(!srb || !p->mutex);
+
     if (srb == p->srb)
         return;
 
@@ -43,6 +43,13 @@ typedef void (*pa_pstream_block_id_cb_t)(pa_pstream *p, uint32_t block_id, void
 
 pa_pstream* pa_pstream_new(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *p);
 
+/* Like pa_pstream_new(), but the pstream may be fed and queried from
+ * any thread. I/O and all callbacks still happen in the thread of the
+ * mainloop, which is also where the pstream has to be created and
+ * unlinked. srbchannels are not supported on such pstreams. Returns
+ * NULL, without taking over the iochannel, on failure. */
+pa_pstream* pa_pstream_new_threaded(pa_mainloop_api *m, pa_iochannel *io, pa_mempool *p);
+
 pa_pstream* pa_pstream_ref(pa_pstream*p);
 void pa_pstream_unref(pa_pstream*p);
 
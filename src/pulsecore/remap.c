@@ -513,6 +513,9 @@ void pa_set_remap_func(pa_remap_t *m, pa_do_remap_func_t func_s16,
 
 static bool force_generic_code = false;
 
+/* optional optimized generic matrix remapping, NULL if there is none */
+static pa_init_remap_func_t init_remap_matrix_func = NULL;
+
 /* set the function that will execute the remapping based on the matrices */
 static void init_remap_c(pa_remap_t *m) {
     unsigned n_oc, n_ic;
@@ -593,6 +596,10 @@ static void init_remap_c(pa_remap_t *m) {
         pa_set_remap_func(m, (pa_do_remap_func_t) remap_channels_matrix_s16ne_c,
             (pa_do_remap_func_t) remap_channels_matrix_s32ne_c,
             (pa_do_remap_func_t) remap_channels_matrix_float32ne_c);
+
+        /* give optimized matrix code a chance to replace some of them */
+        if (init_remap_matrix_func)
+            init_remap_matrix_func(m);
     }
 }
 
@@ -621,6 +628,14 @@ void pa_set_init_remap_func(pa_init_remap_func_t func) {
     init_remap_func = func;
 }
 
+pa_init_remap_func_t pa_get_init_remap_matrix_func(void) {
+    return init_remap_matrix_func;
+}
+
+void pa_set_init_remap_matrix_func(pa_init_remap_func_t func) {
+    init_remap_matrix_func = func;
+}
+
 void pa_remap_func_init(const pa_cpu_info *cpu_info) {
     force_generic_code = cpu_info->force_generic_code;
 }
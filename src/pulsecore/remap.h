@@ -44,6 +44,13 @@ typedef void (*pa_init_remap_func_t) (pa_remap_t *m);
 pa_init_remap_func_t pa_get_init_remap_func(void);
 void pa_set_init_remap_func(pa_init_remap_func_t func);
 
+/* Custom init function for the generic matrix case, i.e. when none of the
+ * special cases apply. It is called after the generic C functions have been
+ * set up and may replace them with optimized ones, and may also set up
+ * m->state, which is freed with pa_xfree(). */
+pa_init_remap_func_t pa_get_init_remap_matrix_func(void);
+void pa_set_init_remap_matrix_func(pa_init_remap_func_t func);
+
 /* Check if remapping can be performed by just copying some or all input
  * channels' data to output channels. Returns true and a table of input
  * channel indices, or false otherwise.
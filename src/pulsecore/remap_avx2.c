@@ -0,0 +1,198 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/sample.h>
+#include <pulse/xmalloc.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "cpu-x86.h"
+#include "remap.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* The output is processed in patterns of lcm(n_oc, 8) samples, i.e. a whole
+ * number of frames that fills whole vectors. For every vector of a pattern,
+ * tap t of each lane gathers the t-th input sample that contributes to the
+ * lane's output channel. Only input channels with a positive coefficient are
+ * taps, in ascending order, and coefficients of 1 or more are clamped to 1,
+ * so the result is the same as that of the generic C code. Lanes with fewer
+ * taps than others in the same vector are masked off. */
+struct remap_matrix_avx2 {
+    unsigned frames;                  /* frames per pattern */
+    unsigned n_vec;                   /* vectors per pattern */
+    unsigned max_taps;
+
+    /* for the frames that don't fill a whole pattern */
+    unsigned n_taps[PA_CHANNELS_MAX];
+    unsigned tap_ic[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+    float tap_vol[PA_CHANNELS_MAX][PA_CHANNELS_MAX];
+
+    /* n_vec * max_taps entries each, the number of taps actually used by
+     * each vector is in vec_taps */
+    unsigned *vec_taps;
+    __m256i *idx;
+    __m256i *mask;
+    __m256 *vol;
+};
+
+static void remap_channels_matrix_float32ne_avx2(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const struct remap_matrix_avx2 *st = m->state;
+    unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    unsigned oc, t, v;
+
+    for (; n >= st->frames; n -= st->frames) {
+        for (v = 0; v < st->n_vec; v++) {
+            unsigned k = v * st->max_taps;
+            __m256 acc = _mm256_setzero_ps();
+
+            /* No FMA, to stay bit exact with the generic code */
+            for (t = 0; t < st->vec_taps[v]; t++, k++) {
+                __m256 s = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), src, st->idx[k],
+                                                    _mm256_castsi256_ps(st->mask[k]), 4);
+                acc = _mm256_add_ps(acc, _mm256_mul_ps(s, st->vol[k]));
+            }
+
+            _mm256_storeu_ps(dst + v * 8, acc);
+        }
+
+        src += st->frames * n_ic;
+        dst += st->frames * n_oc;
+    }
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        for (oc = 0; oc < n_oc; oc++) {
+            float sum = 0.0f;
+
+            for (t = 0; t < st->n_taps[oc]; t++)
+                sum += src[st->tap_ic[oc][t]] * st->tap_vol[oc][t];
+
+            dst[oc] = sum;
+        }
+    }
+}
+
+static void init_remap_matrix_avx2(pa_remap_t *m) {
+    struct remap_matrix_avx2 *st;
+    unsigned n_ic, n_oc, pattern, max_taps, a, b, ic, oc, t, v, l;
+    size_t n_entries;
+    uint8_t *p;
+
+    if (m->format != PA_SAMPLE_FLOAT32NE)
+        return;
+
+    n_ic = m->i_ss.channels;
+    n_oc = m->o_ss.channels;
+
+    /* pattern length is lcm(n_oc, 8) */
+    for (a = n_oc, b = 8; b; ) {
+        unsigned r = a % b;
+        a = b;
+        b = r;
+    }
+    pattern = n_oc / a * 8;
+
+    for (oc = 0, max_taps = 0; oc < n_oc; oc++) {
+        for (ic = 0, t = 0; ic < n_ic; ic++)
+            if (m->map_table_f[oc][ic] > 0.0f)
+                t++;
+
+        max_taps = PA_MAX(max_taps, t);
+    }
+
+    /* Keep the vector tables in the same allocation, so that m->state can
+     * be freed with a single pa_xfree() */
+    n_entries = PA_MAX((pattern / 8) * max_taps, 1U);
+    p = pa_xmalloc0(PA_ALIGN(sizeof(*st)) + 31 + n_entries * (3 * sizeof(__m256i) + sizeof(unsigned)));
+
+    st = (struct remap_matrix_avx2 *) p;
+    st->frames = pattern / n_oc;
+    st->n_vec = pattern / 8;
+    st->max_taps = max_taps;
+
+    p = (uint8_t *) (((uintptr_t) p + PA_ALIGN(sizeof(*st)) + 31) & ~(uintptr_t) 31);
+    st->idx = (__m256i *) p;
+    st->mask = st->idx + n_entries;
+    st->vol = (__m256 *) (st->mask + n_entries);
+    st->vec_taps = (unsigned *) (st->vol + n_entries);
+
+    for (oc = 0; oc < n_oc; oc++) {
+        for (ic = 0; ic < n_ic; ic++) {
+            float vol = m->map_table_f[oc][ic];
+
+            if (vol <= 0.0f)
+                continue;
+
+            st->tap_ic[oc][st->n_taps[oc]] = ic;
+            st->tap_vol[oc][st->n_taps[oc]] = PA_MIN(vol, 1.0f);
+            st->n_taps[oc]++;
+        }
+    }
+
+    for (v = 0; v < st->n_vec; v++) {
+        PA_DECLARE_ALIGNED(32, int32_t, idx[8]);
+        PA_DECLARE_ALIGNED(32, int32_t, mask[8]);
+        PA_DECLARE_ALIGNED(32, float, vol[8]);
+
+        for (t = 0; t < st->max_taps; t++) {
+            unsigned k = v * st->max_taps + t;
+
+            for (l = 0; l < 8; l++) {
+                unsigned s = v * 8 + l;
+                unsigned frame = s / n_oc;
+
+                oc = s % n_oc;
+
+                if (t < st->n_taps[oc]) {
+                    idx[l] = frame * n_ic + st->tap_ic[oc][t];
+                    mask[l] = -1;
+                    vol[l] = st->tap_vol[oc][t];
+                    st->vec_taps[v] = t + 1;
+                } else {
+                    idx[l] = 0;
+                    mask[l] = 0;
+                    vol[l] = 0.0f;
+                }
+            }
+
+            st->idx[k] = _mm256_load_si256((const __m256i *) idx);
+            st->mask[k] = _mm256_load_si256((const __m256i *) mask);
+            st->vol[k] = _mm256_load_ps(vol);
+        }
+    }
+
+    pa_log_info("Using AVX2 matrix remapping (up to %u taps per output channel)", st->max_taps);
+
+    m->state = st;
+    m->do_remap = (pa_do_remap_func_t) remap_channels_matrix_float32ne_avx2;
+}
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_remap_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized matrix remapping.");
+        pa_set_init_remap_matrix_func((pa_init_remap_func_t) init_remap_matrix_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
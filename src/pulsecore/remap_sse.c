@@ -22,8 +22,11 @@
 #include <config.h>
 #endif
 
+#include <string.h>
+
 #include <pulse/sample.h>
 #include <pulse/volume.h>
+#include <pulse/xmalloc.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
 
@@ -99,6 +102,9 @@
                 "4:                             \n\t"
 
 #if defined (__i386__) || defined (__amd64__)
+
+#include <xmmintrin.h>
+
 static void remap_mono_to_stereo_s16ne_sse2(pa_remap_t *m, int16_t *dst, const int16_t *src, unsigned n) {
     pa_reg_x86 temp, temp2;
 
@@ -139,6 +145,93 @@ static void init_remap_sse2(pa_remap_t *m) {
             (pa_do_remap_func_t) remap_mono_to_stereo_any32ne_sse2);
     }
 }
+/* Generic matrix remapping, one frame at a time: every output frame is the
+ * sum of the matrix columns of the input channels, scaled by the respective
+ * input sample. Input channels that don't contribute to any output channel
+ * are left out completely. Coefficients of 1 or more are clamped to 1 and
+ * coefficients of 0 or less are 0, matching what the C code does. */
+struct remap_matrix_sse {
+    unsigned n_active, n_vec;
+    unsigned active_ic[PA_CHANNELS_MAX];
+    /* n_active columns of n_vec * 4 coefficients each */
+    float columns[];
+};
+
+static void remap_channels_matrix_float32ne_sse(pa_remap_t *m, float *dst, const float *src, unsigned n) {
+    const struct remap_matrix_sse *st = m->state;
+    unsigned n_ic = m->i_ss.channels, n_oc = m->o_ss.channels;
+    unsigned spill, n_safe, a, v;
+    __m128 acc[PA_CHANNELS_MAX / 4];
+    float last[PA_CHANNELS_MAX];
+
+    /* Full vectors are stored, which may write up to 3 samples beyond the
+     * frame. That's fine as long as the next frames overwrite them again,
+     * the last frames go through a bounce buffer instead. */
+    spill = (st->n_vec * 4 - 1) / n_oc;
+    n_safe = n > spill ? n - spill : 0;
+
+    for (; n > 0; n--, src += n_ic, dst += n_oc) {
+        const float *col = st->columns;
+
+        for (v = 0; v < st->n_vec; v++)
+            acc[v] = _mm_setzero_ps();
+
+        for (a = 0; a < st->n_active; a++) {
+            __m128 s = _mm_set1_ps(src[st->active_ic[a]]);
+
+            for (v = 0; v < st->n_vec; v++, col += 4)
+                acc[v] = _mm_add_ps(acc[v], _mm_mul_ps(s, _mm_loadu_ps(col)));
+        }
+
+        if (n_safe > 0) {
+            for (v = 0; v < st->n_vec; v++)
+                _mm_storeu_ps(dst + v * 4, acc[v]);
+            n_safe--;
+        } else {
+            for (v = 0; v < st->n_vec; v++)
+                _mm_storeu_ps(last + v * 4, acc[v]);
+            memcpy(dst, last, n_oc * sizeof(float));
+        }
+    }
+}
+
+static void init_remap_matrix_sse(pa_remap_t *m) {
+    struct remap_matrix_sse *st;
+    unsigned n_ic, n_oc, n_vec, ic, oc;
+
+    if (m->format != PA_SAMPLE_FLOAT32NE)
+        return;
+
+    n_ic = m->i_ss.channels;
+    n_oc = m->o_ss.channels;
+    n_vec = (n_oc + 3) / 4;
+
+    st = pa_xmalloc0(sizeof(struct remap_matrix_sse) + n_ic * n_vec * 4 * sizeof(float));
+    st->n_vec = n_vec;
+
+    for (ic = 0; ic < n_ic; ic++) {
+        float *col = st->columns + st->n_active * n_vec * 4;
+        bool used = false;
+
+        for (oc = 0; oc < n_oc; oc++) {
+            float vol = m->map_table_f[oc][ic];
+
+            if (vol <= 0.0f)
+                continue;
+
+            col[oc] = PA_MIN(vol, 1.0f);
+            used = true;
+        }
+
+        if (used)
+            st->active_ic[st->n_active++] = ic;
+    }
+
+    pa_log_info("Using SSE matrix remapping (%u of %u input channels used)", st->n_active, n_ic);
+
+    m->state = st;
+    m->do_remap = (pa_do_remap_func_t) remap_channels_matrix_float32ne_sse;
+}
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags) {
@@ -147,6 +240,7 @@ void pa_remap_func_init_sse(pa_cpu_x86_flag_t flags) {
     if (flags & PA_CPU_X86_SSE2) {
         pa_log_info("Initialising SSE2 optimized remappers.");
         pa_set_init_remap_func ((pa_init_remap_func_t) init_remap_sse2);
+        pa_set_init_remap_matrix_func ((pa_init_remap_func_t) init_remap_matrix_sse);
     }
 
 #endif /* defined (__i386__) || defined (__amd64__) */
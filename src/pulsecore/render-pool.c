@@ -0,0 +1,175 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/util.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/semaphore.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#include "render-pool.h"
+
+struct pa_render_pool {
+    pa_thread **threads;
+    unsigned n_threads;
+    int rtprio;
+
+    /* Posted once for every helper thread that shall take part in a run */
+    pa_semaphore *start;
+    /* Posted by every helper thread once it ran out of jobs */
+    pa_semaphore *done;
+
+    /* The current run. Written by the submitting thread before posting
+     * start, the semaphore makes it visible to the helpers. */
+    pa_render_pool_job_cb_t cb;
+    void *userdata;
+    unsigned n_jobs;
+    pa_thread_mq *thread_mq;
+    pa_atomic_t next_job;
+
+    bool quit;
+};
+
+static void run_jobs(pa_render_pool *p) {
+    int job;
+
+    while ((job = pa_atomic_inc(&p->next_job)) < (int) p->n_jobs)
+        p->cb(p->userdata, (unsigned) job);
+}
+
+static void thread_func(void *userdata) {
+    pa_render_pool *p = userdata;
+
+    if (p->rtprio > 0)
+        pa_thread_make_realtime(p->rtprio);
+
+    for (;;) {
+        pa_semaphore_wait(p->start);
+
+        if (p->quit)
+            break;
+
+        if (p->thread_mq)
+            pa_thread_mq_install(p->thread_mq);
+
+        run_jobs(p);
+
+        if (p->thread_mq)
+            pa_thread_mq_uninstall();
+
+        pa_semaphore_post(p->done);
+    }
+}
+
+pa_render_pool *pa_render_pool_new(const char *name, unsigned n_threads, int rtprio) {
+    pa_render_pool *p;
+    unsigned i;
+
+    pa_assert(name);
+    pa_assert(n_threads > 0);
+
+    p = pa_xnew0(pa_render_pool, 1);
+    p->threads = pa_xnew0(pa_thread*, n_threads);
+    p->rtprio = rtprio;
+    p->start = pa_semaphore_new(0);
+    p->done = pa_semaphore_new(0);
+    pa_atomic_store(&p->next_job, 0);
+
+    for (i = 0; i < n_threads; i++) {
+        char *t;
+
+        t = pa_sprintf_malloc("%s-%u", name, i);
+        p->threads[i] = pa_thread_new(t, thread_func, p);
+        pa_xfree(t);
+
+        if (!p->threads[i]) {
+            pa_log("Failed to create render thread.");
+            break;
+        }
+
+        p->n_threads++;
+    }
+
+    if (p->n_threads == 0) {
+        pa_render_pool_free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+void pa_render_pool_free(pa_render_pool *p) {
+    unsigned i;
+
+    pa_assert(p);
+
+    p->quit = true;
+
+    for (i = 0; i < p->n_threads; i++)
+        pa_semaphore_post(p->start);
+
+    for (i = 0; i < p->n_threads; i++)
+        pa_thread_free(p->threads[i]);
+
+    pa_semaphore_free(p->start);
+    pa_semaphore_free(p->done);
+    pa_xfree(p->threads);
+    pa_xfree(p);
+}
+
+unsigned pa_render_pool_get_n_threads(pa_render_pool *p) {
+    pa_assert(p);
+
+    return p->n_threads;
+}
+
+void pa_render_pool_run(pa_render_pool *p, pa_render_pool_job_cb_t cb, void *userdata, unsigned n_jobs) {
+    unsigned n_wake, i;
+
+    pa_assert(p);
+    pa_assert(cb);
+
+    if (n_jobs <= 0)
+        return;
+
+    p->cb = cb;
+    p->userdata = userdata;
+    p->n_jobs = n_jobs;
+    p->thread_mq = pa_thread_mq_get();
+    pa_atomic_store(&p->next_job, 0);
+
+    /* The calling thread does its share too, so there is no point in
+     * waking up helpers for a single job */
+    n_wake = PA_MIN(p->n_threads, n_jobs - 1);
+
+    for (i = 0; i < n_wake; i++)
+        pa_semaphore_post(p->start);
+
+    run_jobs(p);
+
+    for (i = 0; i < n_wake; i++)
+        pa_semaphore_wait(p->done);
+}
@@ -0,0 +1,42 @@
+#ifndef foopulsecorerenderpoolhfoo
+#define foopulsecorerenderpoolhfoo
+
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as
+  published by the Free Software Foundation; either version 2.1 of the
+  License, or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+/* A small set of helper threads an IO thread can hand independent pieces
+ * of work to. The helpers act on behalf of the IO thread that submitted
+ * the work, i.e. pa_thread_mq_get() returns that thread's queues while a
+ * job runs. */
+
+typedef struct pa_render_pool pa_render_pool;
+
+typedef void (*pa_render_pool_job_cb_t)(void *userdata, unsigned job);
+
+/* If rtprio is > 0 the helper threads are made realtime with that
+ * priority */
+pa_render_pool *pa_render_pool_new(const char *name, unsigned n_threads, int rtprio);
+void pa_render_pool_free(pa_render_pool *p);
+
+unsigned pa_render_pool_get_n_threads(pa_render_pool *p);
+
+/* Calls cb for every job in [0, n_jobs), spread over the helper threads
+ * and the calling thread, and returns when all of them are done. Not
+ * reentrant, only one thread may use a pool at a time. */
+void pa_render_pool_run(pa_render_pool *p, pa_render_pool_job_cb_t cb, void *userdata, unsigned n_jobs);
+
+#endif
@@ -30,20 +30,58 @@
 #include <pulsecore/macro.h>
 #include <pulsecore/strbuf.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/refcnt.h>
 
 #include "resampler.h"
 
 /* Number of samples of extra space we allow the resamplers to return */
 #define EXTRA_FRAMES 128
 
+/* Size of the work format data run_blocked() passes through all stages at
+ * once, small enough to stay in L1 */
+#define BLOCK_BYTES 8192
+
+/* The flags that have an influence on the channel matrix */
+#define REMAP_FLAGS (PA_RESAMPLER_NO_REMAP | PA_RESAMPLER_NO_REMIX | PA_RESAMPLER_NO_FILL_SINK | \
+                     PA_RESAMPLER_PRODUCE_LFE | PA_RESAMPLER_CONSUME_LFE)
+
+/* The remap setup only depends on the work format, the channel maps and the
+ * remix flags, and isn't modified once set up, so resamplers with the same
+ * configuration share it. Each pa_core keeps one cache, so that many
+ * streams of the same format don't each build their own matrix and
+ * optimized tables. */
+struct pa_resampler_cache {
+    pa_mutex *mutex;
+    pa_hashmap *remaps;
+};
+
+/* What a remap setup is looked up by in the cache */
+struct remap_key {
+    pa_sample_format_t work_format;
+    pa_channel_map i_cm, o_cm;
+    pa_resample_flags_t flags;
+};
+
+struct pa_resampler_remap {
+    PA_REFCNT_DECLARE;
+
+    pa_resampler_cache *cache;
+    struct remap_key key;
+
+    pa_remap_t remap;
+    bool lfe_remixed;
+};
+
 struct ffmpeg_data { /* data specific to ffmpeg */
     struct AVResampleContext *state;
 };
 
 static int copy_init(pa_resampler *r);
 
-static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed);
-static void free_remap(pa_remap_t *m);
+static pa_resampler_remap *remap_setup_get(pa_resampler_cache *cache, const pa_resampler *r);
+static void remap_setup_unref(pa_resampler_remap *s);
 
 static int (* const init_table[])(pa_resampler *r) = {
 #ifdef HAVE_LIBSAMPLERATE
@@ -120,6 +158,7 @@ static int (* const init_table[])(pa_resampler *r) = {
     [PA_RESAMPLER_SOXR_HQ]                 = NULL,
     [PA_RESAMPLER_SOXR_VHQ]                = NULL,
 #endif
+    [PA_RESAMPLER_POLYPHASE]               = pa_resampler_polyphase_init,
 };
 
 static void calculate_gcd(pa_resampler *r) {
@@ -349,6 +388,20 @@ pa_resampler* pa_resampler_new(
         pa_resample_method_t method,
         pa_resample_flags_t flags) {
 
+    return pa_resampler_new_with_cache(NULL, pool, a, am, b, bm, crossover_freq, method, flags);
+}
+
+pa_resampler* pa_resampler_new_with_cache(
+        pa_resampler_cache *cache,
+        pa_mempool *pool,
+        const pa_sample_spec *a,
+        const pa_channel_map *am,
+        const pa_sample_spec *b,
+        const pa_channel_map *bm,
+        unsigned crossover_freq,
+        pa_resample_method_t method,
+        pa_resample_flags_t flags) {
+
     pa_resampler *r = NULL;
     bool lfe_remixed = false;
 
@@ -441,8 +494,11 @@ pa_resampler* pa_resampler_new(
     pa_log_debug("  channels %d -> %d (resampling %d)", a->channels, b->channels, r->work_channels);
 
     /* set up the remap structure */
-    if (r->map_required)
-        setup_remap(r, &r->remap, &lfe_remixed);
+    if (r->map_required) {
+        r->remap_setup = remap_setup_get(cache, r);
+        r->remap = &r->remap_setup->remap;
+        lfe_remixed = r->remap_setup->lfe_remixed;
+    }
 
     if (lfe_remixed && crossover_freq > 0) {
         pa_sample_spec wss = r->o_ss;
@@ -456,11 +512,23 @@ pa_resampler* pa_resampler_new(
     if (init_table[method](r) < 0)
         goto fail;
 
+    /* Run the stages block by block if there is more than one of them. The
+     * LFE filter and resamplers that may leave frames unconsumed need the
+     * stages' buffers in full. */
+    if (!r->lfe_filter && (!r->impl.resample || r->impl.no_leftover) &&
+        !!r->to_work_format_func + r->map_required + !!r->impl.resample + !!r->from_work_format_func >= 2) {
+        r->blocked = true;
+        r->block_frames = PA_MAX(BLOCK_BYTES / (r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels)), 1U);
+        pa_log_debug("  running stages in blocks of %u frames", r->block_frames);
+    }
+
     return r;
 
 fail:
     if (r->lfe_filter)
       pa_lfe_filter_free(r->lfe_filter);
+    if (r->remap_setup)
+        remap_setup_unref(r->remap_setup);
     pa_xfree(r);
 
     return NULL;
@@ -485,8 +553,13 @@ void pa_resampler_free(pa_resampler *r) {
         pa_memblock_unref(r->resample_buf.memblock);
     if (r->from_work_format_buf.memblock)
         pa_memblock_unref(r->from_work_format_buf.memblock);
+    if (r->block_buf[0].memblock)
+        pa_memblock_unref(r->block_buf[0].memblock);
+    if (r->block_buf[1].memblock)
+        pa_memblock_unref(r->block_buf[1].memblock);
 
-    free_remap(&r->remap);
+    if (r->remap_setup)
+        remap_setup_unref(r->remap_setup);
 
     pa_xfree(r);
 }
@@ -809,7 +882,8 @@ static const char * const resample_methods[] = {
     "peaks",
     "soxr-mq",
     "soxr-hq",
-    "soxr-vhq"
+    "soxr-vhq",
+    "polyphase"
 };
 
 const char *pa_resample_method_to_string(pa_resample_method_t m) {
@@ -1399,10 +1473,144 @@ static void setup_remap(const pa_resampler *r, pa_remap_t *m, bool *lfe_remixed)
     pa_init_remap_func(m);
 }
 
-static void free_remap(pa_remap_t *m) {
-    pa_assert(m);
+static void remap_setup_key(const pa_resampler *r, struct remap_key *key) {
+    pa_zero(*key);
+    key->work_format = r->work_format;
+    key->i_cm = r->i_cm;
+    key->o_cm = r->o_cm;
+    key->flags = r->flags & REMAP_FLAGS;
+}
+
+static unsigned channel_map_hash(unsigned hash, const pa_channel_map *map) {
+    unsigned c;
+
+    hash = 31 * hash + map->channels;
+    for (c = 0; c < map->channels; c++)
+        hash = 31 * hash + (unsigned) map->map[c];
+
+    return hash;
+}
+
+/* Only the positions of the channels in use count, the rest of the
+ * channel maps is undefined */
+static unsigned remap_key_hash_func(const void *p) {
+    const struct remap_key *key = p;
+    unsigned hash;
+
+    hash = (unsigned) key->work_format;
+    hash = 31 * hash + (unsigned) key->flags;
+    hash = channel_map_hash(hash, &key->i_cm);
+
+    return channel_map_hash(hash, &key->o_cm);
+}
+
+static int remap_key_compare_func(const void *a, const void *b) {
+    const struct remap_key *ka = a, *kb = b;
+
+    if (ka->work_format != kb->work_format)
+        return ka->work_format < kb->work_format ? -1 : 1;
+
+    if (ka->flags != kb->flags)
+        return ka->flags < kb->flags ? -1 : 1;
+
+    if (!pa_channel_map_equal(&ka->i_cm, &kb->i_cm) || !pa_channel_map_equal(&ka->o_cm, &kb->o_cm))
+        return 1;
+
+    return 0;
+}
+
+/* Returns a reference to the remap setup for r, from the cache if there is
+ * one. May be called from any context. */
+static pa_resampler_remap *remap_setup_get(pa_resampler_cache *cache, const pa_resampler *r) {
+    pa_resampler_remap *s;
+    struct remap_key key;
+
+    pa_assert(r);
+
+    remap_setup_key(r, &key);
+
+    if (cache) {
+        pa_mutex_lock(cache->mutex);
+
+        if ((s = pa_hashmap_get(cache->remaps, &key))) {
+            PA_REFCNT_INC(s);
+            pa_mutex_unlock(cache->mutex);
+
+            pa_log_debug("  sharing channel matrix");
+            return s;
+        }
+    }
 
-    pa_xfree(m->state);
+    s = pa_xnew0(pa_resampler_remap, 1);
+    PA_REFCNT_INIT(s);
+    s->cache = cache;
+    s->key = key;
+
+    setup_remap(r, &s->remap, &s->lfe_remixed);
+
+    if (cache) {
+        pa_assert_se(pa_hashmap_put(cache->remaps, &s->key, s) == 0);
+        pa_mutex_unlock(cache->mutex);
+    }
+
+    return s;
+}
+
+static void remap_setup_free(pa_resampler_remap *s) {
+    pa_xfree(s->remap.state);
+    pa_xfree(s);
+}
+
+static void remap_setup_unref(pa_resampler_remap *s) {
+    pa_resampler_cache *cache;
+
+    pa_assert(s);
+    pa_assert(PA_REFCNT_VALUE(s) >= 1);
+
+    if (!(cache = s->cache)) {
+        if (PA_REFCNT_DEC(s) <= 0)
+            remap_setup_free(s);
+        return;
+    }
+
+    /* The lookup takes the lock before taking a reference, so this can't
+     * race with a new user of s */
+    pa_mutex_lock(cache->mutex);
+
+    if (PA_REFCNT_DEC(s) > 0) {
+        pa_mutex_unlock(cache->mutex);
+        return;
+    }
+
+    pa_assert_se(pa_hashmap_remove(cache->remaps, &s->key) == s);
+    pa_mutex_unlock(cache->mutex);
+
+    remap_setup_free(s);
+}
+
+pa_resampler_cache *pa_resampler_cache_new(void) {
+    pa_resampler_cache *c;
+
+    c = pa_xnew(pa_resampler_cache, 1);
+    c->mutex = pa_mutex_new(false, false);
+    c->remaps = pa_hashmap_new(remap_key_hash_func, remap_key_compare_func);
+
+    return c;
+}
+
+void pa_resampler_cache_free(pa_resampler_cache *c) {
+    pa_resampler_remap *s;
+    void *state;
+
+    pa_assert(c);
+
+    /* Setups still in use become private to their users */
+    PA_HASHMAP_FOREACH(s, c->remaps, state)
+        s->cache = NULL;
+
+    pa_hashmap_free(c->remaps);
+    pa_mutex_free(c->mutex);
+    pa_xfree(c);
 }
 
 /* check if buf's memblock is large enough to hold 'len' bytes; create a
@@ -1515,7 +1723,7 @@ static pa_memchunk *remap_channels(pa_resampler *r, pa_memchunk *input) {
     dst = (uint8_t *) pa_memblock_acquire(r->remap_buf.memblock) + leftover_length;
 
     if (r->map_required) {
-        pa_remap_t *remap = &r->remap;
+        pa_remap_t *remap = r->remap;
 
         pa_assert(remap->do_remap);
         remap->do_remap(remap, dst, src, in_n_frames);
@@ -1600,6 +1808,110 @@ static pa_memchunk *convert_from_work_format(pa_resampler *r, pa_memchunk *input
     return &r->from_work_format_buf;
 }
 
+/* Instead of running each stage over all of the input, with an
+ * intermediate buffer of the full size in between, run all stages over a
+ * block of input at a time, so that the intermediate data stays in cache.
+ * The two block buffers are used in turns, the last stage writes straight
+ * to the output. */
+static void run_blocked(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
+    unsigned in_n_frames, out_n_frames, max_out_frames, block_out_frames, offset, n;
+    size_t len;
+    uint8_t *src, *dst, *block[2];
+    bool remap_first = r->o_ss.channels <= r->i_ss.channels;
+
+    in_n_frames = (unsigned) (in->length / r->i_fz);
+    max_out_frames = in_n_frames;
+    block_out_frames = r->block_frames;
+
+    if (r->impl.resample) {
+        max_out_frames = (unsigned) (((uint64_t) in_n_frames * r->o_ss.rate) / r->i_ss.rate) + EXTRA_FRAMES;
+        block_out_frames = (unsigned) (((uint64_t) r->block_frames * r->o_ss.rate) / r->i_ss.rate) + EXTRA_FRAMES;
+    }
+
+    len = PA_MAX(r->block_frames, block_out_frames) * r->w_sz * PA_MAX(r->i_ss.channels, r->o_ss.channels);
+    fit_buf(r, &r->block_buf[0], len, &r->block_buf_size[0], 0);
+    fit_buf(r, &r->block_buf[1], len, &r->block_buf_size[1], 0);
+    fit_buf(r, &r->from_work_format_buf, max_out_frames * r->o_fz, &r->from_work_format_buf_size, 0);
+
+    src = pa_memblock_acquire_chunk(in);
+    block[0] = pa_memblock_acquire(r->block_buf[0].memblock);
+    block[1] = pa_memblock_acquire(r->block_buf[1].memblock);
+    dst = pa_memblock_acquire(r->from_work_format_buf.memblock);
+
+    out_n_frames = 0;
+
+    for (offset = 0; offset < in_n_frames; offset += n) {
+        unsigned n_frames;
+        int cur = -1, next = 0;
+        void *p;
+
+        n = PA_MIN(r->block_frames, in_n_frames - offset);
+        n_frames = n;
+        p = src + offset * r->i_fz;
+
+        if (r->to_work_format_func) {
+            r->to_work_format_func(n * r->i_ss.channels, p, block[next]);
+            p = block[cur = next];
+            next = 1 - cur;
+        }
+
+        if (r->map_required && remap_first) {
+            r->remap->do_remap(r->remap, block[next], p, n_frames);
+            p = block[cur = next];
+            next = 1 - cur;
+        }
+
+        if (r->impl.resample) {
+            pa_memchunk i, o;
+
+            if (cur < 0) {
+                i = *in;
+                i.index += offset * r->i_fz;
+            } else {
+                i = r->block_buf[cur];
+                i.index = 0;
+            }
+            i.length = n_frames * r->w_fz;
+
+            o = r->block_buf[next];
+            o.index = 0;
+            n_frames = PA_MIN(block_out_frames, max_out_frames - out_n_frames);
+            o.length = n_frames * r->w_fz;
+
+            pa_assert_se(r->impl.resample(r, &i, n, &o, &n_frames) == 0);
+            p = block[cur = next];
+            next = 1 - cur;
+        }
+
+        if (r->map_required && !remap_first) {
+            r->remap->do_remap(r->remap, block[next], p, n_frames);
+            p = block[cur = next];
+        }
+
+        pa_assert(out_n_frames + n_frames <= max_out_frames);
+
+        if (r->from_work_format_func)
+            r->from_work_format_func(n_frames * r->o_ss.channels, p, dst + out_n_frames * r->o_fz);
+        else
+            memcpy(dst + out_n_frames * r->o_fz, p, n_frames * r->o_fz);
+
+        out_n_frames += n_frames;
+    }
+
+    pa_memblock_release(in->memblock);
+    pa_memblock_release(r->block_buf[0].memblock);
+    pa_memblock_release(r->block_buf[1].memblock);
+    pa_memblock_release(r->from_work_format_buf.memblock);
+
+    if (out_n_frames > 0) {
+        r->from_work_format_buf.length = out_n_frames * r->o_fz;
+        *out = r->from_work_format_buf;
+        r->out_frames += out_n_frames;
+        pa_memchunk_reset(&r->from_work_format_buf);
+    } else
+        pa_memchunk_reset(out);
+}
+
 void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out) {
     pa_memchunk *buf;
 
@@ -1612,6 +1924,12 @@ void pa_resampler_run(pa_resampler *r, const pa_memchunk *in, pa_memchunk *out)
 
     buf = (pa_memchunk*) in;
     r->in_frames += buf->length / r->i_fz;
+
+    if (r->blocked) {
+        run_blocked(r, in, out);
+        return;
+    }
+
     buf = convert_to_work_format(r, buf);
 
     /* Try to save resampling effort: if we have more output channels than
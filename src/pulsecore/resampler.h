@@ -29,6 +29,8 @@
 #include <pulsecore/filter/lfe-filter.h>
 
 typedef struct pa_resampler pa_resampler;
+typedef struct pa_resampler_cache pa_resampler_cache;
+typedef struct pa_resampler_remap pa_resampler_remap;
 typedef struct pa_resampler_impl pa_resampler_impl;
 
 struct pa_resampler_impl {
@@ -38,6 +40,10 @@ struct pa_resampler_impl {
     /* Returns the number of leftover frames in the input buffer. */
     unsigned (*resample)(pa_resampler *r, const pa_memchunk *in, unsigned in_n_frames, pa_memchunk *out, unsigned *out_n_frames);
 
+    /* Set if resample() never returns leftover frames, given enough room
+     * for the output. The input may then be fed in pieces of any size. */
+    bool no_leftover;
+
     void (*reset)(pa_resampler *r);
     void *data;
 };
@@ -61,6 +67,7 @@ typedef enum pa_resample_method {
     PA_RESAMPLER_SOXR_MQ,
     PA_RESAMPLER_SOXR_HQ,
     PA_RESAMPLER_SOXR_VHQ,
+    PA_RESAMPLER_POLYPHASE,
     PA_RESAMPLER_MAX
 } pa_resample_method_t;
 
@@ -101,6 +108,13 @@ struct pa_resampler {
     pa_memchunk *leftover_buf;
     size_t *leftover_buf_size;
 
+    /* scratch buffers for running all stages block by block, see
+     * run_blocked() */
+    bool blocked;
+    unsigned block_frames;
+    pa_memchunk block_buf[2];
+    size_t block_buf_size[2];
+
     /* have_leftover points to leftover_in_remap or leftover_in_to_work */
     bool *have_leftover;
     bool leftover_in_remap;
@@ -112,7 +126,10 @@ struct pa_resampler {
     pa_convert_func_t to_work_format_func;
     pa_convert_func_t from_work_format_func;
 
-    pa_remap_t remap;
+    /* The remap setup is immutable and may be shared with other resamplers,
+     * see pa_resampler_cache */
+    pa_resampler_remap *remap_setup;
+    pa_remap_t *remap;
     bool map_required;
 
     double in_frames;
@@ -134,8 +151,26 @@ pa_resampler* pa_resampler_new(
         pa_resample_method_t resample_method,
         pa_resample_flags_t flags);
 
+/* Like pa_resampler_new(), but shares the immutable parts of the setup
+ * with the other resamplers created from the same cache */
+pa_resampler* pa_resampler_new_with_cache(
+        pa_resampler_cache *cache,
+        pa_mempool *pool,
+        const pa_sample_spec *a,
+        const pa_channel_map *am,
+        const pa_sample_spec *b,
+        const pa_channel_map *bm,
+        unsigned crossover_freq,
+        pa_resample_method_t resample_method,
+        pa_resample_flags_t flags);
+
 void pa_resampler_free(pa_resampler *r);
 
+/* A cache of resampler setups, keyed on the sample formats, channel maps
+ * and flags. Resamplers may outlive the cache. */
+pa_resampler_cache *pa_resampler_cache_new(void);
+void pa_resampler_cache_free(pa_resampler_cache *c);
+
 /* Returns the size of an input memory block which is required to return the specified amount of output data */
 size_t pa_resampler_request(pa_resampler *r, size_t out_length);
 
@@ -199,6 +234,15 @@ int pa_resampler_peaks_init(pa_resampler *r);
 int pa_resampler_speex_init(pa_resampler *r);
 int pa_resampler_trivial_init(pa_resampler*r);
 int pa_resampler_soxr_init(pa_resampler *r);
+int pa_resampler_polyphase_init(pa_resampler *r);
+
+/* The inner loop of the polyphase resampler: for each channel, the dot
+ * product of the taps samples at x + c * stride with the filter h, which is
+ * 32 byte aligned. taps is a multiple of 8. */
+typedef void (*pa_polyphase_filter_func_t)(float *dst, const float *x, size_t stride, unsigned channels, const float *h, unsigned taps);
+
+pa_polyphase_filter_func_t pa_get_polyphase_filter_func(void);
+void pa_set_polyphase_filter_func(pa_polyphase_filter_func_t func);
 
 /* Resampler-specific quirks */
 bool pa_speex_is_fixed_point(void);
@@ -155,6 +155,7 @@ int pa_resampler_peaks_init(pa_resampler*r) {
     r->impl.resample = peaks_resample;
     r->impl.update_rates = peaks_update_rates_or_reset;
     r->impl.reset = peaks_update_rates_or_reset;
+    r->impl.no_leftover = true;
     r->impl.data = peaks_data;
 
     return 0;
@@ -0,0 +1,442 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/resampler.h>
+
+/* A windowed sinc filter, evaluated at the fractional positions of the
+ * output frames within the input. With out/in = l/m in lowest terms there
+ * are only l different positions, so for the usual ratios (44.1k <-> 48k
+ * has 160 and 147, 16k -> 48k has 3) the filter is precomputed for every
+ * one of them ("phase"). For ratios with more phases than MAX_PHASES, e.g.
+ * while a variable rate resampler adjusts its rate, the filter is
+ * interpolated linearly between INTERP_PHASES precomputed ones.
+ *
+ * The tables only depend on the ratio, so they are shared between all
+ * resamplers using the same one. */
+
+/* Filter length at the lower of the two rates, and the longest one used
+ * when downsampling by large factors. Multiples of 8 keep the SIMD
+ * versions simple. */
+#define BASE_TAPS 48
+#define MAX_TAPS 1024
+
+/* Passband edge relative to the lower Nyquist frequency, and the Kaiser
+ * window parameter, for about 70 dB of stopband attenuation */
+#define CUTOFF 0.91
+#define KAISER_BETA 7.0
+
+#define MAX_PHASES 512
+#define INTERP_PHASES 256
+
+typedef struct polyphase_bank polyphase_bank;
+
+struct polyphase_bank {
+    unsigned ref;
+
+    unsigned phases;
+    bool interpolate;
+    unsigned taps;
+    double cutoff;
+
+    /* phases (+ 1 if interpolating) rows of taps coefficients */
+    float *rows;
+    void *mem;
+
+    PA_LLIST_FIELDS(polyphase_bank);
+};
+
+struct polyphase_data {
+    polyphase_bank *bank;
+    unsigned l, m;
+    unsigned taps;
+
+    /* The input, one row of capacity frames per channel. The filter window
+     * of the next output frame starts at s, and the frame lies p/l input
+     * frames after the center of the window. */
+    float *history;
+    unsigned capacity, n_history;
+    unsigned s, p;
+
+    /* the interpolated filter, if the bank doesn't have all phases */
+    float *row;
+    void *row_mem;
+};
+
+static PA_LLIST_HEAD(polyphase_bank, banks) = NULL;
+static pa_static_mutex banks_mutex = PA_STATIC_MUTEX_INIT;
+
+/* Four partial sums, which the compiler can keep in one vector register */
+static void filter_c(float *dst, const float *x, size_t stride, unsigned channels, const float *h, unsigned taps) {
+    unsigned c, k;
+
+    for (c = 0; c < channels; c++, x += stride) {
+        float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+
+        for (k = 0; k < taps; k += 4) {
+            s0 += x[k] * h[k];
+            s1 += x[k + 1] * h[k + 1];
+            s2 += x[k + 2] * h[k + 2];
+            s3 += x[k + 3] * h[k + 3];
+        }
+
+        dst[c] = (s0 + s1) + (s2 + s3);
+    }
+}
+
+static pa_polyphase_filter_func_t filter_func = filter_c;
+
+pa_polyphase_filter_func_t pa_get_polyphase_filter_func(void) {
+    return filter_func;
+}
+
+void pa_set_polyphase_filter_func(pa_polyphase_filter_func_t func) {
+    pa_assert(func);
+
+    filter_func = func;
+}
+
+static float *aligned_floats(size_t n, void **mem) {
+    *mem = pa_xmalloc(n * sizeof(float) + 31);
+
+    return (float *) (((uintptr_t) *mem + 31) & ~(uintptr_t) 31);
+}
+
+static double bessel_i0(double x) {
+    double sum = 1.0, term = 1.0;
+    unsigned k;
+
+    for (k = 1; term > sum * 1e-12; k++) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+
+    return sum;
+}
+
+static void bank_compute(polyphase_bank *b) {
+    unsigned n_rows = b->phases + (b->interpolate ? 1 : 0);
+    double half = b->taps / 2, norm = bessel_i0(KAISER_BETA);
+    unsigned i, k;
+
+    for (i = 0; i < n_rows; i++) {
+        float *row = b->rows + i * b->taps;
+        double phase = (double) i / b->phases, sum = 0.0;
+
+        for (k = 0; k < b->taps; k++) {
+            double x = (double) k - (half - 1) - phase, t = x / half, v;
+
+            v = b->cutoff * (x == 0 ? 1.0 : sin(M_PI * b->cutoff * x) / (M_PI * b->cutoff * x));
+            v *= t * t < 1.0 ? bessel_i0(KAISER_BETA * sqrt(1.0 - t * t)) / norm : 0.0;
+
+            row[k] = (float) v;
+            sum += v;
+        }
+
+        /* Unity gain at DC for every phase */
+        for (k = 0; k < b->taps; k++)
+            row[k] = (float) (row[k] / sum);
+    }
+}
+
+static polyphase_bank *bank_get(unsigned phases, bool interpolate, unsigned taps, double cutoff) {
+    polyphase_bank *b;
+    pa_mutex *mutex;
+
+    mutex = pa_static_mutex_get(&banks_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    PA_LLIST_FOREACH(b, banks)
+        if (b->phases == phases && b->interpolate == interpolate && b->taps == taps && b->cutoff == cutoff) {
+            b->ref++;
+            goto finish;
+        }
+
+    b = pa_xnew0(polyphase_bank, 1);
+    b->ref = 1;
+    b->phases = phases;
+    b->interpolate = interpolate;
+    b->taps = taps;
+    b->cutoff = cutoff;
+    b->rows = aligned_floats((size_t) (phases + 1) * taps, &b->mem);
+    bank_compute(b);
+
+    PA_LLIST_PREPEND(polyphase_bank, banks, b);
+
+finish:
+    pa_mutex_unlock(mutex);
+
+    return b;
+}
+
+static void bank_unref(polyphase_bank *b) {
+    pa_mutex *mutex;
+
+    pa_assert(b);
+
+    mutex = pa_static_mutex_get(&banks_mutex, false, false);
+    pa_mutex_lock(mutex);
+
+    pa_assert(b->ref >= 1);
+
+    if (--b->ref == 0) {
+        PA_LLIST_REMOVE(polyphase_bank, banks, b);
+        pa_xfree(b->mem);
+        pa_xfree(b);
+    }
+
+    pa_mutex_unlock(mutex);
+}
+
+/* Makes room for at least n frames per channel */
+static void history_fit(struct polyphase_data *d, unsigned channels, unsigned n) {
+    float *h;
+    unsigned c;
+
+    if (n <= d->capacity)
+        return;
+
+    n = PA_MAX(n, d->capacity * 2);
+    h = pa_xnew(float, (size_t) n * channels);
+
+    if (d->history)
+        for (c = 0; c < channels; c++)
+            memcpy(h + c * n, d->history + c * d->capacity, d->n_history * sizeof(float));
+
+    pa_xfree(d->history);
+    d->history = h;
+    d->capacity = n;
+}
+
+/* Inserts n frames of silence in front of the history */
+static void history_prepend_zeros(struct polyphase_data *d, unsigned channels, unsigned n) {
+    unsigned c;
+
+    history_fit(d, channels, d->n_history + n);
+
+    for (c = 0; c < channels; c++) {
+        float *h = d->history + c * d->capacity;
+
+        memmove(h + n, h, d->n_history * sizeof(float));
+        memset(h, 0, n * sizeof(float));
+    }
+
+    d->n_history += n;
+}
+
+static void setup_ratio(pa_resampler *r, struct polyphase_data *d) {
+    polyphase_bank *old = d->bank;
+    unsigned l, m, taps, center;
+    bool interpolate;
+    double cutoff;
+
+    l = r->o_ss.rate / r->gcd;
+    m = r->i_ss.rate / r->gcd;
+
+    taps = BASE_TAPS;
+    cutoff = CUTOFF;
+
+    if (m > l) {
+        taps = (unsigned) PA_MIN(((uint64_t) BASE_TAPS * m / l + 7) & ~7ULL, (uint64_t) MAX_TAPS);
+        cutoff = CUTOFF * l / m;
+    }
+
+    interpolate = l > MAX_PHASES;
+    d->bank = bank_get(interpolate ? INTERP_PHASES : l, interpolate, taps, cutoff);
+
+    if (old)
+        bank_unref(old);
+
+    /* On a rate change keep the window centered on the same input frame */
+    if (d->taps > 0) {
+        center = d->s + d->taps / 2 - 1;
+
+        if (center < taps / 2 - 1) {
+            history_prepend_zeros(d, r->work_channels, taps / 2 - 1 - center);
+            d->s = 0;
+        } else
+            d->s = center - (taps / 2 - 1);
+
+        d->p = (unsigned) ((uint64_t) d->p * l / d->l);
+    }
+
+    if (taps != d->taps) {
+        pa_xfree(d->row_mem);
+        d->row = aligned_floats(taps, &d->row_mem);
+    }
+
+    d->l = l;
+    d->m = m;
+    d->taps = taps;
+}
+
+static const float *get_row(struct polyphase_data *d) {
+    const polyphase_bank *b = d->bank;
+    const float *h0, *h1;
+    uint64_t pos;
+    unsigned k;
+    float a;
+
+    if (!b->interpolate)
+        return b->rows + d->p * b->taps;
+
+    pos = (uint64_t) d->p * INTERP_PHASES;
+    h0 = b->rows + (pos / d->l) * b->taps;
+    h1 = h0 + b->taps;
+    a = (float) (pos % d->l) / d->l;
+
+    for (k = 0; k < b->taps; k++)
+        d->row[k] = h0[k] + a * (h1[k] - h0[k]);
+
+    return d->row;
+}
+
+static unsigned polyphase_resample(pa_resampler *r, const pa_memchunk *input, unsigned in_n_frames, pa_memchunk *output, unsigned *out_n_frames) {
+    struct polyphase_data *d;
+    pa_polyphase_filter_func_t filter = filter_func;
+    unsigned channels, c, i, n, o = 0;
+    const float *src;
+    float *dst;
+
+    pa_assert(r);
+    pa_assert(input);
+    pa_assert(output);
+    pa_assert(out_n_frames);
+
+    d = r->impl.data;
+    channels = r->work_channels;
+
+    history_fit(d, channels, d->n_history + in_n_frames);
+
+    src = pa_memblock_acquire_chunk(input);
+
+    for (c = 0; c < channels; c++) {
+        float *h = d->history + c * d->capacity + d->n_history;
+
+        for (i = 0; i < in_n_frames; i++)
+            h[i] = src[i * channels + c];
+    }
+
+    pa_memblock_release(input->memblock);
+    d->n_history += in_n_frames;
+
+    dst = pa_memblock_acquire_chunk(output);
+
+    for (; o < *out_n_frames && d->s + d->taps <= d->n_history; o++) {
+        filter(dst + o * channels, d->history + d->s, d->capacity, channels, get_row(d), d->taps);
+
+        d->p += d->m;
+        d->s += d->p / d->l;
+        d->p %= d->l;
+    }
+
+    pa_memblock_release(output->memblock);
+
+    *out_n_frames = o;
+
+    /* Drop the frames no window will need anymore */
+    n = PA_MIN(d->s, d->n_history);
+
+    if (n > 0) {
+        for (c = 0; c < channels; c++) {
+            float *h = d->history + c * d->capacity;
+            memmove(h, h + n, (d->n_history - n) * sizeof(float));
+        }
+
+        d->n_history -= n;
+        d->s -= n;
+    }
+
+    return 0;
+}
+
+static void polyphase_reset(pa_resampler *r) {
+    struct polyphase_data *d;
+    unsigned c;
+
+    pa_assert(r);
+
+    d = r->impl.data;
+
+    /* Start with the window centered on the first input frame */
+    d->n_history = d->taps / 2 - 1;
+    d->s = 0;
+    d->p = 0;
+
+    history_fit(d, r->work_channels, d->n_history);
+
+    for (c = 0; c < r->work_channels; c++)
+        memset(d->history + c * d->capacity, 0, d->n_history * sizeof(float));
+}
+
+static void polyphase_update_rates(pa_resampler *r) {
+    pa_assert(r);
+
+    setup_ratio(r, r->impl.data);
+}
+
+static void polyphase_free(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+
+    if (!(d = r->impl.data))
+        return;
+
+    if (d->bank)
+        bank_unref(d->bank);
+
+    pa_xfree(d->history);
+    pa_xfree(d->row_mem);
+    pa_xfree(d);
+}
+
+int pa_resampler_polyphase_init(pa_resampler *r) {
+    struct polyphase_data *d;
+
+    pa_assert(r);
+    pa_assert(r->work_format == PA_SAMPLE_FLOAT32NE);
+
+    d = pa_xnew0(struct polyphase_data, 1);
+
+    r->impl.resample = polyphase_resample;
+    r->impl.update_rates = polyphase_update_rates;
+    r->impl.reset = polyphase_reset;
+    r->impl.free = polyphase_free;
+    r->impl.no_leftover = true;
+    r->impl.data = d;
+
+    setup_ratio(r, d);
+    polyphase_reset(r);
+
+    pa_log_info("Polyphase resampler with %u taps and %u%s phases.", d->taps, d->bank->phases,
+                d->bank->interpolate ? " interpolated" : "");
+
+    return 0;
+}
@@ -0,0 +1,66 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/resampler.h>
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Two accumulators to hide the latency of the adds. The history is not
+ * aligned, the filter is. */
+static void filter_avx2(float *dst, const float *x, size_t stride, unsigned channels, const float *h, unsigned taps) {
+    unsigned c, k;
+
+    for (c = 0; c < channels; c++, x += stride) {
+        __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+        __m128 s;
+
+        for (k = 0; k + 16 <= taps; k += 16) {
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_load_ps(h + k)));
+            a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(x + k + 8), _mm256_load_ps(h + k + 8)));
+        }
+
+        if (k < taps)
+            a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(x + k), _mm256_load_ps(h + k)));
+
+        a0 = _mm256_add_ps(a0, a1);
+        s = _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+
+        dst[c] = _mm_cvtss_f32(s);
+    }
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_polyphase_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized polyphase resampler.");
+        pa_set_polyphase_filter_func(filter_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
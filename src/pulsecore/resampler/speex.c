@@ -155,6 +155,7 @@ int pa_resampler_speex_init(pa_resampler *r) {
     r->impl.free = speex_free;
     r->impl.update_rates = speex_update_rates;
     r->impl.reset = speex_reset;
+    r->impl.no_leftover = true;
 
     if (r->method >= PA_RESAMPLER_SPEEX_FIXED_BASE && r->method <= PA_RESAMPLER_SPEEX_FIXED_MAX) {
 
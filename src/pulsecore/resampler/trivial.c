@@ -94,6 +94,7 @@ int pa_resampler_trivial_init(pa_resampler *r) {
     r->impl.resample = trivial_resample;
     r->impl.update_rates = trivial_update_rates_or_reset;
     r->impl.reset = trivial_update_rates_or_reset;
+    r->impl.no_leftover = true;
     r->impl.data = trivial_data;
 
     return 0;
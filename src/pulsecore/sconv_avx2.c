@@ -0,0 +1,159 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/endianmacros.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* Eight samples at a time version of sconv_sse41.c, see there for the
+ * details. */
+
+static inline __m256i float_to_s32(__m256 f) {
+    const __m256 scale = _mm256_set1_ps((float) (1U << 31));
+    __m256 v = _mm256_mul_ps(f, scale);
+    __m256i overflow = _mm256_castps_si256(_mm256_cmp_ps(v, scale, _CMP_GE_OQ));
+
+    return _mm256_xor_si256(_mm256_cvtps_epi32(v), overflow);
+}
+
+static inline __m256 s32_to_float(__m256i s) {
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(s), _mm256_set1_ps(1.0f / (1U << 31)));
+}
+
+static inline int32_t float_to_s32_1(float f) {
+    return (int32_t) PA_CLAMP_UNLIKELY(llrintf(f * (1U << 31)), -0x80000000LL, 0x7FFFFFFFLL);
+}
+
+static void pa_sconv_s32le_to_float32ne_avx2(unsigned n, const int32_t *a, float *b) {
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(b + i, s32_to_float(_mm256_loadu_si256((const __m256i *) (a + i))));
+
+    for (; i < n; i++)
+        b[i] = a[i] * (1.0f / (1U << 31));
+}
+
+static void pa_sconv_s32le_from_float32ne_avx2(unsigned n, const float *a, int32_t *b) {
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8)
+        _mm256_storeu_si256((__m256i *) (b + i), float_to_s32(_mm256_loadu_ps(a + i)));
+
+    for (; i < n; i++)
+        b[i] = float_to_s32_1(a[i]);
+}
+
+static void pa_sconv_s24_32le_to_float32ne_avx2(unsigned n, const uint32_t *a, float *b) {
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_slli_epi32(_mm256_loadu_si256((const __m256i *) (a + i)), 8);
+
+        _mm256_storeu_ps(b + i, s32_to_float(s));
+    }
+
+    for (; i < n; i++)
+        b[i] = (int32_t) (a[i] << 8) * (1.0f / (1U << 31));
+}
+
+static void pa_sconv_s24_32le_from_float32ne_avx2(unsigned n, const float *a, uint32_t *b) {
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_srli_epi32(float_to_s32(_mm256_loadu_ps(a + i)), 8);
+
+        _mm256_storeu_si256((__m256i *) (b + i), s);
+    }
+
+    for (; i < n; i++)
+        b[i] = ((uint32_t) float_to_s32_1(a[i])) >> 8;
+}
+
+static void pa_sconv_s24le_to_float32ne_avx2(unsigned n, const uint8_t *a, float *b) {
+    const __m256i unpack = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    unsigned i;
+
+    /* Each 128 bit lane is loaded separately, 12 bytes apart, and the second
+     * load reaches 4 bytes past the 24 bytes of the 8 samples */
+    for (i = 0; i + 10 <= n; i += 8) {
+        __m256i s;
+
+        s = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *) (a + i * 3))),
+                                    _mm_loadu_si128((const __m128i *) (a + i * 3 + 12)), 1);
+        _mm256_storeu_ps(b + i, s32_to_float(_mm256_shuffle_epi8(s, unpack)));
+    }
+
+    for (; i < n; i++) {
+        const uint8_t *p = a + i * 3;
+
+        b[i] = (int32_t) (PA_READ24LE(p) << 8) * (1.0f / (1U << 31));
+    }
+}
+
+static void pa_sconv_s24le_from_float32ne_avx2(unsigned n, const float *a, uint8_t *b) {
+    const __m256i pack = _mm256_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+                                          1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+    unsigned i;
+
+    for (i = 0; i + 8 <= n; i += 8) {
+        __m256i s = _mm256_shuffle_epi8(float_to_s32(_mm256_loadu_ps(a + i)), pack);
+        __m128i hi = _mm256_extracti128_si256(s, 1);
+        uint32_t last = (uint32_t) _mm_extract_epi32(hi, 2);
+
+        /* The 4 bytes of garbage after the first 12 are overwritten by the
+         * second half right away */
+        _mm_storeu_si128((__m128i *) (b + i * 3), _mm256_castsi256_si128(s));
+        _mm_storel_epi64((__m128i *) (b + i * 3 + 12), hi);
+        memcpy(b + i * 3 + 20, &last, sizeof(last));
+    }
+
+    for (; i < n; i++)
+        PA_WRITE24LE(b + i * 3, ((uint32_t) float_to_s32_1(a[i])) >> 8);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_convert_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized conversions.");
+
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_float32ne_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_float32ne_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_float32ne_avx2);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_float32ne_avx2);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_from_float32ne_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
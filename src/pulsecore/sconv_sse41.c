@@ -0,0 +1,158 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/endianmacros.h>
+
+#include "cpu-x86.h"
+#include "sconv.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <smmintrin.h>
+
+/* Conversions between float and the 24 and 32 bit integer formats, four
+ * samples at a time. The results are identical to the generic code in
+ * sconv-s16le.c, leftovers are handled the same way as there. */
+
+/* float -> s32 with the same rounding and clipping as
+ * PA_CLAMP_UNLIKELY(llrintf(v * (1U << 31)), ...) */
+static inline __m128i float_to_s32(__m128 f) {
+    const __m128 scale = _mm_set1_ps((float) (1U << 31));
+    __m128 v = _mm_mul_ps(f, scale);
+    __m128i overflow = _mm_castps_si128(_mm_cmpge_ps(v, scale));
+
+    /* cvtps2dq returns 0x80000000 for everything out of range, flipping all
+     * bits of that turns it into 0x7fffffff where we clip on the positive
+     * side */
+    return _mm_xor_si128(_mm_cvtps_epi32(v), overflow);
+}
+
+static inline __m128 s32_to_float(__m128i s) {
+    return _mm_mul_ps(_mm_cvtepi32_ps(s), _mm_set1_ps(1.0f / (1U << 31)));
+}
+
+static inline int32_t float_to_s32_1(float f) {
+    return (int32_t) PA_CLAMP_UNLIKELY(llrintf(f * (1U << 31)), -0x80000000LL, 0x7FFFFFFFLL);
+}
+
+static void pa_sconv_s32le_to_float32ne_sse41(unsigned n, const int32_t *a, float *b) {
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_ps(b + i, s32_to_float(_mm_loadu_si128((const __m128i *) (a + i))));
+
+    for (; i < n; i++)
+        b[i] = a[i] * (1.0f / (1U << 31));
+}
+
+static void pa_sconv_s32le_from_float32ne_sse41(unsigned n, const float *a, int32_t *b) {
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i *) (b + i), float_to_s32(_mm_loadu_ps(a + i)));
+
+    for (; i < n; i++)
+        b[i] = float_to_s32_1(a[i]);
+}
+
+static void pa_sconv_s24_32le_to_float32ne_sse41(unsigned n, const uint32_t *a, float *b) {
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i s = _mm_slli_epi32(_mm_loadu_si128((const __m128i *) (a + i)), 8);
+
+        _mm_storeu_ps(b + i, s32_to_float(s));
+    }
+
+    for (; i < n; i++)
+        b[i] = (int32_t) (a[i] << 8) * (1.0f / (1U << 31));
+}
+
+static void pa_sconv_s24_32le_from_float32ne_sse41(unsigned n, const float *a, uint32_t *b) {
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i s = _mm_srli_epi32(float_to_s32(_mm_loadu_ps(a + i)), 8);
+
+        _mm_storeu_si128((__m128i *) (b + i), s);
+    }
+
+    for (; i < n; i++)
+        b[i] = ((uint32_t) float_to_s32_1(a[i])) >> 8;
+}
+
+static void pa_sconv_s24le_to_float32ne_sse41(unsigned n, const uint8_t *a, float *b) {
+    /* Move the three bytes of each sample to the top of a 32 bit lane */
+    const __m128i unpack = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    unsigned i;
+
+    /* Each load fetches 16 bytes of which only 12 are used, make sure we
+     * never read past the end */
+    for (i = 0; i + 6 <= n; i += 4) {
+        __m128i s = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (a + i * 3)), unpack);
+
+        _mm_storeu_ps(b + i, s32_to_float(s));
+    }
+
+    for (; i < n; i++) {
+        const uint8_t *p = a + i * 3;
+
+        b[i] = (int32_t) (PA_READ24LE(p) << 8) * (1.0f / (1U << 31));
+    }
+}
+
+static void pa_sconv_s24le_from_float32ne_sse41(unsigned n, const float *a, uint8_t *b) {
+    const __m128i pack = _mm_setr_epi8(1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+    unsigned i;
+
+    for (i = 0; i + 4 <= n; i += 4) {
+        __m128i s = _mm_shuffle_epi8(float_to_s32(_mm_loadu_ps(a + i)), pack);
+        uint32_t last = (uint32_t) _mm_extract_epi32(s, 2);
+
+        _mm_storel_epi64((__m128i *) (b + i * 3), s);
+        memcpy(b + i * 3 + 8, &last, sizeof(last));
+    }
+
+    for (; i < n; i++)
+        PA_WRITE24LE(b + i * 3, ((uint32_t) float_to_s32_1(a[i])) >> 8);
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_convert_func_init_sse41(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_SSE4_1) {
+        pa_log_info("Initialising SSE4.1 optimized conversions.");
+
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_to_float32ne_sse41);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S32LE, (pa_convert_func_t) pa_sconv_s32le_from_float32ne_sse41);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_to_float32ne_sse41);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24_32LE, (pa_convert_func_t) pa_sconv_s24_32le_from_float32ne_sse41);
+        pa_set_convert_to_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_to_float32ne_sse41);
+        pa_set_convert_from_float32ne_function(PA_SAMPLE_S24LE, (pa_convert_func_t) pa_sconv_s24le_from_float32ne_sse41);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
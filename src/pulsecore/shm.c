@@ -60,6 +60,14 @@
 #define MADV_REMOVE 9
 #endif
 
+#if defined(__linux__) && !defined(MADV_HUGEPAGE)
+#define MADV_HUGEPAGE 14
+#endif
+
+/* The common huge page size on x86 and ARM, what we round hugetlb
+ * mappings up to */
+#define HUGE_PAGE_SIZE ((size_t) (2*1024*1024))
+
 /* 1 GiB at max */
 #define MAX_SHM_SIZE (PA_ALIGN(1024*1024*1024))
 
@@ -110,7 +118,20 @@ static char *segment_name(char *fn, size_t l, unsigned id) {
 }
 #endif
 
-static int privatemem_create(pa_shm *m, size_t size) {
+/* Ask for transparent huge pages. Failure is harmless, we just end up
+ * with normal pages. */
+static void advise_hugepages(pa_shm *m) {
+#ifdef MADV_HUGEPAGE
+    if (madvise(m->ptr, PA_PAGE_ALIGN(m->size), MADV_HUGEPAGE) >= 0) {
+        m->hugepages = true;
+        return;
+    }
+
+    pa_log_debug("madvise(MADV_HUGEPAGE) failed: %s", pa_cstrerror(errno));
+#endif
+}
+
+static int privatemem_create(pa_shm *m, size_t size, bool hugepages) {
     pa_assert(m);
     pa_assert(size > 0);
 
@@ -118,13 +139,35 @@ static int privatemem_create(pa_shm *m, size_t size) {
     m->id = 0;
     m->size = size;
     m->do_unlink = false;
+    m->hugepages = false;
     m->fd = -1;
 
 #ifdef MAP_ANONYMOUS
+#ifdef MAP_HUGETLB
+    /* Explicit huge pages need to be reserved by the administrator
+     * (vm.nr_hugepages), so this fails more often than not. Fall back
+     * to normal pages and madvise() then. */
+    if (hugepages) {
+        size_t huge_size = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+
+        if ((m->ptr = mmap(NULL, huge_size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE|MAP_HUGETLB, -1, (off_t) 0)) != MAP_FAILED) {
+            pa_log_debug("Using %lu bytes of hugetlb memory.", (unsigned long) huge_size);
+            m->size = huge_size;
+            m->hugepages = true;
+            return 0;
+        }
+
+        pa_log_debug("mmap(MAP_HUGETLB) failed, falling back to transparent huge pages: %s", pa_cstrerror(errno));
+    }
+#endif
+
     if ((m->ptr = mmap(NULL, m->size, PROT_READ|PROT_WRITE, MAP_ANONYMOUS|MAP_PRIVATE, -1, (off_t) 0)) == MAP_FAILED) {
         pa_log("mmap() failed: %s", pa_cstrerror(errno));
         return -1;
     }
+
+    if (hugepages)
+        advise_hugepages(m);
 #elif defined(HAVE_POSIX_MEMALIGN)
     {
         int r;
@@ -141,7 +184,7 @@ static int privatemem_create(pa_shm *m, size_t size) {
     return 0;
 }
 
-static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
+static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, bool hugepages) {
 #if defined(HAVE_SHM_OPEN) || defined(HAVE_MEMFD)
     char fn[32];
     int fd = -1;
@@ -183,6 +226,7 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
     m->type = type;
     m->size = size + shm_marker_size(type);
     m->do_unlink = do_unlink;
+    m->hugepages = false;
 
     if (ftruncate(fd, (off_t) m->size) < 0) {
         pa_log("ftruncate() failed: %s", pa_cstrerror(errno));
@@ -198,6 +242,11 @@ static int sharedmem_create(pa_shm *m, pa_mem_type_t type, size_t size, mode_t m
         goto fail;
     }
 
+    /* hugetlbfs can't back shm_open() or memfd segments here, but THP
+     * can, if shmem_enabled allows advice */
+    if (hugepages)
+        advise_hugepages(m);
+
     if (type == PA_MEM_TYPE_SHARED_POSIX) {
         /* We store our PID at the end of the shm block, so that we
          * can check for dead shm segments later */
@@ -232,7 +281,7 @@ fail:
     return -1;
 }
 
-int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
+int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, bool hugepages) {
     pa_assert(m);
     pa_assert(size > 0);
     pa_assert(size <= MAX_SHM_SIZE);
@@ -243,9 +292,9 @@ int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode) {
     size = PA_PAGE_ALIGN(size);
 
     if (type == PA_MEM_TYPE_PRIVATE)
-        return privatemem_create(m, size);
+        return privatemem_create(m, size, hugepages);
 
-    return sharedmem_create(m, type, size, mode);
+    return sharedmem_create(m, type, size, mode, hugepages);
 }
 
 static void privatemem_free(pa_shm *m) {
@@ -321,6 +370,11 @@ void pa_shm_punch(pa_shm *m, size_t offset, size_t size) {
     /* You're welcome to implement this as NOOP on systems that don't
      * support it */
 
+    /* Punching holes into huge pages would split them up again, which
+     * defeats the point of asking for them */
+    if (m->hugepages)
+        return;
+
     /* Align the pointer up to multiples of the page size */
     ptr = (uint8_t*) m->ptr + offset;
     o = (size_t) ((uint8_t*) ptr - (uint8_t*) PA_PAGE_ALIGN_PTR(ptr));
@@ -412,6 +466,7 @@ static int shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd,
     m->id = id;
     m->size = (size_t) st.st_size;
     m->do_unlink = false;
+    m->hugepages = false;
     m->fd = -1;
 
     return 0;
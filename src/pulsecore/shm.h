@@ -34,6 +34,9 @@ typedef struct pa_shm {
     /* Only for type = PA_MEM_TYPE_SHARED_POSIX */
     bool do_unlink:1;
 
+    /* Whether the segment is (probably) backed by huge pages */
+    bool hugepages:1;
+
     /* Only for type = PA_MEM_TYPE_SHARED_MEMFD
      *
      * To avoid fd leaks, we keep this fd open only until we pass it
@@ -49,7 +52,7 @@ typedef struct pa_shm {
     int fd;
 } pa_shm;
 
-int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode);
+int pa_shm_create_rw(pa_shm *m, pa_mem_type_t type, size_t size, mode_t mode, bool hugepages);
 int pa_shm_attach(pa_shm *m, pa_mem_type_t type, unsigned id, int memfd_fd, bool writable);
 
 void pa_shm_punch(pa_shm *m, size_t offset, size_t size);
@@ -24,6 +24,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include <pulse/utf8.h>
 #include <pulse/xmalloc.h>
@@ -32,6 +33,7 @@
 #include <pulse/timeval.h>
 
 #include <pulsecore/core-format.h>
+#include <pulsecore/dynarray.h>
 #include <pulsecore/mix.h>
 #include <pulsecore/stream-util.h>
 #include <pulsecore/core-subscribe.h>
@@ -39,6 +41,8 @@
 #include <pulsecore/play-memblockq.h>
 #include <pulsecore/namereg.h>
 #include <pulsecore/core-util.h>
+#include <pulsecore/refcnt.h>
+#include <pulsecore/sconv.h>
 
 #include "sink-input.h"
 
@@ -54,15 +58,45 @@ struct volume_factor_entry {
     pa_cvolume volume;
 };
 
+/* A premix group mixes inputs that share their rate and channel map at that
+ * rate and resamples only the submix, which is then handed to the sink by
+ * the first member, the leader. The other members hand out silence. Volumes
+ * are applied while mixing, before resampling, so the group mixes and
+ * resamples in float, which doesn't clip, and only converts to the sink's
+ * format when handing the submix out. The group's render and history queues
+ * work like those of a single input. Each member keeps what it popped from its
+ * implementor in premix_memblockq: the read index is where the group mixes
+ * next, everything before it stays available for rewinds, so the group can
+ * mix again without asking members that don't want to rewrite anything.
+ * Groups are created and freed in the main thread, referenced by the
+ * inputs that may join them, the IO thread only changes the members. */
+struct pa_premix_group {
+    PA_REFCNT_DECLARE;
+
+    pa_sink *sink;
+    pa_sample_spec sample_spec;         /* float, at the members' rate */
+    pa_sample_spec render_spec;         /* float, at the sink's rate */
+    pa_resample_method_t resample_method;
+
+    pa_resampler *resampler;
+    pa_memblockq *render_memblockq;
+    pa_memblockq *history_memblockq;
+    pa_memchunk silence;
+
+    pa_dynarray *members;
+
+    pa_mix_info *mix_info;
+    unsigned n_mix_info;
+};
+
 /* Calculate number of input samples for the resampler so that either the number
  * of input samples or the number of output samples matches the defined history
  * length. */
-static size_t calculate_resampler_history_bytes(pa_sink_input *i, size_t in_rewind_frames) {
+static size_t calculate_resampler_history_bytes(pa_resampler *r, size_t in_rewind_frames) {
     size_t history_frames, history_max, matching_period, total_frames, remainder;
     double delay;
-    pa_resampler *r;
 
-    if (!(r = i->thread_info.resampler))
+    if (!r)
         return 0;
 
     /* Initialize some variables, cut off full seconds from the rewind */
@@ -114,6 +148,37 @@ static size_t calculate_resampler_history_bytes(pa_sink_input *i, size_t in_rewi
     return history_frames * r->i_fz;
 }
 
+/* Rewinds the resampler by replaying some of the history, after the render
+ * queue was rewound by sink_amount, which corresponds to in_amount bytes of
+ * input. Called from thread context. */
+static void rewind_resampler(pa_resampler *r, pa_memblockq *render_memblockq, pa_memblockq *history_memblockq,
+                             size_t in_amount, size_t sink_amount) {
+    size_t history_bytes;
+    int64_t history_result;
+
+    if (!r)
+        return;
+
+    history_bytes = calculate_resampler_history_bytes(r, in_amount / pa_frame_size(pa_resampler_input_sample_spec(r)));
+
+    if (history_bytes > 0) {
+        history_result = pa_resampler_rewind(r, sink_amount, history_memblockq, history_bytes);
+
+        /* We may have produced one sample too much or or one sample less than expected.
+         * The replay of the rewound sink input data will then produce a deviation in
+         * the other direction, so that the total number of produced samples matches
+         * pa_resampler_result(r, in_amount + history_bytes). Therefore we have
+         * to correct the write pointer of the render queue accordingly.
+         * Strictly this is only true, if the history can be replayed from a known
+         * resampler state, that is if a true matching period exists. In case where
+         * we are using an approximate matching period, we may still loose or duplicate
+         * one sample during rewind. */
+        history_result -= (int64_t) pa_resampler_result(r, history_bytes);
+        if (history_result != 0)
+            pa_memblockq_seek(render_memblockq, history_result, PA_SEEK_RELATIVE, true);
+    }
+}
+
 static struct volume_factor_entry *volume_factor_entry_new(const char *key, const pa_cvolume *volume) {
     struct volume_factor_entry *entry;
 
@@ -145,6 +210,8 @@ static void volume_factor_from_hashmap(pa_cvolume *v, pa_hashmap *items, uint8_t
 }
 
 static void sink_input_free(pa_object *o);
+static void premix_set_group(pa_sink_input *i);
+static void premix_unset_group(pa_sink_input *i);
 static void set_real_ratio(pa_sink_input *i, const pa_cvolume *v);
 
 static int check_passthrough_connection(bool passthrough, pa_sink *dest) {
@@ -529,7 +596,8 @@ int pa_sink_input_new(
 
         /* Note: for passthrough content we need to adjust the output rate to that of the current sink-input */
         if (!pa_sink_input_new_data_is_passthrough(data)) /* no resampler for passthrough content */
-            if (!(resampler = pa_resampler_new(
+            if (!(resampler = pa_resampler_new_with_cache(
+                          core->resampler_cache,
                           core->mempool,
                           &data->sample_spec, &data->channel_map,
                           &data->sink->sample_spec, &data->sink->channel_map,
@@ -629,6 +697,10 @@ int pa_sink_input_new(
     i->thread_info.resampler_delay_frames = 0;
     i->thread_info.origin_sink_latency = 0;
     i->thread_info.dont_rewrite = false;
+    i->premix_group = NULL;
+    i->thread_info.premix_group = NULL;
+    i->thread_info.premix_memblockq = NULL;
+    i->thread_info.premix_end = 0;
     i->origin_rewind_bytes = 0;
 
     pa_assert_se(pa_idxset_put(core->sink_inputs, i, &i->index) == 0);
@@ -809,6 +881,8 @@ void pa_sink_input_unlink(pa_sink_input *i) {
             pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_REMOVE_INPUT, i, 0, NULL) == 0);
     }
 
+    premix_unset_group(i);
+
     reset_callbacks(i);
 
     if (i->sink) {
@@ -845,6 +919,9 @@ static void sink_input_free(pa_object *o) {
      * "half-moved" or are connected to sinks that have no asyncmsgq
      * and are hence half-destructed themselves! */
 
+    pa_assert(!i->premix_group);
+    pa_assert(!i->thread_info.premix_group);
+
     if (i->thread_info.render_memblockq)
         pa_memblockq_free(i->thread_info.render_memblockq);
 
@@ -916,6 +993,8 @@ void pa_sink_input_put(pa_sink_input *i) {
     i->thread_info.soft_volume = i->soft_volume;
     i->thread_info.muted = i->muted;
 
+    premix_set_group(i);
+
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_ADD_INPUT, i, 0, NULL) == 0);
 
     pa_subscription_post(i->core, PA_SUBSCRIPTION_EVENT_SINK_INPUT|PA_SUBSCRIPTION_EVENT_NEW, i->index);
@@ -952,6 +1031,762 @@ pa_usec_t pa_sink_input_get_latency(pa_sink_input *i, pa_usec_t *sink_latency) {
     return r[0];
 }
 
+/* Pushes a chunk of input data into the history queue and, resampled, into
+ * the render queue, applying volume_factor_sink if nvfs is set. Called from
+ * thread context. */
+static void render_push(pa_sink_input *i, pa_memchunk *wchunk, bool nvfs) {
+
+    /* Push chunk into history queue to retain some resampler input history. */
+    pa_memblockq_push(i->thread_info.history_memblockq, wchunk);
+
+    if (!i->thread_info.resampler) {
+
+        if (nvfs) {
+            pa_memchunk_make_writable(wchunk, 0);
+            pa_volume_memchunk(wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+        }
+
+        pa_memblockq_push_align(i->thread_info.render_memblockq, wchunk);
+    } else {
+        pa_memchunk rchunk;
+        pa_resampler_run(i->thread_info.resampler, wchunk, &rchunk);
+
+#ifdef SINK_INPUT_DEBUG
+        pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
+#endif
+
+        if (rchunk.memblock) {
+
+            if (nvfs) {
+                pa_memchunk_make_writable(&rchunk, 0);
+                pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
+            }
+
+            pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
+            pa_memblock_unref(rchunk.memblock);
+        }
+    }
+}
+
+/* Keeps the history queue in sync with the render queue after something was
+ * dropped from the latter. Called from thread context. */
+static void sync_history(pa_resampler *r, pa_memblockq *render_memblockq, pa_memblockq *history_memblockq) {
+    int64_t rbq, hbq;
+
+    /* Using pa_resampler_request() on the dropped amount will not work
+     * here because of rounding. */
+    rbq = pa_memblockq_get_write_index(render_memblockq);
+    rbq -= pa_memblockq_get_read_index(render_memblockq);
+    hbq = pa_memblockq_get_write_index(history_memblockq);
+    hbq -= pa_memblockq_get_read_index(history_memblockq);
+    if (rbq >= 0)
+        rbq = pa_resampler_request(r, rbq);
+    else
+        rbq = - (int64_t) pa_resampler_request(r, - rbq);
+
+    if (hbq > rbq)
+        pa_memblockq_drop(history_memblockq, hbq - rbq);
+    else if (rbq > hbq)
+        pa_memblockq_rewind(history_memblockq, rbq - hbq);
+}
+
+/* Called from thread context */
+static bool premix_is_leader(pa_sink_input *i) {
+    return pa_dynarray_get(i->thread_info.premix_group->members, 0) == i;
+}
+
+/* The members, the group and the sink only differ in their sample format
+ * and rate, these convert lengths between the group's sample spec and that
+ * of a member, and between the group's render spec and the sink's sample
+ * spec. Called from thread context. */
+static size_t premix_to_member(pa_premix_group *g, pa_sink_input *m, size_t nbytes) {
+    return nbytes / pa_frame_size(&g->sample_spec) * pa_frame_size(&m->thread_info.sample_spec);
+}
+
+static size_t premix_from_member(pa_premix_group *g, pa_sink_input *m, size_t nbytes) {
+    return nbytes / pa_frame_size(&m->thread_info.sample_spec) * pa_frame_size(&g->sample_spec);
+}
+
+static size_t premix_to_sink(pa_premix_group *g, size_t nbytes) {
+    return nbytes / pa_frame_size(&g->render_spec) * pa_frame_size(&g->sink->sample_spec);
+}
+
+static size_t premix_from_sink(pa_premix_group *g, size_t nbytes) {
+    return nbytes / pa_frame_size(&g->sink->sample_spec) * pa_frame_size(&g->render_spec);
+}
+
+/* Called from thread context */
+static size_t premix_member_max_rewind(pa_premix_group *g, pa_sink_input *m) {
+    /* Members are rewound back to where the group last played, which may
+     * be one block further back than what the history queue keeps */
+    return premix_to_member(g, m, pa_memblockq_get_maxrewind(g->history_memblockq) + pa_resampler_max_block_size(g->resampler));
+}
+
+/* Called from thread context */
+static void premix_group_update_max_rewind(pa_premix_group *g, size_t nbytes /* in the sink's sample spec */) {
+    pa_sink_input *m;
+    size_t history;
+    unsigned idx;
+
+    nbytes = premix_from_sink(g, nbytes);
+    history = pa_resampler_get_max_history(g->resampler) * pa_frame_size(&g->sample_spec);
+
+    pa_memblockq_set_maxrewind(g->render_memblockq, nbytes);
+    pa_memblockq_set_maxrewind(g->history_memblockq, pa_resampler_request(g->resampler, nbytes) + history);
+
+    PA_DYNARRAY_FOREACH(m, g->members, idx)
+        pa_memblockq_set_maxrewind(m->thread_info.premix_memblockq, premix_member_max_rewind(g, m));
+}
+
+/* Called from main context */
+static pa_premix_group *premix_group_new(pa_sink_input *i) {
+    pa_premix_group *g;
+    pa_sample_spec ss, render_ss;
+    pa_resampler *r;
+    char *memblockq_name;
+
+    pa_sample_spec_init(&ss);
+    ss.format = PA_SAMPLE_FLOAT32NE;
+    ss.rate = i->sample_spec.rate;
+    ss.channels = i->sink->sample_spec.channels;
+
+    render_ss = ss;
+    render_ss.rate = i->sink->sample_spec.rate;
+
+    r = pa_resampler_new_with_cache(i->core->resampler_cache, i->core->mempool,
+                                    &ss, &i->sink->channel_map,
+                                    &render_ss, &i->sink->channel_map,
+                                    i->core->lfe_crossover_freq,
+                                    pa_resampler_get_method(i->thread_info.resampler),
+                                    0);
+    if (!r)
+        return NULL;
+
+    /* Methods that only work in S16 would clip the submix */
+    if (r->work_format != PA_SAMPLE_FLOAT32NE) {
+        pa_log_debug("Not premixing sink input %u, its resampler doesn't work in float.", i->index);
+        pa_resampler_free(r);
+        return NULL;
+    }
+
+    g = pa_xnew0(pa_premix_group, 1);
+    PA_REFCNT_INIT(g);
+    g->sink = i->sink;
+    g->sample_spec = ss;
+    g->render_spec = render_ss;
+    g->resample_method = pa_resampler_get_method(i->thread_info.resampler);
+    g->resampler = r;
+    g->members = pa_dynarray_new(NULL);
+
+    pa_silence_memchunk_get(&i->core->silence_cache, i->core->mempool, &g->silence, &g->sample_spec,
+                            pa_resampler_max_block_size(r));
+
+    /* Float silence works for the render queue too, only the rate differs */
+    memblockq_name = pa_sprintf_malloc("premix group render_memblockq [%u]", i->index);
+    g->render_memblockq = pa_memblockq_new(
+            memblockq_name,
+            0,
+            MEMBLOCKQ_MAXLENGTH,
+            0,
+            &g->render_spec,
+            0,
+            1,
+            0,
+            &g->silence);
+    pa_xfree(memblockq_name);
+
+    memblockq_name = pa_sprintf_malloc("premix group history memblockq [%u]", i->index);
+    g->history_memblockq = pa_memblockq_new(
+            memblockq_name,
+            0,
+            MEMBLOCKQ_MAXLENGTH,
+            0,
+            &g->sample_spec,
+            0,
+            1,
+            0,
+            &g->silence);
+    pa_xfree(memblockq_name);
+
+    pa_log_debug("Created a premix group for sink input %u", i->index);
+
+    return g;
+}
+
+/* Called from main context */
+static void premix_group_unref(pa_premix_group *g) {
+    pa_assert(g);
+    pa_assert(PA_REFCNT_VALUE(g) >= 1);
+
+    if (PA_REFCNT_DEC(g) > 0)
+        return;
+
+    pa_assert(pa_dynarray_size(g->members) == 0);
+
+    pa_dynarray_free(g->members);
+    pa_memblockq_free(g->render_memblockq);
+    pa_memblockq_free(g->history_memblockq);
+    pa_memblock_unref(g->silence.memblock);
+    pa_resampler_free(g->resampler);
+    pa_xfree(g->mix_info);
+    pa_xfree(g);
+}
+
+/* Throws away the last amount bytes of the submix. The members are rewound
+ * by the same amount, so the group mixes that part again the next time it
+ * is filled. Called from thread context. */
+static void premix_group_rewrite(pa_premix_group *g, size_t amount /* in the group's sample spec */) {
+    pa_sink_input *m;
+    size_t render_amount;
+    unsigned idx;
+
+    if (amount <= 0)
+        return;
+
+    pa_log_debug("Have to mix %lu bytes of the premix group again.", (unsigned long) amount);
+
+    render_amount = pa_resampler_result(g->resampler, amount);
+
+    pa_memblockq_seek(g->render_memblockq, - (int64_t) render_amount, PA_SEEK_RELATIVE, true);
+    rewind_resampler(g->resampler, g->render_memblockq, g->history_memblockq, amount, render_amount);
+    pa_memblockq_seek(g->history_memblockq, - (int64_t) amount, PA_SEEK_RELATIVE, true);
+
+    PA_DYNARRAY_FOREACH(m, g->members, idx)
+        pa_memblockq_rewind(m->thread_info.premix_memblockq, premix_to_member(g, m, amount));
+}
+
+/* Whether the input only needs a resampler, and can hence be premixed.
+ * Remapping has to happen before mixing, so the channel maps must already
+ * match, and filter sinks render their whole sink when their input is
+ * peeked. Called from main context. */
+static bool premix_suitable(pa_sink_input *i) {
+    if (!i->core->premix_resampling || !i->sink || !i->thread_info.resampler)
+        return false;
+
+    if ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) || i->origin_sink)
+        return false;
+
+    return pa_channel_map_equal(&i->channel_map, &i->sink->channel_map);
+}
+
+/* Called from main context */
+static bool premix_group_matches(pa_premix_group *g, pa_sink_input *i) {
+    /* The sample format doesn't matter, members are converted to float */
+    return g->sink == i->sink &&
+        g->resample_method == pa_resampler_get_method(i->thread_info.resampler) &&
+        g->sample_spec.rate == i->sample_spec.rate &&
+        g->sample_spec.channels == i->sample_spec.channels &&
+        g->render_spec.rate == i->sink->sample_spec.rate &&
+        g->render_spec.channels == i->sink->sample_spec.channels &&
+        pa_channel_map_equal(pa_resampler_output_channel_map(g->resampler), &i->sink->channel_map);
+}
+
+/* Called from main context, while the IO thread doesn't render the input */
+static void premix_unset_group(pa_sink_input *i) {
+    pa_assert(!i->thread_info.premix_group);
+
+    if (!i->premix_group)
+        return;
+
+    pa_memblockq_free(i->thread_info.premix_memblockq);
+    i->thread_info.premix_memblockq = NULL;
+
+    premix_group_unref(i->premix_group);
+    i->premix_group = NULL;
+}
+
+/* Looks for the group the input may join among the other inputs of the
+ * sink, and creates it if there is none yet, so that the IO thread only
+ * needs to add the input to it. Called from main context, while the IO
+ * thread doesn't render the input. */
+static void premix_set_group(pa_sink_input *i) {
+    pa_premix_group *g = NULL;
+    pa_sink_input *other;
+    pa_memchunk silence;
+    char *memblockq_name;
+    uint32_t idx;
+
+    pa_assert(!i->thread_info.premix_group);
+
+    if (!premix_suitable(i)) {
+        premix_unset_group(i);
+        return;
+    }
+
+    if (i->premix_group && premix_group_matches(i->premix_group, i))
+        return;
+
+    premix_unset_group(i);
+
+    PA_IDXSET_FOREACH(other, i->sink->inputs, idx) {
+        if (other != i && other->premix_group && premix_group_matches(other->premix_group, i)) {
+            g = other->premix_group;
+            PA_REFCNT_INC(g);
+            break;
+        }
+    }
+
+    if (!g && !(g = premix_group_new(i)))
+        return;
+
+    memblockq_name = pa_sprintf_malloc("sink input premix_memblockq [%u]", i->index);
+    pa_sink_input_get_silence(i, &silence);
+    i->thread_info.premix_memblockq = pa_memblockq_new(
+            memblockq_name,
+            0,
+            MEMBLOCKQ_MAXLENGTH,
+            0,
+            &i->sample_spec,
+            0,
+            1,
+            0,
+            &silence);
+    pa_memblock_unref(silence.memblock);
+    pa_xfree(memblockq_name);
+
+    i->premix_group = g;
+}
+
+/* Called from thread context */
+static bool premix_possible(pa_sink_input *i) {
+
+    /* Joining is decided here, the group itself was set up by the main
+     * thread if the input is suitable at all */
+    if (!i->premix_group || !i->thread_info.attached)
+        return false;
+
+    if ((i->flags & PA_SINK_INPUT_VARIABLE_RATE) || i->origin_sink)
+        return false;
+
+    /* Direct outputs record the stream as the sink plays it */
+    return pa_hashmap_isempty(i->thread_info.direct_outputs);
+}
+
+/* Called from thread context */
+static void premix_join(pa_sink_input *i) {
+    pa_premix_group *g = i->premix_group;
+
+    /* The sink's max_rewind may have changed while the group was empty */
+    if (pa_dynarray_size(g->members) == 0)
+        premix_group_update_max_rewind(g, i->sink->thread_info.max_rewind);
+
+    pa_memblockq_flush_write(i->thread_info.render_memblockq, true);
+    pa_memblockq_flush_write(i->thread_info.history_memblockq, true);
+
+    pa_dynarray_append(g->members, i);
+    i->thread_info.premix_group = g;
+    i->thread_info.premix_end = pa_memblockq_get_write_index(g->render_memblockq);
+
+    pa_memblockq_set_maxrewind(i->thread_info.premix_memblockq, premix_member_max_rewind(g, i));
+
+    if (pa_dynarray_size(g->members) > g->n_mix_info) {
+        g->n_mix_info = PA_MAX(g->n_mix_info * 2, 8U);
+        g->mix_info = pa_xrenew(pa_mix_info, g->mix_info, g->n_mix_info);
+    }
+
+    pa_log_debug("Sink input %u joined a premix group of %u streams", i->index, pa_dynarray_size(g->members));
+}
+
+/* Takes the input out of its group. Whatever the group has not played yet
+ * of the input is rendered again on its own, and the group mixes the rest
+ * again without it. Called from thread context, or from main context while
+ * the sink is suspended. */
+static void premix_leave(pa_sink_input *i) {
+    pa_premix_group *g = i->thread_info.premix_group;
+    pa_memblockq *q = i->thread_info.premix_memblockq;
+    size_t length, block_size;
+    bool nvfs;
+
+    pa_assert(g);
+
+    pa_assert_se(pa_dynarray_remove_by_data(g->members, i) == 0);
+    i->thread_info.premix_group = NULL;
+
+    /* The history queue of the group reaches back to where the group
+     * played last */
+    pa_memblockq_rewind(q, premix_to_member(g, i, pa_memblockq_get_length(g->history_memblockq)));
+
+    pa_memblockq_flush_write(i->thread_info.render_memblockq, true);
+    pa_memblockq_flush_write(i->thread_info.history_memblockq, true);
+    pa_resampler_reset(i->thread_info.resampler);
+
+    nvfs = !pa_cvolume_is_norm(&i->volume_factor_sink);
+    block_size = pa_resampler_max_block_size(i->thread_info.resampler);
+
+    while ((length = pa_memblockq_get_length(q)) > 0) {
+        pa_memchunk chunk;
+
+        length = PA_MIN(length, block_size);
+
+        if (pa_memblockq_peek_fixed_size(q, length, &chunk) < 0)
+            break;
+
+        render_push(i, &chunk, nvfs);
+        pa_memblock_unref(chunk.memblock);
+
+        pa_memblockq_drop(q, length);
+    }
+
+    /* The queue is kept for joining again */
+    pa_memblockq_flush_write(q, true);
+
+    pa_log_debug("Sink input %u left its premix group", i->index);
+
+    if (pa_dynarray_size(g->members) > 0) {
+        premix_group_rewrite(g, pa_resampler_request(g->resampler, pa_memblockq_get_length(g->render_memblockq)));
+        return;
+    }
+
+    /* Whoever joins next starts from scratch */
+    pa_memblockq_flush_write(g->render_memblockq, true);
+    pa_memblockq_flush_write(g->history_memblockq, true);
+    pa_resampler_reset(g->resampler);
+}
+
+/* Makes sure the member has ilength bytes ready to be mixed. Called from
+ * thread context. */
+static void premix_member_fill(pa_sink_input *i, size_t ilength) {
+    pa_memblockq *q = i->thread_info.premix_memblockq;
+    size_t length;
+
+    while ((length = pa_memblockq_get_length(q)) < ilength) {
+        pa_memchunk tchunk;
+
+        if (i->thread_info.state == PA_SINK_INPUT_CORKED ||
+            i->pop(i, ilength - length, &tchunk) < 0) {
+
+            /* Corked or no data, let the group mix silence for us */
+
+            pa_memblockq_seek(q, (int64_t) (ilength - length), PA_SEEK_RELATIVE, true);
+            i->thread_info.playing_for = 0;
+            if (i->thread_info.underrun_for != (uint64_t) -1) {
+                i->thread_info.underrun_for += ilength - length;
+                i->thread_info.underrun_for_sink += pa_resampler_result(i->thread_info.resampler, ilength - length);
+            }
+            break;
+        }
+
+        pa_assert(tchunk.length > 0);
+        pa_assert(tchunk.memblock);
+
+        i->thread_info.underrun_for = 0;
+        i->thread_info.underrun_for_sink = 0;
+        i->thread_info.playing_for += tchunk.length;
+
+        pa_memblockq_push_align(q, &tchunk);
+        pa_memblock_unref(tchunk.memblock);
+    }
+}
+
+/* Writes length bytes of silence into the queue. Called from thread
+ * context. */
+static void push_silence(pa_memblockq *q, const pa_memchunk *silence, size_t length) {
+    while (length > 0) {
+        pa_memchunk chunk = *silence;
+
+        chunk.length = PA_MIN(chunk.length, length);
+        pa_memblockq_push(q, &chunk);
+        length -= chunk.length;
+    }
+}
+
+/* Converts what a member popped to float. Called from thread context. */
+static void premix_member_to_float(pa_premix_group *g, pa_sink_input *m, pa_memchunk *chunk) {
+    pa_convert_func_t convert;
+    pa_memblock *b;
+    size_t n;
+    void *src, *dst;
+
+    if (m->thread_info.sample_spec.format == g->sample_spec.format)
+        return;
+
+    pa_assert_se(convert = pa_get_convert_to_float32ne_function(m->thread_info.sample_spec.format));
+
+    n = chunk->length / pa_sample_size(&m->thread_info.sample_spec);
+    b = pa_memblock_new(g->sink->core->mempool, n * sizeof(float));
+
+    src = pa_memblock_acquire_chunk(chunk);
+    dst = pa_memblock_acquire(b);
+    convert((unsigned) n, src, dst);
+    pa_memblock_release(b);
+    pa_memblock_release(chunk->memblock);
+
+    pa_memblock_unref(chunk->memblock);
+    chunk->memblock = b;
+    chunk->index = 0;
+    chunk->length = n * sizeof(float);
+}
+
+/* Mixes the next block of all members, resamples it and pushes it into the
+ * render queue of the group. Called from thread context, by the leader. */
+static void premix_group_fill(pa_premix_group *g, size_t slength /* in sink bytes */) {
+    pa_sink_input *m;
+    pa_memchunk chunk, rchunk;
+    size_t ilength;
+    unsigned idx, n = 0, k;
+    int64_t end;
+
+    ilength = pa_resampler_request(g->resampler, premix_from_sink(g, slength));
+
+    if (ilength <= 0)
+        ilength = pa_frame_align(CONVERT_BUFFER_LENGTH, &g->sample_spec);
+
+    if (ilength > pa_resampler_max_block_size(g->resampler))
+        ilength = pa_resampler_max_block_size(g->resampler);
+
+    PA_DYNARRAY_FOREACH(m, g->members, idx) {
+        pa_mix_info *info = g->mix_info + n;
+        size_t mlength = premix_to_member(g, m, ilength);
+
+        premix_member_fill(m, mlength);
+
+        pa_assert_se(pa_memblockq_peek_fixed_size(m->thread_info.premix_memblockq, mlength, &info->chunk) >= 0);
+        pa_memblockq_drop(m->thread_info.premix_memblockq, mlength);
+
+        if (m->thread_info.muted || pa_memblock_is_silence(info->chunk.memblock)) {
+            pa_memblock_unref(info->chunk.memblock);
+            continue;
+        }
+
+        premix_member_to_float(g, m, &info->chunk);
+
+        pa_sw_cvolume_multiply(&info->volume, &m->thread_info.soft_volume, &m->volume_factor_sink);
+        info->userdata = m;
+        n++;
+    }
+
+    /* Seeking is not enough here, a rewrite may have left the submix of
+     * members that are gone behind the write indexes */
+    if (n == 0) {
+        push_silence(g->render_memblockq, &g->silence, pa_resampler_result(g->resampler, ilength));
+        push_silence(g->history_memblockq, &g->silence, ilength);
+        return;
+    }
+
+    if (n == 1) {
+        chunk = g->mix_info[0].chunk;
+
+        if (!pa_cvolume_is_norm(&g->mix_info[0].volume)) {
+            pa_memchunk_make_writable(&chunk, 0);
+            pa_volume_memchunk(&chunk, &g->sample_spec, &g->mix_info[0].volume);
+        }
+    } else {
+        void *ptr;
+
+        chunk.memblock = pa_memblock_new(g->sink->core->mempool, ilength);
+        chunk.index = 0;
+
+        ptr = pa_memblock_acquire(chunk.memblock);
+        chunk.length = pa_mix(g->mix_info, n, ptr, ilength, &g->sample_spec, NULL, false);
+        pa_memblock_release(chunk.memblock);
+
+        for (k = 0; k < n; k++)
+            pa_memblock_unref(g->mix_info[k].chunk.memblock);
+    }
+
+    pa_memblockq_push(g->history_memblockq, &chunk);
+
+    pa_resampler_run(g->resampler, &chunk, &rchunk);
+    pa_memblock_unref(chunk.memblock);
+
+    if (rchunk.memblock) {
+        pa_memblockq_push_align(g->render_memblockq, &rchunk);
+        pa_memblock_unref(rchunk.memblock);
+    }
+
+    end = pa_memblockq_get_write_index(g->render_memblockq);
+    for (k = 0; k < n; k++)
+        ((pa_sink_input *) g->mix_info[k].userdata)->thread_info.premix_end = end;
+}
+
+/* Hands out a chunk of the submix in the sink's sample format, taking over
+ * the reference of fchunk. A submix that is louder than full scale is scaled
+ * down and handed out with the volume that scales it up again, so that, as
+ * without premixing, it's only clipped after the sink applied its own volume.
+ * Called from thread context. */
+static void premix_convert_to_sink(pa_premix_group *g, pa_memchunk *fchunk, pa_memchunk *chunk, pa_cvolume *volume) {
+    const pa_sample_spec *ss = &g->sink->sample_spec;
+    pa_convert_func_t convert;
+    const float *src;
+    float peak = 0;
+    void *dst;
+    size_t n, k;
+
+    pa_cvolume_reset(volume, ss->channels);
+
+    if (ss->format == g->render_spec.format) {
+        *chunk = *fchunk;
+        return;
+    }
+
+    pa_assert_se(convert = pa_get_convert_from_float32ne_function(ss->format));
+
+    n = fchunk->length / sizeof(float);
+
+    src = pa_memblock_acquire_chunk(fchunk);
+    for (k = 0; k < n; k++)
+        peak = PA_MAX(peak, fabsf(src[k]));
+    pa_memblock_release(fchunk->memblock);
+
+    if (peak > 1.0f) {
+        pa_cvolume down;
+
+        pa_cvolume_set(volume, ss->channels, pa_sw_volume_from_linear(peak));
+        pa_cvolume_set(&down, ss->channels, pa_sw_volume_divide(PA_VOLUME_NORM, volume->values[0]));
+
+        pa_memchunk_make_writable(fchunk, 0);
+        pa_volume_memchunk(fchunk, &g->render_spec, &down);
+    }
+
+    chunk->memblock = pa_memblock_new(g->sink->core->mempool, n * pa_sample_size(ss));
+    chunk->index = 0;
+    chunk->length = n * pa_sample_size(ss);
+
+    src = pa_memblock_acquire_chunk(fchunk);
+    dst = pa_memblock_acquire(chunk->memblock);
+    convert((unsigned) n, src, dst);
+    pa_memblock_release(chunk->memblock);
+    pa_memblock_release(fchunk->memblock);
+
+    pa_memblock_unref(fchunk->memblock);
+}
+
+/* pa_sink_input_peek() for members of a premix group. Called from thread
+ * context. */
+static void premix_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
+    pa_premix_group *g = i->thread_info.premix_group;
+    pa_memchunk tchunk;
+    size_t block_size_max_sink;
+
+    block_size_max_sink = pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sink->sample_spec);
+
+    /* Default buffer size */
+    if (slength <= 0)
+        slength = pa_frame_align(CONVERT_BUFFER_LENGTH, &i->sink->sample_spec);
+
+    if (slength > block_size_max_sink)
+        slength = block_size_max_sink;
+
+    /* The volumes were applied while mixing */
+    pa_cvolume_reset(volume, i->sink->sample_spec.channels);
+
+    /* Read-only, the leader may be filling the group, and writing our
+     * thread_info, on another render pool thread at the same time */
+    if (!premix_is_leader(i)) {
+        *chunk = i->sink->silence;
+        pa_memblock_ref(chunk->memblock);
+
+        if (chunk->length > slength)
+            chunk->length = slength;
+
+        return;
+    }
+
+    while (!pa_memblockq_is_readable(g->render_memblockq))
+        premix_group_fill(g, slength);
+
+    pa_assert_se(pa_memblockq_peek(g->render_memblockq, &tchunk) >= 0);
+
+    pa_assert(tchunk.length > 0);
+    pa_assert(tchunk.memblock);
+
+    if (tchunk.length > premix_from_sink(g, block_size_max_sink))
+        tchunk.length = premix_from_sink(g, block_size_max_sink);
+
+    premix_convert_to_sink(g, &tchunk, chunk, volume);
+}
+
+/* Returns how much of the member's rewrite request the group has to mix
+ * again, in the group's sample spec. nbytes and lbq are in the group's
+ * render spec. Called from thread context. */
+static size_t premix_member_rewrite_amount(pa_sink_input *m, size_t nbytes, size_t lbq, bool rewound) {
+    pa_premix_group *g = m->thread_info.premix_group;
+    pa_resampler *r = g->resampler;
+
+    if (m->thread_info.dont_rewrite)
+        return 0;
+
+    /* Everything that is not played yet is dropped */
+    if (m->thread_info.rewrite_nbytes == (size_t) -1)
+        return pa_resampler_request(r, rewound ? nbytes + lbq : lbq);
+
+    if (m->thread_info.rewrite_nbytes > 0 && nbytes > 0)
+        return PA_MIN(premix_from_member(g, m, m->thread_info.rewrite_nbytes), pa_resampler_request(r, nbytes + lbq));
+
+    return 0;
+}
+
+/* pa_sink_input_process_rewind() for a whole premix group, called for its
+ * leader from thread context. rewrite_flush is not honoured, silencing the
+ * render queue would silence the other members too, and the part that is
+ * rewritten is mixed again anyway. */
+static void premix_group_process_rewind(pa_premix_group *g, size_t nbytes /* in sink sample spec */) {
+    pa_sink_input *m;
+    size_t lbq, amount = 0;
+    bool rewound = false;
+    unsigned idx;
+
+    nbytes = premix_from_sink(g, nbytes);
+    lbq = pa_memblockq_get_length(g->render_memblockq);
+
+    if (nbytes > 0) {
+        PA_DYNARRAY_FOREACH(m, g->members, idx)
+            if (!m->thread_info.dont_rewind_render)
+                rewound = true;
+    }
+
+    if (rewound) {
+        pa_log_debug("Have to rewind %lu bytes on premix render memblockq.", (unsigned long) nbytes);
+        pa_memblockq_rewind(g->render_memblockq, nbytes);
+        pa_memblockq_rewind(g->history_memblockq, pa_resampler_request(g->resampler, nbytes));
+    }
+
+    PA_DYNARRAY_FOREACH(m, g->members, idx)
+        amount = PA_MAX(amount, premix_member_rewrite_amount(m, nbytes, lbq, rewound));
+
+    amount = PA_MIN(amount, pa_resampler_request(g->resampler, pa_memblockq_get_length(g->render_memblockq)));
+
+    premix_group_rewrite(g, amount);
+
+    PA_DYNARRAY_FOREACH(m, g->members, idx) {
+        pa_memblockq *q = m->thread_info.premix_memblockq;
+        size_t want, staged;
+
+        want = premix_to_member(g, m, PA_MIN(premix_member_rewrite_amount(m, nbytes, lbq, rewound), amount));
+
+        /* What was popped but not mixed yet has to be given back too */
+        staged = pa_memblockq_get_length(q) - premix_to_member(g, m, amount);
+
+        if (m->thread_info.dont_rewrite) {
+            if (m->process_rewind)
+                m->process_rewind(m, 0);
+
+        } else if (m->thread_info.rewrite_nbytes == (size_t) -1) {
+
+            /* Drop everything and get fresh data from the implementor */
+            pa_memblockq_flush_write(q, true);
+
+            if (m->process_rewind)
+                m->process_rewind(m, 0);
+
+        } else if (want > 0) {
+            pa_log_debug("Have to rewind %lu bytes on implementor.", (unsigned long) (want + staged));
+
+            pa_memblockq_seek(q, - (int64_t) (want + staged), PA_SEEK_RELATIVE, true);
+
+            if (m->process_rewind)
+                m->process_rewind(m, want + staged);
+
+        } else if (m->process_rewind)
+            m->process_rewind(m, 0);
+
+        m->thread_info.dont_rewrite = false;
+        m->thread_info.rewrite_nbytes = 0;
+        m->thread_info.rewrite_flush = false;
+        m->thread_info.dont_rewind_render = false;
+    }
+}
+
 /* Called from thread context */
 void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa_memchunk *chunk, pa_cvolume *volume) {
     bool do_volume_adj_here, need_volume_factor_sink;
@@ -971,6 +1806,11 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
     pa_log_debug("peek");
 #endif
 
+    if (i->thread_info.premix_group) {
+        premix_peek(i, slength, chunk, volume);
+        return;
+    }
+
     block_size_max_sink_input = i->thread_info.resampler ?
         pa_resampler_max_block_size(i->thread_info.resampler) :
         pa_frame_align(pa_mempool_block_size_max(i->core->mempool), &i->sample_spec);
@@ -1068,37 +1908,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
                     pa_volume_memchunk(&wchunk, &i->thread_info.sample_spec, &i->thread_info.soft_volume);
             }
 
-            /* Push chunk into history queue to retain some resampler input history. */
-            pa_memblockq_push(i->thread_info.history_memblockq, &wchunk);
-
-            if (!i->thread_info.resampler) {
-
-                if (nvfs) {
-                    pa_memchunk_make_writable(&wchunk, 0);
-                    pa_volume_memchunk(&wchunk, &i->sink->sample_spec, &i->volume_factor_sink);
-                }
-
-                pa_memblockq_push_align(i->thread_info.render_memblockq, &wchunk);
-            } else {
-                pa_memchunk rchunk;
-                pa_resampler_run(i->thread_info.resampler, &wchunk, &rchunk);
-
-#ifdef SINK_INPUT_DEBUG
-                pa_log_debug("pushing %lu", (unsigned long) rchunk.length);
-#endif
-
-                if (rchunk.memblock) {
-
-                    if (nvfs) {
-                        pa_memchunk_make_writable(&rchunk, 0);
-                        pa_volume_memchunk(&rchunk, &i->sink->sample_spec, &i->volume_factor_sink);
-                    }
-
-                    pa_memblockq_push_align(i->thread_info.render_memblockq, &rchunk);
-                    pa_memblock_unref(rchunk.memblock);
-                }
-            }
-
+            render_push(i, &wchunk, nvfs);
             pa_memblock_unref(wchunk.memblock);
 
             tchunk.index += wchunk.length;
@@ -1135,7 +1945,7 @@ void pa_sink_input_peek(pa_sink_input *i, size_t slength /* in sink bytes */, pa
 
 /* Called from thread context */
 void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec */) {
-    int64_t rbq, hbq;
+    pa_premix_group *g;
 
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
@@ -1147,30 +1957,41 @@ void pa_sink_input_drop(pa_sink_input *i, size_t nbytes /* in sink sample spec *
     pa_log_debug("dropping %lu", (unsigned long) nbytes);
 #endif
 
-    pa_memblockq_drop(i->thread_info.render_memblockq, nbytes);
+    if ((g = i->thread_info.premix_group)) {
+        /* Only the leader handed out any data */
+        if (premix_is_leader(i)) {
+            pa_memblockq_drop(g->render_memblockq, premix_from_sink(g, nbytes));
+            sync_history(g->resampler, g->render_memblockq, g->history_memblockq);
+        }
 
-    /* Keep memblockq's in sync. Using pa_resampler_request()
-     * on nbytes will not work here because of rounding. */
-    rbq = pa_memblockq_get_write_index(i->thread_info.render_memblockq);
-    rbq -= pa_memblockq_get_read_index(i->thread_info.render_memblockq);
-    hbq = pa_memblockq_get_write_index(i->thread_info.history_memblockq);
-    hbq -= pa_memblockq_get_read_index(i->thread_info.history_memblockq);
-    if (rbq >= 0)
-        rbq = pa_resampler_request(i->thread_info.resampler, rbq);
-    else
-        rbq = - (int64_t) pa_resampler_request(i->thread_info.resampler, - rbq);
+        return;
+    }
 
-    if (hbq > rbq)
-        pa_memblockq_drop(i->thread_info.history_memblockq, hbq - rbq);
-    else if (rbq > hbq)
-        pa_memblockq_rewind(i->thread_info.history_memblockq, rbq - hbq);
+    pa_memblockq_drop(i->thread_info.render_memblockq, nbytes);
+
+    /* Keep memblockq's in sync */
+    sync_history(i->thread_info.resampler, i->thread_info.render_memblockq, i->thread_info.history_memblockq);
 }
 
 /* Called from thread context */
 bool pa_sink_input_process_underrun(pa_sink_input *i) {
+    pa_premix_group *g;
+
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
 
+    if ((g = i->thread_info.premix_group)) {
+        if (pa_memblockq_is_readable(i->thread_info.premix_memblockq) ||
+            i->thread_info.premix_end > pa_memblockq_get_read_index(g->render_memblockq))
+            return false;
+
+        if (i->process_underrun && i->process_underrun(i)) {
+            pa_memblockq_silence(i->thread_info.premix_memblockq);
+            return true;
+        }
+        return false;
+    }
+
     if (pa_memblockq_is_readable(i->thread_info.render_memblockq))
         return false;
 
@@ -1198,6 +2019,15 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
     pa_log_debug("rewind(%lu, %lu)", (unsigned long) nbytes, (unsigned long) i->thread_info.rewrite_nbytes);
 #endif
 
+    /* The leader rewinds the whole group, including the flags of the
+     * other members */
+    if (i->thread_info.premix_group) {
+        if (premix_is_leader(i))
+            premix_group_process_rewind(i->thread_info.premix_group, nbytes);
+
+        return;
+    }
+
     lbq = pa_memblockq_get_length(i->thread_info.render_memblockq);
     sink_input_nbytes = pa_resampler_request(i->thread_info.resampler, nbytes);
 
@@ -1249,29 +2079,8 @@ void pa_sink_input_process_rewind(pa_sink_input *i, size_t nbytes /* in sink sam
             pa_memblockq_seek(i->thread_info.render_memblockq, - ((int64_t) pa_resampler_result(i->thread_info.resampler, sink_input_amount)),PA_SEEK_RELATIVE, true);
 
             /* Rewind the resampler */
-            if (i->thread_info.resampler) {
-                size_t history_bytes;
-                int64_t history_result;
-
-                history_bytes = calculate_resampler_history_bytes(i, sink_input_amount / pa_frame_size(&i->sample_spec));
-
-               if (history_bytes > 0) {
-                    history_result = pa_resampler_rewind(i->thread_info.resampler, sink_amount, i->thread_info.history_memblockq, history_bytes);
-
-                    /* We may have produced one sample too much or or one sample less than expected.
-                     * The replay of the rewound sink input data will then produce a deviation in
-                     * the other direction, so that the total number of produced samples matches
-                     * pa_resampler_result(r, sink_input_amount + history_bytes). Therefore we have
-                     * to correct the write pointer of the render queue accordingly.
-                     * Strictly this is only true, if the history can be replayed from a known
-                     * resampler state, that is if a true matching period exists. In case where
-                     * we are using an approximate matching period, we may still loose or duplicate
-                     * one sample during rewind. */
-                    history_result -= (int64_t) pa_resampler_result(i->thread_info.resampler, history_bytes);
-                    if (history_result != 0)
-                        pa_memblockq_seek(i->thread_info.render_memblockq, history_result, PA_SEEK_RELATIVE, true);
-                }
-            }
+            rewind_resampler(i->thread_info.resampler, i->thread_info.render_memblockq, i->thread_info.history_memblockq,
+                             sink_input_amount, sink_amount);
 
             /* Update the history write pointer */
             pa_memblockq_seek(i->thread_info.history_memblockq, - ((int64_t) sink_input_amount), PA_SEEK_RELATIVE, true);
@@ -1332,6 +2141,9 @@ void pa_sink_input_update_max_rewind(pa_sink_input *i, size_t nbytes  /* in the
 
     pa_memblockq_set_maxrewind(i->thread_info.history_memblockq, max_rewind + resampler_history);
 
+    if (i->thread_info.premix_group)
+        premix_group_update_max_rewind(i->thread_info.premix_group, nbytes);
+
     if (i->update_max_rewind)
         i->update_max_rewind(i, max_rewind);
 }
@@ -1899,6 +2711,8 @@ int pa_sink_input_start_move(pa_sink_input *i) {
 
     pa_assert_se(pa_asyncmsgq_send(i->sink->asyncmsgq, PA_MSGOBJECT(i->sink), PA_SINK_MESSAGE_START_MOVE, i, 0, NULL) == 0);
 
+    premix_unset_group(i);
+
     pa_sink_update_status(i->sink);
 
     PA_HASHMAP_FOREACH(v, i->volume_factor_sink_items, state)
@@ -2356,8 +3170,10 @@ int pa_sink_input_process_msg(pa_msgobject *o, int code, void *userdata, int64_t
         case PA_SINK_INPUT_MESSAGE_GET_LATENCY: {
             pa_usec_t *r = userdata;
 
-            r[0] += pa_bytes_to_usec(pa_memblockq_get_length(i->thread_info.render_memblockq), &i->sink->sample_spec);
-            r[0] += pa_resampler_get_delay_usec(i->thread_info.resampler);
+            r[0] += pa_bytes_to_usec(pa_sink_input_get_render_length(i), &i->sink->sample_spec);
+            r[0] += pa_resampler_get_delay_usec(i->thread_info.premix_group ?
+                                                i->thread_info.premix_group->resampler :
+                                                i->thread_info.resampler);
             r[1] += pa_sink_get_latency_within_thread(i->sink, false);
 
             return 0;
@@ -2407,10 +3223,57 @@ bool pa_sink_input_safe_to_remove(pa_sink_input *i) {
     pa_sink_input_assert_ref(i);
     pa_sink_input_assert_io_context(i);
 
-    if (PA_SINK_INPUT_IS_LINKED(i->thread_info.state))
-        return pa_memblockq_is_empty(i->thread_info.render_memblockq);
+    if (!PA_SINK_INPUT_IS_LINKED(i->thread_info.state))
+        return true;
+
+    if (i->thread_info.premix_group)
+        return pa_memblockq_get_length(i->thread_info.premix_memblockq) == 0 &&
+            i->thread_info.premix_end <= pa_memblockq_get_read_index(i->thread_info.premix_group->render_memblockq);
 
-    return true;
+    return pa_memblockq_is_empty(i->thread_info.render_memblockq);
+}
+
+/* Called from IO context */
+size_t pa_sink_input_get_render_length(pa_sink_input *i) {
+    pa_premix_group *g;
+
+    pa_sink_input_assert_ref(i);
+
+    if (!(g = i->thread_info.premix_group))
+        return pa_memblockq_get_length(i->thread_info.render_memblockq);
+
+    return premix_to_sink(g, pa_memblockq_get_length(g->render_memblockq) +
+        pa_resampler_result(g->resampler, premix_from_member(g, i, pa_memblockq_get_length(i->thread_info.premix_memblockq))));
+}
+
+/* Called from IO context, before the sink peeks its inputs */
+void pa_sink_input_update_premix(pa_sink_input *i) {
+    pa_sink_input_assert_ref(i);
+    pa_sink_input_assert_io_context(i);
+
+    if (!i->core->premix_resampling)
+        return;
+
+    if (!premix_possible(i)) {
+        if (i->thread_info.premix_group)
+            premix_leave(i);
+
+        return;
+    }
+
+    if (i->thread_info.premix_group)
+        return;
+
+    /* The group can't take over what we rendered on our own, so only
+     * join when nothing of it is left, not even for rewinding */
+    if (pa_memblockq_get_length(i->thread_info.render_memblockq) > 0)
+        return;
+
+    if (i->thread_info.underrun_for != (uint64_t) -1 &&
+        i->thread_info.underrun_for_sink < i->sink->thread_info.max_rewind)
+        return;
+
+    premix_join(i);
 }
 
 /* Called from IO context */
@@ -2455,7 +3318,7 @@ void pa_sink_input_request_rewind(
     /* Calculate how much we can rewind locally without having to
      * touch the sink */
     if (rewrite)
-        lbq = pa_memblockq_get_length(i->thread_info.render_memblockq);
+        lbq = pa_sink_input_get_render_length(i);
     else
         lbq = 0;
 
@@ -2577,6 +3440,10 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
     pa_sink_input_assert_ref(i);
     pa_assert_ctl_context();
 
+    /* The sink is suspended, nothing renders while we leave the group */
+    if (i->thread_info.premix_group)
+        premix_leave(i);
+
     if (i->thread_info.resampler &&
         pa_sample_spec_equal(pa_resampler_output_sample_spec(i->thread_info.resampler), &i->sink->sample_spec) &&
         pa_channel_map_equal(pa_resampler_output_channel_map(i->thread_info.resampler), &i->sink->channel_map))
@@ -2588,7 +3455,7 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
          !pa_sample_spec_equal(&i->sample_spec, &i->sink->sample_spec) ||
          !pa_channel_map_equal(&i->channel_map, &i->sink->channel_map))) {
 
-        new_resampler = pa_resampler_new(i->core->mempool,
+        new_resampler = pa_resampler_new_with_cache(i->core->resampler_cache, i->core->mempool,
                                      &i->sample_spec, &i->channel_map,
                                      &i->sink->sample_spec, &i->sink->channel_map,
                                      i->core->lfe_crossover_freq,
@@ -2602,6 +3469,7 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
 
         if (!new_resampler) {
             pa_log_warn("Unsupported resampling operation.");
+            premix_unset_group(i);
             return -PA_ERR_NOTSUPPORTED;
         }
     } else
@@ -2610,8 +3478,10 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
     if (flush_history)
         pa_memblockq_flush_write(i->thread_info.history_memblockq, true);
 
-    if (new_resampler == i->thread_info.resampler)
+    if (new_resampler == i->thread_info.resampler) {
+        premix_set_group(i);
         return 0;
+    }
 
     if (i->thread_info.resampler)
         pa_resampler_free(i->thread_info.resampler);
@@ -2637,6 +3507,8 @@ int pa_sink_input_update_resampler(pa_sink_input *i, bool flush_history) {
 
     pa_log_debug("Updated resampler for sink input %d", i->index);
 
+    premix_set_group(i);
+
     return 0;
 }
 
@@ -2660,6 +3532,9 @@ void pa_sink_input_detach(pa_sink_input *i) {
 
     i->thread_info.attached = false;
 
+    if (i->thread_info.premix_group)
+        premix_leave(i);
+
     if (i->detach)
         i->detach(i);
 }
@@ -60,6 +60,10 @@ typedef enum pa_sink_input_flags {
     PA_SINK_INPUT_PASSTHROUGH = 2048
 } pa_sink_input_flags_t;
 
+/* Inputs of the same rate and channel map that are mixed before being
+ * resampled together, see pa_sink_input_update_premix() */
+typedef struct pa_premix_group pa_premix_group;
+
 struct pa_sink_input {
     pa_msgobject parent;
 
@@ -86,6 +90,12 @@ struct pa_sink_input {
 
     pa_sink *origin_sink;               /* only set by filter sinks */
 
+    /* The premix group the IO thread may put the input in. Groups are
+     * shared by the inputs of a sink that could be premixed together, and
+     * are only created and freed here in the main thread. Only changed
+     * while the IO thread doesn't render the input. */
+    pa_premix_group *premix_group;
+
     /* A sink input may be connected to multiple source outputs
      * directly, so that they don't get mixed data of the entire
      * source. */
@@ -278,6 +288,17 @@ struct pa_sink_input {
         bool dont_rewrite;
 
         pa_hashmap *direct_outputs;
+
+        /* Set while the input is in a premix group. Its own render and
+         * history queues are unused then, premix_memblockq holds what was
+         * popped from the implementor, in the input's sample spec. The
+         * queue exists as long as premix_group above is set. */
+        pa_premix_group *premix_group;
+        pa_memblockq *premix_memblockq;
+
+        /* The write index of the group's render queue after the last
+         * data of this input went in */
+        int64_t premix_end;
     } thread_info;
 
     void *userdata;
@@ -441,6 +462,15 @@ pa_usec_t pa_sink_input_set_requested_latency_within_thread(pa_sink_input *i, pa
 bool pa_sink_input_safe_to_remove(pa_sink_input *i);
 bool pa_sink_input_process_underrun(pa_sink_input *i);
 
+/* Returns how much of the input is rendered but not played yet, in the
+ * sink's sample spec */
+size_t pa_sink_input_get_render_length(pa_sink_input *i);
+
+/* Puts the input into the premix group the main thread picked for it, see
+ * premix_group above, or takes it out of its group, depending on the state
+ * of the input. Called by the sink before peeking the input. */
+void pa_sink_input_update_premix(pa_sink_input *i);
+
 pa_memchunk* pa_sink_input_get_silence(pa_sink_input *i, pa_memchunk *ret);
 
 /* Calls the attach() callback if it's set. The input must be in detached
@@ -50,7 +50,9 @@
 
 #include "sink.h"
 
-#define MAX_MIX_CHANNELS 32
+#define MIX_INFO_ALIGN 64
+#define MIX_INFO_MIN 8
+#define PARALLEL_RENDER_MIN_INPUTS 4
 #define MIX_BUFFER_LENGTH (pa_page_size())
 #define ABSOLUTE_MIN_LATENCY (500)
 #define ABSOLUTE_MAX_LATENCY (10*PA_USEC_PER_SEC)
@@ -335,6 +337,13 @@ pa_sink* pa_sink_new(
     s->thread_info.rtpoll = NULL;
     s->thread_info.inputs = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func, NULL,
                                                 (pa_free_cb_t) pa_sink_input_unref);
+    s->thread_info.mix_info = NULL;
+    s->thread_info.mix_info_mem = NULL;
+    s->thread_info.n_mix_info = 0;
+    s->thread_info.render_pool = NULL;
+    if (core->render_threads > 0)
+        s->thread_info.render_pool = pa_render_pool_new("render", core->render_threads,
+                                                        core->realtime_scheduling ? core->realtime_priority : 0);
     s->thread_info.soft_volume =  s->soft_volume;
     s->thread_info.soft_muted = s->muted;
     s->thread_info.state = s->state;
@@ -827,6 +836,10 @@ static void sink_free(pa_object *o) {
 
     pa_idxset_free(s->inputs, NULL);
     pa_hashmap_free(s->thread_info.inputs);
+    pa_xfree(s->thread_info.mix_info_mem);
+
+    if (s->thread_info.render_pool)
+        pa_render_pool_free(s->thread_info.render_pool);
 
     if (s->silence.memblock)
         pa_memblock_unref(s->silence.memblock);
@@ -1098,6 +1111,110 @@ void pa_sink_process_rewind(pa_sink *s, size_t nbytes) {
     }
 }
 
+/* Called from IO thread context, when an input is attached, i.e. never
+ * while rendering */
+static void mix_info_reserve(pa_sink *s) {
+    unsigned needed, n;
+
+    pa_sink_assert_ref(s);
+    pa_sink_assert_io_context(s);
+
+    needed = pa_hashmap_size(s->thread_info.inputs);
+    if (needed <= s->thread_info.n_mix_info)
+        return;
+
+    n = PA_MAX(s->thread_info.n_mix_info * 2, (unsigned) MIX_INFO_MIN);
+    while (n < needed)
+        n *= 2;
+
+    /* The contents don't survive a render cycle, so there is nothing to
+     * copy over */
+    pa_xfree(s->thread_info.mix_info_mem);
+    s->thread_info.mix_info_mem = pa_xmalloc(n * sizeof(pa_mix_info) + MIX_INFO_ALIGN - 1);
+    s->thread_info.mix_info = (pa_mix_info *) (((uintptr_t) s->thread_info.mix_info_mem + MIX_INFO_ALIGN - 1) &
+                                               ~((uintptr_t) MIX_INFO_ALIGN - 1));
+    s->thread_info.n_mix_info = n;
+}
+
+struct parallel_peek {
+    pa_mix_info *info;
+    size_t length;
+};
+
+/* Called from IO thread context or from one of the render pool threads on
+ * behalf of the IO thread */
+static void parallel_peek_cb(void *userdata, unsigned k) {
+    struct parallel_peek *p = userdata;
+    pa_mix_info *m = p->info + k;
+
+    if (m->chunk.memblock)
+        return;
+
+    pa_sink_input_peek(m->userdata, p->length, &m->chunk, &m->volume);
+}
+
+/* Called from IO thread context. Peeks all inputs first, using the render
+ * pool, and then drops the silent ones just like fill_mix_info() does.
+ * Inputs of filter sinks render their whole sink and are hence peeked from
+ * the IO thread beforehand. Any other input only touches its own state
+ * while being peeked, with one exception: the leader of a premix group
+ * pops the other members and writes their thread_info (premix_memblockq,
+ * premix_end, underrun_for, playing_for) from whichever render pool thread
+ * runs it. That is safe because the peek of a member that is not the
+ * leader only reads the group and the sink's silence, and hands that out.
+ * The membership itself only changes in fill_mix_info(), before any
+ * input is peeked. */
+static unsigned fill_mix_info_parallel(pa_sink *s, size_t *length, pa_mix_info *info) {
+    struct parallel_peek p;
+    pa_sink_input *i;
+    unsigned n = 0, n_inputs = 0, k;
+    void *state = NULL;
+    size_t mixlength = *length;
+
+    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL))) {
+        pa_mix_info *m = info + n_inputs++;
+
+        pa_sink_input_assert_ref(i);
+
+        /* The reference is owned by thread_info.inputs for now, which
+         * can't change while we render */
+        m->userdata = i;
+        m->chunk.memblock = NULL;
+
+        if (i->origin_sink)
+            pa_sink_input_peek(i, *length, &m->chunk, &m->volume);
+    }
+
+    p.info = info;
+    p.length = *length;
+    pa_render_pool_run(s->thread_info.render_pool, parallel_peek_cb, &p, n_inputs);
+
+    for (k = 0; k < n_inputs; k++) {
+        pa_mix_info *m = info + k;
+
+        if (mixlength == 0 || m->chunk.length < mixlength)
+            mixlength = m->chunk.length;
+
+        if (pa_memblock_is_silence(m->chunk.memblock)) {
+            pa_memblock_unref(m->chunk.memblock);
+            continue;
+        }
+
+        pa_assert(m->chunk.memblock);
+        pa_assert(m->chunk.length > 0);
+
+        info[n].chunk = m->chunk;
+        info[n].volume = m->volume;
+        info[n].userdata = pa_sink_input_ref(m->userdata);
+        n++;
+    }
+
+    if (mixlength > 0)
+        *length = mixlength;
+
+    return n;
+}
+
 /* Called from IO thread context */
 static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, unsigned maxinfo) {
     pa_sink_input *i;
@@ -1107,9 +1224,23 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
 
     pa_sink_assert_ref(s);
     pa_sink_assert_io_context(s);
-    pa_assert(info);
+    pa_assert(info || maxinfo == 0);
+    pa_assert(pa_hashmap_size(s->thread_info.inputs) <= maxinfo);
+
+    /* Premix groups change before anything is peeked, the first member
+     * of a group renders for all of them */
+    if (s->core->premix_resampling) {
+        PA_HASHMAP_FOREACH(i, s->thread_info.inputs, state)
+            pa_sink_input_update_premix(i);
+
+        state = NULL;
+    }
+
+    if (s->thread_info.render_pool &&
+        pa_hashmap_size(s->thread_info.inputs) >= PARALLEL_RENDER_MIN_INPUTS)
+        return fill_mix_info_parallel(s, length, info);
 
-    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL)) && maxinfo > 0) {
+    while ((i = pa_hashmap_iterate(s->thread_info.inputs, &state, NULL))) {
         pa_sink_input_assert_ref(i);
 
         pa_sink_input_peek(i, *length, &info->chunk, &info->volume);
@@ -1129,7 +1260,6 @@ static unsigned fill_mix_info(pa_sink *s, size_t *length, pa_mix_info *info, uns
 
         info++;
         n++;
-        maxinfo--;
     }
 
     if (mixlength > 0)
@@ -1238,7 +1368,7 @@ static void inputs_drop(pa_sink *s, pa_mix_info *info, unsigned n, pa_memchunk *
 
 /* Called from IO thread context */
 void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t block_size_max;
 
@@ -1269,7 +1399,8 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info, s->thread_info.n_mix_info);
 
     if (n == 0) {
 
@@ -1323,7 +1454,7 @@ void pa_sink_render(pa_sink*s, size_t length, pa_memchunk *result) {
 
 /* Called from IO thread context */
 void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
-    pa_mix_info info[MAX_MIX_CHANNELS];
+    pa_mix_info *info;
     unsigned n;
     size_t length, block_size_max;
 
@@ -1352,7 +1483,8 @@ void pa_sink_render_into(pa_sink*s, pa_memchunk *target) {
 
     pa_assert(length > 0);
 
-    n = fill_mix_info(s, &length, info, MAX_MIX_CHANNELS);
+    info = s->thread_info.mix_info;
+    n = fill_mix_info(s, &length, info, s->thread_info.n_mix_info);
 
     if (n == 0) {
         if (target->length > length)
@@ -2652,6 +2784,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
              * PA_SINK_MESSAGE_FINISH_MOVE, too. */
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            mix_info_reserve(s);
 
             /* Since the caller sleeps in pa_sink_input_put(), we can
              * safely access data outside of thread_info even though
@@ -2795,6 +2928,7 @@ int pa_sink_process_msg(pa_msgobject *o, int code, void *userdata, int64_t offse
             pa_assert(!i->thread_info.sync_prev);
 
             pa_hashmap_put(s->thread_info.inputs, PA_UINT32_TO_PTR(i->index), pa_sink_input_ref(i));
+            mix_info_reserve(s);
 
             pa_sink_input_attach(i);
 
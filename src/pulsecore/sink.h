@@ -33,6 +33,8 @@
 #include <pulsecore/core.h>
 #include <pulsecore/idxset.h>
 #include <pulsecore/memchunk.h>
+#include <pulsecore/mix.h>
+#include <pulsecore/render-pool.h>
 #include <pulsecore/source.h>
 #include <pulsecore/module.h>
 #include <pulsecore/asyncmsgq.h>
@@ -276,6 +278,18 @@ struct pa_sink {
         pa_sink_state_t state;
         pa_hashmap *inputs;
 
+        /* Scratch space for pa_sink_render() with room for at least one
+         * entry per input. It is grown when inputs are attached, so that
+         * rendering itself never has to allocate. mix_info points into
+         * mix_info_mem at the first cache line boundary. */
+        pa_mix_info *mix_info;
+        void *mix_info_mem;
+        unsigned n_mix_info;
+
+        /* Helper threads used to peek the inputs in parallel, NULL if
+         * core->render_threads is 0 */
+        pa_render_pool *render_pool;
+
         pa_rtpoll *rtpoll;
 
         pa_cvolume soft_volume;
@@ -415,7 +415,8 @@ int pa_source_output_new(
         !pa_channel_map_equal(&data->channel_map, &data->source->channel_map)) {
 
         if (!pa_source_output_new_data_is_passthrough(data)) /* no resampler for passthrough content */
-            if (!(resampler = pa_resampler_new(
+            if (!(resampler = pa_resampler_new_with_cache(
+                        core->resampler_cache,
                         core->mempool,
                         &data->source->sample_spec, &data->source->channel_map,
                         &data->sample_spec, &data->channel_map,
@@ -1830,7 +1831,7 @@ int pa_source_output_update_resampler(pa_source_output *o) {
          !pa_sample_spec_equal(&o->sample_spec, &o->source->sample_spec) ||
          !pa_channel_map_equal(&o->channel_map, &o->source->channel_map))) {
 
-        new_resampler = pa_resampler_new(o->core->mempool,
+        new_resampler = pa_resampler_new_with_cache(o->core->resampler_cache, o->core->mempool,
                                      &o->source->sample_spec, &o->source->channel_map,
                                      &o->sample_spec, &o->channel_map,
                                      o->core->lfe_crossover_freq,
@@ -24,6 +24,7 @@
 #include "srbchannel.h"
 
 #include <pulsecore/atomic.h>
+#include <pulse/rtclock.h>
 #include <pulse/xmalloc.h>
 
 /* #define DEBUG_SRBCHANNEL */
@@ -86,6 +87,9 @@ struct pa_srbchannel {
     pa_io_event *read_event;
     pa_defer_event *defer_event;
     pa_mainloop_api *mainloop;
+
+    /* Upper limit and current length of the busy poll, 0 if disabled */
+    pa_usec_t busy_poll_max, busy_poll;
 };
 
 /* We always listen to sem_read, and always signal on sem_write.
@@ -178,6 +182,31 @@ struct srbheader {
     /* TODO: Maybe a marker here to make sure we talk to a server with equally sized struct */
 };
 
+/* Before going back to sleep on sem_read, wait a bit for the other side
+ * to post it. While we're not waiting on the fd, pa_fdsem_post() on the
+ * other side is just an atomic operation, and we don't need a wakeup
+ * either. The length of the wait adapts: it doubles each time something
+ * came in, and halves each time we gave up. Returns true if sem_read
+ * got posted. */
+static bool srbchannel_busy_poll(pa_srbchannel *sr) {
+    pa_usec_t until;
+
+    if (!sr->busy_poll)
+        return false;
+
+    until = pa_rtclock_now() + sr->busy_poll;
+
+    do {
+        if (pa_fdsem_try(sr->sem_read)) {
+            sr->busy_poll = PA_MIN(sr->busy_poll * 2, sr->busy_poll_max);
+            return true;
+        }
+    } while (pa_rtclock_now() < until);
+
+    sr->busy_poll = PA_MAX(sr->busy_poll / 2, PA_MAX(sr->busy_poll_max / 16, 1U));
+    return false;
+}
+
 static void srbchannel_rwloop(pa_srbchannel* sr) {
     do {
 #ifdef DEBUG_SRBCHANNEL
@@ -200,7 +229,7 @@ static void srbchannel_rwloop(pa_srbchannel* sr) {
         pa_log("In rw loop from srbchannel, after callback, count = %d", q);
 #endif
 
-    } while (pa_fdsem_before_poll(sr->sem_read) < 0);
+    } while (srbchannel_busy_poll(sr) || pa_fdsem_before_poll(sr->sem_read) < 0);
 }
 
 static void semread_cb(pa_mainloop_api *m, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
@@ -353,6 +382,18 @@ void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback,
     }
 }
 
+size_t pa_srbchannel_get_capacity(pa_srbchannel *sr) {
+    pa_assert(sr);
+
+    return (size_t) sr->rb_write.capacity;
+}
+
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t usec) {
+    pa_assert(sr);
+
+    sr->busy_poll_max = sr->busy_poll = usec;
+}
+
 void pa_srbchannel_free(pa_srbchannel *sr)
 {
 #ifdef DEBUG_SRBCHANNEL
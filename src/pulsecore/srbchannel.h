@@ -21,6 +21,7 @@
 ***/
 
 #include <pulse/mainloop-api.h>
+#include <pulse/sample.h>
 #include <pulsecore/fdsem.h>
 #include <pulsecore/memblock.h>
 
@@ -34,6 +35,8 @@ typedef struct pa_srbchannel_template {
     pa_memblock *memblock;
 } pa_srbchannel_template;
 
+/* The ring takes up one block of the largest size p has, split in
+ * halves for the two directions */
 pa_srbchannel* pa_srbchannel_new(pa_mainloop_api *m, pa_mempool *p);
 /* Note: this creates a srbchannel with swapped read and write. */
 pa_srbchannel* pa_srbchannel_new_from_template(pa_mainloop_api *m, pa_srbchannel_template *t);
@@ -45,6 +48,9 @@ void pa_srbchannel_export(pa_srbchannel *sr, pa_srbchannel_template *t);
 size_t pa_srbchannel_write(pa_srbchannel *sr, const void *data, size_t l);
 size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 
+/* Returns how many bytes the ring holds in each direction */
+size_t pa_srbchannel_get_capacity(pa_srbchannel *sr);
+
 /* Set the callback function that is called whenever data becomes available for reading.
  * It can also be called if the output buffer was full and can now be written to.
  *
@@ -54,4 +60,10 @@ size_t pa_srbchannel_read(pa_srbchannel *sr, void *data, size_t l);
 typedef bool (*pa_srbchannel_cb_t)(pa_srbchannel *sr, void *userdata);
 void pa_srbchannel_set_callback(pa_srbchannel *sr, pa_srbchannel_cb_t callback, void *userdata);
 
+/* Low latency mode: after the callback has run, spin for up to usec
+ * waiting for the other side before falling back to sleeping on the
+ * fdsem. This trades CPU time for wakeups, so it's only useful for
+ * peers that write small amounts very often. 0 disables it. */
+void pa_srbchannel_set_busy_poll(pa_srbchannel *sr, pa_usec_t usec);
+
 #endif
@@ -0,0 +1,221 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/endianmacros.h>
+
+#include "cpu-x86.h"
+
+#include "sample-util.h"
+
+#if defined (__i386__) || defined (__amd64__)
+
+#include <immintrin.h>
+
+/* All functions handle 8 samples per iteration. The volumes are laid out
+ * once per call for as many samples as it takes for the channel pattern
+ * to line up with a multiple of 8 again, so that they can be fetched with
+ * aligned vector loads. */
+#define PATTERN_MAX (PA_CHANNELS_MAX * 8)
+
+static unsigned pattern_length(unsigned channels) {
+    unsigned a = channels, b = 8;
+
+    while (b) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return channels / a * 8;
+}
+
+/* Same as pa_mult_s16_volume(), but on 8 samples at once. The volume is
+ * split into its low and high 16 bits so that all products fit in 32
+ * bits. */
+static inline __m128i volume_s16x8(__m128i s, const int32_t *vol_lo, const int32_t *vol_hi) {
+    __m256i v = _mm256_cvtepi16_epi32(s);
+    __m256i lo = _mm256_srai_epi32(_mm256_mullo_epi32(v, _mm256_load_si256((const __m256i *) vol_lo)), 16);
+    __m256i hi = _mm256_mullo_epi32(v, _mm256_load_si256((const __m256i *) vol_hi));
+
+    v = _mm256_add_epi32(lo, hi);
+
+    /* packs saturates, which takes care of the clamping */
+    return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+static void pa_volume_s16ne_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, vol_lo[PATTERN_MAX]);
+    PA_DECLARE_ALIGNED(32, int32_t, vol_hi[PATTERN_MAX]);
+    unsigned pattern, nvec, i, p;
+
+    length /= sizeof(int16_t);
+    pattern = pattern_length(channels);
+    nvec = length & ~7U;
+
+    for (i = 0; i < pattern; i++) {
+        vol_lo[i] = volumes[i % channels] & 0xFFFF;
+        vol_hi[i] = volumes[i % channels] >> 16;
+    }
+
+    for (i = 0, p = 0; i < nvec; i += 8) {
+        __m128i s = _mm_loadu_si128((const __m128i *) (samples + i));
+
+        _mm_storeu_si128((__m128i *) (samples + i), volume_s16x8(s, vol_lo + p, vol_hi + p));
+
+        if ((p += 8) == pattern)
+            p = 0;
+    }
+
+    for (; i < length; i++) {
+        int32_t t = pa_mult_s16_volume(samples[i], volumes[i % channels]);
+
+        samples[i] = (int16_t) PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF);
+    }
+}
+
+static void pa_volume_s16re_avx2(int16_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, vol_lo[PATTERN_MAX]);
+    PA_DECLARE_ALIGNED(32, int32_t, vol_hi[PATTERN_MAX]);
+    const __m128i swap = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    unsigned pattern, nvec, i, p;
+
+    length /= sizeof(int16_t);
+    pattern = pattern_length(channels);
+    nvec = length & ~7U;
+
+    for (i = 0; i < pattern; i++) {
+        vol_lo[i] = volumes[i % channels] & 0xFFFF;
+        vol_hi[i] = volumes[i % channels] >> 16;
+    }
+
+    for (i = 0, p = 0; i < nvec; i += 8) {
+        __m128i s = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (samples + i)), swap);
+
+        s = _mm_shuffle_epi8(volume_s16x8(s, vol_lo + p, vol_hi + p), swap);
+        _mm_storeu_si128((__m128i *) (samples + i), s);
+
+        if ((p += 8) == pattern)
+            p = 0;
+    }
+
+    for (; i < length; i++) {
+        int32_t t = pa_mult_s16_volume(PA_INT16_SWAP(samples[i]), volumes[i % channels]);
+
+        samples[i] = PA_INT16_SWAP((int16_t) PA_CLAMP_UNLIKELY(t, -0x8000, 0x7FFF));
+    }
+}
+
+/* (s * v) >> 16 on 4 samples, widened to 64 bits and clamped to the 32 bit
+ * range, with the results in the even 32 bit lanes */
+static inline __m256i volume_s32x4(__m128i s, __m128i v) {
+    const __m256i sign_bits = _mm256_set1_epi64x((int64_t) 0xFFFF000000000000ULL);
+    const __m256i max = _mm256_set1_epi64x(0x7FFFFFFFLL);
+    const __m256i min = _mm256_set1_epi64x(-0x80000000LL);
+    __m256i t;
+
+    t = _mm256_mul_epi32(_mm256_cvtepi32_epi64(s), _mm256_cvtepi32_epi64(v));
+
+    /* AVX2 has no 64 bit arithmetic shift, so put the sign bits back in
+     * by hand */
+    t = _mm256_or_si256(_mm256_srli_epi64(t, 16),
+                        _mm256_and_si256(_mm256_cmpgt_epi64(_mm256_setzero_si256(), t), sign_bits));
+
+    t = _mm256_blendv_epi8(t, max, _mm256_cmpgt_epi64(t, max));
+    return _mm256_blendv_epi8(t, min, _mm256_cmpgt_epi64(min, t));
+}
+
+static void pa_volume_s32ne_avx2(int32_t *samples, const int32_t *volumes, unsigned channels, unsigned length) {
+    PA_DECLARE_ALIGNED(32, int32_t, vol[PATTERN_MAX]);
+    const __m256i even = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    unsigned pattern, nvec, i, p;
+
+    length /= sizeof(int32_t);
+    pattern = pattern_length(channels);
+    nvec = length & ~7U;
+
+    for (i = 0; i < pattern; i++)
+        vol[i] = volumes[i % channels];
+
+    for (i = 0, p = 0; i < nvec; i += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i *) (samples + i));
+        __m256i v = _mm256_load_si256((const __m256i *) (vol + p));
+        __m256i lo, hi;
+
+        lo = volume_s32x4(_mm256_castsi256_si128(s), _mm256_castsi256_si128(v));
+        hi = volume_s32x4(_mm256_extracti128_si256(s, 1), _mm256_extracti128_si256(v, 1));
+
+        /* Gather the low halves of the 64 bit results */
+        lo = _mm256_permutevar8x32_epi32(lo, even);
+        hi = _mm256_permutevar8x32_epi32(hi, even);
+        _mm256_storeu_si256((__m256i *) (samples + i), _mm256_permute2x128_si256(lo, hi, 0x20));
+
+        if ((p += 8) == pattern)
+            p = 0;
+    }
+
+    for (; i < length; i++) {
+        int64_t t;
+
+        t = ((int64_t) samples[i] * volumes[i % channels]) >> 16;
+        samples[i] = (int32_t) PA_CLAMP_UNLIKELY(t, -0x80000000LL, 0x7FFFFFFFLL);
+    }
+}
+
+static void pa_volume_float32ne_avx2(float *samples, const float *volumes, unsigned channels, unsigned length) {
+    PA_DECLARE_ALIGNED(32, float, vol[PATTERN_MAX]);
+    unsigned pattern, nvec, i, p;
+
+    length /= sizeof(float);
+    pattern = pattern_length(channels);
+    nvec = length & ~7U;
+
+    for (i = 0; i < pattern; i++)
+        vol[i] = volumes[i % channels];
+
+    for (i = 0, p = 0; i < nvec; i += 8) {
+        __m256 s = _mm256_loadu_ps(samples + i);
+
+        _mm256_storeu_ps(samples + i, _mm256_mul_ps(s, _mm256_load_ps(vol + p)));
+
+        if ((p += 8) == pattern)
+            p = 0;
+    }
+
+    for (; i < length; i++)
+        samples[i] *= volumes[i % channels];
+}
+
+#endif /* defined (__i386__) || defined (__amd64__) */
+
+void pa_volume_func_init_avx2(pa_cpu_x86_flag_t flags) {
+#if defined (__i386__) || defined (__amd64__)
+    if (flags & PA_CPU_X86_AVX2) {
+        pa_log_info("Initialising AVX2 optimized volume functions.");
+
+        pa_set_volume_func(PA_SAMPLE_S16NE, (pa_do_volume_func_t) pa_volume_s16ne_avx2);
+        pa_set_volume_func(PA_SAMPLE_S16RE, (pa_do_volume_func_t) pa_volume_s16re_avx2);
+        pa_set_volume_func(PA_SAMPLE_S32NE, (pa_do_volume_func_t) pa_volume_s32ne_avx2);
+        pa_set_volume_func(PA_SAMPLE_FLOAT32NE, (pa_do_volume_func_t) pa_volume_float32ne_avx2);
+    }
+#endif /* defined (__i386__) || defined (__amd64__) */
+}
@@ -218,6 +218,11 @@ void pa_thread_mq_install(pa_thread_mq *q) {
     PA_STATIC_TLS_SET(thread_mq, q);
 }
 
+void pa_thread_mq_uninstall(void) {
+    pa_assert(PA_STATIC_TLS_GET(thread_mq));
+    PA_STATIC_TLS_SET(thread_mq, NULL);
+}
+
 pa_thread_mq *pa_thread_mq_get(void) {
     return PA_STATIC_TLS_GET(thread_mq);
 }
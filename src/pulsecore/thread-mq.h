@@ -43,6 +43,11 @@ void pa_thread_mq_done(pa_thread_mq *q);
 /* Install the specified pa_thread_mq object for the current thread */
 void pa_thread_mq_install(pa_thread_mq *q);
 
+/* Detach the pa_thread_mq object from the current thread again. Only
+ * needed for threads that act on behalf of another IO thread for a
+ * limited time. */
+void pa_thread_mq_uninstall(void);
+
 /* Return the pa_thread_mq object that is set for the current thread */
 pa_thread_mq *pa_thread_mq_get(void);
 
@@ -21,11 +21,13 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <check.h>
 
 #include <pulsecore/asyncmsgq.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/thread.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
@@ -105,6 +107,112 @@ START_TEST (asyncmsgq_test) {
 }
 END_TEST
 
+#define N_PRODUCERS 4
+#define N_MESSAGES 20000
+
+struct small_payload {
+    unsigned producer;
+    unsigned seq;
+};
+
+/* Too large to be stored inline */
+struct large_payload {
+    unsigned producer;
+    unsigned seq;
+    uint8_t fill[200];
+};
+
+static pa_atomic_t n_freed = PA_ATOMIC_INIT(0);
+
+static void payload_free(void *userdata) {
+    pa_atomic_inc(&n_freed);
+}
+
+static void producer_thread(void *userdata) {
+    pa_asyncmsgq *q = userdata;
+    static pa_atomic_t next_producer = PA_ATOMIC_INIT(0);
+    unsigned producer = (unsigned) pa_atomic_inc(&next_producer);
+    unsigned seq;
+
+    for (seq = 0; seq < N_MESSAGES; seq++) {
+        if (seq % 2 == 0) {
+            struct small_payload p = { producer, seq };
+
+            pa_asyncmsgq_post_data(q, NULL, OPERATION_A, &p, sizeof(p), seq, NULL, payload_free);
+        } else {
+            struct large_payload p;
+
+            p.producer = producer;
+            p.seq = seq;
+            memset(p.fill, seq & 0xff, sizeof(p.fill));
+
+            pa_asyncmsgq_post_data(q, NULL, OPERATION_B, &p, sizeof(p), seq, NULL, payload_free);
+        }
+    }
+}
+
+/* Several threads post at once, the messages of each one have to come
+ * out complete and in the order they were posted in */
+START_TEST (multi_producer_test) {
+    pa_asyncmsgq *q;
+    pa_thread *t[N_PRODUCERS];
+    unsigned next[N_PRODUCERS] = { 0 };
+    unsigned i, n;
+
+    q = pa_asyncmsgq_new(0);
+    fail_unless(q != NULL);
+
+    for (i = 0; i < N_PRODUCERS; i++)
+        fail_unless((t[i] = pa_thread_new("producer", producer_thread, q)) != NULL);
+
+    for (n = 0; n < N_PRODUCERS * N_MESSAGES; n++) {
+        int code;
+        void *data;
+        int64_t offset;
+        unsigned producer, seq;
+
+        fail_unless(pa_asyncmsgq_get(q, NULL, &code, &data, &offset, NULL, true) == 0);
+
+        if (code == OPERATION_A) {
+            struct small_payload *p = data;
+
+            producer = p->producer;
+            seq = p->seq;
+        } else {
+            struct large_payload *p = data;
+
+            fail_unless(code == OPERATION_B);
+            producer = p->producer;
+            seq = p->seq;
+            fail_unless(p->fill[0] == (seq & 0xff));
+            fail_unless(p->fill[sizeof(p->fill) - 1] == (seq & 0xff));
+        }
+
+        fail_unless(producer < N_PRODUCERS);
+        fail_unless(seq == next[producer]);
+        fail_unless(offset == (int64_t) seq);
+        fail_unless(code == (seq % 2 == 0 ? OPERATION_A : OPERATION_B));
+        next[producer]++;
+
+        pa_asyncmsgq_done(q, 0);
+    }
+
+    for (i = 0; i < N_PRODUCERS; i++) {
+        pa_thread_free(t[i]);
+        fail_unless(next[i] == N_MESSAGES);
+    }
+
+    /* Nothing else is left in the queue */
+    fail_unless(pa_asyncmsgq_read_before_poll(q) == 0);
+    pa_asyncmsgq_read_after_poll(q);
+    fail_unless(pa_asyncmsgq_process_one(q) == 0);
+
+    fail_unless(pa_atomic_load(&n_freed) == N_PRODUCERS * N_MESSAGES);
+
+    pa_asyncmsgq_unref(q);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -114,6 +222,7 @@ int main(int argc, char *argv[]) {
     s = suite_create("Async Message Queue");
     tc = tcase_create("asyncmsgq");
     tcase_add_test(tc, asyncmsgq_test);
+    tcase_add_test(tc, multi_producer_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,283 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#define FRAME_SIZE 4
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static pa_context *context = NULL;
+static pa_stream *stream = NULL;
+static const char *bname = NULL;
+
+static const pa_sample_spec sample_spec = {
+    .format = PA_SAMPLE_S16LE,
+    .rate = 44100,
+    .channels = 2
+};
+
+/* This is called whenever the context status changes */
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+        case PA_CONTEXT_TERMINATED:
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            pa_threaded_mainloop_signal(mainloop, false);
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+            break;
+
+        default:
+            fail();
+    }
+}
+
+/* This is called whenever the stream status changes */
+static void stream_state_callback(pa_stream *s, void *userdata) {
+    fail_unless(s != NULL);
+
+    switch (pa_stream_get_state(s)) {
+        case PA_STREAM_UNCONNECTED:
+        case PA_STREAM_CREATING:
+            break;
+
+        case PA_STREAM_READY:
+        case PA_STREAM_TERMINATED:
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_STREAM_FAILED:
+            pa_threaded_mainloop_signal(mainloop, false);
+            fprintf(stderr, "Stream error: %s\n", pa_strerror(pa_context_errno(pa_stream_get_context(s))));
+            fail();
+            break;
+
+        default:
+            fail();
+    }
+}
+
+/* Connects the context, with SHM as the client config says or with SHM
+ * disabled, and sets up a playback stream on the default sink */
+static void connect_stream(bool shm) {
+    char *conf = NULL;
+    int r;
+
+    if (!shm) {
+        FILE *f;
+        int fd;
+
+        conf = pa_xstrdup("/tmp/begin-write-min-test-XXXXXX");
+        fail_unless((fd = mkstemp(conf)) >= 0);
+        fail_unless((f = fdopen(fd, "w")) != NULL);
+        fprintf(f, "enable-shm = no\n");
+        fclose(f);
+
+        /* Only read when the context is created */
+        setenv("PULSE_CLIENTCONFIG", conf, 1);
+    }
+
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    mainloop_api = pa_threaded_mainloop_get_api(mainloop);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_threaded_mainloop_start(mainloop);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    if (conf) {
+        unsetenv("PULSE_CLIENTCONFIG");
+        unlink(conf);
+        pa_xfree(conf);
+    }
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    r = pa_context_connect(context, NULL, 0, NULL);
+    fail_unless(r == 0);
+
+    while (pa_context_get_state(context) != PA_CONTEXT_READY)
+        pa_threaded_mainloop_wait(mainloop);
+
+    stream = pa_stream_new(context, "begin-write-min-test", &sample_spec, NULL);
+    fail_unless(stream != NULL);
+
+    pa_stream_set_state_callback(stream, stream_state_callback, NULL);
+
+    /* Keep the stream from playing, so that it takes all we write */
+    r = pa_stream_connect_playback(stream, NULL, NULL, PA_STREAM_START_CORKED, NULL, NULL);
+    fail_unless(r == 0);
+
+    while (pa_stream_get_state(stream) != PA_STREAM_READY)
+        pa_threaded_mainloop_wait(mainloop);
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void disconnect_stream(void) {
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_stream_disconnect(stream);
+    pa_stream_unref(stream);
+    stream = NULL;
+
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+    context = NULL;
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+    mainloop = NULL;
+}
+
+START_TEST (pooled_test) {
+    void *data, *big_data;
+    size_t nbytes, max;
+
+    connect_stream(true);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    /* The largest block the pool can hand out */
+    nbytes = (size_t) -1;
+    fail_unless(pa_stream_begin_write(stream, &big_data, &nbytes) == 0);
+    max = nbytes;
+    fail_unless(max >= 4096);
+    fail_unless(pa_stream_cancel_write(stream) == 0);
+
+    /* A request below the minimum is raised to it */
+    nbytes = FRAME_SIZE;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, 64 * FRAME_SIZE) == 0);
+    fail_unless(data != NULL);
+    fail_unless(nbytes >= 64 * FRAME_SIZE);
+    memset(data, 0, nbytes);
+    fail_unless(pa_stream_write(stream, data, nbytes, NULL, 0, PA_SEEK_RELATIVE) == 0);
+
+    /* A -1 request gets as much as possible */
+    nbytes = (size_t) -1;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, FRAME_SIZE) == 0);
+    fail_unless(nbytes == max);
+    fail_unless(pa_stream_cancel_write(stream) == 0);
+
+    /* Nothing larger than a block of the pool can be had */
+    nbytes = max + FRAME_SIZE;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, max + FRAME_SIZE) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_TOOLARGE);
+
+    /* A large enough block from pa_stream_begin_write() is kept */
+    nbytes = (size_t) -1;
+    fail_unless(pa_stream_begin_write(stream, &big_data, &nbytes) == 0);
+    nbytes = FRAME_SIZE;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, 256 * FRAME_SIZE) == 0);
+    fail_unless(data == big_data);
+    fail_unless(nbytes == max);
+    fail_unless(pa_stream_cancel_write(stream) == 0);
+
+    /* A too small one is replaced */
+    nbytes = 16 * FRAME_SIZE;
+    fail_unless(pa_stream_begin_write(stream, &data, &nbytes) == 0);
+    nbytes = FRAME_SIZE;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, 1024 * FRAME_SIZE) == 0);
+    fail_unless(nbytes >= 1024 * FRAME_SIZE);
+    memset(data, 0, nbytes);
+    fail_unless(pa_stream_write(stream, data, nbytes, NULL, 0, PA_SEEK_RELATIVE) == 0);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    disconnect_stream();
+}
+END_TEST
+
+START_TEST (not_pooled_test) {
+    void *data;
+    size_t nbytes;
+
+    connect_stream(false);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    /* Without SHM the data is always copied */
+    nbytes = 64 * FRAME_SIZE;
+    fail_unless(pa_stream_begin_write_min(stream, &data, &nbytes, 64 * FRAME_SIZE) < 0);
+    fail_unless(pa_context_errno(context) == PA_ERR_NOTSUPPORTED);
+
+    /* ... which pa_stream_begin_write() still does */
+    nbytes = FRAME_SIZE;
+    fail_unless(pa_stream_begin_write(stream, &data, &nbytes) == 0);
+    fail_unless(nbytes >= FRAME_SIZE);
+    memset(data, 0, nbytes);
+    fail_unless(pa_stream_write(stream, data, nbytes, NULL, 0, PA_SEEK_RELATIVE) == 0);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    disconnect_stream();
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Begin write min");
+    tc = tcase_create("beginwritemin");
+    tcase_add_test(tc, pooled_test);
+    tcase_add_test(tc, not_pooled_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
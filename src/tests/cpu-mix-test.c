@@ -21,8 +21,11 @@
 
 #include <check.h>
 
+#include <pulse/xmalloc.h>
+
 #include <pulsecore/cpu.h>
 #include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/random.h>
 #include <pulsecore/macro.h>
 #include <pulsecore/mix.h>
@@ -145,6 +148,139 @@ static void run_mix_test(
     pa_mempool_unref(pool);
 }
 
+/* Like run_mix_test(), but for any number of streams and for the s16, s32
+ * and float32 formats. Results have to be bit exact with the reference. */
+static void run_mix_test_format(
+        pa_do_mix_func_t func,
+        pa_do_mix_func_t orig_func,
+        pa_sample_format_t format,
+        int channels,
+        int nstreams,
+        bool correct,
+        bool perf) {
+
+    pa_sample_spec ss;
+    pa_mempool *pool;
+    pa_mix_info m[8];
+    void *out, *out_ref;
+    size_t length;
+    int i, c;
+
+    pa_assert(nstreams >= 2 && nstreams <= 8);
+
+    ss.format = format;
+    ss.channels = channels;
+    ss.rate = 44100;
+
+    /* Deliberately not a multiple of the vector width */
+    length = pa_frame_size(&ss) * (SAMPLES - 3);
+
+    fail_unless((pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true)) != NULL);
+
+    for (i = 0; i < nstreams; i++) {
+        void *d;
+
+        m[i].chunk.memblock = pa_memblock_new(pool, length);
+        m[i].chunk.length = length;
+        m[i].chunk.index = 0;
+
+        d = pa_memblock_acquire(m[i].chunk.memblock);
+        if (format == PA_SAMPLE_FLOAT32NE) {
+            float *f = d;
+            unsigned k;
+
+            for (k = 0; k < length / sizeof(float); k++)
+                f[k] = (float) (rand() / (RAND_MAX + 1.0) * 2.0 - 1.0);
+        } else
+            pa_random(d, length);
+        pa_memblock_release(m[i].chunk.memblock);
+
+        m[i].volume.channels = channels;
+        for (c = 0; c < channels; c++) {
+            /* one muted channel on one stream, the rest at varying volumes */
+            if (i == 1 && c == 0) {
+                m[i].linear[c].i = 0;
+                m[i].linear[c].f = 0.0f;
+            } else if (format == PA_SAMPLE_FLOAT32NE)
+                m[i].linear[c].f = 0.1f + 0.2f * ((i + c) % 7);
+            else
+                m[i].linear[c].i = 0x1234 + 0x2345 * ((i + c) % 7);
+        }
+    }
+
+    out = pa_xmalloc(length);
+    out_ref = pa_xmalloc(length);
+
+    if (correct) {
+        acquire_mix_streams(m, nstreams);
+        orig_func(m, nstreams, channels, out_ref, length);
+        release_mix_streams(m, nstreams);
+
+        acquire_mix_streams(m, nstreams);
+        func(m, nstreams, channels, out, length);
+        release_mix_streams(m, nstreams);
+
+        if (memcmp(out, out_ref, length)) {
+            pa_log_debug("Correctness test failed: format=%s, channels=%d, streams=%d",
+                         pa_sample_format_to_string(format), channels, nstreams);
+            ck_abort();
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing %d-channel %s mixing performance of %d streams",
+                     channels, pa_sample_format_to_string(format), nstreams);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            func(m, nstreams, channels, out, length);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            acquire_mix_streams(m, nstreams);
+            orig_func(m, nstreams, channels, out_ref, length);
+            release_mix_streams(m, nstreams);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+
+    pa_xfree(out);
+    pa_xfree(out_ref);
+
+    for (i = 0; i < nstreams; i++)
+        pa_memblock_unref(m[i].chunk.memblock);
+
+    pa_mempool_unref(pool);
+}
+
+static void run_mix_test_formats(void (*init_func)(pa_cpu_x86_flag_t), pa_cpu_x86_flag_t flags, const char *name) {
+    static const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_S32NE, PA_SAMPLE_FLOAT32NE };
+    static const int channels[] = { 1, 2, 3, 6, 8 };
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, true };
+    pa_do_mix_func_t orig_func[PA_ELEMENTSOF(formats)], func[PA_ELEMENTSOF(formats)];
+    unsigned f, c;
+
+    /* the generic code is the reference for the formats */
+    pa_mix_func_init(&cpu_info);
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+        orig_func[f] = pa_get_mix_func(formats[f]);
+
+    init_func(flags);
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++)
+        func[f] = pa_get_mix_func(formats[f]);
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        for (c = 0; c < PA_ELEMENTSOF(channels); c++) {
+            pa_log_debug("Checking %s mix (%s, %d channels)", name, pa_sample_format_to_string(formats[f]), channels[c]);
+            run_mix_test_format(func[f], orig_func[f], formats[f], channels[c], 2, true, false);
+            run_mix_test_format(func[f], orig_func[f], formats[f], channels[c], 7, true, channels[c] == 2 || channels[c] == 8);
+        }
+    }
+
+    cpu_info.force_generic_code = false;
+    pa_mix_func_init(&cpu_info);
+}
+
 START_TEST (mix_special_test) {
     pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
     pa_do_mix_func_t orig_func, special_func;
@@ -196,6 +332,38 @@ START_TEST (mix_neon_test) {
 END_TEST
 #endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (mix_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    run_mix_test_formats(pa_mix_func_init_avx2, flags, "AVX2");
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512)
+START_TEST (mix_avx512_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX512F)) {
+        pa_log_info("AVX-512 not supported. Skipping");
+        return;
+    }
+
+    run_mix_test_formats(pa_mix_func_init_avx512, flags, "AVX-512");
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512) */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -211,6 +379,12 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, mix_special_test);
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, mix_neon_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, mix_avx2_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX512)
+    tcase_add_test(tc, mix_avx512_test);
 #endif
     suite_add_tcase(s, tc);
 
@@ -226,6 +226,36 @@ static void setup_remap_channels(
     }
 }
 
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE) || defined (HAVE_AVX2))
+static void setup_remap_matrix(
+    pa_remap_t *m,
+    pa_sample_format_t f,
+    unsigned in_channels,
+    unsigned out_channels) {
+
+    unsigned i, o;
+
+    m->format = f;
+    m->i_ss.channels = in_channels;
+    m->o_ss.channels = out_channels;
+
+    /* A sparse matrix with some unity and some zero coefficients, like the
+     * ones used for up- and downmixing */
+    for (o = 0; o < out_channels; o++) {
+        for (i = 0; i < in_channels; i++) {
+            if (o == i)
+                m->map_table_f[o][i] = 1.0f;
+            else if ((o + i) % 3 == 0)
+                m->map_table_f[o][i] = 0.0f;
+            else
+                m->map_table_f[o][i] = 0.7071f / (1 + (o + 2 * i) % 4);
+
+            m->map_table_i[o][i] = (int32_t) (m->map_table_f[o][i] * 0x10000);
+        }
+    }
+}
+#endif /* (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE) || defined (HAVE_AVX2)) */
+
 static void remap_test_channels(
     pa_remap_t *remap_func, pa_remap_t *remap_orig) {
 
@@ -308,6 +338,46 @@ static void remap_init2_test_channels(
     pa_xfree(remap_func.state);
 }
 
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE) || defined (HAVE_AVX2))
+static void remap_matrix_test_channels(
+        pa_init_remap_func_t matrix_func,
+        unsigned in_channels,
+        unsigned out_channels) {
+
+    pa_cpu_info cpu_info = { PA_CPU_UNDEFINED, {}, false };
+    pa_init_remap_func_t orig_matrix_func;
+    pa_remap_t remap_orig = {0}, remap_func = {0};
+
+    cpu_info.force_generic_code = true;
+    pa_remap_func_init(&cpu_info);
+    setup_remap_matrix(&remap_orig, PA_SAMPLE_FLOAT32NE, in_channels, out_channels);
+    pa_init_remap_func(&remap_orig);
+
+    cpu_info.force_generic_code = false;
+    pa_remap_func_init(&cpu_info);
+    orig_matrix_func = pa_get_init_remap_matrix_func();
+    pa_set_init_remap_matrix_func(matrix_func);
+    setup_remap_matrix(&remap_func, PA_SAMPLE_FLOAT32NE, in_channels, out_channels);
+    pa_init_remap_func(&remap_func);
+    pa_set_init_remap_matrix_func(orig_matrix_func);
+
+    remap_test_channels(&remap_func, &remap_orig);
+
+    pa_xfree(remap_func.state);
+}
+
+static void remap_matrix_test(pa_init_remap_func_t matrix_func) {
+    pa_log_debug("Checking matrix remap (float, 6-channel->stereo)");
+    remap_matrix_test_channels(matrix_func, 6, 2);
+    pa_log_debug("Checking matrix remap (float, 8-channel->6-channel)");
+    remap_matrix_test_channels(matrix_func, 8, 6);
+    pa_log_debug("Checking matrix remap (float, 3-channel->5-channel)");
+    remap_matrix_test_channels(matrix_func, 3, 5);
+    pa_log_debug("Checking matrix remap (float, stereo->8-channel)");
+    remap_matrix_test_channels(matrix_func, 2, 8);
+}
+#endif /* (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE) || defined (HAVE_AVX2)) */
+
 START_TEST (remap_special_test) {
     pa_log_debug("Checking special remap (float, mono->stereo)");
     remap_init2_test_channels(PA_SAMPLE_FLOAT32NE, 1, 2, false);
@@ -408,8 +478,44 @@ START_TEST (remap_sse2_test) {
     remap_init_test_channels(init_func, orig_init_func, PA_SAMPLE_S16NE, 1, 2, false);
 }
 END_TEST
+
+START_TEST (remap_matrix_sse_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t orig_matrix_func;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_SSE2)) {
+        pa_log_info("SSE2 not supported. Skipping");
+        return;
+    }
+
+    orig_matrix_func = pa_get_init_remap_matrix_func();
+    pa_remap_func_init_sse(flags);
+    remap_matrix_test(pa_get_init_remap_matrix_func());
+    pa_set_init_remap_matrix_func(orig_matrix_func);
+}
+END_TEST
 #endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (remap_matrix_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_init_remap_func_t orig_matrix_func;
+
+    pa_cpu_get_x86_flags(&flags);
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_matrix_func = pa_get_init_remap_matrix_func();
+    pa_remap_func_init_avx2(flags);
+    remap_matrix_test(pa_get_init_remap_matrix_func());
+    pa_set_init_remap_matrix_func(orig_matrix_func);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (remap_neon_test) {
     pa_cpu_arm_flag_t flags = 0;
@@ -526,6 +632,15 @@ int main(int argc, char *argv[]) {
 #endif
     suite_add_tcase(s, tc);
 
+    tc = tcase_create("matrix");
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE)
+    tcase_add_test(tc, remap_matrix_sse_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, remap_matrix_avx2_test);
+#endif
+    suite_add_tcase(s, tc);
+
     tc = tcase_create("rearrange");
     tcase_add_test(tc, rearrange_special_test);
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
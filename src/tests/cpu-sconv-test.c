@@ -83,6 +83,125 @@ static void run_conv_test_float_to_s16(
     }
 }
 
+#if (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE41) || defined (HAVE_AVX2))
+/* Checks a float -> format and a format -> float conversion of one of the
+ * 24 or 32 bit formats, both must be bit exact with the generic code */
+static void run_conv_test_format(
+        pa_convert_func_t from_func,
+        pa_convert_func_t orig_from_func,
+        pa_convert_func_t to_func,
+        pa_convert_func_t orig_to_func,
+        pa_sample_format_t format,
+        int align,
+        bool correct,
+        bool perf) {
+
+    PA_DECLARE_ALIGNED(8, uint8_t, s[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, uint8_t, s_ref[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(8, float, f[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, float, f_ref[SAMPLES]) = { 0.0f };
+    PA_DECLARE_ALIGNED(8, float, f_in[SAMPLES]);
+    uint8_t *samples, *samples_ref;
+    float *floats, *floats_ref, *floats_in;
+    size_t ss = pa_sample_size_of_format(format);
+    int i, nsamples;
+
+    /* Force sample alignment as requested */
+    samples = s + (8 - align) * ss;
+    samples_ref = s_ref + (8 - align) * ss;
+    floats = f + (8 - align);
+    floats_ref = f_ref + (8 - align);
+    floats_in = f_in + (8 - align);
+    nsamples = SAMPLES - (8 - align);
+
+    /* Include some values that need clipping */
+    for (i = 0; i < nsamples; i++)
+        floats_in[i] = 2.1f * (rand()/(float) RAND_MAX - 0.5f);
+    floats_in[0] = 1.0f;
+    floats_in[1] = -1.0f;
+
+    if (correct) {
+        orig_from_func(nsamples, floats_in, samples_ref);
+        from_func(nsamples, floats_in, samples);
+
+        for (i = 0; i < nsamples; i++) {
+            if (memcmp(samples + i * ss, samples_ref + i * ss, ss) != 0) {
+                pa_log_debug("Correctness test failed: %s, align=%d", pa_sample_format_to_string(format), align);
+                pa_log_debug("%d: float -> sample mismatch (%.24f)\n", i, floats_in[i]);
+                ck_abort();
+            }
+        }
+
+        pa_random(samples, nsamples * ss);
+        orig_to_func(nsamples, samples, floats_ref);
+        to_func(nsamples, samples, floats);
+
+        for (i = 0; i < nsamples; i++) {
+            if (memcmp(&floats[i], &floats_ref[i], sizeof(float)) != 0) {
+                pa_log_debug("Correctness test failed: %s, align=%d", pa_sample_format_to_string(format), align);
+                pa_log_debug("%d: %.24f != %.24f\n", i, floats[i], floats_ref[i]);
+                ck_abort();
+            }
+        }
+    }
+
+    if (perf) {
+        pa_log_debug("Testing sconv float -> %s performance with %d sample alignment",
+                pa_sample_format_to_string(format), align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            from_func(nsamples, floats_in, samples);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_from_func(nsamples, floats_in, samples_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        pa_log_debug("Testing sconv %s -> float performance with %d sample alignment",
+                pa_sample_format_to_string(format), align);
+
+        PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
+            to_func(nsamples, samples, floats);
+        } PA_RUNTIME_TEST_RUN_STOP
+
+        PA_RUNTIME_TEST_RUN_START("orig", TIMES, TIMES2) {
+            orig_to_func(nsamples, samples, floats_ref);
+        } PA_RUNTIME_TEST_RUN_STOP
+    }
+}
+
+static void run_conv_test_formats(void (*init_func)(pa_cpu_x86_flag_t flags), pa_cpu_x86_flag_t flags, const char *name) {
+    const pa_sample_format_t formats[] = { PA_SAMPLE_S32LE, PA_SAMPLE_S24LE, PA_SAMPLE_S24_32LE };
+    pa_convert_func_t orig_from_func[PA_ELEMENTSOF(formats)], from_func[PA_ELEMENTSOF(formats)];
+    pa_convert_func_t orig_to_func[PA_ELEMENTSOF(formats)], to_func[PA_ELEMENTSOF(formats)];
+    unsigned i;
+    int align;
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        orig_from_func[i] = pa_get_convert_from_float32ne_function(formats[i]);
+        orig_to_func[i] = pa_get_convert_to_float32ne_function(formats[i]);
+    }
+
+    init_func(flags);
+
+    /* Put the previous functions back so that later tests compare against
+     * the generic code again */
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        from_func[i] = pa_get_convert_from_float32ne_function(formats[i]);
+        to_func[i] = pa_get_convert_to_float32ne_function(formats[i]);
+        pa_set_convert_from_float32ne_function(formats[i], orig_from_func[i]);
+        pa_set_convert_to_float32ne_function(formats[i], orig_to_func[i]);
+    }
+
+    for (i = 0; i < PA_ELEMENTSOF(formats); i++) {
+        pa_log_debug("Checking %s sconv (%s)", name, pa_sample_format_to_string(formats[i]));
+        for (align = 0; align < 8; align++)
+            run_conv_test_format(from_func[i], orig_from_func[i], to_func[i], orig_to_func[i], formats[i],
+                                 align, true, align == 7);
+    }
+}
+#endif /* (defined (__i386__) || defined (__amd64__)) && (defined (HAVE_SSE41) || defined (HAVE_AVX2)) */
+
 /* This test is currently only run under NEON */
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 static void run_conv_test_s16_to_float(
@@ -190,6 +309,38 @@ START_TEST (sconv_sse_test) {
 END_TEST
 #endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE) */
 
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE41)
+START_TEST (sconv_sse41_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_SSE4_1)) {
+        pa_log_info("SSE4.1 not supported. Skipping");
+        return;
+    }
+
+    run_conv_test_formats(pa_convert_func_init_sse41, flags, "SSE4.1");
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE41) */
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (sconv_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    run_conv_test_formats(pa_convert_func_init_avx2, flags, "AVX2");
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
 START_TEST (sconv_neon_test) {
     pa_cpu_arm_flag_t flags = 0;
@@ -248,6 +399,12 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, sconv_sse2_test);
     tcase_add_test(tc, sconv_sse_test);
 #endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_SSE41)
+    tcase_add_test(tc, sconv_sse41_test);
+#endif
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, sconv_avx2_test);
+#endif
 #if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
     tcase_add_test(tc, sconv_neon_test);
 #endif
@@ -36,35 +36,60 @@
 #define TIMES2 100
 #define PADDING 16
 
+static uint32_t read_sample(const uint8_t *samples, pa_sample_format_t format, int i) {
+    switch (pa_sample_size_of_format(format)) {
+        case 2:
+            return ((const uint16_t *) samples)[i];
+        default:
+            return ((const uint32_t *) samples)[i];
+    }
+}
+
 static void run_volume_test(
         pa_do_volume_func_t func,
         pa_do_volume_func_t orig_func,
+        pa_sample_format_t format,
         int align,
         int channels,
         bool correct,
         bool perf) {
     fail_unless(align % channels == 0);
 
-    PA_DECLARE_ALIGNED(8, int16_t, s[SAMPLES]) = { 0 };
-    PA_DECLARE_ALIGNED(8, int16_t, s_ref[SAMPLES]) = { 0 };
-    PA_DECLARE_ALIGNED(8, int16_t, s_orig[SAMPLES]) = { 0 };
-    int32_t volumes[channels + PADDING];
-    int16_t *samples, *samples_ref, *samples_orig;
+    PA_DECLARE_ALIGNED(32, uint8_t, s[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(32, uint8_t, s_ref[SAMPLES * 4]) = { 0 };
+    PA_DECLARE_ALIGNED(32, uint8_t, s_orig[SAMPLES * 4]) = { 0 };
+    union {
+        int32_t i;
+        float f;
+    } volumes[channels + PADDING];
+    uint8_t *samples, *samples_ref, *samples_orig;
     int i, padding, nsamples, size;
+    size_t ss = pa_sample_size_of_format(format);
 
     /* Force sample alignment as requested */
-    samples = s + (8 - align);
-    samples_ref = s_ref + (8 - align);
-    samples_orig = s_orig + (8 - align);
+    samples = s + (8 - align) * ss;
+    samples_ref = s_ref + (8 - align) * ss;
+    samples_orig = s_orig + (8 - align) * ss;
     nsamples = SAMPLES - (8 - align);
-    size = nsamples * sizeof(int16_t);
+    size = nsamples * ss;
+
+    if (format == PA_SAMPLE_FLOAT32NE) {
+        float *f = (float *) samples;
+
+        for (i = 0; i < nsamples; i++)
+            f[i] = 2.0f * rand() / (float) RAND_MAX - 1.0f;
+    } else
+        pa_random(samples, size);
 
-    pa_random(samples, size);
     memcpy(samples_ref, samples, size);
     memcpy(samples_orig, samples, size);
 
-    for (i = 0; i < channels; i++)
-        volumes[i] = PA_CLAMP_VOLUME((pa_volume_t)(rand() >> 15));
+    for (i = 0; i < channels; i++) {
+        if (format == PA_SAMPLE_FLOAT32NE)
+            volumes[i].f = 2.0f * rand() / (float) RAND_MAX;
+        else
+            volumes[i].i = PA_CLAMP_VOLUME((pa_volume_t)(rand() >> 15));
+    }
     for (padding = 0; padding < PADDING; padding++, i++)
         volumes[i] = volumes[padding];
 
@@ -73,17 +98,20 @@ static void run_volume_test(
         func(samples, volumes, channels, size);
 
         for (i = 0; i < nsamples; i++) {
-            if (samples[i] != samples_ref[i]) {
-                pa_log_debug("Correctness test failed: align=%d, channels=%d", align, channels);
-                pa_log_debug("%d: %04hx != %04hx (%04hx * %08x)", i, samples[i], samples_ref[i],
-                        samples_orig[i], volumes[i % channels]);
+            if (memcmp(samples + i * ss, samples_ref + i * ss, ss) != 0) {
+                pa_log_debug("Correctness test failed: format=%s, align=%d, channels=%d",
+                        pa_sample_format_to_string(format), align, channels);
+                pa_log_debug("%d: %08x != %08x (%08x * %08x)", i,
+                        read_sample(samples, format, i), read_sample(samples_ref, format, i),
+                        read_sample(samples_orig, format, i), volumes[i % channels].i);
                 ck_abort();
             }
         }
     }
 
     if (perf) {
-        pa_log_debug("Testing svolume %dch performance with %d sample alignment", channels, align);
+        pa_log_debug("Testing svolume %s %dch performance with %d sample alignment",
+                pa_sample_format_to_string(format), channels, align);
 
         PA_RUNTIME_TEST_RUN_START("func", TIMES, TIMES2) {
             memcpy(samples, samples_orig, size);
@@ -119,11 +147,11 @@ START_TEST (svolume_mmx_test) {
     pa_log_debug("Checking MMX svolume");
     for (i = 1; i <= 3; i++) {
         for (j = 0; j <= 7; j += i)
-            run_volume_test(mmx_func, orig_func, j, i, true, j == 0);
+            run_volume_test(mmx_func, orig_func, PA_SAMPLE_S16NE, j, i, true, j == 0);
     }
-    run_volume_test(mmx_func, orig_func, 7, 1, true, true);
-    run_volume_test(mmx_func, orig_func, 6, 2, true, true);
-    run_volume_test(mmx_func, orig_func, 6, 3, true, true);
+    run_volume_test(mmx_func, orig_func, PA_SAMPLE_S16NE, 7, 1, true, true);
+    run_volume_test(mmx_func, orig_func, PA_SAMPLE_S16NE, 6, 2, true, true);
+    run_volume_test(mmx_func, orig_func, PA_SAMPLE_S16NE, 6, 3, true, true);
 }
 END_TEST
 
@@ -146,13 +174,47 @@ START_TEST (svolume_sse_test) {
     pa_log_debug("Checking SSE2 svolume");
     for (i = 1; i <= 3; i++) {
         for (j = 0; j < 7; j += i)
-            run_volume_test(sse_func, orig_func, j, i, true, j == 0);
+            run_volume_test(sse_func, orig_func, PA_SAMPLE_S16NE, j, i, true, j == 0);
     }
-    run_volume_test(sse_func, orig_func, 7, 1, true, true);
-    run_volume_test(sse_func, orig_func, 6, 2, true, true);
-    run_volume_test(sse_func, orig_func, 6, 3, true, true);
+    run_volume_test(sse_func, orig_func, PA_SAMPLE_S16NE, 7, 1, true, true);
+    run_volume_test(sse_func, orig_func, PA_SAMPLE_S16NE, 6, 2, true, true);
+    run_volume_test(sse_func, orig_func, PA_SAMPLE_S16NE, 6, 3, true, true);
 }
 END_TEST
+
+#ifdef HAVE_AVX2
+START_TEST (svolume_avx2_test) {
+    const pa_sample_format_t formats[] = { PA_SAMPLE_S16NE, PA_SAMPLE_S16RE, PA_SAMPLE_S32NE, PA_SAMPLE_FLOAT32NE };
+    pa_do_volume_func_t orig_func, avx2_func;
+    pa_cpu_x86_flag_t flags = 0;
+    unsigned f;
+    int i, j;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    for (f = 0; f < PA_ELEMENTSOF(formats); f++) {
+        orig_func = pa_get_volume_func(formats[f]);
+        pa_volume_func_init_avx2(flags);
+        avx2_func = pa_get_volume_func(formats[f]);
+        pa_set_volume_func(formats[f], orig_func);
+
+        pa_log_debug("Checking AVX2 svolume for %s", pa_sample_format_to_string(formats[f]));
+        for (i = 1; i <= 8; i++) {
+            for (j = 0; j < 7; j += i)
+                run_volume_test(avx2_func, orig_func, formats[f], j, i, true, j == 0 && i <= 3);
+        }
+        run_volume_test(avx2_func, orig_func, formats[f], 7, 1, true, true);
+        run_volume_test(avx2_func, orig_func, formats[f], 6, 2, true, true);
+        run_volume_test(avx2_func, orig_func, formats[f], 6, 3, true, true);
+    }
+}
+END_TEST
+#endif /* HAVE_AVX2 */
 #endif /* defined (__i386__) || defined (__amd64__) */
 
 #if defined (__arm__) && defined (__linux__)
@@ -175,11 +237,11 @@ START_TEST (svolume_arm_test) {
     pa_log_debug("Checking ARM svolume");
     for (i = 1; i <= 3; i++) {
         for (j = 0; j < 7; j += i)
-            run_volume_test(arm_func, orig_func, j, i, true, j == 0);
+            run_volume_test(arm_func, orig_func, PA_SAMPLE_S16NE, j, i, true, j == 0);
     }
-    run_volume_test(arm_func, orig_func, 7, 1, true, true);
-    run_volume_test(arm_func, orig_func, 6, 2, true, true);
-    run_volume_test(arm_func, orig_func, 6, 3, true, true);
+    run_volume_test(arm_func, orig_func, PA_SAMPLE_S16NE, 7, 1, true, true);
+    run_volume_test(arm_func, orig_func, PA_SAMPLE_S16NE, 6, 2, true, true);
+    run_volume_test(arm_func, orig_func, PA_SAMPLE_S16NE, 6, 3, true, true);
 }
 END_TEST
 #endif /* defined (__arm__) && defined (__linux__) */
@@ -207,10 +269,10 @@ START_TEST (svolume_orc_test) {
     pa_log_debug("Checking Orc svolume");
     for (i = 1; i <= 2; i++) {
         for (j = 0; j < 7; j += i)
-            run_volume_test(orc_func, orig_func, j, i, true, j == 0);
+            run_volume_test(orc_func, orig_func, PA_SAMPLE_S16NE, j, i, true, j == 0);
     }
-    run_volume_test(orc_func, orig_func, 7, 1, true, true);
-    run_volume_test(orc_func, orig_func, 6, 2, true, true);
+    run_volume_test(orc_func, orig_func, PA_SAMPLE_S16NE, 7, 1, true, true);
+    run_volume_test(orc_func, orig_func, PA_SAMPLE_S16NE, 6, 2, true, true);
 }
 END_TEST
 
@@ -229,6 +291,9 @@ int main(int argc, char *argv[]) {
 #if defined (__i386__) || defined (__amd64__)
     tcase_add_test(tc, svolume_mmx_test);
     tcase_add_test(tc, svolume_sse_test);
+#ifdef HAVE_AVX2
+    tcase_add_test(tc, svolume_avx2_test);
+#endif
 #endif
 #if defined (__arm__) && defined (__linux__)
     tcase_add_test(tc, svolume_arm_test);
@@ -0,0 +1,201 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/xmalloc.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/idxset.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "runtime-test-util.h"
+
+#define N_ENTRIES 10000
+
+/* Entries are handed out in order and removed in a scattered order, so
+ * that the tables grow and shrink a few times along the way */
+START_TEST (order_test) {
+    pa_idxset *s;
+    uint32_t idx[N_ENTRIES];
+    uint32_t i, j, k;
+    void *p;
+
+    s = pa_idxset_new(NULL, NULL);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), &idx[i]) == 0);
+        fail_unless(idx[i] == i);
+    }
+
+    /* Duplicates are refused and report the existing index */
+    fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(42), &j) < 0);
+    fail_unless(j == 41);
+
+    for (i = 0; i < N_ENTRIES; i++) {
+        fail_unless(pa_idxset_get_by_index(s, idx[i]) == PA_UINT_TO_PTR(i + 1));
+        fail_unless(pa_idxset_get_by_data(s, PA_UINT_TO_PTR(i + 1), &j) == PA_UINT_TO_PTR(i + 1));
+        fail_unless(j == idx[i]);
+    }
+
+    /* Remove everything but every 100th entry */
+    for (i = 0; i < N_ENTRIES; i++) {
+        j = (i * 7919) % N_ENTRIES;
+
+        if (j % 100 != 0)
+            fail_unless(pa_idxset_remove_by_index(s, j) == PA_UINT_TO_PTR(j + 1));
+    }
+
+    fail_unless(pa_idxset_size(s) == N_ENTRIES / 100);
+
+    i = 0;
+    PA_IDXSET_FOREACH(p, s, k) {
+        fail_unless(p == PA_UINT_TO_PTR(i + 1));
+        i += 100;
+    }
+    fail_unless(i == N_ENTRIES);
+
+    /* pa_idxset_next() skips over removed entries */
+    j = 1;
+    fail_unless(pa_idxset_next(s, &j) == PA_UINT_TO_PTR(101));
+    fail_unless(j == 100);
+
+    /* New entries get new indexes and go to the end */
+    fail_unless(pa_idxset_put(s, PA_UINT_TO_PTR(N_ENTRIES + 1), &j) == 0);
+    fail_unless(j == N_ENTRIES);
+    fail_unless(pa_idxset_last(s, &j) == PA_UINT_TO_PTR(N_ENTRIES + 1));
+
+    pa_idxset_free(s, NULL);
+}
+END_TEST
+
+static void idxset_perf(unsigned n) {
+    pa_idxset *s;
+    uint32_t i, idx = 0;
+    unsigned times = PA_MAX(100000 / n, 1U);
+    unsigned found = 0;
+    char label[64];
+
+    s = pa_idxset_new(NULL, NULL);
+
+    pa_snprintf(label, sizeof(label), "idxset put %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, 1, 10) {
+        for (i = 0; i < n; i++)
+            pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), NULL);
+
+        pa_idxset_remove_all(s, NULL);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    for (i = 0; i < n; i++)
+        pa_idxset_put(s, PA_UINT_TO_PTR(i + 1), &idx);
+
+    pa_snprintf(label, sizeof(label), "idxset get_by_index %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, times, 10) {
+        for (i = 0; i < n; i++)
+            found += pa_idxset_get_by_index(s, idx - i) != NULL;
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    pa_snprintf(label, sizeof(label), "idxset get_by_data %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, times, 10) {
+        for (i = 0; i < n; i++)
+            found += pa_idxset_get_by_data(s, PA_UINT_TO_PTR(i + 1), NULL) != NULL;
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(found == 2 * 10 * times * n);
+
+    pa_idxset_free(s, NULL);
+}
+
+static void hashmap_perf(unsigned n) {
+    pa_hashmap *h;
+    char **keys;
+    uint32_t i;
+    unsigned times = PA_MAX(100000 / n, 1U);
+    unsigned found = 0;
+    char label[64];
+
+    keys = pa_xnew(char*, n);
+    for (i = 0; i < n; i++)
+        keys[i] = pa_sprintf_malloc("sink-input-%u", i);
+
+    h = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    pa_snprintf(label, sizeof(label), "hashmap put %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, 1, 10) {
+        for (i = 0; i < n; i++)
+            pa_hashmap_put(h, keys[i], keys[i]);
+
+        pa_hashmap_remove_all(h);
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    for (i = 0; i < n; i++)
+        pa_hashmap_put(h, keys[i], keys[i]);
+
+    pa_snprintf(label, sizeof(label), "hashmap get %u", n);
+    PA_RUNTIME_TEST_RUN_START(label, times, 10) {
+        for (i = 0; i < n; i++)
+            found += pa_hashmap_get(h, keys[i]) != NULL;
+    } PA_RUNTIME_TEST_RUN_STOP
+
+    fail_unless(found == 10 * times * n);
+
+    pa_hashmap_free(h);
+
+    for (i = 0; i < n; i++)
+        pa_xfree(keys[i]);
+    pa_xfree(keys);
+}
+
+START_TEST (perf_test) {
+    idxset_perf(10);
+    idxset_perf(1000);
+    idxset_perf(100000);
+
+    hashmap_perf(10);
+    hashmap_perf(1000);
+    hashmap_perf(100000);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Idxset");
+    tc = tcase_create("idxset");
+    tcase_add_test(tc, order_test);
+    tcase_add_test(tc, perf_test);
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -20,11 +20,14 @@
 #endif
 
 #include <check.h>
+#include <math.h>
 
 #include <pulse/pulseaudio.h>
 #include <pulse/sample.h>
+#include <pulsecore/cpu-x86.h>
 #include <pulsecore/memblock.h>
 
+#include <pulsecore/filter/crossover.h>
 #include <pulsecore/filter/lfe-filter.h>
 
 struct lfe_filter_test {
@@ -172,6 +175,151 @@ START_TEST (lfe_filter_test) {
 }
 END_TEST
 
+#define FLOAT_CHANNELS 6
+#define FLOAT_FRAMES 10000
+
+/* Runs n frames of in through f in chunks of the given size, into out */
+static void run_float(pa_mempool *pool, pa_lfe_filter_t *f, const float *in, float *out, unsigned n, unsigned chunk) {
+    unsigned offset, len;
+
+    for (offset = 0; offset < n; offset += len) {
+        pa_memchunk mc;
+
+        len = PA_MIN(chunk, n - offset);
+        mc.memblock = pa_memblock_new(pool, len * FLOAT_CHANNELS * sizeof(float));
+        mc.index = 0;
+        mc.length = len * FLOAT_CHANNELS * sizeof(float);
+
+        memcpy(pa_memblock_acquire(mc.memblock), in + offset * FLOAT_CHANNELS, mc.length);
+        pa_memblock_release(mc.memblock);
+
+        pa_lfe_filter_process(f, &mc);
+
+        memcpy(out + offset * FLOAT_CHANNELS, pa_memblock_acquire(mc.memblock), mc.length);
+        pa_memblock_release(mc.memblock);
+        pa_memblock_unref(mc.memblock);
+    }
+}
+
+/* Rewinds to positions on and between the saved states, over more than one
+   of them, and to before the start of the stream */
+START_TEST (lfe_filter_float_rewind_test) {
+    static const unsigned rewinds[] = { 1, 511, 512, 513, 1000, 3333, FLOAT_FRAMES - 1 };
+    pa_sample_spec ss = { PA_SAMPLE_FLOAT32NE, 48000, FLOAT_CHANNELS };
+    pa_channel_map cm;
+    pa_mempool *pool;
+    pa_lfe_filter_t *f;
+    float *in, *ref, *out;
+    unsigned i, j;
+
+    pa_assert_se(pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true));
+    pa_channel_map_init_auto(&cm, FLOAT_CHANNELS, PA_CHANNEL_MAP_DEFAULT);
+
+    in = pa_xnew(float, FLOAT_FRAMES * FLOAT_CHANNELS);
+    ref = pa_xnew(float, FLOAT_FRAMES * FLOAT_CHANNELS);
+    out = pa_xnew(float, FLOAT_FRAMES * FLOAT_CHANNELS);
+
+    for (i = 0; i < FLOAT_FRAMES * FLOAT_CHANNELS; i++)
+        in[i] = rand() / (float) RAND_MAX - 0.5f;
+
+    pa_assert_se(f = pa_lfe_filter_new(&ss, &cm, 120, ss.rate * 3));
+    run_float(pool, f, in, ref, FLOAT_FRAMES, 700);
+
+    for (i = 0; i < PA_ELEMENTSOF(rewinds); i++) {
+        unsigned pos = FLOAT_FRAMES - rewinds[i];
+
+        pa_lfe_filter_rewind(f, rewinds[i] * pa_frame_size(&ss));
+        run_float(pool, f, in + pos * FLOAT_CHANNELS, out, rewinds[i], 300);
+
+        for (j = 0; j < rewinds[i] * FLOAT_CHANNELS; j++)
+            fail_unless(fabsf(out[j] - ref[pos * FLOAT_CHANNELS + j]) < 1e-6f,
+                        "rewind %u, sample %u: %f != %f", rewinds[i], j, out[j], ref[pos * FLOAT_CHANNELS + j]);
+    }
+
+    /* Past the start, the filter starts over */
+    pa_lfe_filter_rewind(f, (FLOAT_FRAMES + 1) * pa_frame_size(&ss));
+    run_float(pool, f, in, out, FLOAT_FRAMES, 1000);
+    fail_unless(memcmp(out, ref, FLOAT_FRAMES * FLOAT_CHANNELS * sizeof(float)) == 0);
+
+    pa_lfe_filter_free(f);
+    pa_xfree(in);
+    pa_xfree(ref);
+    pa_xfree(out);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* Compares func on a bank against one LR4 filter per channel */
+static void run_bank_test(lr4_bank_process_func_t func) {
+    static const int channels[] = { 1, 2, 6, 8, 11, 32 };
+    float src[300 * 32], out[300 * 32], ref[300 * 32];
+    unsigned i, k;
+
+    for (i = 0; i < PA_ELEMENTSOF(src); i++)
+        src[i] = rand() / (float) RAND_MAX - 0.5f;
+
+    for (k = 0; k < PA_ELEMENTSOF(channels); k++) {
+        int n = channels[k], c;
+        struct lr4 lr4[32];
+        struct lr4_bank *bank;
+        float *state;
+
+        bank = lr4_bank_new(n);
+        state = pa_xnew(float, LR4_BANK_STATE_SIZE(bank));
+        lr4_bank_reset_state(bank, state);
+
+        for (c = 0; c < n; c++) {
+            enum biquad_type type = c % 3 ? BQ_HIGHPASS : BQ_LOWPASS;
+            float freq = 0.002f + 0.01f * c;
+
+            lr4_set(&lr4[c], type, freq);
+            lr4_bank_set(bank, c, type, freq);
+        }
+
+        /* In two parts, so that the history is carried over; the second
+           part is filtered in place */
+        for (c = 0; c < n; c++) {
+            lr4_process_float32(&lr4[c], 100, n, src + c, ref + c);
+            lr4_process_float32(&lr4[c], 200, n, src + 100 * n + c, ref + 100 * n + c);
+        }
+
+        func(bank, state, 100, src, out);
+        memcpy(out + 100 * n, src + 100 * n, 200 * n * sizeof(float));
+        func(bank, state, 200, out + 100 * n, out + 100 * n);
+
+        for (i = 0; i < 300 * (unsigned) n; i++)
+            fail_unless(fabsf(out[i] - ref[i]) < 1e-6f, "%d channels, sample %u: %f != %f", n, i, out[i], ref[i]);
+
+        pa_xfree(state);
+        lr4_bank_free(bank);
+    }
+}
+
+START_TEST (lr4_bank_test) {
+    run_bank_test(lr4_get_bank_process_func());
+}
+END_TEST
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (lr4_bank_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    lr4_bank_process_func_t orig_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_func = lr4_get_bank_process_func();
+    pa_crossover_func_init_avx2(flags);
+    run_bank_test(lr4_get_bank_process_func());
+    lr4_set_bank_process_func(orig_func);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -184,6 +332,11 @@ int main(int argc, char *argv[]) {
     s = suite_create("lfe-filter");
     tc = tcase_create("lfe-filter");
     tcase_add_test(tc, lfe_filter_test);
+    tcase_add_test(tc, lfe_filter_float_rewind_test);
+    tcase_add_test(tc, lr4_bank_test);
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, lr4_bank_avx2_test);
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
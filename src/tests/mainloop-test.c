@@ -21,7 +21,9 @@
 
 #include <stdio.h>
 #include <unistd.h>
+#include <dirent.h>
 #include <sys/time.h>
+#include <sys/socket.h>
 #include <assert.h>
 #include <check.h>
 
@@ -30,6 +32,7 @@
 
 #include <pulsecore/core-util.h>
 #include <pulsecore/core-rtclock.h>
+#include <pulsecore/poll.h>
 
 #ifdef GLIB_MAIN_LOOP
 
@@ -140,6 +143,314 @@ START_TEST (mainloop_test) {
 }
 END_TEST
 
+#ifndef GLIB_MAIN_LOOP
+#define N_TIME_EVENTS 200
+
+typedef struct time_events {
+    pa_time_event *e[N_TIME_EVENTS];
+    pa_usec_t last;
+    unsigned n_fired, n_expected;
+} time_events;
+
+static void order_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    time_events *te = userdata;
+    pa_usec_t t = pa_timeval_load(tv);
+
+    /* Expired events are dispatched in the order they are due */
+    fail_unless(t >= te->last);
+    te->last = t;
+
+    if (++te->n_fired == te->n_expected)
+        a->quit(a, 0);
+}
+
+START_TEST (time_events_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    time_events te;
+    struct timeval tv;
+    pa_usec_t now;
+    unsigned i;
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    memset(&te, 0, sizeof(te));
+    now = pa_rtclock_now();
+
+    for (i = 0; i < N_TIME_EVENTS; i++) {
+        pa_usec_t t = now + ((i * 7919) % N_TIME_EVENTS) * 100;
+        te.e[i] = a->time_new(a, pa_timeval_rtstore(&tv, t, true), order_cb, &te);
+    }
+
+    /* Free every fifth, disable every seventh and move every third one */
+    for (i = 0; i < N_TIME_EVENTS; i++) {
+        if (i % 5 == 0) {
+            a->time_free(te.e[i]);
+            te.e[i] = NULL;
+        } else if (i % 7 == 0)
+            a->time_restart(te.e[i], NULL);
+        else {
+            if (i % 3 == 0)
+                a->time_restart(te.e[i], pa_timeval_rtstore(&tv, now + (N_TIME_EVENTS - i) * 50, true));
+
+            te.n_expected++;
+        }
+    }
+
+    pa_mainloop_run(m, NULL);
+
+    fail_unless(te.n_fired == te.n_expected);
+
+    for (i = 0; i < N_TIME_EVENTS; i++)
+        if (te.e[i])
+            a->time_free(te.e[i]);
+
+    pa_mainloop_free(m);
+}
+END_TEST
+
+static void rearm_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *tv, void *userdata) {
+    unsigned *n = userdata;
+    struct timeval tv2;
+
+    /* Restarting an event in the past from its own callback must not keep
+     * the dispatcher busy, it's only due again in the next iteration */
+    (*n)++;
+    a->time_restart(e, pa_timeval_rtstore(&tv2, 1, true));
+}
+
+START_TEST (time_rearm_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_time_event *e;
+    struct timeval tv;
+    unsigned n = 0;
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    e = a->time_new(a, pa_timeval_rtstore(&tv, 1, true), rearm_cb, &n);
+
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+    fail_unless(n == 1);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) >= 0);
+    fail_unless(n == 2);
+
+    a->time_free(e);
+    pa_mainloop_free(m);
+}
+END_TEST
+
+#define N_IO_EVENTS 64
+
+typedef struct io_events {
+    pa_io_event *e[N_IO_EVENTS];
+    int fds[N_IO_EVENTS][2];
+    unsigned n_fired[N_IO_EVENTS];
+} io_events;
+
+static void io_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    io_events *ie = userdata;
+    unsigned i;
+    char c;
+
+    for (i = 0; i < N_IO_EVENTS; i++)
+        if (ie->e[i] == e)
+            break;
+
+    fail_unless(i < N_IO_EVENTS);
+    fail_unless(fd == ie->fds[i][0]);
+    fail_unless(f & PA_IO_EVENT_INPUT);
+    fail_unless(read(fd, &c, 1) == 1);
+
+    ie->n_fired[i]++;
+
+    /* Freeing an event that is ready too must keep it from being
+     * dispatched in this iteration */
+    if (i == 10 && ie->e[20]) {
+        a->io_free(ie->e[20]);
+        ie->e[20] = NULL;
+    } else if (i == 20 && ie->e[10]) {
+        a->io_free(ie->e[10]);
+        ie->e[10] = NULL;
+    }
+}
+
+static int wrapped_poll(struct pollfd *ufds, unsigned long nfds, int timeout, void *userdata) {
+    return pa_poll(ufds, nfds, timeout);
+}
+
+static void run_io_events_test(bool custom_poll) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    pa_io_event *old;
+    io_events ie;
+    unsigned i;
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    if (custom_poll)
+        pa_mainloop_set_poll_func(m, wrapped_poll, NULL);
+
+    memset(&ie, 0, sizeof(ie));
+
+    for (i = 0; i < N_IO_EVENTS; i++) {
+        fail_unless(pipe(ie.fds[i]) == 0);
+        ie.e[i] = a->io_new(a, ie.fds[i][0], PA_IO_EVENT_NULL, io_cb, &ie);
+    }
+
+    /* Only enabled events are dispatched */
+    for (i = 0; i < N_IO_EVENTS; i += 2)
+        a->io_enable(ie.e[i], PA_IO_EVENT_INPUT);
+
+    for (i = 0; i < N_IO_EVENTS; i += 5)
+        fail_unless(write(ie.fds[i][1], "x", 1) == 1);
+
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) > 0);
+
+    /* Whichever of these two came first freed the other one */
+    fail_unless(ie.n_fired[10] + ie.n_fired[20] == 1);
+    fail_unless(!ie.e[10] == (ie.n_fired[20] == 1));
+
+    for (i = 0; i < N_IO_EVENTS; i++)
+        if (i != 10 && i != 20)
+            fail_unless(ie.n_fired[i] == (i % 10 == 0));
+
+    /* The fd of an event may be closed, and its number reused, before
+     * the event is freed. That must not disturb the new event. */
+    pa_close_pipe(ie.fds[0]);
+    fail_unless(pipe(ie.fds[0]) == 0);
+    old = ie.e[0];
+    ie.e[0] = a->io_new(a, ie.fds[0][0], PA_IO_EVENT_INPUT, io_cb, &ie);
+    a->io_free(old);
+
+    ie.n_fired[0] = 0;
+    fail_unless(write(ie.fds[0][1], "x", 1) == 1);
+    fail_unless(pa_mainloop_iterate(m, 0, NULL) > 0);
+    fail_unless(ie.n_fired[0] == 1);
+
+    for (i = 0; i < N_IO_EVENTS; i++) {
+        if (ie.e[i])
+            a->io_free(ie.e[i]);
+
+        pa_close_pipe(ie.fds[i]);
+    }
+
+    pa_mainloop_free(m);
+}
+
+START_TEST (io_events_test) {
+    run_io_events_test(false);
+    run_io_events_test(true);
+}
+END_TEST
+
+#ifdef HAVE_SYS_EPOLL_H
+/* The number of epoll instances this process has open */
+static unsigned count_epoll_fds(void) {
+    DIR *d;
+    struct dirent *de;
+    unsigned n = 0;
+
+    fail_unless((d = opendir("/proc/self/fd")) != NULL);
+
+    while ((de = readdir(d))) {
+        char path[64], target[64];
+        ssize_t r;
+
+        pa_snprintf(path, sizeof(path), "/proc/self/fd/%s", de->d_name);
+
+        if ((r = readlink(path, target, sizeof(target) - 1)) < 0)
+            continue;
+
+        target[r] = 0;
+        if (pa_streq(target, "anon_inode:[eventpoll]"))
+            n++;
+    }
+
+    closedir(d);
+    return n;
+}
+
+typedef struct shared_fd_events {
+    pa_io_event *in, *out;
+    pa_io_event_flags_t in_fired, out_fired;
+} shared_fd_events;
+
+static void shared_fd_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t f, void *userdata) {
+    shared_fd_events *se = userdata;
+    char c;
+
+    if (e == se->in) {
+        fail_unless(read(fd, &c, 1) == 1);
+        se->in_fired |= f;
+    } else {
+        fail_unless(e == se->out);
+        se->out_fired |= f;
+    }
+}
+
+/* Two events watching one fd, like the read and write watches of a D-Bus
+ * connection, must both work without losing epoll */
+START_TEST (io_shared_fd_test) {
+    pa_mainloop *m;
+    pa_mainloop_api *a;
+    shared_fd_events se;
+    unsigned n_epoll;
+    int fds[2];
+
+    n_epoll = count_epoll_fds();
+
+    m = pa_mainloop_new();
+    fail_if(!m);
+    a = pa_mainloop_get_api(m);
+
+    fail_unless(count_epoll_fds() == n_epoll + 1);
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+    memset(&se, 0, sizeof(se));
+    se.in = a->io_new(a, fds[0], PA_IO_EVENT_INPUT, shared_fd_cb, &se);
+    se.out = a->io_new(a, fds[0], PA_IO_EVENT_OUTPUT, shared_fd_cb, &se);
+
+    /* The socket is writable but has nothing to read */
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) > 0);
+    fail_unless(se.out_fired == PA_IO_EVENT_OUTPUT);
+    fail_unless(se.in_fired == 0);
+
+    a->io_enable(se.out, PA_IO_EVENT_NULL);
+    se.out_fired = 0;
+
+    fail_unless(write(fds[1], "x", 1) == 1);
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) > 0);
+    fail_unless(se.in_fired == PA_IO_EVENT_INPUT);
+    fail_unless(se.out_fired == 0);
+
+    /* The other event keeps working when one is freed */
+    a->io_free(se.in);
+    se.in = NULL;
+    a->io_enable(se.out, PA_IO_EVENT_OUTPUT);
+
+    fail_unless(pa_mainloop_iterate(m, 1, NULL) > 0);
+    fail_unless(se.out_fired == PA_IO_EVENT_OUTPUT);
+
+    fail_unless(count_epoll_fds() == n_epoll + 1);
+
+    a->io_free(se.out);
+    pa_close_pipe(fds);
+    pa_mainloop_free(m);
+
+    fail_unless(count_epoll_fds() == n_epoll);
+}
+END_TEST
+#endif
+#endif /* GLIB_MAIN_LOOP */
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -149,6 +460,14 @@ int main(int argc, char *argv[]) {
     s = suite_create("MainLoop");
     tc = tcase_create("mainloop");
     tcase_add_test(tc, mainloop_test);
+#ifndef GLIB_MAIN_LOOP
+    tcase_add_test(tc, time_events_test);
+    tcase_add_test(tc, time_rearm_test);
+    tcase_add_test(tc, io_events_test);
+#ifdef HAVE_SYS_EPOLL_H
+    tcase_add_test(tc, io_shared_fd_test);
+#endif
+#endif
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -28,6 +28,7 @@
 
 #include <pulsecore/log.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/thread.h>
 #include <pulsecore/macro.h>
 
 static void release_cb(pa_memimport *i, uint32_t block_id, void *userdata) {
@@ -52,6 +53,9 @@ static void print_stats(pa_mempool *p, const char *text) {
                  "\texported_size = %u\n"
                  "\tn_too_large_for_pool = %u\n"
                  "\tn_pool_full = %u\n"
+                 "\tn_cache_refills = %u\n"
+                 "\tn_cache_flushes = %u\n"
+                 "\tn_cache_steals = %u\n"
                  "}",
            text,
            (unsigned) pa_atomic_load(&s->n_allocated),
@@ -63,7 +67,10 @@ static void print_stats(pa_mempool *p, const char *text) {
            (unsigned) pa_atomic_load(&s->imported_size),
            (unsigned) pa_atomic_load(&s->exported_size),
            (unsigned) pa_atomic_load(&s->n_too_large_for_pool),
-           (unsigned) pa_atomic_load(&s->n_pool_full));
+           (unsigned) pa_atomic_load(&s->n_pool_full),
+           (unsigned) pa_atomic_load(&s->n_cache_refills),
+           (unsigned) pa_atomic_load(&s->n_cache_flushes),
+           (unsigned) pa_atomic_load(&s->n_cache_steals));
 }
 
 START_TEST (memblock_test) {
@@ -176,6 +183,157 @@ START_TEST (memblock_test) {
 }
 END_TEST
 
+/* Whatever the machine provides, a pool with huge pages and NUMA parts
+ * must hand out every slot exactly once and take them all back */
+START_TEST (mempool_flags_test) {
+    pa_mem_type_t types[] = { PA_MEM_TYPE_PRIVATE, PA_MEM_TYPE_SHARED_POSIX };
+    unsigned t;
+
+    for (t = 0; t < PA_ELEMENTSOF(types); t++) {
+        pa_mempool *pool;
+        pa_memblock *blocks[256];
+        const pa_mempool_stat *stat;
+        unsigned n, i, j;
+
+        pool = pa_mempool_new_full(types[t], 1024*1024, true, PA_MEMPOOL_HUGEPAGES|PA_MEMPOOL_NUMA, NULL, 0);
+        fail_unless(pool != NULL);
+
+        stat = pa_mempool_get_stat(pool);
+
+        for (n = 0; n < PA_ELEMENTSOF(blocks); n++) {
+            uint8_t *d;
+
+            if (!(blocks[n] = pa_memblock_new_pool(pool, 16)))
+                break;
+
+            d = pa_memblock_acquire(blocks[n]);
+            memset(d, (int) n, 16);
+            pa_memblock_release(blocks[n]);
+        }
+
+        /* 1 MiB is far less than 256 slots */
+        fail_unless(n >= 2 && n < PA_ELEMENTSOF(blocks));
+        fail_unless(pa_atomic_load(&stat->n_pool_full) == 1);
+
+        for (i = 0; i < n; i++) {
+            uint8_t *d = pa_memblock_acquire(blocks[i]);
+
+            for (j = 0; j < 16; j++)
+                fail_unless(d[j] == (uint8_t) i);
+
+            pa_memblock_release(blocks[i]);
+        }
+
+        for (i = 0; i < n; i++)
+            pa_memblock_unref(blocks[i]);
+
+        fail_unless(pa_atomic_load(&stat->n_allocated) == 0);
+
+        pa_mempool_vacuum(pool);
+
+        /* Freed slots are reused */
+        for (i = 0; i < n; i++)
+            fail_unless((blocks[i] = pa_memblock_new_pool(pool, 16)) != NULL);
+        for (i = 0; i < n; i++)
+            pa_memblock_unref(blocks[i]);
+
+        pa_mempool_unref(pool);
+    }
+}
+END_TEST
+
+/* Blocks come from the smallest size class that fits, and from the
+ * larger ones once that is full */
+START_TEST (mempool_classes_test) {
+    const size_t sizes[] = { 256*1024, 4096, 16*1024, 64*1024, 4096 };
+    pa_mempool *pool;
+    pa_memblock *blocks[512];
+    unsigned n, i;
+
+    pool = pa_mempool_new_full(PA_MEM_TYPE_PRIVATE, 4*1024*1024, true, 0, sizes, PA_ELEMENTSOF(sizes));
+    fail_unless(pool != NULL);
+
+    fail_unless(pa_mempool_block_size_max(pool) > 200*1024);
+    fail_unless(pa_mempool_block_size_max(pool) < 256*1024);
+
+    /* 1 MiB per class */
+    for (n = 0; n < 4; n++)
+        fail_unless((blocks[n] = pa_memblock_new_pool(pool, 200*1024)) != NULL);
+    fail_unless(pa_memblock_new_pool(pool, 200*1024) == NULL);
+
+    for (i = 0; i < n; i++)
+        pa_memblock_unref(blocks[i]);
+
+    for (n = 0; n < PA_ELEMENTSOF(blocks); n++)
+        if (!(blocks[n] = pa_memblock_new_pool(pool, 100)))
+            break;
+
+    fail_unless(n == 256 + 64 + 16 + 4);
+
+    for (i = 0; i < n; i++)
+        pa_memblock_unref(blocks[i]);
+
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+#define CACHE_TEST_BLOCKS 2048
+
+struct cache_test {
+    pa_mempool *pool;
+    pa_memblock *blocks[CACHE_TEST_BLOCKS];
+    unsigned n;
+};
+
+static void cache_test_allocate_all(struct cache_test *t) {
+    for (t->n = 0; t->n < CACHE_TEST_BLOCKS; t->n++)
+        if (!(t->blocks[t->n] = pa_memblock_new_pool(t->pool, 16)))
+            break;
+}
+
+static void cache_test_thread(void *userdata) {
+    cache_test_allocate_all(userdata);
+}
+
+/* Slots sitting in the cache of one thread must still be available to
+ * the others */
+START_TEST (mempool_cache_test) {
+    struct cache_test t;
+    const pa_mempool_stat *stat;
+    pa_thread *thread;
+    unsigned i, n;
+
+    t.pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    fail_unless(t.pool != NULL);
+    stat = pa_mempool_get_stat(t.pool);
+
+    cache_test_allocate_all(&t);
+    n = t.n;
+    fail_unless(n > 0 && n < CACHE_TEST_BLOCKS);
+    fail_unless(pa_atomic_load(&stat->n_cache_refills) > 0);
+
+    for (i = 0; i < n; i++)
+        pa_memblock_unref(t.blocks[i]);
+
+    /* Most of them went back to the free lists in batches, the rest
+     * stays cached for this thread */
+    fail_unless(pa_atomic_load(&stat->n_cache_flushes) > 0);
+
+    fail_unless(thread = pa_thread_new("cache-test", cache_test_thread, &t));
+    pa_thread_free(thread);
+
+    fail_unless(t.n == n);
+    fail_unless(pa_atomic_load(&stat->n_cache_steals) > 0);
+
+    print_stats(t.pool, "cache");
+
+    for (i = 0; i < t.n; i++)
+        pa_memblock_unref(t.blocks[i]);
+
+    pa_mempool_unref(t.pool);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -188,6 +346,9 @@ int main(int argc, char *argv[]) {
     s = suite_create("Memblock");
     tc = tcase_create("memblock");
     tcase_add_test(tc, memblock_test);
+    tcase_add_test(tc, mempool_flags_test);
+    tcase_add_test(tc, mempool_classes_test);
+    tcase_add_test(tc, mempool_cache_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -682,6 +682,108 @@ START_TEST (memblockq_test_push_to_middle) {
 }
 END_TEST
 
+/* Enough pushes to grow the ring a few times, with the write index
+ * occasionally moved back into queued data or forward to leave a hole.
+ * The queue is compared against a plain byte array. */
+START_TEST (memblockq_test_peek_many) {
+    pa_sample_spec ss = {
+        .format = PA_SAMPLE_S16BE,
+        .rate = 48000,
+        .channels = 1
+    };
+
+    char model[4096];
+    pa_memchunk silence, chunks[8], out;
+    pa_mempool *p;
+    pa_memblockq *bq;
+    int64_t wi = 0, end = 0;
+    size_t left;
+    unsigned i, k, n;
+
+    p = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    ck_assert_ptr_ne(p, NULL);
+    silence = memchunk_from_str(p, "__");
+
+    bq = pa_memblockq_new("test memblockq", 0, sizeof(model), sizeof(model), &ss, 0, 2, 0, &silence);
+    memset(model, '_', sizeof(model));
+
+    for (k = 0; k < 300; k++) {
+        pa_memchunk chunk;
+        char *d;
+
+        if (k % 7 == 3 && wi >= 6) {
+            pa_memblockq_seek(bq, -6, PA_SEEK_RELATIVE, true);
+            wi -= 6;
+        } else if (k % 11 == 5) {
+            pa_memblockq_seek(bq, 4, PA_SEEK_RELATIVE, true);
+            wi += 4;
+        }
+
+        chunk.index = 0;
+        chunk.length = 2 * (1 + k % 3);
+        chunk.memblock = pa_memblock_new(p, chunk.length);
+
+        d = pa_memblock_acquire(chunk.memblock);
+        for (i = 0; i < chunk.length; i++)
+            d[i] = model[wi + i] = (char) ('a' + (k + i) % 26);
+        pa_memblock_release(chunk.memblock);
+
+        ck_assert_int_eq(pa_memblockq_push(bq, &chunk), 0);
+        pa_memblock_unref(chunk.memblock);
+
+        wi += (int64_t) chunk.length;
+        end = PA_MAX(end, wi);
+    }
+
+    ck_assert_int_eq(pa_memblockq_get_write_index(bq), wi);
+
+    /* Never more than asked for */
+    ck_assert_int_eq(pa_memblockq_peek_many(bq, chunks, 3, (size_t) end), 3);
+    for (i = 0; i < 3; i++)
+        pa_memblock_unref(chunks[i].memblock);
+
+    n = pa_memblockq_peek_many(bq, chunks, 8, 5);
+    for (i = 0, left = 0; i < n; i++) {
+        left += chunks[i].length;
+        pa_memblock_unref(chunks[i].memblock);
+    }
+    ck_assert_int_eq(left, 5);
+
+    /* Peeking several chunks at a time and dropping them gives the same
+     * data as pa_memblockq_peek() would */
+    left = (size_t) wi;
+    for (i = 0; i < (size_t) wi; ) {
+        n = pa_memblockq_peek_many(bq, chunks, PA_ELEMENTSOF(chunks), left);
+        ck_assert_int_gt(n, 0);
+
+        ck_assert_int_eq(pa_memblockq_peek(bq, &out), 0);
+        ck_assert_ptr_eq(out.memblock, chunks[0].memblock);
+        ck_assert_int_eq(out.index, chunks[0].index);
+        pa_memblock_unref(out.memblock);
+
+        for (k = 0; k < n; k++) {
+            char *d = pa_memblock_acquire(chunks[k].memblock);
+
+            ck_assert_int_eq(memcmp(d + chunks[k].index, model + i, chunks[k].length), 0);
+            pa_memblock_release(chunks[k].memblock);
+
+            pa_memblockq_drop(bq, chunks[k].length);
+            pa_memblock_unref(chunks[k].memblock);
+
+            i += chunks[k].length;
+            left -= chunks[k].length;
+        }
+    }
+
+    ck_assert_int_eq(pa_memblockq_get_length(bq), 0);
+    ck_assert_int_eq(pa_memblockq_peek_many(bq, chunks, PA_ELEMENTSOF(chunks), 0), 0);
+
+    pa_memblockq_free(bq);
+    pa_memblock_unref(silence.memblock);
+    pa_mempool_unref(p);
+}
+END_TEST
+
 int main(int argc, char *argv[]) {
     int failed = 0;
     Suite *s;
@@ -700,6 +802,7 @@ int main(int argc, char *argv[]) {
     tcase_add_test(tc, memblockq_test_pop_missing);
     tcase_add_test(tc, memblockq_test_tlength_change);
     tcase_add_test(tc, memblockq_test_push_to_middle);
+    tcase_add_test(tc, memblockq_test_peek_many);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);
@@ -0,0 +1,560 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/sink-input.h>
+#include <pulsecore/thread.h>
+#include <pulsecore/thread-mq.h>
+
+#define FRAME_SIZE 4
+#define BLOCK_BYTES 4096
+#define MAX_REWIND (8 * BLOCK_BYTES)
+#define MAX_OUT_FRAMES 100000
+
+/* Ramps that run up to this value and stop, so that every sample the
+ * inputs play can be told apart */
+#define RAMP_FRAMES 30000
+
+/* A sink that renders when told to, and keeps everything it rendered. What
+ * is rewound is overwritten by what is rendered next. */
+struct fake_sink {
+    pa_mainloop *mainloop;
+    pa_core *core;
+    pa_sink *sink;
+    pa_rtpoll *rtpoll;
+    pa_thread_mq thread_mq;
+    pa_thread *thread;
+
+    int16_t *out;
+    size_t n_out;
+};
+
+enum {
+    SINK_MESSAGE_RENDER = PA_SINK_MESSAGE_MAX,
+    SINK_MESSAGE_REWRITE,
+    SINK_MESSAGE_LEAVE
+};
+
+struct fake_input {
+    pa_sink_input *input;
+
+    /* The channel a ramp is played on, or -1 for a triangle wave with the
+     * given step and amplitude scale on both channels */
+    int channel;
+    unsigned step;
+    int scale;
+
+    int64_t pos;
+    bool negate;
+    size_t rewound;
+};
+
+static int16_t triangle(unsigned x) {
+    return (int16_t) (abs((int) (x % 8000) - 4000) - 2000);
+}
+
+static int fake_input_pop(pa_sink_input *i, size_t nbytes, pa_memchunk *chunk) {
+    struct fake_input *fi = i->userdata;
+    int16_t *p;
+    size_t j;
+
+    if (fi->channel >= 0) {
+        if (fi->pos >= RAMP_FRAMES)
+            return -1;
+
+        nbytes = PA_MIN(nbytes, (size_t) (RAMP_FRAMES - fi->pos) * FRAME_SIZE);
+    }
+
+    chunk->memblock = pa_memblock_new(i->core->mempool, nbytes);
+    chunk->index = 0;
+    chunk->length = nbytes;
+
+    p = pa_memblock_acquire(chunk->memblock);
+    for (j = 0; j < nbytes / FRAME_SIZE; j++, fi->pos++) {
+        if (fi->channel >= 0) {
+            int16_t v = (int16_t) (fi->pos + 1);
+
+            p[2 * j + fi->channel] = fi->negate ? -v : v;
+            p[2 * j + 1 - fi->channel] = 0;
+        } else {
+            p[2 * j] = (int16_t) (triangle((unsigned) fi->pos * fi->step) * fi->scale);
+            p[2 * j + 1] = (int16_t) (triangle((unsigned) fi->pos * fi->step + 3000) * fi->scale);
+        }
+    }
+    pa_memblock_release(chunk->memblock);
+
+    return 0;
+}
+
+static void fake_input_process_rewind(pa_sink_input *i, size_t nbytes) {
+    struct fake_input *fi = i->userdata;
+
+    fi->pos -= (int64_t) (nbytes / FRAME_SIZE);
+    fi->rewound += nbytes;
+}
+
+static void fake_input_kill(pa_sink_input *i) {
+    pa_assert_not_reached();
+}
+
+/* Called from the IO thread */
+static void fake_sink_render(struct fake_sink *f, size_t nbytes) {
+    pa_sink *s = f->sink;
+    pa_memchunk chunk;
+
+    if (s->thread_info.rewind_requested) {
+        size_t amount = PA_MIN(s->thread_info.rewind_nbytes, f->n_out);
+
+        f->n_out -= amount;
+        pa_sink_process_rewind(s, amount);
+    }
+
+    pa_sink_render_full(s, nbytes, &chunk);
+
+    pa_assert(f->n_out + chunk.length <= MAX_OUT_FRAMES * FRAME_SIZE);
+    memcpy((uint8_t *) f->out + f->n_out, pa_memblock_acquire_chunk(&chunk), chunk.length);
+    pa_memblock_release(chunk.memblock);
+    pa_memblock_unref(chunk.memblock);
+
+    f->n_out += chunk.length;
+}
+
+static int fake_sink_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct fake_sink *f = PA_SINK(o)->userdata;
+    struct fake_input *fi = data;
+
+    switch (code) {
+        case SINK_MESSAGE_RENDER:
+            fake_sink_render(f, (size_t) offset);
+            return 0;
+
+        case SINK_MESSAGE_REWRITE:
+            /* From now on the input plays something else, and wants to
+             * replace what it played last */
+            fi->negate = true;
+            pa_sink_input_request_rewind(fi->input, (size_t) offset, true, false, false);
+            return 0;
+
+        case SINK_MESSAGE_LEAVE:
+            /* Makes premix_possible() fail for the input, and has the sink
+             * rewind without any rewrite, so that the input leaves with
+             * some of what the group rendered for it not played */
+            fi->input->flags |= PA_SINK_INPUT_VARIABLE_RATE;
+            pa_sink_request_rewind(f->sink, (size_t) -1);
+            return 0;
+    }
+
+    return pa_sink_process_msg(o, code, data, offset, chunk);
+}
+
+static void thread_func(void *userdata) {
+    struct fake_sink *f = userdata;
+    int ret;
+
+    pa_thread_mq_install(&f->thread_mq);
+
+    while ((ret = pa_rtpoll_run(f->rtpoll)) > 0)
+        ;
+
+    pa_assert(ret == 0);
+}
+
+static void dispatch(struct fake_sink *f) {
+    while (pa_mainloop_iterate(f->mainloop, 0, NULL) > 0)
+        ;
+}
+
+static void send_msg(struct fake_sink *f, int code, void *data, int64_t offset) {
+    pa_assert_se(pa_asyncmsgq_send(f->sink->asyncmsgq, PA_MSGOBJECT(f->sink), code, data, offset, NULL) == 0);
+    dispatch(f);
+}
+
+static void render(struct fake_sink *f, unsigned n_blocks) {
+    while (n_blocks-- > 0)
+        send_msg(f, SINK_MESSAGE_RENDER, NULL, BLOCK_BYTES);
+}
+
+static struct fake_sink *fake_sink_new(bool premix, unsigned render_threads) {
+    struct fake_sink *f = pa_xnew0(struct fake_sink, 1);
+    pa_sample_spec ss = { PA_SAMPLE_S16NE, 48000, 2 };
+    pa_channel_map map;
+    pa_sink_new_data data;
+
+    f->mainloop = pa_mainloop_new();
+    f->core = pa_core_new(pa_mainloop_get_api(f->mainloop), false, false, 0, 0, NULL, 0);
+    fail_unless(f->core != NULL);
+
+    f->core->premix_resampling = premix;
+    f->core->render_threads = render_threads;
+    f->core->flat_volumes = false;
+
+    f->out = pa_xnew(int16_t, MAX_OUT_FRAMES * 2);
+    f->rtpoll = pa_rtpoll_new();
+    fail_unless(pa_thread_mq_init(&f->thread_mq, pa_mainloop_get_api(f->mainloop), f->rtpoll) >= 0);
+
+    pa_channel_map_init_stereo(&map);
+
+    pa_sink_new_data_init(&data);
+    data.driver = __FILE__;
+    pa_sink_new_data_set_name(&data, "premix-test");
+    pa_sink_new_data_set_sample_spec(&data, &ss);
+    pa_sink_new_data_set_channel_map(&data, &map);
+
+    f->sink = pa_sink_new(f->core, &data, 0);
+    pa_sink_new_data_done(&data);
+    fail_unless(f->sink != NULL);
+
+    f->sink->parent.process_msg = fake_sink_process_msg;
+    f->sink->userdata = f;
+
+    pa_sink_set_asyncmsgq(f->sink, f->thread_mq.inq);
+    pa_sink_set_rtpoll(f->sink, f->rtpoll);
+    pa_sink_set_max_request(f->sink, BLOCK_BYTES);
+    pa_sink_set_max_rewind(f->sink, MAX_REWIND);
+
+    fail_unless((f->thread = pa_thread_new("premix-test", thread_func, f)) != NULL);
+
+    pa_sink_put(f->sink);
+    dispatch(f);
+
+    return f;
+}
+
+static void fake_sink_free(struct fake_sink *f) {
+    pa_sink_unlink(f->sink);
+
+    pa_asyncmsgq_send(f->thread_mq.inq, NULL, PA_MESSAGE_SHUTDOWN, NULL, 0, NULL);
+    pa_thread_free(f->thread);
+    pa_thread_mq_done(&f->thread_mq);
+
+    pa_sink_unref(f->sink);
+    pa_rtpoll_free(f->rtpoll);
+
+    pa_core_unref(f->core);
+    pa_mainloop_free(f->mainloop);
+
+    pa_xfree(f->out);
+    pa_xfree(f);
+}
+
+/* Adds a 44.1 kHz input with the sink's channel map, so that it only needs
+ * a resampler */
+static void fake_input_put(struct fake_sink *f, struct fake_input *fi, pa_resample_method_t method, pa_volume_t volume) {
+    pa_sample_spec ss = { PA_SAMPLE_S16NE, 44100, 2 };
+    pa_channel_map map;
+    pa_sink_input_new_data data;
+    pa_cvolume v;
+
+    pa_channel_map_init_stereo(&map);
+    pa_cvolume_set(&v, 2, volume);
+
+    pa_sink_input_new_data_init(&data);
+    data.driver = __FILE__;
+    data.resample_method = method;
+    pa_sink_input_new_data_set_sink(&data, f->sink, false, true);
+    pa_sink_input_new_data_set_sample_spec(&data, &ss);
+    pa_sink_input_new_data_set_channel_map(&data, &map);
+    pa_sink_input_new_data_set_volume(&data, &v);
+
+    fail_unless(pa_sink_input_new(&fi->input, f->core, &data) == 0);
+    pa_sink_input_new_data_done(&data);
+
+    fi->input->pop = fake_input_pop;
+    fi->input->process_rewind = fake_input_process_rewind;
+    fi->input->kill = fake_input_kill;
+    fi->input->userdata = fi;
+
+    pa_sink_input_put(fi->input);
+    dispatch(f);
+}
+
+static void fake_input_unlink(struct fake_sink *f, struct fake_input *fi) {
+    pa_sink_input_unlink(fi->input);
+    pa_sink_input_unref(fi->input);
+    fi->input = NULL;
+    dispatch(f);
+}
+
+/* Checks that the channel plays the ramp of one input from start to end,
+ * each value once or repeated by the resampler, and returns the index of
+ * the first frame that is negative. Where an input switches between its
+ * own resampler and the one of its group, converting the position between
+ * the sample rates may skip or repeat one sample, up to max_slips of those
+ * are accepted. */
+static unsigned check_ramp(struct fake_sink *f, unsigned channel, unsigned max_slips) {
+    unsigned n_frames = f->n_out / FRAME_SIZE, j, repeats = 0, slips = 0, first_negative = n_frames;
+    int last = 0;
+
+    for (j = 0; j < n_frames; j++) {
+        int v = f->out[2 * j + channel];
+
+        if (v < 0 && first_negative == n_frames)
+            first_negative = j;
+
+        v = abs(v);
+
+        /* Silence only before and after the ramp */
+        if (last == RAMP_FRAMES) {
+            fail_unless(v == 0 || v == RAMP_FRAMES);
+            continue;
+        }
+
+        if (v == last) {
+            if (last > 0 && ++repeats > 2)
+                slips++;
+            continue;
+        }
+
+        if (last > 0 && v == last + 2)
+            slips++;
+        else
+            fail_unless(v == last + 1);
+
+        last = v;
+        repeats = 0;
+    }
+
+    fail_unless(last == RAMP_FRAMES);
+    fail_unless(slips <= max_slips);
+
+    return first_negative;
+}
+
+/* Renders the same triangle waves with and without premixing. The second
+ * input plays at half the volume of the others. */
+static void render_triangles(bool premix, unsigned render_threads, int scale, pa_volume_t volume, pa_volume_t sink_volume,
+                             int16_t *out, size_t *n_out) {
+    struct fake_sink *f;
+    struct fake_input fi[5];
+    pa_cvolume v;
+    unsigned k;
+
+    f = fake_sink_new(premix, render_threads);
+
+    pa_cvolume_set(&v, 2, sink_volume);
+    pa_sink_set_volume(f->sink, &v, true, false);
+    dispatch(f);
+
+    pa_zero(fi);
+    for (k = 0; k < PA_ELEMENTSOF(fi); k++) {
+        fi[k].channel = -1;
+        fi[k].step = 37 + 101 * k;
+        fi[k].scale = scale;
+        fake_input_put(f, fi + k, PA_RESAMPLER_POLYPHASE, k == 1 ? volume / 2 : volume);
+    }
+
+    render(f, 30);
+
+    for (k = 0; k < PA_ELEMENTSOF(fi); k++) {
+        fail_unless(!premix == !fi[k].input->thread_info.premix_group);
+        fake_input_unlink(f, fi + k);
+    }
+
+    memcpy(out, f->out, f->n_out);
+    *n_out = f->n_out;
+
+    fake_sink_free(f);
+}
+
+START_TEST (premix_mix_test) {
+    int16_t *premixed, *reference;
+    size_t n_premixed, n_reference, j;
+    unsigned render_threads;
+    int max_diff = 0, max_v = 0;
+
+    premixed = pa_xnew(int16_t, MAX_OUT_FRAMES * 2);
+    reference = pa_xnew(int16_t, MAX_OUT_FRAMES * 2);
+
+    /* Five inputs, so that the render pool peeks them in parallel */
+    for (render_threads = 0; render_threads <= 2; render_threads += 2) {
+        render_triangles(false, render_threads, 1, PA_VOLUME_NORM, PA_VOLUME_NORM, reference, &n_reference);
+        render_triangles(true, render_threads, 1, PA_VOLUME_NORM, PA_VOLUME_NORM, premixed, &n_premixed);
+
+        fail_unless(n_premixed == n_reference);
+        fail_unless(n_premixed == 30 * BLOCK_BYTES);
+
+        for (j = 0; j < n_premixed / sizeof(int16_t); j++) {
+            max_diff = PA_MAX(max_diff, abs(premixed[j] - reference[j]));
+            max_v = PA_MAX(max_v, abs(reference[j]));
+        }
+
+        pa_log_debug("%u render threads: max difference %i of %i", render_threads, max_diff, max_v);
+
+        /* Mixing before resampling only changes the rounding */
+        fail_unless(max_v > 2000);
+        fail_unless(max_diff <= 4);
+    }
+
+    pa_xfree(premixed);
+    pa_xfree(reference);
+}
+END_TEST
+
+START_TEST (premix_loud_test) {
+    int16_t *premixed, *reference;
+    size_t n_premixed, n_reference, j;
+    int max_diff = 0, max_v = 0;
+
+    premixed = pa_xnew(int16_t, MAX_OUT_FRAMES * 2);
+    reference = pa_xnew(int16_t, MAX_OUT_FRAMES * 2);
+
+    /* Loud streams at 150% whose sum only fits because of the low sink
+     * volume. They must not clip before the sink volume is applied. */
+    render_triangles(false, 0, 12, pa_sw_volume_from_linear(1.5), pa_sw_volume_from_linear(0.1), reference, &n_reference);
+    render_triangles(true, 0, 12, pa_sw_volume_from_linear(1.5), pa_sw_volume_from_linear(0.1), premixed, &n_premixed);
+
+    fail_unless(n_premixed == n_reference);
+
+    for (j = 0; j < n_premixed / sizeof(int16_t); j++) {
+        max_diff = PA_MAX(max_diff, abs(premixed[j] - reference[j]));
+        max_v = PA_MAX(max_v, abs(reference[j]));
+    }
+
+    pa_log_debug("Max difference %i of %i", max_diff, max_v);
+
+    /* The rounding errors are scaled up by the volumes */
+    fail_unless(max_v > 8000 && max_v < 32767);
+    fail_unless(max_diff <= 8);
+
+    pa_xfree(premixed);
+    pa_xfree(reference);
+}
+END_TEST
+
+START_TEST (premix_rewrite_test) {
+    struct fake_sink *f;
+    struct fake_input a, b;
+    size_t n_before;
+
+    f = fake_sink_new(true, 0);
+
+    pa_zero(a);
+    pa_zero(b);
+    a.channel = 0;
+    b.channel = 1;
+    fake_input_put(f, &a, PA_RESAMPLER_TRIVIAL, PA_VOLUME_NORM);
+    fake_input_put(f, &b, PA_RESAMPLER_TRIVIAL, PA_VOLUME_NORM);
+
+    /* The group is set up by the main thread, the IO thread only joins it */
+    fail_unless(a.input->premix_group);
+    fail_unless(a.input->premix_group == b.input->premix_group);
+    fail_unless(!a.input->thread_info.premix_group);
+
+    render(f, 10);
+    fail_unless(a.input->thread_info.premix_group);
+    fail_unless(a.input->thread_info.premix_group == b.input->thread_info.premix_group);
+
+    /* Only a rewrites the last 100 ms */
+    n_before = f->n_out;
+    send_msg(f, SINK_MESSAGE_REWRITE, &a, 4410 * FRAME_SIZE);
+
+    render(f, 40);
+
+    /* b is neither asked for its data again nor played twice, a plays the
+     * new data right where it was rewound to */
+    fail_unless(a.rewound > 0);
+    fail_unless(b.rewound == 0);
+    fail_unless(check_ramp(f, 0, 0) < n_before / FRAME_SIZE);
+    fail_unless(check_ramp(f, 1, 0) == f->n_out / FRAME_SIZE);
+
+    fake_input_unlink(f, &a);
+    fake_input_unlink(f, &b);
+    fake_sink_free(f);
+}
+END_TEST
+
+START_TEST (premix_leave_join_test) {
+    struct fake_sink *f;
+    struct fake_input a, b;
+
+    f = fake_sink_new(true, 0);
+
+    pa_zero(a);
+    pa_zero(b);
+    a.channel = 0;
+    b.channel = 1;
+    fake_input_put(f, &a, PA_RESAMPLER_TRIVIAL, PA_VOLUME_NORM);
+
+    render(f, 5);
+    fail_unless(a.input->thread_info.premix_group);
+
+    /* b joins while a is playing */
+    fake_input_put(f, &b, PA_RESAMPLER_TRIVIAL, PA_VOLUME_NORM);
+
+    render(f, 5);
+    fail_unless(a.input->thread_info.premix_group == b.input->thread_info.premix_group);
+
+    /* a leaves while both are playing */
+    send_msg(f, SINK_MESSAGE_LEAVE, &a, 0);
+
+    render(f, 40);
+    fail_unless(!a.input->thread_info.premix_group);
+    fail_unless(b.input->thread_info.premix_group);
+
+    /* Neither of them lost or repeated anything, a only switched to its
+     * own resampler */
+    check_ramp(f, 0, 1);
+    check_ramp(f, 1, 0);
+    fail_unless(a.rewound == 0 && b.rewound == 0);
+
+    fake_input_unlink(f, &a);
+    fake_input_unlink(f, &b);
+    fake_sink_free(f);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Premix");
+    tc = tcase_create("premix");
+    tcase_add_test(tc, premix_mix_test);
+    tcase_add_test(tc, premix_loud_test);
+    tcase_add_test(tc, premix_rewrite_test);
+    tcase_add_test(tc, premix_leave_join_test);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,118 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+
+#include <check.h>
+
+#include <pulsecore/atomic.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/render-pool.h>
+#include <pulsecore/thread-mq.h>
+
+#define N_JOBS 64
+#define N_RUNS 1000
+
+struct job_data {
+    pa_atomic_t calls[N_JOBS];
+    pa_thread_mq *expected_mq;
+    pa_atomic_t wrong_mq;
+};
+
+static void job_cb(void *userdata, unsigned k) {
+    struct job_data *d = userdata;
+
+    fail_unless(k < N_JOBS);
+
+    pa_atomic_inc(&d->calls[k]);
+
+    if (pa_thread_mq_get() != d->expected_mq)
+        pa_atomic_inc(&d->wrong_mq);
+}
+
+static void run_test(unsigned n_threads, unsigned n_jobs) {
+    pa_render_pool *p;
+    struct job_data d;
+    unsigned i, k;
+
+    p = pa_render_pool_new("test", n_threads, 0);
+    fail_unless(p != NULL);
+    fail_unless(pa_render_pool_get_n_threads(p) == n_threads);
+
+    for (k = 0; k < N_JOBS; k++)
+        pa_atomic_store(&d.calls[k], 0);
+    pa_atomic_store(&d.wrong_mq, 0);
+    d.expected_mq = pa_thread_mq_get();
+
+    for (i = 0; i < N_RUNS; i++)
+        pa_render_pool_run(p, job_cb, &d, n_jobs);
+
+    for (k = 0; k < N_JOBS; k++)
+        fail_unless(pa_atomic_load(&d.calls[k]) == (int) (k < n_jobs ? N_RUNS : 0));
+    fail_unless(pa_atomic_load(&d.wrong_mq) == 0);
+
+    pa_render_pool_free(p);
+}
+
+START_TEST (render_pool_test) {
+    pa_thread_mq q;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    /* Jobs run on the helper threads must see the thread_mq of the
+     * thread that submitted them */
+    pa_zero(q);
+    pa_thread_mq_install(&q);
+
+    run_test(1, 0);
+    run_test(1, 1);
+    run_test(1, N_JOBS);
+    run_test(3, 2);
+    run_test(3, N_JOBS);
+    run_test(8, 5);
+
+    pa_thread_mq_uninstall();
+
+    /* And no thread_mq at all if the submitter has none */
+    run_test(4, N_JOBS);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    s = suite_create("Render Pool");
+    tc = tcase_create("render-pool");
+    tcase_add_test(tc, render_pool_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
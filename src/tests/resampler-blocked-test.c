@@ -0,0 +1,171 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/channelmap.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+
+#define MAX_OUT_FRAMES 40000
+
+static pa_resampler *new_resampler(pa_mempool *pool, pa_resample_method_t method,
+                                   unsigned i_channels, unsigned o_channels) {
+    pa_sample_spec a = { PA_SAMPLE_S16NE, 44100, i_channels }, b = { PA_SAMPLE_S16NE, 48000, o_channels };
+    pa_channel_map am, bm;
+    pa_resampler *r;
+
+    pa_channel_map_init_auto(&am, a.channels, PA_CHANNEL_MAP_DEFAULT);
+    pa_channel_map_init_auto(&bm, b.channels, PA_CHANNEL_MAP_DEFAULT);
+
+    r = pa_resampler_new(pool, &a, &am, &b, &bm, 0, method, 0);
+    fail_unless(r != NULL);
+
+    return r;
+}
+
+/* Runs chunks of the given sizes through r and returns the number of
+ * output frames, which are stored in out */
+static unsigned run(pa_mempool *pool, pa_resampler *r, const unsigned *chunk_frames, unsigned n_chunks, int16_t *out) {
+    size_t i_fs = pa_frame_size(pa_resampler_input_sample_spec(r));
+    size_t o_fs = pa_frame_size(pa_resampler_output_sample_spec(r));
+    unsigned out_frames = 0, i, j, k = 0;
+
+    for (i = 0; i < n_chunks; i++) {
+        pa_memchunk in, o;
+        int16_t *p;
+
+        in.memblock = pa_memblock_new(pool, chunk_frames[i] * i_fs);
+        in.index = 0;
+        in.length = chunk_frames[i] * i_fs;
+
+        p = pa_memblock_acquire(in.memblock);
+        for (j = 0; j < in.length / sizeof(int16_t); j++, k++)
+            p[j] = (int16_t) ((k * 397) % 20000 - 10000);
+        pa_memblock_release(in.memblock);
+
+        pa_resampler_run(r, &in, &o);
+        pa_memblock_unref(in.memblock);
+
+        if (!o.memblock)
+            continue;
+
+        fail_unless(o.length % o_fs == 0);
+        fail_unless(out_frames + o.length / o_fs <= MAX_OUT_FRAMES);
+        memcpy((uint8_t *) out + out_frames * o_fs, (uint8_t *) pa_memblock_acquire(o.memblock) + o.index, o.length);
+        pa_memblock_release(o.memblock);
+        pa_memblock_unref(o.memblock);
+
+        out_frames += o.length / o_fs;
+    }
+
+    return out_frames;
+}
+
+/* The blocked path must produce exactly what running each stage over
+ * all of the input produces */
+static void compare(pa_resample_method_t method, unsigned i_channels, unsigned o_channels) {
+    pa_mempool *pool;
+    pa_resampler *blocked, *unblocked;
+    unsigned chunk_frames[8], n1, n2, b;
+    int16_t *out1, *out2;
+
+    if (!pa_resample_method_supported(method))
+        return;
+
+    pa_log_debug("Comparing %s, %u to %u channels", pa_resample_method_to_string(method), i_channels, o_channels);
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+
+    blocked = new_resampler(pool, method, i_channels, o_channels);
+    unblocked = new_resampler(pool, method, i_channels, o_channels);
+
+    fail_unless(blocked->blocked);
+    unblocked->blocked = false;
+
+    /* Mostly not a multiple of the block size */
+    b = blocked->block_frames;
+    chunk_frames[0] = 1;
+    chunk_frames[1] = 37;
+    chunk_frames[2] = b - 1;
+    chunk_frames[3] = b;
+    chunk_frames[4] = b + 1;
+    chunk_frames[5] = 3 * b + 17;
+    chunk_frames[6] = 2 * b;
+    chunk_frames[7] = 5001;
+
+    out1 = pa_xnew(int16_t, MAX_OUT_FRAMES * o_channels);
+    out2 = pa_xnew(int16_t, MAX_OUT_FRAMES * o_channels);
+
+    n1 = run(pool, blocked, chunk_frames, PA_ELEMENTSOF(chunk_frames), out1);
+    n2 = run(pool, unblocked, chunk_frames, PA_ELEMENTSOF(chunk_frames), out2);
+
+    fail_unless(n1 > 0);
+    fail_unless(n1 == n2);
+    fail_unless(memcmp(out1, out2, n1 * o_channels * sizeof(int16_t)) == 0);
+
+    pa_xfree(out1);
+    pa_xfree(out2);
+    pa_resampler_free(blocked);
+    pa_resampler_free(unblocked);
+    pa_mempool_unref(pool);
+}
+
+START_TEST (remap_first_test) {
+    compare(PA_RESAMPLER_TRIVIAL, 6, 2);
+    compare(PA_RESAMPLER_SPEEX_FLOAT_BASE + 1, 6, 2);
+    compare(PA_RESAMPLER_POLYPHASE, 6, 2);
+}
+END_TEST
+
+START_TEST (remap_last_test) {
+    compare(PA_RESAMPLER_TRIVIAL, 1, 6);
+    compare(PA_RESAMPLER_SPEEX_FLOAT_BASE + 1, 1, 6);
+    compare(PA_RESAMPLER_POLYPHASE, 1, 6);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Resampler blocked");
+    tc = tcase_create("resampler-blocked");
+    tcase_add_test(tc, remap_first_test);
+    tcase_add_test(tc, remap_last_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,188 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+
+#include <pulse/channelmap.h>
+
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+
+#define N_FRAMES 512
+
+static pa_resampler *new_resampler(pa_resampler_cache *cache, pa_mempool *pool, unsigned i_channels, uint32_t o_rate,
+                                   pa_resample_flags_t flags) {
+    pa_sample_spec a = { PA_SAMPLE_S16NE, 44100, i_channels }, b = { PA_SAMPLE_FLOAT32NE, o_rate, 6 };
+    pa_channel_map am, bm;
+    pa_resampler *r;
+
+    pa_channel_map_init_auto(&am, a.channels, PA_CHANNEL_MAP_DEFAULT);
+    pa_channel_map_init_auto(&bm, b.channels, PA_CHANNEL_MAP_DEFAULT);
+
+    r = pa_resampler_new_with_cache(cache, pool, &a, &am, &b, &bm, 0, PA_RESAMPLER_TRIVIAL, flags);
+    fail_unless(r != NULL);
+
+    return r;
+}
+
+/* Runs a ramp through r and returns the output, which must have room for
+ * twice the number of input frames */
+static void run(pa_mempool *pool, pa_resampler *r, float *out) {
+    pa_memchunk in, o;
+    int16_t *p;
+    unsigned i;
+
+    in.memblock = pa_memblock_new(pool, N_FRAMES * pa_frame_size(pa_resampler_input_sample_spec(r)));
+    in.index = 0;
+    in.length = pa_memblock_get_length(in.memblock);
+
+    p = pa_memblock_acquire(in.memblock);
+    for (i = 0; i < in.length / sizeof(int16_t); i++)
+        p[i] = (int16_t) (i * 37);
+    pa_memblock_release(in.memblock);
+
+    pa_resampler_run(r, &in, &o);
+    pa_memblock_unref(in.memblock);
+
+    fail_unless(o.length > 0);
+    fail_unless(o.length <= 2 * N_FRAMES * 6 * sizeof(float));
+    memcpy(out, (uint8_t *) pa_memblock_acquire(o.memblock) + o.index, o.length);
+    pa_memblock_release(o.memblock);
+    pa_memblock_unref(o.memblock);
+}
+
+START_TEST (cache_test) {
+    static float out1[2 * N_FRAMES * 6], out2[2 * N_FRAMES * 6];
+    pa_resampler_cache *cache;
+    pa_mempool *pool;
+    pa_resampler *r1, *r2, *r3, *r4, *r5;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    cache = pa_resampler_cache_new();
+
+    /* Rates don't matter for the channel matrix */
+    r1 = new_resampler(cache, pool, 2, 44100, 0);
+    r2 = new_resampler(cache, pool, 2, 48000, PA_RESAMPLER_VARIABLE_RATE);
+    fail_unless(r1->remap_setup == r2->remap_setup);
+
+    /* Different input channels or remix flags get a setup of their own */
+    r3 = new_resampler(cache, pool, 1, 44100, 0);
+    r4 = new_resampler(cache, pool, 2, 44100, PA_RESAMPLER_NO_REMIX);
+    fail_unless(r3->remap_setup != r1->remap_setup);
+    fail_unless(r4->remap_setup != r1->remap_setup);
+
+    /* Without a cache nothing is shared */
+    r5 = new_resampler(NULL, pool, 2, 44100, 0);
+    fail_unless(r5->remap_setup != r1->remap_setup);
+
+    run(pool, r1, out1);
+    run(pool, r5, out2);
+    fail_unless(memcmp(out1, out2, N_FRAMES * 6 * sizeof(float)) == 0);
+
+    /* The setup stays alive as long as it is used */
+    pa_resampler_free(r1);
+    run(pool, r2, out2);
+
+    pa_resampler_free(r2);
+    pa_resampler_free(r3);
+    pa_resampler_free(r4);
+
+    /* Resamplers may outlive the cache */
+    r1 = new_resampler(cache, pool, 2, 44100, 0);
+    pa_resampler_cache_free(cache);
+    run(pool, r1, out2);
+    fail_unless(memcmp(out1, out2, N_FRAMES * 6 * sizeof(float)) == 0);
+
+    pa_resampler_free(r1);
+    pa_resampler_free(r5);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* Two maps of 32 channels with long names, that only differ in the last
+ * channel, far beyond what pa_channel_map_snprint() can print */
+static pa_resampler *new_wide_resampler(pa_resampler_cache *cache, pa_mempool *pool, pa_channel_position_t last) {
+    pa_sample_spec a = { PA_SAMPLE_S16NE, 44100, PA_CHANNELS_MAX }, b = { PA_SAMPLE_FLOAT32NE, 44100, 2 };
+    pa_channel_map am, bm;
+    pa_resampler *r;
+    unsigned c;
+
+    am.channels = PA_CHANNELS_MAX;
+    for (c = 0; c < PA_CHANNELS_MAX - 1; c++)
+        am.map[c] = PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER;
+    am.map[PA_CHANNELS_MAX - 1] = last;
+
+    pa_channel_map_init_stereo(&bm);
+
+    r = pa_resampler_new_with_cache(cache, pool, &a, &am, &b, &bm, 0, PA_RESAMPLER_TRIVIAL, 0);
+    fail_unless(r != NULL);
+
+    return r;
+}
+
+START_TEST (wide_map_test) {
+    pa_resampler_cache *cache;
+    pa_mempool *pool;
+    pa_resampler *r1, *r2, *r3;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    cache = pa_resampler_cache_new();
+
+    r1 = new_wide_resampler(cache, pool, PA_CHANNEL_POSITION_FRONT_LEFT);
+    r2 = new_wide_resampler(cache, pool, PA_CHANNEL_POSITION_FRONT_RIGHT);
+    r3 = new_wide_resampler(cache, pool, PA_CHANNEL_POSITION_FRONT_LEFT);
+
+    fail_unless(r1->remap_setup != r2->remap_setup);
+    fail_unless(r1->remap_setup == r3->remap_setup);
+    fail_unless(memcmp(r1->remap->map_table_i, r2->remap->map_table_i, sizeof(r1->remap->map_table_i)) != 0);
+
+    pa_resampler_free(r1);
+    pa_resampler_free(r2);
+    pa_resampler_free(r3);
+    pa_resampler_cache_free(cache);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Resampler cache");
+    tc = tcase_create("resampler-cache");
+    tcase_add_test(tc, cache_test);
+    tcase_add_test(tc, wide_map_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,277 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <check.h>
+#include <math.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/cpu-arm.h>
+#include <pulsecore/cpu-x86.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/memblock.h>
+#include <pulsecore/resampler.h>
+#include <pulsecore/sample-util.h>
+
+#define CHANNELS 2
+#define FREQ 1000.0
+#define IN_FRAMES 20000
+
+/* Resamples a sine in chunks of varying size, into out, which must have
+ * room for the result. Returns the number of output frames. */
+static unsigned resample_sine(pa_mempool *pool, uint32_t in_rate, uint32_t out_rate, unsigned chunk, float *out) {
+    pa_sample_spec a = { PA_SAMPLE_FLOAT32NE, in_rate, CHANNELS }, b = { PA_SAMPLE_FLOAT32NE, out_rate, CHANNELS };
+    pa_resampler *r;
+    unsigned i, n, offset, n_out = 0;
+
+    r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, PA_RESAMPLER_VARIABLE_RATE);
+    fail_unless(r != NULL);
+    fail_unless(pa_resampler_get_method(r) == PA_RESAMPLER_POLYPHASE);
+
+    for (offset = 0; offset < IN_FRAMES; offset += n) {
+        pa_memchunk in_chunk, out_chunk;
+        float *p;
+
+        n = PA_MIN(chunk + offset % 7, IN_FRAMES - offset);
+
+        in_chunk.memblock = pa_memblock_new(pool, n * CHANNELS * sizeof(float));
+        in_chunk.index = 0;
+        in_chunk.length = n * CHANNELS * sizeof(float);
+
+        p = pa_memblock_acquire(in_chunk.memblock);
+        for (i = 0; i < n; i++) {
+            p[i * CHANNELS] = (float) (0.5 * sin(2 * M_PI * FREQ * (offset + i) / in_rate));
+            p[i * CHANNELS + 1] = -p[i * CHANNELS];
+        }
+        pa_memblock_release(in_chunk.memblock);
+
+        pa_resampler_run(r, &in_chunk, &out_chunk);
+        pa_memblock_unref(in_chunk.memblock);
+
+        if (out_chunk.length > 0) {
+            memcpy(out + n_out * CHANNELS, (uint8_t *) pa_memblock_acquire(out_chunk.memblock) + out_chunk.index, out_chunk.length);
+            pa_memblock_release(out_chunk.memblock);
+            pa_memblock_unref(out_chunk.memblock);
+
+            n_out += out_chunk.length / (CHANNELS * sizeof(float));
+        }
+    }
+
+    pa_resampler_free(r);
+
+    return n_out;
+}
+
+/* The output is aligned with the input, so output frame n must match the
+ * sine at n / out_rate. The first frames are skipped, the filter sees the
+ * silence before the start of the sine there. */
+START_TEST (polyphase_quality_test) {
+    static const uint32_t rates[][2] = {
+        { 44100, 48000 },
+        { 48000, 44100 },
+        { 16000, 48000 },
+        { 48000, 96000 },
+        { 96000, 48000 },
+        { 44100, 47999 },
+        { 48000, 8000 },
+    };
+    pa_mempool *pool;
+    float *out;
+    unsigned i, j, n;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    out = pa_xnew(float, IN_FRAMES * 13 * CHANNELS);
+
+    for (i = 0; i < PA_ELEMENTSOF(rates); i++) {
+        double max_err = 0;
+
+        n = resample_sine(pool, rates[i][0], rates[i][1], 1000, out);
+        fail_unless(n > IN_FRAMES * (uint64_t) rates[i][1] / rates[i][0] - 200);
+
+        for (j = 200; j < n; j++) {
+            double ref = 0.5 * sin(2 * M_PI * FREQ * j / rates[i][1]);
+
+            max_err = PA_MAX(max_err, fabs(out[j * CHANNELS] - ref));
+            max_err = PA_MAX(max_err, fabs(out[j * CHANNELS + 1] + ref));
+        }
+
+        pa_log_debug("%u -> %u: %u frames, max error %g", rates[i][0], rates[i][1], n, max_err);
+        fail_unless(max_err < 1e-3);
+    }
+
+    pa_xfree(out);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* The result must not depend on how the input is split up */
+START_TEST (polyphase_split_test) {
+    pa_mempool *pool;
+    float *out1, *out2;
+    unsigned n1, n2;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    out1 = pa_xnew(float, IN_FRAMES * 2 * CHANNELS);
+    out2 = pa_xnew(float, IN_FRAMES * 2 * CHANNELS);
+
+    n1 = resample_sine(pool, 44100, 48000, 64, out1);
+    n2 = resample_sine(pool, 44100, 48000, 4000, out2);
+
+    fail_unless(n1 == n2);
+    fail_unless(memcmp(out1, out2, n1 * CHANNELS * sizeof(float)) == 0);
+
+    pa_xfree(out1);
+    pa_xfree(out2);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+/* Rate changes between all kinds of ratios keep the stream going */
+START_TEST (polyphase_rate_change_test) {
+    pa_sample_spec a = { PA_SAMPLE_FLOAT32NE, 44100, CHANNELS }, b = { PA_SAMPLE_FLOAT32NE, 48000, CHANNELS };
+    static const uint32_t rates[] = { 44100, 44117, 96000, 8000, 44100 };
+    pa_mempool *pool;
+    pa_resampler *r;
+    unsigned i;
+
+    pool = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    r = pa_resampler_new(pool, &a, NULL, &b, NULL, 0, PA_RESAMPLER_POLYPHASE, PA_RESAMPLER_VARIABLE_RATE);
+
+    for (i = 0; i < PA_ELEMENTSOF(rates); i++) {
+        pa_memchunk in_chunk, out_chunk;
+        size_t expected;
+
+        pa_resampler_set_input_rate(r, rates[i]);
+
+        in_chunk.memblock = pa_memblock_new(pool, 4096 * CHANNELS * sizeof(float));
+        in_chunk.index = 0;
+        in_chunk.length = 4096 * CHANNELS * sizeof(float);
+        pa_silence_memchunk(&in_chunk, &a);
+
+        pa_resampler_run(r, &in_chunk, &out_chunk);
+        pa_memblock_unref(in_chunk.memblock);
+
+        /* The frames held back for the filter window were received at the
+         * old rate, so they may yield more or fewer output frames now */
+        expected = pa_resampler_result(r, in_chunk.length);
+        fail_unless(out_chunk.length > 0);
+        fail_unless(out_chunk.length <= expected + 1024 * CHANNELS * sizeof(float));
+
+        pa_memblock_unref(out_chunk.memblock);
+    }
+
+    pa_resampler_free(r);
+    pa_mempool_unref(pool);
+}
+END_TEST
+
+static void run_filter_test(pa_polyphase_filter_func_t func, pa_polyphase_filter_func_t orig_func) {
+    PA_DECLARE_ALIGNED(32, float, h[256]);
+    float x[CHANNELS * 300], out[CHANNELS], out_ref[CHANNELS];
+    unsigned taps, i, c;
+
+    for (i = 0; i < PA_ELEMENTSOF(x); i++)
+        x[i] = rand() / (float) RAND_MAX - 0.5f;
+
+    for (taps = 8; taps <= 256; taps += 8) {
+        for (i = 0; i < taps; i++)
+            h[i] = rand() / (float) RAND_MAX / taps;
+
+        /* Odd offset, the history is not aligned */
+        func(out, x + 1, 300, CHANNELS, h, taps);
+        orig_func(out_ref, x + 1, 300, CHANNELS, h, taps);
+
+        for (c = 0; c < CHANNELS; c++)
+            fail_unless(fabsf(out[c] - out_ref[c]) < 1e-5f, "taps %u: %f != %f", taps, out[c], out_ref[c]);
+    }
+}
+
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+START_TEST (polyphase_avx2_test) {
+    pa_cpu_x86_flag_t flags = 0;
+    pa_polyphase_filter_func_t orig_func;
+
+    pa_cpu_get_x86_flags(&flags);
+
+    if (!(flags & PA_CPU_X86_AVX2)) {
+        pa_log_info("AVX2 not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_filter_func();
+    pa_polyphase_func_init_avx2(flags);
+    run_filter_test(pa_get_polyphase_filter_func(), orig_func);
+    pa_set_polyphase_filter_func(orig_func);
+}
+END_TEST
+#endif /* (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2) */
+
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+START_TEST (polyphase_neon_test) {
+    pa_cpu_arm_flag_t flags = 0;
+    pa_polyphase_filter_func_t orig_func;
+
+    pa_cpu_get_arm_flags(&flags);
+
+    if (!(flags & PA_CPU_ARM_NEON)) {
+        pa_log_info("NEON not supported. Skipping");
+        return;
+    }
+
+    orig_func = pa_get_polyphase_filter_func();
+    pa_polyphase_func_init_neon(flags);
+    run_filter_test(pa_get_polyphase_filter_func(), orig_func);
+    pa_set_polyphase_filter_func(orig_func);
+}
+END_TEST
+#endif /* defined (__arm__) && defined (__linux__) && defined (HAVE_NEON) */
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    if (!getenv("MAKE_CHECK"))
+        pa_log_set_level(PA_LOG_DEBUG);
+
+    s = suite_create("Polyphase resampler");
+    tc = tcase_create("polyphase");
+    tcase_add_test(tc, polyphase_quality_test);
+    tcase_add_test(tc, polyphase_split_test);
+    tcase_add_test(tc, polyphase_rate_change_test);
+#if (defined (__i386__) || defined (__amd64__)) && defined (HAVE_AVX2)
+    tcase_add_test(tc, polyphase_avx2_test);
+#endif
+#if defined (__arm__) && defined (__linux__) && defined (HAVE_NEON)
+    tcase_add_test(tc, polyphase_neon_test);
+#endif
+    tcase_set_timeout(tc, 120);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,323 @@
+/***
+  This file is part of PulseAudio.
+
+  PulseAudio is free software; you can redistribute it and/or modify
+  it under the terms of the GNU Lesser General Public License as published
+  by the Free Software Foundation; either version 2.1 of the License,
+  or (at your option) any later version.
+
+  PulseAudio is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+  General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public License
+  along with PulseAudio; if not, see <http://www.gnu.org/licenses/>.
+***/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <check.h>
+
+#include <pulse/pulseaudio.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/macro.h>
+
+#define SINK_NAME "snapshot-test"
+
+#define WAIT_FOR_OPERATION(o)                                           \
+    do {                                                                \
+        while (pa_operation_get_state(o) == PA_OPERATION_RUNNING) {     \
+            pa_threaded_mainloop_wait(mainloop);                        \
+        }                                                               \
+                                                                        \
+        fail_unless(pa_operation_get_state(o) == PA_OPERATION_DONE);    \
+        pa_operation_unref(o);                                          \
+    } while (false)
+
+static pa_threaded_mainloop *mainloop = NULL;
+static pa_context *context = NULL;
+static pa_mainloop_api *mainloop_api = NULL;
+static const char *bname = NULL;
+
+/* What one snapshot reported */
+struct result {
+    bool done;
+    int success;
+    uint64_t seq;
+    int full;
+
+    unsigned n_sinks, n_modules;
+    unsigned sink_eol, module_eol;
+    uint32_t test_sink, test_module;
+    unsigned n_removed_sinks, n_removed_modules;
+    uint32_t removed_sink, removed_module;
+};
+
+/* This is called whenever the context status changes */
+static void context_state_callback(pa_context *c, void *userdata) {
+    fail_unless(c != NULL);
+
+    switch (pa_context_get_state(c)) {
+        case PA_CONTEXT_CONNECTING:
+        case PA_CONTEXT_AUTHORIZING:
+        case PA_CONTEXT_SETTING_NAME:
+            break;
+
+        case PA_CONTEXT_READY:
+            fprintf(stderr, "Connection established.\n");
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_CONTEXT_TERMINATED:
+            mainloop_api->quit(mainloop_api, 0);
+            pa_threaded_mainloop_signal(mainloop, false);
+            break;
+
+        case PA_CONTEXT_FAILED:
+            mainloop_api->quit(mainloop_api, 0);
+            pa_threaded_mainloop_signal(mainloop, false);
+            fprintf(stderr, "Context error: %s\n", pa_strerror(pa_context_errno(c)));
+            fail();
+            break;
+
+        default:
+            fail();
+    }
+}
+
+static void sink_cb(pa_context *c, const pa_sink_info *i, int eol, void *userdata) {
+    struct result *r = userdata;
+
+    if (eol) {
+        r->sink_eol++;
+        return;
+    }
+
+    r->n_sinks++;
+    if (pa_streq(i->name, SINK_NAME))
+        r->test_sink = i->index;
+}
+
+static void module_cb(pa_context *c, const pa_module_info *i, int eol, void *userdata) {
+    struct result *r = userdata;
+
+    if (eol) {
+        r->module_eol++;
+        return;
+    }
+
+    r->n_modules++;
+    if (pa_streq(i->name, "module-null-sink") && i->argument && strstr(i->argument, SINK_NAME))
+        r->test_module = i->index;
+}
+
+static void removed_cb(pa_context *c, pa_subscription_event_type_t facility, uint32_t idx, void *userdata) {
+    struct result *r = userdata;
+
+    if (facility == PA_SUBSCRIPTION_EVENT_SINK) {
+        r->n_removed_sinks++;
+        r->removed_sink = idx;
+    } else if (facility == PA_SUBSCRIPTION_EVENT_MODULE) {
+        r->n_removed_modules++;
+        r->removed_module = idx;
+    } else
+        fail();
+}
+
+static void done_cb(pa_context *c, int success, uint64_t seq, int full, void *userdata) {
+    struct result *r = userdata;
+
+    r->done = true;
+    r->success = success;
+    r->seq = seq;
+    r->full = full;
+
+    pa_threaded_mainloop_signal(mainloop, false);
+}
+
+static void get_snapshot(uint64_t since, struct result *r) {
+    static const pa_snapshot_callbacks cb = {
+        .sink = sink_cb,
+        .module = module_cb,
+        .removed = removed_cb,
+    };
+    pa_operation *o;
+
+    pa_zero(*r);
+    r->test_sink = r->test_module = PA_INVALID_INDEX;
+    r->removed_sink = r->removed_module = PA_INVALID_INDEX;
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    o = pa_context_get_snapshot(context, PA_SUBSCRIPTION_MASK_SINK | PA_SUBSCRIPTION_MASK_MODULE, since, &cb, done_cb, r);
+    fail_unless(o != NULL);
+    WAIT_FOR_OPERATION(o);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    fail_unless(r->done);
+    fail_unless(r->success);
+
+    /* Every selected kind ends with an eol call, also in a delta */
+    fail_unless(r->sink_eol == 1);
+    fail_unless(r->module_eol == 1);
+}
+
+static void module_index_cb(pa_context *c, uint32_t idx, void *userdata) {
+    fail_unless(idx != PA_INVALID_INDEX);
+
+    *(uint32_t *) userdata = idx;
+
+    pa_threaded_mainloop_signal(mainloop, false);
+}
+
+static void success_cb(pa_context *c, int success, void *userdata) {
+    fail_unless(success != 0);
+
+    pa_threaded_mainloop_signal(mainloop, false);
+}
+
+static void snapshot_setup() {
+    int r;
+
+    /* Set up a new main loop */
+    mainloop = pa_threaded_mainloop_new();
+    fail_unless(mainloop != NULL);
+
+    mainloop_api = pa_threaded_mainloop_get_api(mainloop);
+
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_threaded_mainloop_start(mainloop);
+
+    context = pa_context_new(mainloop_api, bname);
+    fail_unless(context != NULL);
+
+    pa_context_set_state_callback(context, context_state_callback, NULL);
+
+    /* Connect the context */
+    r = pa_context_connect(context, NULL, 0, NULL);
+    fail_unless(r == 0);
+
+    pa_threaded_mainloop_wait(mainloop);
+
+    fail_unless(pa_context_get_state(context) == PA_CONTEXT_READY);
+
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+static void snapshot_teardown() {
+    pa_threaded_mainloop_lock(mainloop);
+
+    pa_context_disconnect(context);
+    pa_context_unref(context);
+
+    pa_threaded_mainloop_unlock(mainloop);
+
+    pa_threaded_mainloop_stop(mainloop);
+    pa_threaded_mainloop_free(mainloop);
+}
+
+START_TEST (snapshot_delta_test) {
+    struct result full, delta;
+    uint32_t module_idx = PA_INVALID_INDEX;
+    pa_operation *o;
+
+    get_snapshot(0, &full);
+    fail_unless(full.full);
+    fail_unless(full.test_sink == PA_INVALID_INDEX);
+
+    /* No module changed, so none is in the delta */
+    get_snapshot(full.seq, &delta);
+    fail_unless(!delta.full);
+    fail_unless(delta.seq >= full.seq);
+    fail_unless(delta.n_modules == 0);
+    fail_unless(delta.n_removed_sinks == 0 && delta.n_removed_modules == 0);
+
+    pa_threaded_mainloop_lock(mainloop);
+    o = pa_context_load_module(context, "module-null-sink", "sink_name=" SINK_NAME, module_index_cb, &module_idx);
+    WAIT_FOR_OPERATION(o);
+    pa_threaded_mainloop_unlock(mainloop);
+
+    /* The new objects show up in the delta, and only them */
+    get_snapshot(full.seq, &delta);
+    fail_unless(!delta.full);
+    fail_unless(delta.seq > full.seq);
+    fail_unless(delta.test_module == module_idx);
+    fail_unless(delta.test_sink != PA_INVALID_INDEX);
+    fail_unless(delta.n_modules == 1);
+    fail_unless(delta.n_sinks >= 1 && delta.n_sinks <= full.n_sinks + 1);
+    fail_unless(delta.n_removed_sinks == 0 && delta.n_removed_modules == 0);
+
+    get_snapshot(0, &full);
+    fail_unless(full.full);
+    fail_unless(full.test_module == module_idx);
+    fail_unless(full.test_sink == delta.test_sink);
+
+    pa_threaded_mainloop_lock(mainloop);
+    o = pa_context_unload_module(context, module_idx, success_cb, NULL);
+    WAIT_FOR_OPERATION(o);
+    pa_threaded_mainloop_unlock(mainloop);
+
+    /* The removed objects are reported by index */
+    get_snapshot(full.seq, &delta);
+    fail_unless(!delta.full);
+    fail_unless(delta.test_sink == PA_INVALID_INDEX);
+    fail_unless(delta.test_module == PA_INVALID_INDEX);
+    fail_unless(delta.n_removed_modules == 1);
+    fail_unless(delta.removed_module == module_idx);
+    fail_unless(delta.n_removed_sinks == 1);
+    fail_unless(delta.removed_sink == full.test_sink);
+}
+END_TEST
+
+START_TEST (snapshot_fallback_test) {
+    struct result first, r;
+
+    get_snapshot(0, &first);
+    fail_unless(first.full);
+
+    /* Far older than what the server keeps track of */
+    get_snapshot(first.seq - 1000000, &r);
+    fail_unless(r.full);
+    fail_unless(r.n_sinks == first.n_sinks);
+    fail_unless(r.n_modules == first.n_modules);
+    fail_unless(r.n_removed_sinks == 0 && r.n_removed_modules == 0);
+
+    /* From the future, e.g. from another instance of the server */
+    get_snapshot(first.seq + 1000, &r);
+    fail_unless(r.full);
+    fail_unless(r.n_sinks == first.n_sinks);
+}
+END_TEST
+
+int main(int argc, char *argv[]) {
+    int failed = 0;
+    Suite *s;
+    TCase *tc;
+    SRunner *sr;
+
+    bname = argv[0];
+
+    s = suite_create("Snapshot");
+    tc = tcase_create("snapshot");
+    tcase_add_checked_fixture(tc, snapshot_setup, snapshot_teardown);
+    tcase_add_test(tc, snapshot_delta_test);
+    tcase_add_test(tc, snapshot_fallback_test);
+    suite_add_tcase(s, tc);
+
+    sr = srunner_create(s);
+    srunner_run_all(sr, CK_NORMAL);
+    failed = srunner_ntests_failed(sr);
+    srunner_free(sr);
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -22,13 +22,16 @@
 #endif
 
 #include <unistd.h>
+#include <sys/socket.h>
 #include <check.h>
 
 #include <pulse/mainloop.h>
 #include <pulsecore/packet.h>
 #include <pulsecore/pstream.h>
+#include <pulsecore/srbchannel.h>
 #include <pulsecore/iochannel.h>
 #include <pulsecore/memblock.h>
+#include <pulsecore/thread.h>
 
 static unsigned packets_received;
 static unsigned packets_checksum;
@@ -80,6 +83,196 @@ static void packet_test(unsigned npackets, size_t plength, pa_mainloop *ml, pa_p
     pa_packet_unref(packet);
 }
 
+static unsigned batch_received;
+static size_t batch_bytes;
+static int64_t batch_offset;
+static bool batch_drained;
+
+static void batch_packet_received(pa_pstream *p, pa_packet *packet, pa_cmsg_ancil_data *ancil_data, void *userdata) {
+    const uint8_t *pdata;
+    size_t plen;
+
+    /* Packets carry their sequence number in the first byte */
+    pdata = pa_packet_data(packet, &plen);
+    fail_unless(plen == 8);
+    fail_unless(pdata[0] == (uint8_t) batch_received);
+
+    batch_received++;
+}
+
+static void batch_memblock_received(pa_pstream *p, uint32_t channel, int64_t offset, pa_seek_mode_t seek,
+                                    const pa_memchunk *chunk, void *userdata) {
+    const uint8_t *d;
+    size_t i;
+
+    /* Memblocks may be handed over in pieces, but in order and without gaps */
+    fail_unless(channel == 7);
+    fail_unless(offset == batch_offset);
+
+    d = (const uint8_t *) pa_memblock_acquire_chunk(chunk);
+    for (i = 0; i < chunk->length; i++)
+        fail_unless(d[i] == (uint8_t) (batch_bytes + i));
+    pa_memblock_release(chunk->memblock);
+
+    batch_bytes += chunk->length;
+    batch_offset += chunk->length;
+}
+
+static void batch_drain(pa_pstream *p, void *userdata) {
+    batch_drained = true;
+}
+
+/* Queue a burst of small packets and memblocks of various sizes without
+ * running the mainloop in between, so that the writes get batched */
+static void batch_test(pa_mainloop *ml, pa_mempool *mp, pa_pstream *p1, pa_pstream *p2) {
+    const unsigned npackets = 1000;
+    size_t sent = 0;
+    unsigned i;
+
+    batch_received = 0;
+    batch_bytes = 0;
+    batch_offset = 0;
+    batch_drained = false;
+
+    pa_pstream_set_receive_packet_callback(p2, batch_packet_received, NULL);
+    pa_pstream_set_receive_memblock_callback(p2, batch_memblock_received, NULL);
+    pa_pstream_set_drain_callback(p1, batch_drain, NULL);
+
+    for (i = 0; i < npackets; i++) {
+        pa_packet *packet = pa_packet_new(8);
+        size_t plen;
+        uint8_t *pdata = (uint8_t *) pa_packet_data(packet, &plen);
+
+        memset(pdata, 0, plen);
+        pdata[0] = (uint8_t) i;
+        pa_pstream_send_packet(p1, packet, NULL);
+        pa_packet_unref(packet);
+
+        if (i % 3 == 0) {
+            pa_memchunk chunk;
+            uint8_t *d;
+            size_t j;
+
+            chunk.length = 1 + (i * 397) % 20000;
+            chunk.index = 0;
+            chunk.memblock = pa_memblock_new(mp, chunk.length);
+
+            d = pa_memblock_acquire(chunk.memblock);
+            for (j = 0; j < chunk.length; j++)
+                d[j] = (uint8_t) (sent + j);
+            pa_memblock_release(chunk.memblock);
+
+            pa_pstream_send_memblock(p1, 7, (int64_t) sent, PA_SEEK_ABSOLUTE, &chunk, 0);
+            pa_memblock_unref(chunk.memblock);
+
+            sent += chunk.length;
+        }
+    }
+
+    fail_unless(pa_pstream_is_pending(p1));
+
+    while (batch_received < npackets || batch_bytes < sent)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(batch_bytes == sent);
+    fail_unless(batch_drained);
+    fail_unless(!pa_pstream_is_pending(p1));
+
+    pa_pstream_set_receive_memblock_callback(p2, NULL, NULL);
+    pa_pstream_set_drain_callback(p1, NULL, NULL);
+}
+
+START_TEST (batch_write_test) {
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+    int pipefd[4], sockfd[2];
+
+    /* Over pipes, which get plain writev() */
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]);
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), io1, mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+
+    batch_test(ml, mp, p1, p2);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+
+    /* Over a socket, which gets sendmsg() */
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, sockfd) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), sockfd[0], sockfd[0]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), sockfd[1], sockfd[1]);
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), io1, mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+
+    batch_test(ml, mp, p1, p2);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
+#define THREADED_PACKETS 10000
+
+static void threaded_send(void *userdata) {
+    pa_pstream *p = userdata;
+    unsigned i;
+
+    for (i = 0; i < THREADED_PACKETS; i++) {
+        pa_packet *packet = pa_packet_new(8);
+        size_t plen;
+        uint8_t *pdata = (uint8_t *) pa_packet_data(packet, &plen);
+
+        memset(pdata, 0, plen);
+        pdata[0] = (uint8_t) i;
+        pa_pstream_send_packet(p, packet, NULL);
+        pa_packet_unref(packet);
+    }
+}
+
+/* Packets queued from another thread must wake up the pstream's
+ * mainloop and arrive in order */
+START_TEST (threaded_test) {
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_PRIVATE, 0, true);
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+    pa_thread *t;
+    int sockfd[2];
+
+    fail_unless(socketpair(AF_UNIX, SOCK_STREAM, 0, sockfd) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), sockfd[0], sockfd[0]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), sockfd[1], sockfd[1]);
+    fail_unless((p1 = pa_pstream_new_threaded(pa_mainloop_get_api(ml), io1, mp)) != NULL);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+
+    batch_received = 0;
+    pa_pstream_set_receive_packet_callback(p2, batch_packet_received, NULL);
+
+    fail_unless((t = pa_thread_new("threaded-send", threaded_send, p1)) != NULL);
+
+    while (batch_received < THREADED_PACKETS)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    pa_thread_free(t);
+
+    while (pa_pstream_is_pending(p1))
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    pa_pstream_unlink(p1);
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
+
 START_TEST (srbchannel_test) {
 
     int pipefd[4];
@@ -114,6 +307,14 @@ START_TEST (srbchannel_test) {
     packet_test(250, 5, ml, p1, p2);
     packet_test(10, 1234567, ml, p1, p2);
 
+    pa_log_debug("And with busy polling...");
+
+    pa_srbchannel_set_busy_poll(sr1, 100);
+    pa_srbchannel_set_busy_poll(sr2, 100);
+
+    packet_test(250, 5, ml, p1, p2);
+    packet_test(10, 1234567, ml, p1, p2);
+
     pa_pstream_unref(p1);
     pa_pstream_unref(p2);
     pa_mempool_unref(mp);
@@ -121,6 +322,73 @@ START_TEST (srbchannel_test) {
 }
 END_TEST
 
+/* Small memblocks are copied into the ring instead of being exported,
+ * no matter which stream they are for */
+START_TEST (srbchannel_inline_test) {
+    pa_mainloop *ml = pa_mainloop_new();
+    pa_mempool *mp = pa_mempool_new(PA_MEM_TYPE_SHARED_POSIX, 0, true);
+    pa_iochannel *io1, *io2;
+    pa_pstream *p1, *p2;
+    pa_srbchannel *sr1, *sr2;
+    pa_srbchannel_template srt;
+    size_t sent = 0;
+    unsigned i;
+    int pipefd[4];
+
+    fail_unless(pipe(pipefd) == 0);
+    fail_unless(pipe(&pipefd[2]) == 0);
+    io1 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[2], pipefd[1]);
+    io2 = pa_iochannel_new(pa_mainloop_get_api(ml), pipefd[0], pipefd[3]);
+    p1 = pa_pstream_new(pa_mainloop_get_api(ml), io1, mp);
+    p2 = pa_pstream_new(pa_mainloop_get_api(ml), io2, mp);
+    pa_pstream_enable_shm(p1, true);
+    pa_pstream_enable_shm(p2, true);
+
+    sr1 = pa_srbchannel_new(pa_mainloop_get_api(ml), mp);
+    pa_srbchannel_export(sr1, &srt);
+    pa_pstream_set_srbchannel(p1, sr1);
+    sr2 = pa_srbchannel_new_from_template(pa_mainloop_get_api(ml), &srt);
+    pa_pstream_set_srbchannel(p2, sr2);
+
+    fail_unless(pa_srbchannel_get_capacity(sr1) >= 4096);
+
+    batch_bytes = 0;
+    batch_offset = 0;
+    pa_pstream_set_receive_memblock_callback(p2, batch_memblock_received, NULL);
+
+    for (i = 0; i < 100; i++) {
+        pa_memchunk chunk;
+        uint8_t *d;
+        size_t j;
+
+        chunk.length = 1 + (i * 37) % 512;
+        chunk.index = 0;
+        chunk.memblock = pa_memblock_new(mp, chunk.length);
+
+        d = pa_memblock_acquire(chunk.memblock);
+        for (j = 0; j < chunk.length; j++)
+            d[j] = (uint8_t) (sent + j);
+        pa_memblock_release(chunk.memblock);
+
+        pa_pstream_send_memblock(p1, 7, (int64_t) sent, PA_SEEK_ABSOLUTE, &chunk, 0);
+        pa_memblock_unref(chunk.memblock);
+
+        sent += chunk.length;
+        pa_mainloop_iterate(ml, 0, NULL);
+    }
+
+    while (batch_bytes < sent)
+        pa_mainloop_iterate(ml, 1, NULL);
+
+    fail_unless(batch_bytes == sent);
+    fail_unless(pa_atomic_load(&pa_mempool_get_stat(mp)->n_exported) == 0);
+
+    pa_pstream_unref(p1);
+    pa_pstream_unref(p2);
+    pa_mempool_unref(mp);
+    pa_mainloop_free(ml);
+}
+END_TEST
 
 int main(int argc, char *argv[]) {
     int failed = 0;
@@ -134,6 +402,9 @@ int main(int argc, char *argv[]) {
     s = suite_create("srbchannel");
     tc = tcase_create("srbchannel");
     tcase_add_test(tc, srbchannel_test);
+    tcase_add_test(tc, srbchannel_inline_test);
+    tcase_add_test(tc, batch_write_test);
+    tcase_add_test(tc, threaded_test);
     suite_add_tcase(s, tc);
 
     sr = srunner_create(s);